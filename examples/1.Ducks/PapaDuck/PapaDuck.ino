@@ -139,7 +139,7 @@ String convertToHex(byte* data, int size) {
 bool retry = true;
 int quackJson(std::vector<byte> packetBuffer) {
 
-  CdpPacket packet = CdpPacket(packetBuffer);
+  CdpPacketView packet = CdpPacketView(packetBuffer);
   const int bufferSize = 4 * JSON_OBJECT_SIZE(4);
   StaticJsonDocument<bufferSize> doc;
 
@@ -149,12 +149,12 @@ int quackJson(std::vector<byte> packetBuffer) {
   // forward the CDP packet as a byte array and let the Network Server (or DMS) deal with
   // the parsing based on some business logic.
 
-  std::string payload(packet.data.begin(), packet.data.end());
-  std::string sduid(packet.sduid.begin(), packet.sduid.end());
-  std::string dduid(packet.dduid.begin(), packet.dduid.end());
+  std::string payload(packet.getData(), packet.getData() + packet.getDataLength());
+  std::string sduid(packet.getSduid(), packet.getSduid() + DUID_LENGTH);
+  std::string dduid(packet.getDduid(), packet.getDduid() + DUID_LENGTH);
 
-  std::string muid(packet.muid.begin(), packet.muid.end());
-  std::string path(packet.path.begin(), packet.path.end());
+  std::string muid(packet.getMuid(), packet.getMuid() + MUID_LENGTH);
+  std::string path;
 
   Serial.println("[PAPA] Packet Received:");
   Serial.println("[PAPA] sduid:   " + String(sduid.c_str()));
@@ -163,17 +163,17 @@ int quackJson(std::vector<byte> packetBuffer) {
   Serial.println("[PAPA] muid:    " + String(muid.c_str()));
   Serial.println("[PAPA] path:    " + String(path.c_str()));
   Serial.println("[PAPA] data:    " + String(payload.c_str()));
-  Serial.println("[PAPA] hops:    " + String(packet.hopCount));
-  Serial.println("[PAPA] duck:    " + String(packet.duckType));
+  Serial.println("[PAPA] hops:    " + String(packet.getHopCount()));
+  Serial.println("[PAPA] duck:    " + String(packet.getDuckType()));
 
   doc["DeviceID"] = sduid;
   doc["MessageID"] = muid;
   doc["Payload"].set(payload);
   doc["path"].set(path);
-  doc["hops"].set(packet.hopCount);
-  doc["duckType"].set(packet.duckType);
+  doc["hops"].set(packet.getHopCount());
+  doc["duckType"].set(packet.getDuckType());
 
-  std::string cdpTopic = toTopicString(packet.topic);
+  std::string cdpTopic = toTopicString(packet.getTopic());
 
   display->clear();
   display->drawString(0, 10, "New Message");
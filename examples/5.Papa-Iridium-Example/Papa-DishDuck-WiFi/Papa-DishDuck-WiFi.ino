@@ -187,7 +187,7 @@ std::string toTopicString(byte topic) {
 
 void quackJson(std::vector<byte> packetBuffer) {
 
-  CdpPacket packet = CdpPacket(packetBuffer);
+  CdpPacketView packet = CdpPacketView(packetBuffer);
   const int bufferSize = 4 * JSON_OBJECT_SIZE(4);
   StaticJsonDocument<bufferSize> doc;
 
@@ -197,12 +197,12 @@ void quackJson(std::vector<byte> packetBuffer) {
   // forward the CDP packet as a byte array and let the Network Server (or DMS)
   // deal with the parsing based on some business logic.
 
-  std::string payload(packet.data.begin(), packet.data.end());
-  std::string sduid(packet.sduid.begin(), packet.sduid.end());
-  std::string dduid(packet.dduid.begin(), packet.dduid.end());
+  std::string payload(packet.getData(), packet.getData() + packet.getDataLength());
+  std::string sduid(packet.getSduid(), packet.getSduid() + DUID_LENGTH);
+  std::string dduid(packet.getDduid(), packet.getDduid() + DUID_LENGTH);
 
-  std::string muid(packet.muid.begin(), packet.muid.end());
-  std::string path(packet.path.begin(), packet.path.end());
+  std::string muid(packet.getMuid(), packet.getMuid() + MUID_LENGTH);
+  std::string path;
 
   Serial.println("[DISH] Packet Received:");
   Serial.println("[DISH] sduid:   " + String(sduid.c_str()));
@@ -211,17 +211,17 @@ void quackJson(std::vector<byte> packetBuffer) {
   Serial.println("[DISH] muid:    " + String(muid.c_str()));
   Serial.println("[DISH] path:    " + String(path.c_str()));
   Serial.println("[DISH] data:    " + String(payload.c_str()));
-  Serial.println("[DISH] hops:    " + String(packet.hopCount));
-  Serial.println("[DISH] duck:    " + String(packet.duckType));
+  Serial.println("[DISH] hops:    " + String(packet.getHopCount()));
+  Serial.println("[DISH] duck:    " + String(packet.getDuckType()));
 
   doc["DeviceID"] = sduid;
   doc["MessageID"] = muid;
   doc["Payload"].set(payload);
   doc["path"].set(path);
-  doc["hops"].set(packet.hopCount);
-  doc["duckType"].set(packet.duckType);
+  doc["hops"].set(packet.getHopCount());
+  doc["duckType"].set(packet.getDuckType());
 
-  std::string cdpTopic = toTopicString(packet.topic);
+  std::string cdpTopic = toTopicString(packet.getTopic());
   std::string topic = "iot-2/evt/" + cdpTopic + "/fmt/json";
 
   String jsonstat;
@@ -241,7 +241,7 @@ void quackBeam(std::vector<byte> packetBuffer) {
   Serial.print("[DISH] quackBeam");
   int err;
 
-  CdpPacket packet = CdpPacket(packetBuffer);
+  CdpPacketView packet = CdpPacketView(packetBuffer);
   const int bufferSize = 4 * JSON_OBJECT_SIZE(4);
   StaticJsonDocument<bufferSize> doc;
 
@@ -251,12 +251,12 @@ void quackBeam(std::vector<byte> packetBuffer) {
   // forward the CDP packet as a byte array and let the Network Server (or DMS) deal with
   // the parsing based on some business logic.
 
-  std::string payload(packet.data.begin(), packet.data.end());
-  std::string sduid(packet.sduid.begin(), packet.sduid.end());
-  std::string dduid(packet.dduid.begin(), packet.dduid.end());
+  std::string payload(packet.getData(), packet.getData() + packet.getDataLength());
+  std::string sduid(packet.getSduid(), packet.getSduid() + DUID_LENGTH);
+  std::string dduid(packet.getDduid(), packet.getDduid() + DUID_LENGTH);
 
-  std::string muid(packet.muid.begin(), packet.muid.end());
-  std::string path(packet.path.begin(), packet.path.end());
+  std::string muid(packet.getMuid(), packet.getMuid() + MUID_LENGTH);
+  std::string path;
 
   Serial.println("[DISH] Packet Received:");
   Serial.println("[DISH] sduid:   " + String(sduid.c_str()));
@@ -265,10 +265,10 @@ void quackBeam(std::vector<byte> packetBuffer) {
   Serial.println("[DISH] muid:    " + String(muid.c_str()));
   Serial.println("[DISH] path:    " + String(path.c_str()));
   Serial.println("[DISH] data:    " + String(payload.c_str()));
-  Serial.println("[DISH] hops:    " + String(packet.hopCount));
-  Serial.println("[DISH] duck:    " + String(packet.duckType));
+  Serial.println("[DISH] hops:    " + String(packet.getHopCount()));
+  Serial.println("[DISH] duck:    " + String(packet.getDuckType()));
 
-  std::string cdpTopic = toTopicString(packet.topic);
+  std::string cdpTopic = toTopicString(packet.getTopic());
 
   String data = String(sduid.c_str()) + "/" + String(muid.c_str()) + "/" + String(payload.c_str()) +
                 "/" + String(path.c_str()) + "/" + String(cdpTopic.c_str());
@@ -163,7 +163,7 @@ std::string toTopicString(byte topic) {
  */
 void quackJson(std::vector<byte> packetBuffer) {
 
-  CdpPacket packet = CdpPacket(packetBuffer);
+  CdpPacketView packet = CdpPacketView(packetBuffer);
   const int bufferSize = 4 * JSON_OBJECT_SIZE(4);
   StaticJsonDocument<bufferSize> doc;
 
@@ -173,32 +173,32 @@ void quackJson(std::vector<byte> packetBuffer) {
   // forward the CDP packet as a byte array and let the Network Server (or DMS) deal with
   // the parsing based on some business logic.
 
-  std::string payload(packet.data.begin(), packet.data.end());
-  std::string sduid(packet.sduid.begin(), packet.sduid.end());
-  std::string dduid(packet.dduid.begin(), packet.dduid.end());
+  std::string payload(packet.getData(), packet.getData() + packet.getDataLength());
+  std::string sduid(packet.getSduid(), packet.getSduid() + DUID_LENGTH);
+  std::string dduid(packet.getDduid(), packet.getDduid() + DUID_LENGTH);
 
-  std::string muid(packet.muid.begin(), packet.muid.end());
-  std::string path(packet.path.begin(), packet.path.end());
+  std::string muid(packet.getMuid(), packet.getMuid() + MUID_LENGTH);
+  std::string path;
 
   Serial.println("[PAPI] Packet Received:");
   Serial.println("[PAPI] sduid:   " + String(sduid.c_str()));
   Serial.println("[PAPI] dduid:   " + String(dduid.c_str()));
-  Serial.println("[PAPI] topic:   " + String(toTopicString(packet.topic).c_str()));
+  Serial.println("[PAPI] topic:   " + String(toTopicString(packet.getTopic()).c_str()));
   Serial.println("[PAPI] muid:    " + String(muid.c_str()));
   Serial.println("[PAPI] path:    " + String(path.c_str()));
   Serial.println("[PAPI] data:    " + String(payload.c_str()));
-  Serial.println("[PAPI] hops:    " + String(packet.hopCount));
-  Serial.println("[PAPI] duck:    " + String(packet.duckType));
+  Serial.println("[PAPI] hops:    " + String(packet.getHopCount()));
+  Serial.println("[PAPI] duck:    " + String(packet.getDuckType()));
 
   doc["DeviceID"] = sduid;
   doc["MessageID"] = muid;
   doc["Payload"].set(payload);
   doc["path"].set(path);
-  doc["hops"].set(packet.hopCount);
-  doc["duckType"].set(packet.duckType);
-  doc["topic"].set(toTopicString(packet.topic));
+  doc["hops"].set(packet.getHopCount());
+  doc["duckType"].set(packet.getDuckType());
+  doc["topic"].set(toTopicString(packet.getTopic()));
 
-  //std::string cdpTopic = toTopicString(packet.topic);
+  //std::string cdpTopic = toTopicString(packet.getTopic());
   //std::string topic = "iot-2/evt/" + cdpTopic + "/fmt/json";
 
   String jsonstat;
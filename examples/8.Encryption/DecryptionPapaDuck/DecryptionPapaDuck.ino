@@ -124,7 +124,8 @@ int quackJson(std::vector<byte> packetBuffer) {
    std::string dduid(packet.dduid.begin(), packet.dduid.end());
 
    std::string muid(packet.muid.begin(), packet.muid.end());
-   std::string path(packet.path.begin(), packet.path.end());
+   // short IDs of the relays, when the sender asked for a route record
+   std::string path(packet.getPathAsHexString().c_str());
 
    Serial.println("[PAPA] Packet Received:");
    Serial.println("[PAPA] sduid:   " + String(sduid.c_str()));
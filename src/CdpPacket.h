@@ -56,6 +56,33 @@ Each MUID:     04  byte array          - Message unique ID
 // header + 1 hop + 1 byte data
 #define MIN_PACKET_LENGTH (HEADER_LENGTH + 1)
 
+/*
+Extension trailer, present when the duck type has EXT_FLAG set:
+
+|27                      |                                |length - 1
++------------------------+--------+---+-------+--- ... ---+-+
+|          DATA          |  TYPE  |LEN| VALUE |  more TLV |L|
++------------------------+--------+---+-------+--- ... ---+-+
+
+TYPE:      01  byte value          - Extension type (EXT_*)
+LEN:       01  byte value          - Length of the value
+VALUE:    LEN  byte array          - Extension value
+L   :      01  byte value          - Length of the TLVs, without L
+
+Like the hop count, the trailer is rewritten by the relays so it is not
+covered by the data CRC.
+*/
+#define EXT_FLAG 0x80
+// extensions are not added past the longest frame the SX127x sends
+#define EXT_MAX_FRAME_LENGTH 255
+#define EXT_TLV_HEADER_LENGTH 2
+/// Distance of the transmitter to the DDUID, EXT_DISTANCE_UNKNOWN if it has no route
+#define EXT_DISTANCE 0x01
+#define EXT_DISTANCE_UNKNOWN 0xFF
+/// Route record, the short IDs of the relays in the order they relayed the frame
+#define EXT_ROUTE 0x02
+#define SHORT_ID_LENGTH 2
+
 
 #define ARRAY_LENGTH(array) (sizeof(array) / sizeof((array)[0]))
 
@@ -110,6 +137,117 @@ DATA:      229 byte array          - Data payload (e.g sensor read, text,...)
 typedef std::vector<byte> Duid;
 typedef std::vector<byte> Muid;
 
+/**
+ * @brief Non-owning, read-only view of a cdp packet frame.
+ *
+ * Fields are read in place at their `*_POS` offsets so inspecting a received
+ * packet does not allocate. The underlying frame must outlive the view.
+ */
+class CdpPacketView {
+public:
+  CdpPacketView(const byte* buffer, int length)
+    : buffer(buffer), length(length) {}
+
+  CdpPacketView(const std::vector<byte> & buffer)
+    : buffer(buffer.data()), length(buffer.size()) {}
+
+  /**
+   * @brief Check that the frame is large enough to hold a cdp packet.
+   *
+   * @returns true if the header and at least one data byte are present.
+   */
+  bool isValid() const {
+    if (buffer == NULL || length < MIN_PACKET_LENGTH || length > PACKET_LENGTH) {
+      return false;
+    }
+    // the trailer leaves at least one data byte
+    return !hasExtensions() || getTrailerLength() <= length - MIN_PACKET_LENGTH;
+  }
+
+  /// Source Device UID (8 bytes)
+  const byte* getSduid() const { return &buffer[SDUID_POS]; }
+  /// Destination Device UID (8 bytes)
+  const byte* getDduid() const { return &buffer[DDUID_POS]; }
+  /// Message UID (4 bytes)
+  const byte* getMuid() const { return &buffer[MUID_POS]; }
+  /// Message topic
+  byte getTopic() const { return buffer[TOPIC_POS]; }
+  /// Type of duck as defined in DuckTypes.h
+  byte getDuckType() const { return buffer[DUCK_TYPE_POS] & ~EXT_FLAG; }
+  /// Number of times the packet was relayed in the mesh
+  byte getHopCount() const { return buffer[HOP_COUNT_POS]; }
+  /// crc32 for the data section
+  uint32_t getDcrc() const { return duckutils::toUnit32(&buffer[DATA_CRC_POS]); }
+  /// Data section
+  const byte* getData() const { return &buffer[DATA_POS]; }
+  /// Length of the data section in bytes
+  int getDataLength() const { return length - DATA_POS - getTrailerLength(); }
+
+  /// True if the frame has an extension trailer
+  bool hasExtensions() const { return (buffer[DUCK_TYPE_POS] & EXT_FLAG) != 0; }
+
+  /**
+   * @brief Find an extension in the trailer.
+   *
+   * @param type the extension type (EXT_*)
+   * @param valueLength set to the length of the value
+   * @returns the value, or NULL if the frame does not carry the extension
+   */
+  const byte* findExtension(byte type, int* valueLength) const {
+    if (!hasExtensions()) {
+      return NULL;
+    }
+    int end = length - 1;
+    for (int pos = DATA_POS + getDataLength(); pos + EXT_TLV_HEADER_LENGTH <= end;) {
+      int tlvLength = EXT_TLV_HEADER_LENGTH + buffer[pos + 1];
+      if (pos + tlvLength > end) {
+        break;
+      }
+      if (buffer[pos] == type) {
+        *valueLength = buffer[pos + 1];
+        return &buffer[pos + EXT_TLV_HEADER_LENGTH];
+      }
+      pos += tlvLength;
+    }
+    return NULL;
+  }
+
+  /**
+   * @brief Get the route record of the frame.
+   *
+   * The record holds the short ID (SHORT_ID_LENGTH bytes, big endian) of
+   * each relay, first relay first. Relays that found no room left in the
+   * frame are missing, the record is then shorter than the hop count.
+   *
+   * @param hops set to the number of short IDs in the record
+   * @returns the first short ID, or NULL if the origin did not ask for a record
+   */
+  const byte* getRoute(int* hops) const {
+    int valueLength = 0;
+    const byte* route = findExtension(EXT_ROUTE, &valueLength);
+    *hops = route != NULL ? valueLength / SHORT_ID_LENGTH : 0;
+    return route;
+  }
+
+  /// The whole frame
+  const byte* getFrame() const { return buffer; }
+  /// Length of the whole frame in bytes
+  int getFrameLength() const { return length; }
+
+private:
+  /// Length of the extension trailer, TLVs and length byte
+  int getTrailerLength() const { return hasExtensions() ? buffer[length - 1] + 1 : 0; }
+
+  const byte* buffer;
+  int length;
+};
+
+/**
+ * @brief Owning copy of a cdp packet.
+ *
+ * Convenient when the packet must outlive the frame it was read from,
+ * otherwise prefer CdpPacketView.
+ */
 class CdpPacket {
 public:
   /// Source Device UID (8 bytes)
@@ -120,7 +258,7 @@ public:
   std::vector<byte> muid;
   /// Message topic (1 byte)
   byte topic;
-  /// Offset to the Path section (1 byte)
+  /// Offset of the route record in the frame, 0 if there is none
   byte path_offset;
   /// Type of ducks as define in DuckTypes.h
   byte duckType;
@@ -130,30 +268,38 @@ public:
   uint32_t dcrc;
   /// Data section
   std::vector<byte> data;
-  /// Path section (48 bytes max)
+  /// Route record, SHORT_ID_LENGTH bytes per relay
   std::vector<byte> path;
 
-  CdpPacket(const std::vector<byte> & buffer) {
-    int buffer_length = buffer.size();
+  CdpPacket(const CdpPacketView & view) {
     // sduid
-    sduid.assign(&buffer[SDUID_POS], &buffer[DDUID_POS]);
+    sduid.assign(view.getSduid(), view.getSduid() + DUID_LENGTH);
     // dduid
-    dduid.assign(&buffer[DDUID_POS], &buffer[MUID_POS]);
+    dduid.assign(view.getDduid(), view.getDduid() + DUID_LENGTH);
     // muid
-    muid.assign(&buffer[MUID_POS], &buffer[TOPIC_POS]);
+    muid.assign(view.getMuid(), view.getMuid() + MUID_LENGTH);
     // topic
-    topic = buffer[TOPIC_POS];
+    topic = view.getTopic();
     // duckType
-    duckType = buffer[DUCK_TYPE_POS];
+    duckType = view.getDuckType();
     // hop count
-    hopCount = buffer[HOP_COUNT_POS];
+    hopCount = view.getHopCount();
     // data crc
-    dcrc = duckutils::toUnit32(&buffer[DATA_CRC_POS]);
+    dcrc = view.getDcrc();
     // data section
-    data.assign(&buffer[DATA_POS], &buffer[buffer_length]);
+    data.assign(view.getData(), view.getData() + view.getDataLength());
+    // route record
+    int hops = 0;
+    const byte* route = view.getRoute(&hops);
+    path_offset = route != NULL ? route - view.getFrame() : 0;
+    if (route != NULL) {
+      path.assign(route, route + hops * SHORT_ID_LENGTH);
+    }
 
   }
 
+  CdpPacket(const std::vector<byte> & buffer) : CdpPacket(CdpPacketView(buffer)) {}
+
   ~CdpPacket() {}
 
 
@@ -0,0 +1,104 @@
+#include "include/DuckAckAggregator.h"
+
+#include <string.h>
+
+DuckAckAggregator::DuckAckAggregator()
+    : batchSize(CDPCFG_ACK_BATCH_SIZE), deadline(CDPCFG_ACK_DEADLINE_MS) {
+    clear();
+    memset(&stats, 0, sizeof(stats));
+}
+
+void DuckAckAggregator::setBatch(uint8_t size, uint16_t deadline) {
+    this->batchSize = size < MAX_MUID_PER_ACK ? size : MAX_MUID_PER_ACK;
+    this->deadline = deadline;
+}
+
+void DuckAckAggregator::clear() {
+    numPending = 0;
+    numRecent = 0;
+    nextRecent = 0;
+}
+
+bool DuckAckAggregator::matches(const DuckAckPair & pair, const byte* duid, const byte* muid) {
+    return std::equal(muid, muid + MUID_LENGTH, pair.muid)
+        && std::equal(duid, duid + DUID_LENGTH, pair.duid);
+}
+
+bool DuckAckAggregator::add(const byte* duid, const byte* muid, unsigned long now) {
+    for (int i = 0; i < numPending; i++) {
+        if (matches(batch[i], duid, muid)) {
+            stats.duplicates++;
+            return false;
+        }
+    }
+    bool reack = false;
+    for (int i = 0; i < numRecent; i++) {
+        if (matches(recent[i], duid, muid)) {
+            if (now - recent[i].time < CDPCFG_ACK_REPEAT_MS) {
+                stats.duplicates++;
+                return false;
+            }
+            reack = true;
+            break;
+        }
+    }
+    if (numPending >= MAX_MUID_PER_ACK) {
+        stats.overflows++;
+        return false;
+    }
+    DuckAckPair* pair = &batch[numPending++];
+    memcpy(pair->duid, duid, DUID_LENGTH);
+    memcpy(pair->muid, muid, MUID_LENGTH);
+    pair->time = now;
+    stats.queued++;
+    if (reack) {
+        stats.reacked++;
+    }
+    return true;
+}
+
+bool DuckAckAggregator::isDue(unsigned long now) const {
+    if (numPending == 0) {
+        return false;
+    }
+    // the first pair of the batch is the oldest one
+    return numPending >= batchSize || now - batch[0].time >= deadline;
+}
+
+int DuckAckAggregator::build(byte* data) const {
+    if (numPending == 0) {
+        return 0;
+    }
+    data[0] = numPending;
+    byte* pair = data + 1;
+    for (int i = 0; i < numPending; i++) {
+        memcpy(pair, batch[i].duid, DUID_LENGTH);
+        memcpy(pair + DUID_LENGTH, batch[i].muid, MUID_LENGTH);
+        pair += DUID_LENGTH + MUID_LENGTH;
+    }
+    return pair - data;
+}
+
+void DuckAckAggregator::sent(unsigned long now) {
+    for (int i = 0; i < numPending; i++) {
+        // a pair acked again takes the place of its previous ack
+        DuckAckPair* entry = NULL;
+        for (int j = 0; j < numRecent && entry == NULL; j++) {
+            if (matches(recent[j], batch[i].duid, batch[i].muid)) {
+                entry = &recent[j];
+            }
+        }
+        if (entry == NULL) {
+            entry = &recent[nextRecent];
+            nextRecent = (nextRecent + 1) % CDPCFG_ACK_RECENT_SIZE;
+            if (numRecent < CDPCFG_ACK_RECENT_SIZE) {
+                numRecent++;
+            }
+        }
+        *entry = batch[i];
+        entry->time = now;
+    }
+    stats.acks++;
+    stats.pairs += numPending;
+    numPending = 0;
+}
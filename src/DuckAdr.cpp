@@ -0,0 +1,262 @@
+#define CDP_LOG_MODULE CDP_LOG_DUCK
+
+#include "include/DuckAdr.h"
+#include "DuckLogger.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace {
+    // neighbors not heard for this many beacon intervals are forgotten
+    const unsigned long NEIGHBOR_TIMEOUT_INTERVALS = 3;
+    // time given to the neighbors to be heard after lowering the spreading factor
+    const unsigned long CONFIRM_INTERVALS = 2;
+    // the spreading factor is pinned for this long after a rollback
+    const unsigned long HOLDOFF_INTERVALS = 10;
+    // upper bound of the delay before forwarding a proposal (ms)
+    const unsigned long FORWARD_JITTER_MS = 1000;
+}
+
+DuckAdr::DuckAdr(DuckNeighborTable & neighbors)
+    : enabled(false), sf(CDPCFG_RF_LORA_SF), interval(CDPCFG_ADR_INTERVAL_MS),
+      neighbors(neighbors), lastEvaluation(0), nextBeacon(0), proposedSf(0),
+      switchAt(0), previousSf(0), switchedAt(0), confirming(false),
+      holdoffSf(0), holdoffUntil(0) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+void DuckAdr::setEnabled(bool enable, uint8_t sf, unsigned long interval) {
+    unsigned long now = millis();
+    this->enabled = enable;
+    this->sf = sf;
+    this->interval = interval > 0 ? interval : 1;
+    proposedSf = 0;
+    confirming = false;
+    holdoffSf = 0;
+    lastEvaluation = now;
+    nextBeacon = now + this->interval;
+    scheduleBeacon(now, random(this->interval / 10 + 1));
+}
+
+bool DuckAdr::isFresh(const DuckNeighbor & neighbor, unsigned long now) const {
+    return neighbor.used && now - neighbor.lastHeard < NEIGHBOR_TIMEOUT_INTERVALS * interval;
+}
+
+bool DuckAdr::onReport(const byte* sduid, const DuckAdrReport & report, bool forUs,
+                       unsigned long now) {
+    DuckNeighbor* neighbor = neighbors.find(sduid);
+    if (neighbor != NULL) {
+        if (forUs && report.snr != DUCK_ADR_NO_SNR) {
+            neighbor->reportedSnr = report.snr / 4.0f;
+        }
+        neighbor->need = report.need;
+        neighbor->needHops = report.needHops;
+    }
+
+    uint8_t target = report.proposedSf;
+    if (!enabled || target < CDPCFG_ADR_MIN_SF || target > CDPCFG_ADR_MAX_SF
+        || (target == sf && !hasPending())) {
+        return false;
+    }
+    unsigned long at = now + report.switchIn * 100UL;
+    if (hasPending() && target <= proposedSf) {
+        // same proposal heard from another neighbor: keep the earliest switch
+        if (target == proposedSf && (long) (at - switchAt) < 0) {
+            switchAt = at;
+        }
+        return false;
+    }
+    loginfo_f("ADR: switching to SF%d in %lums\n", target, at - now);
+    proposedSf = target;
+    switchAt = at;
+    scheduleBeacon(now, random(FORWARD_JITTER_MS + 1));
+    return true;
+}
+
+uint8_t DuckAdr::getRequiredSf(unsigned long now) const {
+    float worst = INFINITY;
+    bool known = false;
+    for (int i = 0; i < neighbors.size(); i++) {
+        const DuckNeighbor & neighbor = *neighbors.get(i);
+        if (!isFresh(neighbor, now)) {
+            continue;
+        }
+        // a link is as good as its worst direction
+        float snr = neighbor.snr;
+        if (!isnan(neighbor.reportedSnr) && neighbor.reportedSnr < snr) {
+            snr = neighbor.reportedSnr;
+        }
+        if (snr < worst) {
+            worst = snr;
+        }
+        known = true;
+    }
+    if (!known) {
+        return sf;
+    }
+    for (uint8_t candidate = CDPCFG_ADR_MIN_SF; candidate < CDPCFG_ADR_MAX_SF; candidate++) {
+        float margin = CDPCFG_ADR_MARGIN_DB + (candidate < sf ? CDPCFG_ADR_HYSTERESIS_DB : 0);
+        if (worst - getSnrFloor(candidate) >= margin) {
+            return candidate;
+        }
+    }
+    return CDPCFG_ADR_MAX_SF;
+}
+
+uint8_t DuckAdr::getClusterNeed(unsigned long now, uint8_t* hops) const {
+    uint8_t need = enabled ? getRequiredSf(now) : sf;
+    uint8_t needHops = 0;
+    if ((long) (now - holdoffUntil) < 0 && holdoffSf > need) {
+        need = holdoffSf;
+    }
+    for (int i = 0; i < neighbors.size(); i++) {
+        const DuckNeighbor & neighbor = *neighbors.get(i);
+        // needs relayed more than MAX_HOPS times are echoes of a need that is gone
+        if (isFresh(neighbor, now) && neighbor.needHops < MAX_HOPS && neighbor.need > need) {
+            need = neighbor.need;
+            needHops = neighbor.needHops + 1;
+        }
+    }
+    if (hops != NULL) {
+        *hops = needHops;
+    }
+    return need;
+}
+
+DuckAdrReport DuckAdr::getReport(float snr, unsigned long now) {
+    DuckAdrReport report;
+    if (isnan(snr)) {
+        report.snr = DUCK_ADR_NO_SNR;
+    } else {
+        float quarters = roundf(snr * 4);
+        report.snr = quarters < -127 ? -127 : quarters > 127 ? 127 : (int8_t) quarters;
+    }
+    report.sf = sf;
+    report.need = getClusterNeed(now, &report.needHops);
+    report.proposedSf = 0;
+    report.switchIn = 0;
+    if (hasPending()) {
+        report.proposedSf = proposedSf;
+        if ((long) (switchAt - now) > 0) {
+            unsigned long left = (switchAt - now) / 100;
+            report.switchIn = left > 0xFFFF ? 0xFFFF : left;
+        }
+    }
+    return report;
+}
+
+void DuckAdr::propose(uint8_t target, unsigned long now) {
+    loginfo_f("ADR: proposing SF%d\n", target);
+    proposedSf = target;
+    switchAt = now + CDPCFG_ADR_SWITCH_DELAY_MS;
+    stats.proposals++;
+    scheduleBeacon(now, random(FORWARD_JITTER_MS + 1));
+}
+
+bool DuckAdr::service(unsigned long now) {
+    if (!enabled) {
+        return false;
+    }
+    bool changed = false;
+
+    if (hasPending() && (long) (now - switchAt) >= 0) {
+        uint8_t target = proposedSf;
+        proposedSf = 0;
+        if (target != sf) {
+            loginfo_f("ADR: SF%d -> SF%d\n", sf, target);
+            previousSf = sf;
+            confirming = target < sf;
+            switchedAt = now;
+            sf = target;
+            stats.switches++;
+            changed = true;
+            // let the neighbors hear us at the new spreading factor
+            scheduleBeacon(now, random(FORWARD_JITTER_MS + 1));
+        }
+    }
+
+    if (confirming && now - switchedAt >= CONFIRM_INTERVALS * interval) {
+        confirming = false;
+        int lost = 0;
+        int kept = 0;
+        for (int i = 0; i < neighbors.size(); i++) {
+            // the neighbors that were fresh when the spreading factor changed
+            const DuckNeighbor & neighbor = *neighbors.get(i);
+            if ((long) (neighbor.firstHeard - switchedAt) >= 0) {
+                continue;
+            }
+            if ((long) (neighbor.lastHeard - switchedAt) >= 0) {
+                kept++;
+            } else if (isFresh(neighbor, switchedAt)) {
+                lost++;
+            }
+        }
+        if (lost > 0) {
+            logwarn_f("ADR: %d neighbors lost at SF%d, back to SF%d\n", lost, sf, previousSf);
+            stats.rollbacks++;
+            // keep the cluster from trying again right away
+            holdoffSf = previousSf;
+            holdoffUntil = now + HOLDOFF_INTERVALS * interval;
+            if (kept == 0) {
+                // nobody can hear us anymore, nobody would hear a proposal
+                sf = previousSf;
+                changed = true;
+                scheduleBeacon(now, random(FORWARD_JITTER_MS + 1));
+            } else {
+                propose(previousSf, now);
+            }
+        }
+    }
+
+    if (now - lastEvaluation >= interval) {
+        lastEvaluation = now;
+        uint8_t need = getClusterNeed(now);
+        if (need < CDPCFG_ADR_MIN_SF) {
+            need = CDPCFG_ADR_MIN_SF;
+        } else if (need > CDPCFG_ADR_MAX_SF) {
+            need = CDPCFG_ADR_MAX_SF;
+        }
+        if (!hasPending() && !confirming && need != sf) {
+            propose(need, now);
+        }
+    }
+    return changed;
+}
+
+void DuckAdr::scheduleBeacon(unsigned long now, unsigned long delay) {
+    // only ever brings the next beacon forward
+    if ((long) (now + delay - nextBeacon) < 0) {
+        nextBeacon = now + delay;
+    }
+}
+
+bool DuckAdr::isBeaconDue(unsigned long now) const {
+    return enabled && (long) (now - nextBeacon) >= 0;
+}
+
+void DuckAdr::onBeaconSent(unsigned long now) {
+    stats.beacons++;
+    // +/- 10% so that the beacons of the neighbors do not stay in step
+    nextBeacon = now + interval - interval / 10 + random(interval / 5 + 1);
+}
+
+void DuckAdr::writeReport(const DuckAdrReport & report, byte* data) {
+    data[0] = (byte) report.snr;
+    data[1] = report.sf;
+    data[2] = report.need;
+    data[3] = report.needHops;
+    data[4] = report.proposedSf;
+    data[5] = report.switchIn >> 8;
+    data[6] = report.switchIn & 0xFF;
+}
+
+DuckAdrReport DuckAdr::readReport(const byte* data) {
+    DuckAdrReport report;
+    report.snr = (int8_t) data[0];
+    report.sf = data[1];
+    report.need = data[2];
+    report.needHops = data[3];
+    report.proposedSf = data[4];
+    report.switchIn = (data[5] << 8) | data[6];
+    return report;
+}
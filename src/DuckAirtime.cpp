@@ -0,0 +1,20 @@
+#include "include/DuckAirtime.h"
+
+namespace duckairtime {
+
+uint32_t getTimeOnAir(uint8_t sf, float bw, uint8_t cr, uint16_t preamble, size_t length) {
+    // symbol duration in us
+    float symbol = (float) (1UL << sf) * 1000.0f / bw;
+    int lowDataRate = symbol > 16000.0f ? 1 : 0;
+
+    // payload symbols: 8 + ceil((8PL - 4SF + 28 + 16CRC - 20IH) / 4(SF - 2DE)) * CR
+    long bits = 8L * length - 4L * sf + 28 + 16;
+    long bitsPerBlock = 4L * (sf - 2 * lowDataRate);
+    long blocks = bits > 0 ? (bits + bitsPerBlock - 1) / bitsPerBlock : 0;
+    long symbols = 8 + blocks * cr;
+
+    // the preamble lasts preamble + 4.25 symbols
+    return (uint32_t) ((4.0f * (preamble + symbols) + 17.0f) * symbol / 4.0f);
+}
+
+} // namespace duckairtime
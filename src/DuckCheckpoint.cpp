@@ -0,0 +1,218 @@
+#include "include/DuckCheckpoint.h"
+#include "include/DuckCrc.h"
+
+#include <string.h>
+
+#if CDPCFG_CHECKPOINT_SLOTS < 2
+#error "CDPCFG_CHECKPOINT_SLOTS must be at least 2"
+#endif
+
+namespace {
+    const uint16_t CHECKPOINT_MAGIC = 0xDC01;
+    // bytes read at once to check the CRC of a slot
+    const int CHECK_BUFFER_LENGTH = 64;
+
+    void putUint16(byte* data, uint16_t value) {
+        data[0] = value & 0xFF;
+        data[1] = value >> 8;
+    }
+
+    void putUint32(byte* data, uint32_t value) {
+        for (int i = 0; i < 4; i++) {
+            data[i] = (value >> (8 * i)) & 0xFF;
+        }
+    }
+
+    uint16_t getUint16(const byte* data) {
+        return data[0] | ((uint16_t) data[1] << 8);
+    }
+
+    uint32_t getUint32(const byte* data) {
+        return data[0] | ((uint32_t) data[1] << 8) | ((uint32_t) data[2] << 16)
+               | ((uint32_t) data[3] << 24);
+    }
+
+    // the CRC also covers the length and sequence number of the header
+    uint32_t finishCrc(uint32_t crc, uint16_t length, uint32_t sequence) {
+        byte fields[6];
+        putUint16(fields, length);
+        putUint32(fields + 2, sequence);
+        return duckcrc::crc32(fields, sizeof(fields), crc);
+    }
+}
+
+DuckCheckpoint::DuckCheckpoint()
+    : storage(NULL), slotSize(0), slot(-1), length(0), writeSlot(-1),
+      writeLength(0), written(0), writeCrc(0) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+int DuckCheckpoint::setStorage(DuckStorage* storage, int length) {
+    this->storage = NULL;
+    this->slot = -1;
+    this->length = 0;
+    this->writeSlot = -1;
+    memset(&stats, 0, sizeof(stats));
+    if (storage == NULL) {
+        return DUCK_ERR_NONE;
+    }
+
+    slotSize = DUCK_CHECKPOINT_HEADER_LENGTH + length;
+    stats.slots = storage->getSize() / slotSize;
+    if (stats.slots > CDPCFG_CHECKPOINT_SLOTS) {
+        stats.slots = CDPCFG_CHECKPOINT_SLOTS;
+    }
+    if (length > 0xFFFF || stats.slots < 2) {
+        stats.slots = 0;
+        return DUCK_ERR_STORAGE;
+    }
+    this->storage = storage;
+
+    for (int i = 0; i < stats.slots; i++) {
+        uint16_t slotLength;
+        uint32_t sequence;
+        uint32_t crc;
+        if (readHeader(i, &slotLength, &sequence, &crc) != DUCK_ERR_NONE) {
+            continue;
+        }
+        if ((this->slot < 0 || sequence > stats.sequence) && isValid(i, slotLength, sequence, crc)) {
+            this->slot = i;
+            this->length = slotLength;
+            stats.sequence = sequence;
+        }
+    }
+    return DUCK_ERR_NONE;
+}
+
+int DuckCheckpoint::readHeader(int slot, uint16_t* length, uint32_t* sequence, uint32_t* crc) {
+    byte header[DUCK_CHECKPOINT_HEADER_LENGTH];
+    int err = storage->read(slot * slotSize, header, sizeof(header));
+    if (err != DUCK_ERR_NONE) {
+        return err;
+    }
+    *length = getUint16(header + 2);
+    if (getUint16(header) != CHECKPOINT_MAGIC || *length > slotSize - DUCK_CHECKPOINT_HEADER_LENGTH) {
+        return DUCK_ERR_NO_CHECKPOINT;
+    }
+    *sequence = getUint32(header + 4);
+    *crc = getUint32(header + 8);
+    return DUCK_ERR_NONE;
+}
+
+bool DuckCheckpoint::isValid(int slot, uint16_t length, uint32_t sequence, uint32_t crc) {
+    byte buffer[CHECK_BUFFER_LENGTH];
+    uint32_t actual = 0;
+    int start = slot * slotSize + DUCK_CHECKPOINT_HEADER_LENGTH;
+    for (int offset = 0; offset < length; offset += CHECK_BUFFER_LENGTH) {
+        int n = length - offset < CHECK_BUFFER_LENGTH ? length - offset : CHECK_BUFFER_LENGTH;
+        if (storage->read(start + offset, buffer, n) != DUCK_ERR_NONE) {
+            return false;
+        }
+        actual = duckcrc::crc32(buffer, n, actual);
+    }
+    return finishCrc(actual, length, sequence) == crc;
+}
+
+int DuckCheckpoint::read(int offset, byte* data, int length) {
+    if (storage == NULL || slot < 0) {
+        return DUCK_ERR_NO_CHECKPOINT;
+    }
+    if (offset < 0 || length < 0 || offset + length > this->length) {
+        return DUCK_ERR_STORAGE;
+    }
+    return storage->read(slot * slotSize + DUCK_CHECKPOINT_HEADER_LENGTH + offset, data, length);
+}
+
+int DuckCheckpoint::fail() {
+    writeSlot = -1;
+    stats.failures++;
+    return DUCK_ERR_STORAGE;
+}
+
+void DuckCheckpoint::addStepTime(unsigned long start) {
+    unsigned long elapsed = micros() - start;
+    stats.lastSaveTime += elapsed;
+    if (elapsed > stats.maxStepTime) {
+        stats.maxStepTime = elapsed;
+    }
+}
+
+int DuckCheckpoint::begin(int length) {
+    if (storage == NULL || length < 0 || length > slotSize - DUCK_CHECKPOINT_HEADER_LENGTH) {
+        return fail();
+    }
+    unsigned long start = micros();
+    stats.lastSaveTime = 0;
+    writeSlot = (slot + 1) % stats.slots;
+    writeLength = length;
+    written = 0;
+    writeCrc = 0;
+    // the slot stays invalid until end(), even if an older checkpoint in it
+    // happened to match the new bytes
+    byte header[DUCK_CHECKPOINT_HEADER_LENGTH];
+    memset(header, 0, sizeof(header));
+    if (storage->write(writeSlot * slotSize, header, sizeof(header)) != DUCK_ERR_NONE) {
+        return fail();
+    }
+    addStepTime(start);
+    return DUCK_ERR_NONE;
+}
+
+int DuckCheckpoint::write(const byte* data, int length) {
+    if (writeSlot < 0 || written + length > writeLength) {
+        return fail();
+    }
+    unsigned long start = micros();
+    int err = storage->write(writeSlot * slotSize + DUCK_CHECKPOINT_HEADER_LENGTH + written, data, length);
+    if (err != DUCK_ERR_NONE) {
+        return fail();
+    }
+    writeCrc = duckcrc::crc32(data, length, writeCrc);
+    written += length;
+    addStepTime(start);
+    return DUCK_ERR_NONE;
+}
+
+int DuckCheckpoint::end() {
+    if (writeSlot < 0 || written != writeLength) {
+        return fail();
+    }
+    unsigned long start = micros();
+    uint32_t sequence = stats.sequence + 1;
+    byte header[DUCK_CHECKPOINT_HEADER_LENGTH];
+    putUint16(header, CHECKPOINT_MAGIC);
+    putUint16(header + 2, writeLength);
+    putUint32(header + 4, sequence);
+    putUint32(header + 8, finishCrc(writeCrc, writeLength, sequence));
+    if (storage->write(writeSlot * slotSize, header, sizeof(header)) != DUCK_ERR_NONE
+        || storage->commit() != DUCK_ERR_NONE) {
+        return fail();
+    }
+    slot = writeSlot;
+    length = writeLength;
+    stats.sequence = sequence;
+    stats.saves++;
+    writeSlot = -1;
+    addStepTime(start);
+    return DUCK_ERR_NONE;
+}
+
+namespace duckcheckpoint {
+
+void save(const void* region, int start, int size, int offset, byte* data, int length) {
+    int from = offset > start ? offset : start;
+    int to = offset + length < start + size ? offset + length : start + size;
+    if (from < to) {
+        memcpy(data + from - offset, (const byte*) region + from - start, to - from);
+    }
+}
+
+void load(void* region, int start, int size, int offset, const byte* data, int length) {
+    int from = offset > start ? offset : start;
+    int to = offset + length < start + size ? offset + length : start + size;
+    if (from < to) {
+        memcpy((byte*) region + from - start, data + from - offset, to - from);
+    }
+}
+
+} // namespace duckcheckpoint
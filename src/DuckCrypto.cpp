@@ -1,3 +1,5 @@
+#define CDP_LOG_MODULE CDP_LOG_UTILS
+
 #include "include/DuckCrypto.h"
 #include "include/DuckUtils.h"
 
@@ -0,0 +1,67 @@
+#include "include/DuckDutyCycle.h"
+
+#include <limits.h>
+#include <string.h>
+
+#define SLOTS (CDPCFG_DUTY_CYCLE_BUCKETS + 1)
+
+DuckDutyCycle::DuckDutyCycle()
+    : permille(0), maxDwell(CDPCFG_MAX_DWELL_MS), bucketStart(0), current(0), used(0) {
+    memset(buckets, 0, sizeof(buckets));
+    memset(&stats, 0, sizeof(stats));
+    setLimit(CDPCFG_DUTY_CYCLE_PERMILLE, CDPCFG_DUTY_CYCLE_WINDOW_MS);
+}
+
+void DuckDutyCycle::setLimit(uint16_t permille, unsigned long window) {
+    this->permille = permille;
+    this->window = window;
+    bucketLength = window / CDPCFG_DUTY_CYCLE_BUCKETS;
+    if (bucketLength == 0) {
+        bucketLength = 1;
+    }
+}
+
+void DuckDutyCycle::expire(unsigned long now) {
+    unsigned long elapsed = now - bucketStart;
+    if (elapsed < bucketLength) {
+        return;
+    }
+    if (elapsed >= bucketLength * SLOTS) {
+        // idle for a whole window
+        memset(buckets, 0, sizeof(buckets));
+        used = 0;
+        bucketStart = now;
+        return;
+    }
+    while (now - bucketStart >= bucketLength) {
+        current = (current + 1) % SLOTS;
+        used -= buckets[current];
+        buckets[current] = 0;
+        bucketStart += bucketLength;
+    }
+}
+
+unsigned long DuckDutyCycle::getRemaining(unsigned long now) {
+    if (!isLimited()) {
+        return ULONG_MAX;
+    }
+    expire(now);
+    unsigned long budget = getBudget();
+    return used < budget ? budget - used : 0;
+}
+
+bool DuckDutyCycle::canTransmit(unsigned long airtime, unsigned long now, uint8_t reserve) {
+    if (!isLimited()) {
+        return true;
+    }
+    unsigned long remaining = getRemaining(now);
+    unsigned long kept = getBudget() / 100 * reserve;
+    return remaining >= kept && airtime <= remaining - kept;
+}
+
+void DuckDutyCycle::record(unsigned long airtime, unsigned long now) {
+    expire(now);
+    buckets[current] += airtime;
+    used += airtime;
+    stats.airtime += airtime;
+}
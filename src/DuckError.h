@@ -11,6 +11,10 @@
 // Device Id is too long
 #define DUCK_ERR_ID_TOO_LONG   -5101
 #define DUCK_ERR_OTA           -5200
+// Persistent storage access out of bounds or failed
+#define DUCK_ERR_STORAGE       -5300
+// No valid checkpoint in the persistent storage
+#define DUCK_ERR_NO_CHECKPOINT -5301
 
 /// Lora module initialization error
 #define DUCKLORA_ERR_BEGIN          -1000
@@ -27,8 +31,12 @@
 #define DUCKLORA_ERR_HANDLE_PACKET  -1050
 // Attempted to send a message larger than 256 bytes
 #define DUCKLORA_ERR_MSG_TOO_LARGE  -1051
-// Radio is busy sending data
+// Radio is busy sending data, the transmit queue is full
 #define DUCKLORA_ERR_TX_BUSY        -1052
+// The duty cycle budget is exhausted, the frame was deferred or dropped
+#define DUCKLORA_ERR_DUTY_CYCLE     -1053
+// The frame time on air is longer than the maximum dwell time
+#define DUCKLORA_ERR_DWELL_TIME     -1054
 
 // Wifi network is not availble
 #define DUCKWIFI_ERR_NOT_AVAILABLE  -2000
@@ -43,6 +51,8 @@
 #define DUCKPACKET_ERR_SIZE_INVALID  -4000
 #define DUCKPACKET_ERR_TOPIC_INVALID -4001
 #define DUCKPACKET_ERR_MAX_HOPS      -4002
+// Too many reliable messages are waiting for their ack
+#define DUCKPACKET_ERR_RELIABLE_FULL -4003
 
 #define DUCK_INTERNET_ERR_SETUP      -6000
 #define DUCK_INTERNET_ERR_SSID       -6001
@@ -0,0 +1,197 @@
+#include "include/DuckInflightTable.h"
+
+#include <string.h>
+
+#if CDPCFG_RELIABLE_PENDING >= CDPCFG_INFLIGHT_TABLE_SIZE
+#error "CDPCFG_RELIABLE_PENDING must be smaller than CDPCFG_INFLIGHT_TABLE_SIZE"
+#endif
+
+DuckInflightTable::DuckInflightTable() {
+    clear();
+    memset(&stats, 0, sizeof(stats));
+}
+
+void DuckInflightTable::clear() {
+    for (int i = 0; i < CDPCFG_INFLIGHT_TABLE_SIZE; i++) {
+        entries[i].used = false;
+        entries[i].frame = -1;
+    }
+    for (int i = 0; i < CDPCFG_RELIABLE_PENDING; i++) {
+        frameLengths[i] = 0;
+    }
+}
+
+const DuckInflight* DuckInflightTable::find(const byte* muid) const {
+    for (int i = 0; i < CDPCFG_INFLIGHT_TABLE_SIZE; i++) {
+        const DuckInflight* entry = &entries[i];
+        if (entry->used && std::equal(muid, muid + MUID_LENGTH, entry->muid)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+DuckInflight* DuckInflightTable::replace(unsigned long now) {
+    // a free entry, the message acked the longest time ago, or the message
+    // sent the longest time ago. The frame kept for a reliable message is
+    // never dropped: there are fewer frames than entries.
+    DuckInflight* entry = NULL;
+    for (int i = 0; i < CDPCFG_INFLIGHT_TABLE_SIZE; i++) {
+        DuckInflight* candidate = &entries[i];
+        if (!candidate->used) {
+            return candidate;
+        }
+        if (candidate->frame >= 0) {
+            continue;
+        }
+        if (entry == NULL
+            || (candidate->acked && !entry->acked)
+            || (candidate->acked == entry->acked
+                && (candidate->acked ? now - candidate->ackedAt > now - entry->ackedAt
+                                     : now - candidate->sentAt > now - entry->sentAt))) {
+            entry = candidate;
+        }
+    }
+    if (!entry->acked) {
+        stats.evicted++;
+    }
+    return entry;
+}
+
+DuckInflight* DuckInflightTable::add(const byte* muid, unsigned long now) {
+    DuckInflight* entry = const_cast<DuckInflight*>(find(muid));
+    if (entry == NULL) {
+        entry = replace(now);
+    } else {
+        release(entry);
+    }
+    memcpy(entry->muid, muid, MUID_LENGTH);
+    entry->sentAt = now;
+    entry->lastSent = now;
+    entry->ackedAt = 0;
+    entry->retries = 0;
+    entry->acked = false;
+    entry->used = true;
+    entry->reliable = false;
+    entry->deadline = 0;
+    entry->nextRetry = 0;
+    entry->frame = -1;
+    stats.sent++;
+    return entry;
+}
+
+bool DuckInflightTable::canAddReliable() const {
+    for (int i = 0; i < CDPCFG_RELIABLE_PENDING; i++) {
+        if (frameLengths[i] == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+DuckInflight* DuckInflightTable::addReliable(const byte* muid, const byte* frame, int length,
+                                             unsigned long now, unsigned long deadline,
+                                             unsigned long nextRetry) {
+    if (length <= 0 || length > EXT_MAX_FRAME_LENGTH) {
+        return NULL;
+    }
+    // the frame of a message sent again with the same MUID is reused
+    const DuckInflight* previous = find(muid);
+    if (!canAddReliable() && (previous == NULL || previous->frame < 0)) {
+        return NULL;
+    }
+    DuckInflight* entry = add(muid, now);
+    int slot = 0;
+    while (frameLengths[slot] != 0) {
+        slot++;
+    }
+    memcpy(frames[slot], frame, length);
+    frameLengths[slot] = length;
+    entry->frame = slot;
+    entry->reliable = true;
+    entry->deadline = deadline;
+    entry->nextRetry = nextRetry;
+    return entry;
+}
+
+const byte* DuckInflightTable::getFrame(const DuckInflight & message, int* length) const {
+    if (message.frame < 0) {
+        *length = 0;
+        return NULL;
+    }
+    *length = frameLengths[(int) message.frame];
+    return frames[(int) message.frame];
+}
+
+void DuckInflightTable::release(DuckInflight* message) {
+    if (message->frame >= 0) {
+        frameLengths[(int) message->frame] = 0;
+        message->frame = -1;
+    }
+}
+
+DuckInflight* DuckInflightTable::nextDue(unsigned long now) {
+    for (int i = 0; i < CDPCFG_INFLIGHT_TABLE_SIZE; i++) {
+        DuckInflight* entry = &entries[i];
+        if (entry->used && entry->frame >= 0
+            && ((long) (now - entry->nextRetry) >= 0 || (long) (now - entry->deadline) >= 0)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+void DuckInflightTable::retried(DuckInflight* message, unsigned long now, unsigned long nextRetry) {
+    message->lastSent = now;
+    message->nextRetry = nextRetry;
+    if (message->retries < 0xFF) {
+        message->retries++;
+    }
+    stats.retransmissions++;
+}
+
+void DuckInflightTable::expire(DuckInflight* message) {
+    release(message);
+    stats.expired++;
+}
+
+DuckInflight* DuckInflightTable::ack(const byte* muid, unsigned long now) {
+    DuckInflight* entry = const_cast<DuckInflight*>(find(muid));
+    if (entry == NULL || entry->acked) {
+        return NULL;
+    }
+    release(entry);
+    entry->acked = true;
+    entry->ackedAt = now;
+    stats.acked++;
+    return entry;
+}
+
+int DuckInflightTable::pending() const {
+    int count = 0;
+    for (int i = 0; i < CDPCFG_INFLIGHT_TABLE_SIZE; i++) {
+        if (entries[i].used && !entries[i].acked) {
+            count++;
+        }
+    }
+    return count;
+}
+
+int DuckInflightTable::size() const {
+    int count = 0;
+    for (int i = 0; i < CDPCFG_INFLIGHT_TABLE_SIZE; i++) {
+        if (entries[i].used) {
+            count++;
+        }
+    }
+    return count;
+}
+
+const DuckInflight* DuckInflightTable::get(int index) const {
+    for (int i = 0; i < CDPCFG_INFLIGHT_TABLE_SIZE; i++) {
+        if (entries[i].used && index-- == 0) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
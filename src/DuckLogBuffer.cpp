@@ -0,0 +1,81 @@
+#include "include/DuckLogBuffer.h"
+
+#ifdef CDP_LOG_BINARY
+
+#include <Arduino.h>
+
+#include "include/DuckRingBuffer.h"
+
+namespace ducklog {
+
+namespace {
+
+DuckRingBuffer<DuckLogEntry, CDP_LOG_BUFFER_SIZE> entries;
+unsigned long dropped = 0;
+unsigned long reportedDropped = 0;
+
+} // namespace
+
+void record(uint8_t level, uint32_t id, const int32_t* args, int numArgs) {
+    DuckLogEntry* entry = entries.acquire();
+    if (entry == NULL) {
+        dropped++;
+        return;
+    }
+    entry->id = id;
+    entry->timestamp = millis();
+    entry->level = level;
+    entry->numArgs = numArgs < CDP_LOG_MAX_ARGS ? numArgs : CDP_LOG_MAX_ARGS;
+    for (int i = 0; i < entry->numArgs; i++) {
+        entry->args[i] = args[i];
+    }
+    entries.commit();
+}
+
+bool pop(DuckLogEntry* entry) {
+    DuckLogEntry* oldest = entries.peek();
+    if (oldest == NULL) {
+        return false;
+    }
+    *entry = *oldest;
+    entries.pop();
+    return true;
+}
+
+int drain(int maxEntries) {
+    if (dropped != reportedDropped) {
+        // "#D <entries lost>"
+        Serial.print("#D ");
+        Serial.println(dropped - reportedDropped);
+        reportedDropped = dropped;
+    }
+    int count = 0;
+    DuckLogEntry entry;
+    while (count < maxEntries && pop(&entry)) {
+        // "#L <site id> <timestamp> <level> <args...>"
+        Serial.print("#L ");
+        Serial.print(entry.id, HEX);
+        Serial.print(' ');
+        Serial.print(entry.timestamp);
+        Serial.print(' ');
+        Serial.print((int) entry.level);
+        for (int i = 0; i < entry.numArgs; i++) {
+            Serial.print(' ');
+            Serial.print(entry.args[i]);
+        }
+        Serial.println();
+        count++;
+    }
+    return count;
+}
+
+void dump() {
+    while (drain(CDP_LOG_BUFFER_SIZE) > 0) {
+    }
+}
+
+unsigned long getDropped() { return dropped; }
+
+} // namespace ducklog
+
+#endif
@@ -1,106 +1,176 @@
 #ifndef DUCKLOGGER_H
 #define DUCKLOGGER_H
 
-#ifndef CDP_NO_LOG
-#include "Arduino.h"
-#define CDP_DEBUG
+// Log levels. A log statement is compiled in only when its level is at or
+// below the threshold of the module it belongs to.
+#define CDP_LOG_LEVEL_NONE  0
+#define CDP_LOG_LEVEL_ERROR 1
+#define CDP_LOG_LEVEL_WARN  2
+#define CDP_LOG_LEVEL_INFO  3
+#define CDP_LOG_LEVEL_DEBUG 4
+
+// Global threshold, e.g -DCDP_LOG_LEVEL=CDP_LOG_LEVEL_WARN
+#ifndef CDP_LOG_LEVEL
+#ifdef CDP_NO_LOG
+#define CDP_LOG_LEVEL CDP_LOG_LEVEL_NONE
+#else
+#define CDP_LOG_LEVEL CDP_LOG_LEVEL_DEBUG
+#endif
 #endif
 
-#ifdef CDP_DEBUG
-#define CDP_LOG_ERROR
-#define CDP_LOG_INFO
-#define CDP_LOG_DEBUG
-#define CDP_LOG_WARN
+// Per module thresholds, they default to the global threshold,
+// e.g -DCDP_LOG_RADIO=CDP_LOG_LEVEL_DEBUG to only debug the radio.
+#ifndef CDP_LOG_RADIO
+#define CDP_LOG_RADIO CDP_LOG_LEVEL
+#endif
+#ifndef CDP_LOG_PACKET
+#define CDP_LOG_PACKET CDP_LOG_LEVEL
+#endif
+#ifndef CDP_LOG_DUCK
+#define CDP_LOG_DUCK CDP_LOG_LEVEL
 #endif
+#ifndef CDP_LOG_UTILS
+#define CDP_LOG_UTILS CDP_LOG_LEVEL
+#endif
+
+// A source file selects its module threshold by defining CDP_LOG_MODULE
+// before including any header, e.g #define CDP_LOG_MODULE CDP_LOG_RADIO
+#ifndef CDP_LOG_MODULE
+#define CDP_LOG_MODULE CDP_LOG_LEVEL
+#endif
+
+#ifdef CDP_NO_LOG
+// Logging is compiled out entirely and does not depend on Arduino.
+#define CDP_LOG_ENABLED(level) 0
+#define logerr(...) do {} while (0)
+#define logerr_f(...) do {} while (0)
+#define logwarn(...) do {} while (0)
+#define logwarn_f(...) do {} while (0)
+#define loginfo(...) do {} while (0)
+#define loginfo_f(...) do {} while (0)
+#define logdbg(...) do {} while (0)
+#define logdbg_f(...) do {} while (0)
+
+#elif defined(CDP_LOG_BINARY)
+// Binary mode: a statement records its site id, a timestamp and the integer
+// arguments of the _f variants in a RAM ring buffer, see DuckLogBuffer.h.
+// The message itself is never formatted on the device.
+#include "include/DuckLogBuffer.h"
+
+#define CDP_LOG_ENABLED(level) (CDP_LOG_MODULE >= (level))
+#define CDP_LOG_SITE                                                           \
+  (std::integral_constant<uint32_t, ducklog::siteId(__FILE__, __LINE__)>::value)
+
+#define cdp_log_record(level)                                                  \
+  do {                                                                         \
+    if (CDP_LOG_ENABLED(level)) {                                              \
+      ducklog::record(level, CDP_LOG_SITE, NULL, 0);                           \
+    }                                                                          \
+  } while (0)
+#define cdp_log_recordf(level, ...)                                            \
+  do {                                                                         \
+    if (CDP_LOG_ENABLED(level)) {                                              \
+      ducklog::recordf(level, CDP_LOG_SITE, __VA_ARGS__);                      \
+    }                                                                          \
+  } while (0)
+
+#define logerr(...) cdp_log_record(CDP_LOG_LEVEL_ERROR)
+#define logerr_f(...) cdp_log_recordf(CDP_LOG_LEVEL_ERROR, __VA_ARGS__)
+#define logwarn(...) cdp_log_record(CDP_LOG_LEVEL_WARN)
+#define logwarn_f(...) cdp_log_recordf(CDP_LOG_LEVEL_WARN, __VA_ARGS__)
+#define loginfo(...) cdp_log_record(CDP_LOG_LEVEL_INFO)
+#define loginfo_f(...) cdp_log_recordf(CDP_LOG_LEVEL_INFO, __VA_ARGS__)
+#define logdbg(...) cdp_log_record(CDP_LOG_LEVEL_DEBUG)
+#define logdbg_f(...) cdp_log_recordf(CDP_LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+#else
+
+#include "Arduino.h"
+
+// The condition is a compile time constant: a disabled statement is removed by
+// the compiler and its arguments (String concatenations, hex dumps...) are
+// never evaluated.
+#define CDP_LOG_ENABLED(level) (CDP_LOG_MODULE >= (level))
 
 #define __FILENAME__                                                           \
   (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
 
-#if defined(CDP_LOG_ERROR)
 #define logerr(...)                                                            \
   do {                                                                         \
-    Serial.print("[ERR: ");                                                    \
-    Serial.print(String(__FILENAME__) + ":" + String(__LINE__) + "]  ");       \
-    Serial.println(__VA_ARGS__);                                               \
+    if (CDP_LOG_ENABLED(CDP_LOG_LEVEL_ERROR)) {                                \
+      Serial.print("[ERR: ");                                                  \
+      Serial.print(String(__FILENAME__) + ":" + String(__LINE__) + "]  ");     \
+      Serial.println(__VA_ARGS__);                                             \
+    }                                                                          \
   } while (0)
 #if !defined(ARDUINO_SAMD_ZERO)
 #define logerr_f(...)                                                          \
   do {                                                                         \
-    Serial.print("[ERR: ");                                                    \
-    Serial.print(String(__FILENAME__) + ":" + String(__LINE__) + "]  ");       \
-    Serial.printf(__VA_ARGS__);                                                \
+    if (CDP_LOG_ENABLED(CDP_LOG_LEVEL_ERROR)) {                                \
+      Serial.print("[ERR: ");                                                  \
+      Serial.print(String(__FILENAME__) + ":" + String(__LINE__) + "]  ");     \
+      Serial.printf(__VA_ARGS__);                                              \
+    }                                                                          \
   } while (0)
 #endif
-#else
-#define logerr(...)                                                            \
-  {}
-#define logerr_f(...)                                                          \
-  {}
-#endif
 
-#if defined(CDP_LOG_WARN)
 #define logwarn(...)                                                           \
   do {                                                                         \
-    Serial.print("[WRN: ");                                                    \
-    Serial.print(String(__FILENAME__) + ":" + String(__LINE__) + "]  ");       \
-    Serial.println(__VA_ARGS__);                                               \
+    if (CDP_LOG_ENABLED(CDP_LOG_LEVEL_WARN)) {                                 \
+      Serial.print("[WRN: ");                                                  \
+      Serial.print(String(__FILENAME__) + ":" + String(__LINE__) + "]  ");     \
+      Serial.println(__VA_ARGS__);                                             \
+    }                                                                          \
   } while (0)
 #if !defined(ARDUINO_SAMD_ZERO)
 #define logwarn_f(...)                                                         \
   do {                                                                         \
-    Serial.print("[WRN: ");                                                    \
-    Serial.print(String(__FILENAME__) + ":" + String(__LINE__) + "]  ");       \
-    Serial.printf(__VA_ARGS__);                                                \
+    if (CDP_LOG_ENABLED(CDP_LOG_LEVEL_WARN)) {                                 \
+      Serial.print("[WRN: ");                                                  \
+      Serial.print(String(__FILENAME__) + ":" + String(__LINE__) + "]  ");     \
+      Serial.printf(__VA_ARGS__);                                              \
+    }                                                                          \
   } while (0)
 #endif
-#else
-#define logwarn(...)                                                           \
-  {}
-#define logwarn_f(...)                                                         \
-  {}
-#endif
 
-#if defined(CDP_LOG_INFO)
 #define loginfo(...)                                                           \
   do {                                                                         \
-    Serial.print("[INF: ");                                                    \
-    Serial.print(String(__FILENAME__) + "]  ");                                \
-    Serial.println(__VA_ARGS__);                                               \
+    if (CDP_LOG_ENABLED(CDP_LOG_LEVEL_INFO)) {                                 \
+      Serial.print("[INF: ");                                                  \
+      Serial.print(String(__FILENAME__) + "]  ");                              \
+      Serial.println(__VA_ARGS__);                                             \
+    }                                                                          \
   } while (0)
 #if !defined(ARDUINO_SAMD_ZERO)
 #define loginfo_f(...)                                                         \
   do {                                                                         \
-    Serial.print("[INF: ");                                                    \
-    Serial.print(String(__FILENAME__) + "]  ");                                \
-    Serial.printf(__VA_ARGS__);                                                \
+    if (CDP_LOG_ENABLED(CDP_LOG_LEVEL_INFO)) {                                 \
+      Serial.print("[INF: ");                                                  \
+      Serial.print(String(__FILENAME__) + "]  ");                              \
+      Serial.printf(__VA_ARGS__);                                              \
+    }                                                                          \
   } while (0)
 #endif
-#else
-#define loginfo(...)                                                           \
-  {}
-#define loginfo_f(...)                                                         \
-  {}
-#endif
 
-#if defined(CDP_LOG_DEBUG)
 #define logdbg(...)                                                            \
   do {                                                                         \
-    Serial.print("[DBG: ");                                                    \
-    Serial.print(String(__FILENAME__) + "]  ");                                \
-    Serial.println(__VA_ARGS__);                                               \
+    if (CDP_LOG_ENABLED(CDP_LOG_LEVEL_DEBUG)) {                                \
+      Serial.print("[DBG: ");                                                  \
+      Serial.print(String(__FILENAME__) + "]  ");                              \
+      Serial.println(__VA_ARGS__);                                             \
+    }                                                                          \
   } while (0)
 #if !defined(ARDUINO_SAMD_ZERO)
 #define logdbg_f(...)                                                          \
   do {                                                                         \
-    Serial.print("[DBG: ");                                                    \
-    Serial.print(String(__FILENAME__) + "]  ");                                \
-    Serial.printf(__VA_ARGS__);                                                \
+    if (CDP_LOG_ENABLED(CDP_LOG_LEVEL_DEBUG)) {                                \
+      Serial.print("[DBG: ");                                                  \
+      Serial.print(String(__FILENAME__) + "]  ");                              \
+      Serial.printf(__VA_ARGS__);                                              \
+    }                                                                          \
   } while (0)
 #endif
-#else
-#define logdbg(...)                                                            \
-  {}
-#define logdbg_f(...)                                                          \
-  {}
-#endif
+
+#endif // CDP_NO_LOG
+
 #endif
@@ -0,0 +1,201 @@
+#include "include/DuckMuidCache.h"
+#include "include/DuckCheckpoint.h"
+
+#include <string.h>
+
+#if (CDPCFG_DEDUP_CACHE_SIZE & (CDPCFG_DEDUP_CACHE_SIZE - 1)) != 0
+#error "CDPCFG_DEDUP_CACHE_SIZE must be a power of 2"
+#endif
+
+namespace {
+    // slots looked at from the home slot of a message
+    const int MAX_PROBES = 8;
+    // version of the state saved by dedup_save()
+    const uint32_t STATE_VERSION = 1;
+    // longest window, 3 of them fit in the 16 bit ages
+    const uint16_t MAX_WINDOW = 0x3FFF;
+}
+
+DuckMuidCache::DuckMuidCache() : window(CDPCFG_DEDUP_WINDOW_S) {
+    clear();
+}
+
+void DuckMuidCache::clear() {
+    memset(entries, 0, sizeof(entries));
+    memset(&stats, 0, sizeof(stats));
+    memset(&loaded, 0, sizeof(loaded));
+    lastSweep = millis();
+}
+
+void DuckMuidCache::setWindow(uint16_t seconds) {
+    // ages are 16 bit and wrap around, sweep() keeps them under 3 windows
+    window = seconds < 1 ? 1 : seconds > MAX_WINDOW ? MAX_WINDOW : seconds;
+}
+
+uint16_t DuckMuidCache::hashSduid(const byte* sduid) {
+    // FNV-1a folded to 16 bits, 0 marks a free slot
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < DUID_LENGTH; i++) {
+        hash = (hash ^ sduid[i]) * 16777619u;
+    }
+    uint16_t folded = (hash >> 16) ^ (hash & 0xFFFF);
+    return folded != 0 ? folded : 1;
+}
+
+uint16_t DuckMuidCache::seconds() {
+    return (uint16_t) (millis() / 1000);
+}
+
+uint32_t DuckMuidCache::home(uint16_t sduidHash, const byte* muid) const {
+    // MUIDs are random, the SDUID hash separates the ducks that drew the same one
+    uint32_t key = ((uint32_t) muid[0] << 24) | ((uint32_t) muid[1] << 16)
+                   | ((uint32_t) muid[2] << 8) | muid[3];
+    key ^= (uint32_t) sduidHash * 0x9E3779B1u;
+    return (key ^ (key >> 16)) & (CDPCFG_DEDUP_CACHE_SIZE - 1);
+}
+
+bool DuckMuidCache::isLive(const Entry & entry, uint16_t now) const {
+    return entry.sduidHash != 0 && (uint16_t) (now - entry.firstSeen) < window;
+}
+
+bool DuckMuidCache::allExpired() const {
+    // two windows without a call: even the entries added just before the
+    // last sweep expired, and their 16 bit age may have wrapped since
+    return millis() - lastSweep >= 2000UL * window;
+}
+
+void DuckMuidCache::sweep() {
+    if (millis() - lastSweep < 1000UL * window) {
+        return;
+    }
+    if (allExpired()) {
+        memset(entries, 0, sizeof(entries));
+    } else {
+        // the entries left are less than 3 windows old, their age is right
+        uint16_t now = seconds();
+        for (int i = 0; i < CDPCFG_DEDUP_CACHE_SIZE; i++) {
+            if (entries[i].sduidHash != 0 && !isLive(entries[i], now)) {
+                memset(&entries[i], 0, sizeof(Entry));
+            }
+        }
+    }
+    lastSweep = millis();
+}
+
+DuckMuidCache::Entry* DuckMuidCache::find(uint16_t sduidHash, const byte* muid, uint16_t now) {
+    uint32_t slot = home(sduidHash, muid);
+    for (int i = 0; i < MAX_PROBES; i++) {
+        Entry* entry = &entries[(slot + i) & (CDPCFG_DEDUP_CACHE_SIZE - 1)];
+        if (entry->sduidHash == sduidHash && memcmp(entry->muid, muid, MUID_LENGTH) == 0) {
+            if (isLive(*entry, now)) {
+                return entry;
+            }
+            memset(entry, 0, sizeof(Entry));
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+bool DuckMuidCache::dedup_check(const byte* sduid, const byte* muid) {
+    sweep();
+    bool seen = find(hashSduid(sduid), muid, seconds()) != NULL;
+    if (seen) {
+        stats.hits++;
+    }
+    return seen;
+}
+
+void DuckMuidCache::dedup_add(const byte* sduid, const byte* muid) {
+    sweep();
+    uint16_t sduidHash = hashSduid(sduid);
+    uint16_t now = seconds();
+    if (find(sduidHash, muid, now) != NULL) {
+        // remembered from when it was first seen
+        return;
+    }
+
+    // the first free or expired slot, or the oldest entry
+    uint32_t slot = home(sduidHash, muid);
+    Entry* target = NULL;
+    for (int i = 0; i < MAX_PROBES; i++) {
+        Entry* entry = &entries[(slot + i) & (CDPCFG_DEDUP_CACHE_SIZE - 1)];
+        if (!isLive(*entry, now)) {
+            target = entry;
+            break;
+        }
+        if (target == NULL
+            || (uint16_t) (now - entry->firstSeen) > (uint16_t) (now - target->firstSeen)) {
+            target = entry;
+        }
+    }
+    if (isLive(*target, now)) {
+        stats.evicted++;
+    }
+    memcpy(target->muid, muid, MUID_LENGTH);
+    target->sduidHash = sduidHash;
+    target->firstSeen = now;
+    stats.added++;
+}
+
+DuckMuidCacheStats DuckMuidCache::dedup_stats() const {
+    DuckMuidCacheStats result = stats;
+    uint16_t now = seconds();
+    result.entries = 0;
+    if (allExpired()) {
+        return result;
+    }
+    for (int i = 0; i < CDPCFG_DEDUP_CACHE_SIZE; i++) {
+        if (isLive(entries[i], now)) {
+            result.entries++;
+        }
+    }
+    return result;
+}
+
+int DuckMuidCache::dedup_state_size() const {
+    return sizeof(entries) + sizeof(State);
+}
+
+void DuckMuidCache::dedup_save(int offset, byte* data, int length) const {
+    duckcheckpoint::save(entries, 0, sizeof(entries), offset, data, length);
+    if (offset + length > (int) sizeof(entries)) {
+        State state;
+        memset(&state, 0, sizeof(state));
+        state.version = STATE_VERSION;
+        state.size = CDPCFG_DEDUP_CACHE_SIZE;
+        state.savedAt = seconds();
+        duckcheckpoint::save(&state, sizeof(entries), sizeof(state), offset, data, length);
+    }
+}
+
+void DuckMuidCache::dedup_load(int offset, const byte* data, int length) {
+    if (offset == 0) {
+        memset(&loaded, 0, sizeof(loaded));
+    }
+    duckcheckpoint::load(entries, 0, sizeof(entries), offset, data, length);
+    duckcheckpoint::load(&loaded, sizeof(entries), sizeof(State), offset, data, length);
+}
+
+bool DuckMuidCache::dedup_load_end() {
+    if (loaded.version != STATE_VERSION || loaded.size != CDPCFG_DEDUP_CACHE_SIZE) {
+        memset(entries, 0, sizeof(entries));
+        return false;
+    }
+    // the clock restarted, move the entries to the same age on the new clock
+    uint16_t now = seconds();
+    for (int i = 0; i < CDPCFG_DEDUP_CACHE_SIZE; i++) {
+        Entry & entry = entries[i];
+        if (entry.sduidHash == 0) {
+            continue;
+        }
+        uint16_t age = loaded.savedAt - entry.firstSeen;
+        if (age >= window) {
+            memset(&entry, 0, sizeof(entry));
+        } else {
+            entry.firstSeen = now - age;
+        }
+    }
+    lastSweep = millis();
+    return true;
+}
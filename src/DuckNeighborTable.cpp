@@ -0,0 +1,85 @@
+#include "include/DuckNeighborTable.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace {
+    // weight of a new RSSI/SNR sample
+    const float SAMPLE_WEIGHT = 0.25f;
+}
+
+DuckNeighborTable::DuckNeighborTable() : timeout(CDPCFG_NEIGHBOR_TIMEOUT_MS) {
+    clear();
+}
+
+void DuckNeighborTable::clear() {
+    for (int i = 0; i < CDPCFG_NEIGHBOR_TABLE_SIZE; i++) {
+        neighbors[i].used = false;
+    }
+}
+
+DuckNeighbor* DuckNeighborTable::find(const byte* duid) {
+    for (int i = 0; i < CDPCFG_NEIGHBOR_TABLE_SIZE; i++) {
+        DuckNeighbor* neighbor = &neighbors[i];
+        if (neighbor->used && std::equal(duid, duid + DUID_LENGTH, neighbor->duid)) {
+            return neighbor;
+        }
+    }
+    return NULL;
+}
+
+DuckNeighbor* DuckNeighborTable::update(const byte* duid, byte duckType, float rssi, float snr,
+                                        unsigned long now) {
+    DuckNeighbor* neighbor = find(duid);
+    if (neighbor != NULL) {
+        neighbor->rssi += SAMPLE_WEIGHT * (rssi - neighbor->rssi);
+        neighbor->snr += SAMPLE_WEIGHT * (snr - neighbor->snr);
+        neighbor->duckType = duckType;
+        neighbor->packets++;
+        neighbor->lastHeard = now;
+        return neighbor;
+    }
+
+    // a free entry, or the neighbor heard the longest time ago
+    for (int i = 0; i < CDPCFG_NEIGHBOR_TABLE_SIZE; i++) {
+        DuckNeighbor* entry = &neighbors[i];
+        if (!entry->used) {
+            neighbor = entry;
+            break;
+        }
+        if (neighbor == NULL || now - entry->lastHeard > now - neighbor->lastHeard) {
+            neighbor = entry;
+        }
+    }
+    memcpy(neighbor->duid, duid, DUID_LENGTH);
+    neighbor->duckType = duckType;
+    neighbor->rssi = rssi;
+    neighbor->snr = snr;
+    neighbor->reportedSnr = NAN;
+    neighbor->need = 0;
+    neighbor->needHops = 0;
+    neighbor->packets = 1;
+    neighbor->firstHeard = now;
+    neighbor->lastHeard = now;
+    neighbor->used = true;
+    return neighbor;
+}
+
+int DuckNeighborTable::size() const {
+    int count = 0;
+    for (int i = 0; i < CDPCFG_NEIGHBOR_TABLE_SIZE; i++) {
+        if (neighbors[i].used) {
+            count++;
+        }
+    }
+    return count;
+}
+
+const DuckNeighbor* DuckNeighborTable::get(int index) const {
+    for (int i = 0; i < CDPCFG_NEIGHBOR_TABLE_SIZE; i++) {
+        if (neighbors[i].used && index-- == 0) {
+            return &neighbors[i];
+        }
+    }
+    return NULL;
+}
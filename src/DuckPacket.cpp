@@ -1,19 +1,34 @@
+#define CDP_LOG_MODULE CDP_LOG_PACKET
+
 #include "Arduino.h"
 #include "include/DuckPacket.h"
 #include "DuckError.h"
 #include "DuckLogger.h"
 #include "MemoryFree.h"
 #include "include/DuckUtils.h"
+#include "include/DuckCrc.h"
 #include "include/DuckCrypto.h"
-#include "include/bloomfilter.h"
+#include "include/DuckDedup.h"
 #include <string>
 
 
-bool DuckPacket::prepareForRelaying(BloomFilter *filter, std::vector<byte> dataBuffer) {
-
+bool DuckPacket::prepareForRelaying(DuckDedupFilter *filter, const std::vector<byte> & dataBuffer) {
 
   this->reset();
 
+  if (dataBuffer.size() < MIN_PACKET_LENGTH || dataBuffer.size() > PACKET_LENGTH) {
+    logerr_f("prepareForRelaying: invalid packet size: %d\n", (int) dataBuffer.size());
+    return false;
+  }
+
+  // update the rx packet internal byte buffer
+  memcpy(buffer, dataBuffer.data(), dataBuffer.size());
+  length = dataBuffer.size();
+  return prepareForRelaying(filter);
+}
+
+bool DuckPacket::prepareForRelaying(DuckDedupFilter *filter) {
+
   loginfo("prepareForRelaying: START");
   loginfo("prepareForRelaying: Packet is built. Checking for relay...");
 
@@ -22,42 +37,104 @@ bool DuckPacket::prepareForRelaying(BloomFilter *filter, std::vector<byte> dataB
   //TODO: Calculate false positive chance
   //TODO: Add backwards compatibility
 
+  if (length < MIN_PACKET_LENGTH) {
+    logerr_f("prepareForRelaying: invalid packet size: %d\n", length);
+    return false;
+  }
+
   // Query the existence of strings
-  bool alreadySeen = filter->bloom_check(&dataBuffer[MUID_POS], MUID_LENGTH);
+  unsigned char* muid = &buffer[MUID_POS];
+  bool alreadySeen = filter->dedup_check(&buffer[SDUID_POS], muid);
   if (alreadySeen) {
     logdbg("handleReceivedPacket: Packet already seen. No relay.");
     return false;
   } else {
-    filter->bloom_add(&dataBuffer[MUID_POS], MUID_LENGTH);
-    logdbg("handleReceivedPacket: Relaying packet: "  + duckutils::convertToHex(&dataBuffer[MUID_POS], MUID_LENGTH));
+    filter->dedup_add(&buffer[SDUID_POS], muid);
+    logdbg("handleReceivedPacket: Relaying packet: "  + duckutils::convertToHex(muid, MUID_LENGTH));
   }
 
-  // update the rx packet internal byte buffer
-  buffer.assign(dataBuffer.begin(), dataBuffer.end());
-  int hops = buffer[HOP_COUNT_POS]++;
-  loginfo("prepareForRelaying: hops count: "+ String(hops));
+  // the frame is relayed as is, only the hop count changes. It saturates so a
+  // corrupt or hostile hop count cannot wrap around the hop limit.
+  int hops = buffer[HOP_COUNT_POS];
+  if (hops < 0xFF) {
+    buffer[HOP_COUNT_POS]++;
+  }
+  loginfo_f("prepareForRelaying: hops count: %d\n", hops);
   return true;
-  
-  
 }
 
-void DuckPacket::getUniqueMessageId(BloomFilter * filter, byte message_id[MUID_LENGTH]) {
+int DuckPacket::addExtension(byte type, const byte* value, int valueLength) {
+  if (length < MIN_PACKET_LENGTH) {
+    return DUCKPACKET_ERR_SIZE_INVALID;
+  }
+  bool extended = (buffer[DUCK_TYPE_POS] & EXT_FLAG) != 0;
+  int tlvsLength = extended ? buffer[length - 1] : 0;
+  // the new TLV goes where the length byte is, or after the data
+  int pos = extended ? length - 1 : length;
+  int tlvLength = EXT_TLV_HEADER_LENGTH + valueLength;
+  if (valueLength < 0 || valueLength > 0xFF || pos + tlvLength + 1 > EXT_MAX_FRAME_LENGTH) {
+    return DUCKPACKET_ERR_SIZE_INVALID;
+  }
+  buffer[pos] = type;
+  buffer[pos + 1] = valueLength;
+  if (valueLength > 0) {
+    memcpy(&buffer[pos + EXT_TLV_HEADER_LENGTH], value, valueLength);
+  }
+  buffer[pos + tlvLength] = tlvsLength + tlvLength;
+  buffer[DUCK_TYPE_POS] |= EXT_FLAG;
+  length = pos + tlvLength + 1;
+  return DUCK_ERR_NONE;
+}
+
+int DuckPacket::appendToExtension(byte type, const byte* value, int valueLength) {
+  int currentLength = 0;
+  byte* current = findExtension(type, &currentLength);
+  if (current == NULL) {
+    return addExtension(type, value, valueLength);
+  }
+  if (valueLength < 0 || currentLength + valueLength > 0xFF
+      || length + valueLength > EXT_MAX_FRAME_LENGTH) {
+    return DUCKPACKET_ERR_SIZE_INVALID;
+  }
+  // make room after the current value, the following TLVs and the length move
+  byte* end = current + currentLength;
+  memmove(end + valueLength, end, &buffer[length] - end);
+  memcpy(end, value, valueLength);
+  current[-1] += valueLength;
+  length += valueLength;
+  buffer[length - 1] += valueLength;
+  return DUCK_ERR_NONE;
+}
+
+uint16_t DuckPacket::getShortId(const byte* duid) {
+  uint32_t crc = duckcrc::crc32(duid, DUID_LENGTH);
+  return (crc >> 16) ^ (crc & 0xFFFF);
+}
+
+void DuckPacket::getUniqueMessageId(DuckDedupFilter * filter, const byte* sduid, byte message_id[MUID_LENGTH]) {
 
   bool getNewUnique = true;
   while (getNewUnique) {
     duckutils::getRandomBytes(MUID_LENGTH, message_id);
-    getNewUnique = filter->bloom_check(message_id, MUID_LENGTH);
+    getNewUnique = filter->dedup_check(sduid, message_id);
     loginfo("prepareForSending: new MUID -> " + duckutils::convertToHex(message_id, MUID_LENGTH));
     
   }
 }
 
-int DuckPacket::prepareForSending(BloomFilter *filter,
-                                  std::vector<byte> targetDevice, byte duckType,
-                                  byte topic, std::vector<byte> app_data) {
+int DuckPacket::prepareForSending(DuckDedupFilter *filter,
+                                  const std::vector<byte> & targetDevice, byte duckType,
+                                  byte topic, const std::vector<byte> & app_data) {
+  if (targetDevice.size() != DUID_LENGTH) {
+    return DUCK_ERR_ID_TOO_LONG;
+  }
+  return prepareForSending(filter, targetDevice.data(), duckType, topic,
+                           app_data.data(), app_data.size());
+}
 
-  std::vector<uint8_t> encryptedData;
-  uint8_t app_data_length = app_data.size();
+int DuckPacket::prepareForSending(DuckDedupFilter *filter,
+                                  const byte* targetDevice, byte duckType,
+                                  byte topic, const byte* app_data, int app_data_length) {
 
   this->reset();
 
@@ -68,71 +145,49 @@ int DuckPacket::prepareForSending(BloomFilter *filter,
   loginfo("prepareForSending: DATA LENGTH: " + String(app_data_length) +
           " TOPIC: " + String(topic));
 
-  byte message_id[MUID_LENGTH];
-  getUniqueMessageId(filter, message_id);
-
-  byte crc_bytes[DATA_CRC_LENGTH];
-  uint32_t value;
-  // TODO: update the CRC32 library to return crc as a byte array
-  if(duckcrypto::getState()) {
-    encryptedData.resize(app_data.size());
-    duckcrypto::encryptData(app_data.data(), encryptedData.data(), app_data.size());
-    value = CRC32::calculate(encryptedData.data(), encryptedData.size());
-  } else {
-    value = CRC32::calculate(app_data.data(), app_data.size());
-  }
-  
-  crc_bytes[0] = (value >> 24) & 0xFF;
-  crc_bytes[1] = (value >> 16) & 0xFF;
-  crc_bytes[2] = (value >> 8) & 0xFF;
-  crc_bytes[3] = value & 0xFF;
-
   // ----- insert packet header  -----
   // source device uid
-  buffer.insert(buffer.end(), duid.begin(), duid.end());
-  logdbg("SDuid:     " + duckutils::convertToHex(duid.data(), duid.size()));
-
+  memcpy(&buffer[SDUID_POS], duid, DUID_LENGTH);
   // destination device uid
-  buffer.insert(buffer.end(), targetDevice.begin(), targetDevice.end());
-  logdbg("DDuid:     " + duckutils::convertToHex(targetDevice.data(), targetDevice.size()));
-
+  memcpy(&buffer[DDUID_POS], targetDevice, DUID_LENGTH);
   // message uid
-  buffer.insert(buffer.end(), &message_id[0], &message_id[MUID_LENGTH]);
-  logdbg("Muid:      " + duckutils::convertToHex(buffer.data(), buffer.size()));
-
+  getUniqueMessageId(filter, duid, &buffer[MUID_POS]);
   // topic
-  buffer.insert(buffer.end(), topic);
-  logdbg("Topic:     " + duckutils::convertToHex(buffer.data(), buffer.size()));
-
+  buffer[TOPIC_POS] = topic;
   // duckType
-  buffer.insert(buffer.end(), duckType);
-  logdbg("duck type: " + duckutils::convertToHex(buffer.data(), buffer.size()));
-
+  buffer[DUCK_TYPE_POS] = duckType;
   // hop count
-  buffer.insert(buffer.end(), 0x00);
-  logdbg("hop count: " + duckutils::convertToHex(buffer.data(), buffer.size()));
-
-  // data crc
-  buffer.insert(buffer.end(), &crc_bytes[0], &crc_bytes[DATA_CRC_LENGTH]);
-  logdbg("Data CRC:  " + duckutils::convertToHex(buffer.data(), buffer.size()));
+  buffer[HOP_COUNT_POS] = 0x00;
 
   // ----- insert data -----
   if(duckcrypto::getState()) {
-
-    buffer.insert(buffer.end(), encryptedData.begin(), encryptedData.end());
-    logdbg("Encrypted Data:      " + duckutils::convertToHex(buffer.data(), buffer.size()));
-
+    duckcrypto::encryptData((uint8_t*) app_data, &buffer[DATA_POS], app_data_length);
   } else {
-    buffer.insert(buffer.end(), app_data.begin(), app_data.end());
-    logdbg("Data:      " + duckutils::convertToHex(buffer.data(), buffer.size()));
+    memcpy(&buffer[DATA_POS], app_data, app_data_length);
   }
-  
+  length = DATA_POS + app_data_length;
+
+  // data crc
+  uint32_t value = duckcrc::crc32(&buffer[DATA_POS], app_data_length);
+  buffer[DATA_CRC_POS] = (value >> 24) & 0xFF;
+  buffer[DATA_CRC_POS + 1] = (value >> 16) & 0xFF;
+  buffer[DATA_CRC_POS + 2] = (value >> 8) & 0xFF;
+  buffer[DATA_CRC_POS + 3] = value & 0xFF;
+
+  logdbg("SDuid:     " + duckutils::convertToHex(&buffer[SDUID_POS], DUID_LENGTH));
+  logdbg("DDuid:     " + duckutils::convertToHex(&buffer[DDUID_POS], DUID_LENGTH));
+  logdbg("Muid:      " + duckutils::convertToHex(&buffer[MUID_POS], MUID_LENGTH));
+  logdbg("Topic:     " + duckutils::convertToHex(&buffer[TOPIC_POS], 1));
+  logdbg("duck type: " + duckutils::convertToHex(&buffer[DUCK_TYPE_POS], 1));
+  logdbg("hop count: " + duckutils::convertToHex(&buffer[HOP_COUNT_POS], 1));
+  logdbg("Data CRC:  " + duckutils::convertToHex(&buffer[DATA_CRC_POS], DATA_CRC_LENGTH));
+  logdbg("Data:      " + duckutils::convertToHex(&buffer[DATA_POS], app_data_length));
+
   // ----- insert path -----
   // buffer.insert(buffer.end(), duid.begin(), duid.end());
   // logdbg("Path:      " + duckutils::convertToHex(buffer.data(), buffer.size()));
 
   logdbg("Built packet: " +
-         duckutils::convertToHex(buffer.data(), buffer.size()));
+         duckutils::convertToHex(buffer, length));
   return DUCK_ERR_NONE;
 }
-
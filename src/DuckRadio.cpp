@@ -1,7 +1,11 @@
+#define CDP_LOG_MODULE CDP_LOG_RADIO
+
 #include "include/DuckRadio.h"
 
 #if !defined(CDPCFG_HELTEC_CUBE_CELL)
 
+#include "include/DuckAirtime.h"
+#include "include/DuckCrc.h"
 #include "include/DuckUtils.h"
 
 #define AM_PART_APOLLO3
@@ -12,25 +16,49 @@
 #include "SPI.h"
 SPIClass _spi;
 SPISettings _spiSettings;
-CDPCFG_LORA_CLASS lora =
-    new Module(CDPCFG_PIN_LORA_CS, CDPCFG_PIN_LORA_DIO0, CDPCFG_PIN_LORA_RST,
-               CDPCFG_PIN_LORA_DIO1, _spi, _spiSettings);
-#else
-CDPCFG_LORA_CLASS lora = new Module(CDPCFG_PIN_LORA_CS, CDPCFG_PIN_LORA_DIO0,
-                                    CDPCFG_PIN_LORA_RST, CDPCFG_PIN_LORA_DIO1);
 #endif
 
-volatile uint16_t DuckRadio::interruptFlags = 0;
-volatile bool DuckRadio::receivedFlag = false;
+DuckRadio* DuckRadio::interruptTarget = NULL;
 
-// if the radio is receiving a message
-volatile bool radio_receiving = false;
-// if the radio is sending a message
-volatile bool radio_sending = false;
-// if an interupt has happened
-volatile bool interruptFired = false;
+DuckRadio::DuckRadio() {
+#ifdef CDPCFG_PIN_LORA_SPI_SCK
+    lora = new CDPCFG_LORA_CLASS(
+        new Module(CDPCFG_PIN_LORA_CS, CDPCFG_PIN_LORA_DIO0, CDPCFG_PIN_LORA_RST,
+                   CDPCFG_PIN_LORA_DIO1, _spi, _spiSettings));
+#else
+    lora = new CDPCFG_LORA_CLASS(new Module(CDPCFG_PIN_LORA_CS, CDPCFG_PIN_LORA_DIO0,
+                                            CDPCFG_PIN_LORA_RST, CDPCFG_PIN_LORA_DIO1));
+#endif
+    interruptFlags = 0;
+    interruptFired = false;
+    radio_receiving = false;
+    radio_sending = false;
+    txStartedAt = 0;
+    csma = false;
+    csmaBackoff = CDPCFG_CSMA_BACKOFF_MS;
+    csmaMaxBackoffs = CDPCFG_CSMA_MAX_BACKOFFS;
+    cadState = CAD_IDLE;
+    cadAttempts = 0;
+    cadStartedAt = 0;
+    backoffUntil = 0;
+    memset(&csmaStats, 0, sizeof(csmaStats));
+    bw = CDPCFG_RF_LORA_BW;
+    sf = CDPCFG_RF_LORA_SF;
+    cr = CDPCFG_RF_LORA_CR;
+    preamble = CDPCFG_RF_LORA_PREAMBLE;
+    deferring = false;
+    deferredSequence = 0;
+    rxStats.received = 0;
+    rxStats.overflows = 0;
+    rxStats.highWater = 0;
+}
 
-DuckRadio::DuckRadio() {}
+DuckRadio::~DuckRadio() {
+    if (interruptTarget == this) {
+        interruptTarget = NULL;
+    }
+    delete lora;
+}
 
 
 int DuckRadio::setupRadio(LoraConfigParams config) {
@@ -39,27 +67,27 @@ int DuckRadio::setupRadio(LoraConfigParams config) {
     Serial.print(config.band);
 
 #ifdef CDPCFG_SPARKFUN_APOLLO3
-    lora = new Module(config.ss, config.di1, config.rst, config.di0, SPI1);
+    *lora = new Module(config.ss, config.di1, config.rst, config.di0, SPI1);
 #elif CDPCFG_PIN_LORA_SPI_SCK
     log_n("_spi.begin(CDPCFG_PIN_LORA_SPI_SCK, CDPCFG_PIN_LORA_SPI_MISO, "
           "CDPCFG_PIN_LORA_SPI_MOSI, CDPCFG_PIN_LORA_CS)");
     _spi.begin(CDPCFG_PIN_LORA_SPI_SCK, CDPCFG_PIN_LORA_SPI_MISO,
                CDPCFG_PIN_LORA_SPI_MOSI, CDPCFG_PIN_LORA_CS);
-    lora = new Module(config.ss, config.di0, config.rst, config.di1, _spi,
-                      _spiSettings);
+    *lora = new Module(config.ss, config.di0, config.rst, config.di1, _spi,
+                       _spiSettings);
 #else
-    lora = new Module(config.ss, config.di0, config.rst, config.di1);
+    *lora = new Module(config.ss, config.di0, config.rst, config.di1);
 #endif
 
 #ifdef CDPCFG_SPARKFUN_APOLLO3
-    int rc = lora.begin(config.band, config.bw, config.sf, CDPCFG_SPARKFUN_APOLLO3_CODING_RATE,
+    int rc = lora->begin(config.band, config.bw, config.sf, CDPCFG_SPARKFUN_APOLLO3_CODING_RATE,
                         CDPCFG_DEFAULT_SYNC_WORD,
                         config.txPower,
                         CDPCFG_SPARKFUN_APOLLO3_PREAMBLE_LENGTH,
                         CDPCFG_SPARKFUN_APOLLO3_TCXO_VOLTAGE,
                         CDPCFG_SPARKFUN_APOLLO3_USE_REGULATOR_LDO);
-#elif
-    int rc = lora.begin();
+#else
+    int rc = lora->begin();
 #endif
     if (rc != RADIOLIB_ERR_NONE) {
         logerr("ERROR  initializing LoRa driver. state = ");
@@ -70,49 +98,63 @@ int DuckRadio::setupRadio(LoraConfigParams config) {
 
     // Lora is started, we need to set all the radio parameters, before it can
     // start receiving packets
-    rc = lora.setFrequency(config.band);
+    rc = lora->setFrequency(config.band);
     if (rc == RADIOLIB_ERR_INVALID_FREQUENCY) {
         logerr("ERROR  frequency is invalid");
         return DUCKLORA_ERR_SETUP;
     }
 
-    rc = lora.setBandwidth(config.bw);
+    rc = lora->setBandwidth(config.bw);
     if (rc == RADIOLIB_ERR_INVALID_BANDWIDTH) {
         logerr("ERROR  bandwidth is invalid");
         return DUCKLORA_ERR_SETUP;
     }
 
-    rc = lora.setSpreadingFactor(config.sf);
+    rc = lora->setSpreadingFactor(config.sf);
     if (rc == RADIOLIB_ERR_INVALID_SPREADING_FACTOR) {
         logerr("ERROR  spreading factor is invalid");
         return DUCKLORA_ERR_SETUP;
     }
 
-    rc = lora.setOutputPower(config.txPower);
+    rc = lora->setCodingRate(config.cr);
+    if (rc == RADIOLIB_ERR_INVALID_CODING_RATE) {
+        logerr("ERROR  coding rate is invalid");
+        return DUCKLORA_ERR_SETUP;
+    }
+
+    rc = lora->setPreambleLength(config.preamble);
+    if (rc == RADIOLIB_ERR_INVALID_PREAMBLE_LENGTH) {
+        logerr("ERROR  preamble length is invalid");
+        return DUCKLORA_ERR_SETUP;
+    }
+
+    rc = lora->setOutputPower(config.txPower);
     if (rc == RADIOLIB_ERR_INVALID_OUTPUT_POWER) {
         logerr("ERROR  output power is invalid");
         return DUCKLORA_ERR_SETUP;
     }
 
 
-    rc = lora.setGain(config.gain);
+    rc = lora->setGain(config.gain);
     if (rc == RADIOLIB_ERR_INVALID_GAIN) {
         logerr("ERROR  gain is invalid");
         return DUCKLORA_ERR_SETUP;
     }
 
 #endif
+    // only one radio can own the interrupt line
+    interruptTarget = this;
 #ifdef CDPCFG_SPARKFUN_APOLLO3
     // set the interrupt handler to execute when packet tx or rx is done.
-    lora.setDio1Action(config.func);
+    lora->setDio1Action(config.func);
 
 #else
     // set the interrupt handler to execute when packet tx or rx is done.
-    lora.setDio0Action(config.func);
+    lora->setDio0Action(config.func);
 #endif
 #ifndef CDPCFG_SPARKFUN_APOLLO3
     // set sync word to private network
-    rc = lora.setSyncWord(CDPCFG_DEFAULT_SYNC_WORD);
+    rc = lora->setSyncWord(CDPCFG_DEFAULT_SYNC_WORD);
     if (rc != RADIOLIB_ERR_NONE) {
         logerr("ERROR  sync word is invalid");
         return DUCKLORA_ERR_SETUP;
@@ -121,7 +163,19 @@ int DuckRadio::setupRadio(LoraConfigParams config) {
 #endif
 
 
-    rc = lora.startReceive();
+    bw = config.bw;
+    sf = config.sf;
+#ifdef CDPCFG_SPARKFUN_APOLLO3
+    cr = CDPCFG_SPARKFUN_APOLLO3_CODING_RATE;
+    preamble = CDPCFG_SPARKFUN_APOLLO3_PREAMBLE_LENGTH;
+#else
+    cr = config.cr;
+    preamble = config.preamble;
+#endif
+
+    setCsma(config.csma, config.csmaBackoff, config.csmaMaxBackoffs);
+
+    rc = lora->startReceive();
 
     if (rc != RADIOLIB_ERR_NONE) {
         logerr("ERROR Failed to start receive");
@@ -131,46 +185,92 @@ int DuckRadio::setupRadio(LoraConfigParams config) {
 }
 
 void DuckRadio::setSyncWord(byte syncWord) {
-    int error = lora.setSyncWord(syncWord);
+    int error = lora->setSyncWord(syncWord);
     if (error != RADIOLIB_ERR_NONE) {
         logerr("ERROR  sync word is invalid");
     }
-    lora.startReceive();
+    lora->startReceive();
 }
 
 int DuckRadio::readReceivedData(std::vector<byte> *packetBytes) {
 
+    int length = 0;
+    packetBytes->resize(PACKET_LENGTH);
+    int err = readReceivedFrame(packetBytes->data(), &length);
+    packetBytes->resize(length);
+    return err;
+}
+
+int DuckRadio::readReceivedData(DuckPacket *packet) {
+
+    packet->reset();
+    int length = 0;
+    int err = readReceivedFrame(packet->buffer, &length);
+    if (err == DUCK_ERR_NONE) {
+        packet->length = length;
+    }
+    return err;
+}
+
+void DuckRadio::queueReceivedFrame() {
+
+    DuckRxFrame* slot = rxQueue.acquire();
+    if (slot == NULL) {
+        // the duck is falling behind: drop this frame but keep listening
+        rxStats.overflows++;
+        logwarn("WARNING receive queue full, frame dropped. overflows: " +
+                String(rxStats.overflows));
+        startReceive();
+        return;
+    }
+
+    int err = readReceivedData(&slot->packet);
+    if (err != DUCK_ERR_NONE) {
+        logerr_f("ERROR failed to read received frame. rc = %d\n", err);
+        return;
+    }
+    slot->rssi = lora->getRSSI();
+    slot->snr = lora->getSNR();
+    slot->timestamp = millis();
+    rxQueue.commit();
+
+    rxStats.received++;
+    unsigned int depth = rxQueue.size();
+    if (depth > rxStats.highWater) {
+        rxStats.highWater = depth;
+    }
+}
+
+int DuckRadio::readReceivedFrame(byte *frame, int *length) {
+
     int packet_length = 0;
     int err = DUCK_ERR_NONE;
 
-    packet_length = lora.getPacketLength();
+    *length = 0;
+    packet_length = lora->getPacketLength();
 
-    if (packet_length < MIN_PACKET_LENGTH) {
+    if (packet_length < MIN_PACKET_LENGTH || packet_length > PACKET_LENGTH) {
         logerr("ERROR  handlePacket rx data size invalid: " +
                String(packet_length));
 
-        DuckRadio::setReceiveFlag(false);
-        int rxState = startReceive();
+        startReceive();
         return DUCKLORA_ERR_HANDLE_PACKET;
     }
 
-    loginfo("readReceivedData() - packet length returns: " +
-            String(packet_length));
+    loginfo_f("readReceivedData() - packet length returns: %d\n", packet_length);
 
-    packetBytes->resize(packet_length);
-    err = lora.readData(packetBytes->data(), packet_length);
-    loginfo("readReceivedData() - lora.readData returns: " + String(err));
+    err = lora->readData(frame, packet_length);
+    loginfo_f("readReceivedData() - lora.readData returns: %d\n", err);
 
-    DuckRadio::setReceiveFlag(false);
     int rxState = startReceive();
 
     if (err != RADIOLIB_ERR_NONE) {
-        logerr("ERROR  readReceivedData failed. err: " + String(err));
+        logerr_f("ERROR  readReceivedData failed. err: %d\n", err);
         return DUCKLORA_ERR_HANDLE_PACKET;
     }
+    *length = packet_length;
 
-    loginfo("Rx packet: " + duckutils::convertToHex(packetBytes->data(), packetBytes->size()));
-    loginfo("Rx packet: " + duckutils::toString(*packetBytes));
+    loginfo("Rx packet: " + duckutils::convertToHex(frame, packet_length));
 
     loginfo("readReceivedData: checking path offset integrity");
 
@@ -179,27 +279,28 @@ int DuckRadio::readReceivedData(std::vector<byte> *packetBytes) {
     // to the app despite CRC check being enabled in the radio by both sender and
     // receiver.
 
-    byte *data = packetBytes->data();
-
     loginfo("readReceivedData: checking data section CRC");
 
-    std::vector<byte> data_section;
-    data_section.insert(data_section.end(), &data[DATA_POS], &data[packet_length]);
-    uint32_t packet_data_crc = duckutils::toUnit32(&data[DATA_CRC_POS]);
+    CdpPacketView packet(frame, packet_length);
+    if (!packet.isValid()) {
+        logerr_f("ERROR invalid extension trailer, size: %d\n", packet_length);
+        return DUCKLORA_ERR_HANDLE_PACKET;
+    }
+    // the extension trailer is not covered
+    uint32_t packet_data_crc = packet.getDcrc();
     uint32_t computed_data_crc =
-            CRC32::calculate(data_section.data(), data_section.size());
+            duckcrc::crc32(packet.getData(), packet.getDataLength());
     if (computed_data_crc != packet_data_crc) {
-        logerr("ERROR data crc mismatch: received: " + String(packet_data_crc) +
-               " calculated:" + String(computed_data_crc));
+        logerr_f("ERROR data crc mismatch: received: %lu calculated: %lu\n",
+                 (unsigned long) packet_data_crc, (unsigned long) computed_data_crc);
         return DUCKLORA_ERR_HANDLE_PACKET;
     }
     // we have a good packet
-    loginfo("RX: rssi: " + String(lora.getRSSI()) +
-            " snr: " + String(lora.getSNR()) +
+    loginfo_f("RX: rssi: %d snr: %d size: %d\n",
+              (int) lora->getRSSI(), (int) lora->getSNR(), packet_length);
 #ifndef CDPCFG_SPARKFUN_APOLLO3
-                    " fe: " + String(lora.getFrequencyError(true)) +
+    logdbg("RX: frequency error: " + String(lora->getFrequencyError(true)));
 #endif
-                    " size: " + String(packet_length));
 
     if (rxState != RADIOLIB_ERR_NONE) {
         return rxState;
@@ -208,42 +309,41 @@ int DuckRadio::readReceivedData(std::vector<byte> *packetBytes) {
     return err;
 }
 
-int DuckRadio::sendData(byte *data, int length) {
+int DuckRadio::sendData(const byte *data, int length) {
 
     return startTransmitData(data, length);
 }
 
 int DuckRadio::relayPacket(DuckPacket *packet) {
 
-    return startTransmitData(packet->getBuffer().data(),
-                             packet->getBuffer().size());
+    return startTransmitData(packet->getBuffer(), packet->getBufferLength());
 }
 
-int DuckRadio::sendData(std::vector<byte> data) {
+int DuckRadio::sendData(const std::vector<byte> & data) {
 
     return startTransmitData(data.data(), data.size());
 }
 
 int DuckRadio::startReceive() {
 
-    int state = lora.startReceive();
+    int state = lora->startReceive();
     radio_receiving = true;
     if (state != RADIOLIB_ERR_NONE) {
-        logerr("ERROR startReceive failed, code " + String(state));
+        logerr_f("ERROR startReceive failed, code %d\n", state);
         return DUCKLORA_ERR_RECEIVE;
     }
 
     return DUCK_ERR_NONE;
 }
 
-int DuckRadio::getRSSI() { return lora.getRSSI(); }
+int DuckRadio::getRSSI() { return lora->getRSSI(); }
 
 // TODO: implement this
 int DuckRadio::ping() { return DUCK_ERR_NOT_SUPPORTED; }
 
-int DuckRadio::standBy() { return lora.standby(); }
+int DuckRadio::standBy() { return lora->standby(); }
 
-int DuckRadio::sleep() { return lora.sleep(); }
+int DuckRadio::sleep() { return lora->sleep(); }
 
 void DuckRadio::processRadioIrq() {}
 
@@ -256,152 +356,332 @@ void DuckRadio::setChannel(int channelNum, bool isEU) {
         switch (channelNum) {
             case 2:
                 loginfo("Set channel: " + String(channelNum));
-                err = lora.setFrequency(CHANNEL_2_EU);
-                lora.startReceive();
+                err = lora->setFrequency(CHANNEL_2_EU);
+                lora->startReceive();
                 break;
             case 3:
                 loginfo("Set channel: " + String(channelNum));
-                err = lora.setFrequency(CHANNEL_3_EU);
-                lora.startReceive();
+                err = lora->setFrequency(CHANNEL_3_EU);
+                lora->startReceive();
                 break;
             case 4:
                 loginfo("Set channel: " + String(channelNum));
-                err = lora.setFrequency(CHANNEL_4_EU);
-                lora.startReceive();
+                err = lora->setFrequency(CHANNEL_4_EU);
+                lora->startReceive();
                 break;
             case 5:
                 loginfo("Set channel: " + String(channelNum));
-                err = lora.setFrequency(CHANNEL_5_EU);
-                lora.startReceive();
+                err = lora->setFrequency(CHANNEL_5_EU);
+                lora->startReceive();
                 break;
             case 6:
                 loginfo("Set channel: " + String(channelNum));
-                err = lora.setFrequency(CHANNEL_6_EU);
-                lora.startReceive();
+                err = lora->setFrequency(CHANNEL_6_EU);
+                lora->startReceive();
                 break;
             case 1:
             default:
                 loginfo("Set channel: " + String(channelNum));
-                err = lora.setFrequency(CHANNEL_1_EU);
-                lora.startReceive();
+                err = lora->setFrequency(CHANNEL_1_EU);
+                lora->startReceive();
                 break;
         }
+        // 1% duty cycle on the g1 sub-band, unless the application set its own
+        if (!dutyCycle.isLimited()) {
+            dutyCycle.setLimit(CDPCFG_DUTY_CYCLE_EU_PERMILLE);
+        }
+    } else {
         switch (channelNum) {
             case 2:
                 loginfo("Set channel: " + String(channelNum));
-                err = lora.setFrequency(CHANNEL_2);
-                lora.startReceive();
+                err = lora->setFrequency(CHANNEL_2);
+                lora->startReceive();
                 break;
             case 3:
                 loginfo("Set channel: " + String(channelNum));
-                err = lora.setFrequency(CHANNEL_3);
-                lora.startReceive();
+                err = lora->setFrequency(CHANNEL_3);
+                lora->startReceive();
                 break;
             case 4:
                 loginfo("Set channel: " + String(channelNum));
-                err = lora.setFrequency(CHANNEL_4);
-                lora.startReceive();
+                err = lora->setFrequency(CHANNEL_4);
+                lora->startReceive();
                 break;
             case 5:
                 loginfo("Set channel: " + String(channelNum));
-                err = lora.setFrequency(CHANNEL_5);
-                lora.startReceive();
+                err = lora->setFrequency(CHANNEL_5);
+                lora->startReceive();
                 break;
             case 6:
                 loginfo("Set channel: " + String(channelNum));
-                err = lora.setFrequency(CHANNEL_6);
-                lora.startReceive();
+                err = lora->setFrequency(CHANNEL_6);
+                lora->startReceive();
                 break;
             case 1:
             default:
                 loginfo("Set channel: " + String(channelNum));
-                err = lora.setFrequency(CHANNEL_1);
-                lora.startReceive();
+                err = lora->setFrequency(CHANNEL_1);
+                lora->startReceive();
                 break;
         }
     }
     if (err != RADIOLIB_ERR_NONE) {
         logerr("ERROR Failed to set channel");
     } else {
-        lora.startReceive();
+        lora->startReceive();
         channel = channelNum;
         loginfo("Channel Set");
     }
 }
 
+int DuckRadio::setSpreadingFactor(uint8_t sf) {
+    if (radio_sending || cadState == CAD_SCANNING) {
+        return DUCKLORA_ERR_TX_BUSY;
+    }
+    int rc = lora->setSpreadingFactor(sf);
+    if (rc != RADIOLIB_ERR_NONE) {
+        logerr_f("ERROR  spreading factor %d is invalid\n", sf);
+        return DUCKLORA_ERR_SETUP;
+    }
+    this->sf = sf;
+    loginfo_f("Spreading factor set to %d\n", sf);
+    return startReceive();
+}
+
 void DuckRadio::serviceInterruptFlags() {
 #ifdef CDPCFG_SPARKFUN_APOLLO3
     if(interruptFired){
         if(radio_sending){
             loginfo("Interrupt was called while sending data, meaning data completely sent");
-            radio_sending = false;
-            startReceive();
+            onTransmitDone();
         }else if(radio_receiving){
             loginfo("Interrupt was called while recieving data, meaning data received");
-            DuckRadio::setReceiveFlag(true);
             radio_receiving = false;
+            queueReceivedFrame();
         }
         // reset interrupt flag
         interruptFired = false;
     }
 #else
-    if (DuckRadio::interruptFlags != 0) {
-        if (DuckRadio::interruptFlags & RADIOLIB_SX127X_CLEAR_IRQ_FLAG_RX_TIMEOUT) {
+#ifdef CDPCFG_RADIO_POLL_IRQ
+    // no interrupt line: read the flags and acknowledge them before handling
+    // them, so events raised while they are being handled are not lost
+    interruptFlags = lora->getIRQFlags();
+    if (interruptFlags != 0) {
+        lora->clearIRQFlags();
+    }
+#endif
+    if (interruptFlags != 0) {
+        if (interruptFlags & RADIOLIB_SX127X_CLEAR_IRQ_FLAG_RX_TIMEOUT) {
             loginfo("Interrupt flag was set: timeout");
         }
-        if (DuckRadio::interruptFlags & RADIOLIB_SX127X_CLEAR_IRQ_FLAG_RX_DONE) {
+        if (interruptFlags & RADIOLIB_SX127X_CLEAR_IRQ_FLAG_RX_DONE) {
             loginfo("Interrupt flag was set: packet reception complete");
-            DuckRadio::setReceiveFlag(true);
+            queueReceivedFrame();
         }
-        if (DuckRadio::interruptFlags & RADIOLIB_SX127X_CLEAR_IRQ_FLAG_PAYLOAD_CRC_ERROR) {
+        if (interruptFlags & RADIOLIB_SX127X_CLEAR_IRQ_FLAG_PAYLOAD_CRC_ERROR) {
             loginfo("Interrupt flag was set: payload CRC error");
         }
-        if (DuckRadio::interruptFlags & RADIOLIB_SX127X_CLEAR_IRQ_FLAG_VALID_HEADER) {
+        if (interruptFlags & RADIOLIB_SX127X_CLEAR_IRQ_FLAG_VALID_HEADER) {
             loginfo("Interrupt flag was set: valid header received");
         }
-        if (DuckRadio::interruptFlags & RADIOLIB_SX127X_CLEAR_IRQ_FLAG_TX_DONE) {
+        if (interruptFlags & RADIOLIB_SX127X_CLEAR_IRQ_FLAG_TX_DONE) {
             loginfo("Interrupt flag was set: payload transmission complete");
-            startReceive();
+            onTransmitDone();
         }
-        if (DuckRadio::interruptFlags & RADIOLIB_SX127X_CLEAR_IRQ_FLAG_CAD_DONE) {
+        if (interruptFlags & RADIOLIB_SX127X_CLEAR_IRQ_FLAG_CAD_DONE) {
             loginfo("Interrupt flag was set: CAD complete");
+            onChannelScanDone(interruptFlags & RADIOLIB_SX127X_CLEAR_IRQ_FLAG_CAD_DETECTED);
         }
-        if (DuckRadio::interruptFlags & RADIOLIB_SX127X_CLEAR_IRQ_FLAG_FHSS_CHANGE_CHANNEL) {
+        if (interruptFlags & RADIOLIB_SX127X_CLEAR_IRQ_FLAG_FHSS_CHANGE_CHANNEL) {
             loginfo("Interrupt flag was set: FHSS change channel");
         }
-        if (DuckRadio::interruptFlags & RADIOLIB_SX127X_CLEAR_IRQ_FLAG_CAD_DETECTED) {
+        if (interruptFlags & RADIOLIB_SX127X_CLEAR_IRQ_FLAG_CAD_DETECTED) {
             loginfo("Interrupt flag was set: valid LoRa signal detected during CAD operation");
         }
 
-        DuckRadio::interruptFlags = 0;
+        interruptFlags = 0;
+    }
+#endif
+    serviceTransmitQueue();
+}
+
+void DuckRadio::onTransmitDone() {
+    radio_sending = false;
+    // go back to listening unless there is more to send
+    if (txQueue.isEmpty()) {
+        startReceive();
+    }
+}
+
+void DuckRadio::serviceTransmitQueue() {
+    if (radio_sending && millis() - txStartedAt > CDPCFG_TX_TIMEOUT_MS) {
+        logerr("ERROR TX done interrupt not received, abandoning transmission");
+        radio_sending = false;
+        startReceive();
+    }
+    if (radio_sending || txQueue.isEmpty()) {
+        return;
+    }
+    // do not scan the channel for a frame the budget holds back
+    if (cadState != CAD_SCANNING && nextAllowedFrame() == NULL) {
+        return;
+    }
+    if (!csma) {
+        transmitNext();
+        return;
     }
+    switch (cadState) {
+        case CAD_IDLE:
+            startChannelScan();
+            break;
+        case CAD_SCANNING:
+            if (millis() - cadStartedAt > CDPCFG_CAD_TIMEOUT_MS) {
+                logerr("ERROR CAD done interrupt not received, transmitting without CAD");
+                cadState = CAD_IDLE;
+                cadAttempts = 0;
+                transmitNext();
+            }
+            break;
+        case CAD_BACKOFF:
+            if ((long) (millis() - backoffUntil) >= 0) {
+                startChannelScan();
+            }
+            break;
+    }
+}
+
+void DuckRadio::setCsma(bool enable, uint16_t backoff, uint8_t maxBackoffs) {
+#ifdef CDPCFG_SPARKFUN_APOLLO3
+    // the Apollo3 interrupt handler cannot tell a CAD done from a TX/RX done
+    if (enable) {
+        logwarn("WARNING CSMA is not supported on this board");
+    }
+    enable = false;
 #endif
+    csma = enable;
+    csmaBackoff = backoff > 0 ? backoff : 1;
+    csmaMaxBackoffs = maxBackoffs;
+    cadState = CAD_IDLE;
+    cadAttempts = 0;
+}
+
+int DuckRadio::startChannelScan() {
+    int rc = lora->startChannelScan();
+    if (rc != RADIOLIB_ERR_NONE) {
+        logerr_f("ERROR startChannelScan failed, err: %d, transmitting without CAD\n", rc);
+        cadState = CAD_IDLE;
+        cadAttempts = 0;
+        return transmitNext();
+    }
+    radio_receiving = false;
+    cadState = CAD_SCANNING;
+    cadStartedAt = millis();
+    csmaStats.scans++;
+    return DUCK_ERR_NONE;
+}
+
+void DuckRadio::onChannelScanDone(bool busy) {
+    if (cadState != CAD_SCANNING) {
+        return;
+    }
+    if (busy && cadAttempts >= csmaMaxBackoffs) {
+        logwarn_f("WARNING channel still busy after %d backoffs, transmitting\n", cadAttempts);
+        csmaStats.forced++;
+        busy = false;
+    }
+    if (!busy) {
+        cadState = CAD_IDLE;
+        cadAttempts = 0;
+        transmitNext();
+        return;
+    }
+
+    // Randomized binary exponential backoff, so that ducks which heard the
+    // same frame do not all retry at the same time.
+    unsigned long window = (unsigned long) csmaBackoff << (cadAttempts < 10 ? cadAttempts : 10);
+    unsigned long backoff = random(window) + 1;
+    cadAttempts++;
+    csmaStats.backoffs++;
+    csmaStats.totalBackoff += backoff;
+    backoffUntil = millis() + backoff;
+    cadState = CAD_BACKOFF;
+    loginfo_f("Channel busy, backing off %lums\n", backoff);
+
+    // the channel is busy because someone is talking: listen while waiting
+    startReceive();
 }
 
 // IMPORTANT: this function MUST be 'void' type and MUST NOT have any arguments!
 void DuckRadio::onInterrupt(void) {
+    DuckRadio* radio = interruptTarget;
+    if (radio == NULL) {
+        return;
+    }
 #ifdef CDPCFG_SPARKFUN_APOLLO3
-    interruptFired = true;
+    radio->interruptFired = true;
 #else
-    interruptFlags = lora.getIRQFlags();
+    radio->interruptFlags = radio->lora->getIRQFlags();
 #endif
 }
 
-int DuckRadio::startTransmitData(byte *data, int length) {
-    int err = DUCK_ERR_NONE;
-    int tx_err = RADIOLIB_ERR_NONE;
+int DuckRadio::startTransmitData(const byte *data, int length) {
     loginfo("TX data");
-    logdbg(" -> " + duckutils::convertToHex(data, length));
-    logdbg(" -> length: " + String(length));
-    radio_sending = true;
-    long t1 = millis();
-    // this is going to wait for transmission to complete or to timeout
-    // when transmit is complete, the Di0 interrupt will be triggered
-    tx_err = lora.transmit(data, length);
+    logdbg(" -> " + duckutils::convertToHex((byte*) data, length));
+    logdbg_f(" -> length: %d\n", length);
+
+    unsigned long airtime = getTimeOnAir(length);
+    if (dutyCycle.exceedsDwell(airtime)) {
+        logerr_f("ERROR startTransmitData frame on air for %lums, longer than the dwell time\n", airtime);
+        dutyCycle.getStats().tooLong++;
+        return DUCKLORA_ERR_DWELL_TIME;
+    }
+    if (length > TOPIC_POS
+        && DuckTxQueue::getPriority(data[TOPIC_POS]) == DuckTxQueue::PRIORITY_LOW
+        && !dutyCycle.canTransmit(airtime, millis(), CDPCFG_DUTY_CYCLE_RESERVE_PERCENT)) {
+        logwarn("WARNING duty cycle budget exhausted, low priority frame dropped");
+        dutyCycle.getStats().dropped++;
+        return DUCKLORA_ERR_DUTY_CYCLE;
+    }
+
+    int err = txQueue.push(data, length);
+    if (err != DUCK_ERR_NONE) {
+        logerr_f("ERROR startTransmitData failed to queue data, rc = %d\n", err);
+        return err;
+    }
+    // start right away if the radio is idle, otherwise the TX done interrupt
+    // (or the end of the channel scan when CSMA is enabled) picks up the next frame
+    if (!radio_sending && !csma) {
+        err = transmitNext();
+    } else {
+        serviceTransmitQueue();
+    }
+    return err;
+}
+
+int DuckRadio::transmitNext() {
+    int err = DUCK_ERR_NONE;
+    DuckTxFrame* frame = nextAllowedFrame();
+    if (frame == NULL) {
+        // deferred after a channel scan: listen while the budget refills
+        if (!txQueue.isEmpty() && !radio_receiving) {
+            startReceive();
+        }
+        return err;
+    }
+    unsigned long airtime = getTimeOnAir(frame->length);
+
+    // the frame is copied into the radio FIFO, the slot can be released now
+    int tx_err = lora->startTransmit(frame->frame, frame->length);
+    txQueue.pop(frame);
     switch (tx_err) {
         case RADIOLIB_ERR_NONE:
-
-            loginfo("TX data done in : " + String((millis() - t1)) + "ms");
+            radio_sending = true;
+            radio_receiving = false;
+            txStartedAt = millis();
+            dutyCycle.record(airtime, txStartedAt);
+            deferring = false;
+            loginfo_f("TX started, queue depth: %u\n", txQueue.size());
             break;
 
         case RADIOLIB_ERR_PACKET_TOO_LONG:
@@ -416,13 +696,51 @@ int DuckRadio::startTransmitData(byte *data, int length) {
             break;
 
         default:
-            logerr("ERROR startTransmitData failed, err: " + String(tx_err));
+            logerr_f("ERROR startTransmitData failed, err: %d\n", tx_err);
 
             err = DUCKLORA_ERR_TRANSMIT;
             break;
     }
+    if (err != DUCK_ERR_NONE) {
+        startReceive();
+    }
 
     return err;
 }
 
-#endif
\ No newline at end of file
+unsigned long DuckRadio::getTimeOnAir(int length) const {
+    return (duckairtime::getTimeOnAir(sf, bw, cr, preamble, length) + 999) / 1000;
+}
+
+DuckTxFrame* DuckRadio::nextAllowedFrame() {
+    DuckTxFrame* frame;
+    while ((frame = txQueue.front()) != NULL) {
+        if (!dutyCycle.isLimited()) {
+            return frame;
+        }
+        unsigned long airtime = getTimeOnAir(frame->length);
+        unsigned long now = millis();
+        if (frame->priority != DuckTxQueue::PRIORITY_LOW) {
+            if (dutyCycle.canTransmit(airtime, now)) {
+                return frame;
+            }
+            if (!deferring || frame->sequence != deferredSequence) {
+                loginfo_f("Duty cycle budget exhausted, frame deferred, %lums left\n",
+                          dutyCycle.getRemaining(now));
+                dutyCycle.getStats().deferred++;
+                deferring = true;
+                deferredSequence = frame->sequence;
+            }
+            return NULL;
+        }
+        if (dutyCycle.canTransmit(airtime, now, CDPCFG_DUTY_CYCLE_RESERVE_PERCENT)) {
+            return frame;
+        }
+        logwarn("WARNING duty cycle budget exhausted, low priority frame dropped");
+        dutyCycle.getStats().dropped++;
+        txQueue.discard(frame);
+    }
+    return NULL;
+}
+
+#endif
@@ -1,4 +1,4 @@
-
+#define CDP_LOG_MODULE CDP_LOG_RADIO
 
 #include "include/DuckRadio.h"
 
@@ -97,23 +97,23 @@ int DuckRadio::setupRadio(LoraConfigParams config) {
   return DUCK_ERR_NONE;
 }
 
-int DuckRadio::sendData(byte* data, int length) {
+int DuckRadio::sendData(const byte* data, int length) {
   // turnOnRGB(0, 300);
   loginfo("Sending packet: len: " + String(length));
-  Radio.Send(data, length);
+  Radio.Send((uint8_t*) data, length);
   return DUCK_ERR_NONE;
 }
 
-int DuckRadio::sendData(std::vector<byte> data) {
+int DuckRadio::sendData(const std::vector<byte> & data) {
   // turnOnRGB(0x0000F0, 0);
   loginfo("Sending packet: len: " + String(data.size()));
-  Radio.Send(data.data(), data.size());
+  Radio.Send((uint8_t*) data.data(), data.size());
   return DUCK_ERR_NONE;
 }
 
 int DuckRadio::relayPacket(DuckPacket* packet) {
-  loginfo("Relaying packet: len: " + packet->getBuffer().size());
-  Radio.Send(packet->getBuffer().data(), packet->getBuffer().size());
+  loginfo("Relaying packet: len: " + String(packet->getBufferLength()));
+  Radio.Send((uint8_t*) packet->getBuffer(), packet->getBufferLength());
   return DUCK_ERR_NONE;
 }
 
@@ -121,6 +121,9 @@ int DuckRadio::startReceive() { return DUCK_ERR_NOT_SUPPORTED; }
 int DuckRadio::readReceivedData(std::vector<byte>* packetBytes) {
   return DUCK_ERR_NOT_SUPPORTED;
 }
+int DuckRadio::readReceivedData(DuckPacket* packet) {
+  return DUCK_ERR_NOT_SUPPORTED;
+}
 
 int DuckRadio::getRSSI() { return Radio.Rssi(MODEM_LORA); }
 
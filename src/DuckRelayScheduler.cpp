@@ -0,0 +1,62 @@
+#define CDP_LOG_MODULE CDP_LOG_DUCK
+
+#include "include/DuckRelayScheduler.h"
+#include "DuckLogger.h"
+
+DuckRelayScheduler::DuckRelayScheduler()
+    : threshold(CDPCFG_RELAY_SUPPRESSION_COUNT),
+      window(CDPCFG_RELAY_ASSESSMENT_DELAY_MS) {
+    for (int i = 0; i < CDPCFG_RELAY_PENDING_SIZE; i++) {
+        pending[i].used = false;
+    }
+    memset(&stats, 0, sizeof(stats));
+}
+
+void DuckRelayScheduler::setSuppression(uint8_t threshold, uint16_t window) {
+    this->threshold = threshold;
+    this->window = window;
+}
+
+bool DuckRelayScheduler::schedule(const DuckPacket & packet) {
+    for (int i = 0; i < CDPCFG_RELAY_PENDING_SIZE; i++) {
+        DuckPendingRelay* relay = &pending[i];
+        if (relay->used) {
+            continue;
+        }
+        relay->packet = packet;
+        relay->due = millis() + (window > 0 ? random(window + 1) : 0);
+        relay->copies = 1;
+        relay->used = true;
+        stats.scheduled++;
+        return true;
+    }
+    stats.overflows++;
+    return false;
+}
+
+void DuckRelayScheduler::onDuplicate(const byte* muid) {
+    for (int i = 0; i < CDPCFG_RELAY_PENDING_SIZE; i++) {
+        DuckPendingRelay* relay = &pending[i];
+        if (!relay->used
+            || !std::equal(muid, muid + MUID_LENGTH, relay->packet.getView().getMuid())) {
+            continue;
+        }
+        relay->copies++;
+        if (relay->copies >= threshold) {
+            loginfo_f("Relay suppressed after %d copies\n", relay->copies);
+            relay->used = false;
+            stats.suppressed++;
+        }
+        return;
+    }
+}
+
+DuckPendingRelay* DuckRelayScheduler::nextDue(unsigned long now) {
+    for (int i = 0; i < CDPCFG_RELAY_PENDING_SIZE; i++) {
+        DuckPendingRelay* relay = &pending[i];
+        if (relay->used && (long) (now - relay->due) >= 0) {
+            return relay;
+        }
+    }
+    return NULL;
+}
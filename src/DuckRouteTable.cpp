@@ -0,0 +1,81 @@
+#include "include/DuckRouteTable.h"
+
+#include <string.h>
+
+DuckRouteTable::DuckRouteTable() : timeout(CDPCFG_ROUTE_TIMEOUT_MS) {
+    clear();
+}
+
+void DuckRouteTable::clear() {
+    for (int i = 0; i < CDPCFG_ROUTE_TABLE_SIZE; i++) {
+        routes[i].used = false;
+    }
+}
+
+const DuckRoute* DuckRouteTable::find(const byte* duid) const {
+    for (int i = 0; i < CDPCFG_ROUTE_TABLE_SIZE; i++) {
+        const DuckRoute* route = &routes[i];
+        if (route->used && std::equal(duid, duid + DUID_LENGTH, route->duid)) {
+            return route;
+        }
+    }
+    return NULL;
+}
+
+void DuckRouteTable::update(const byte* duid, byte distance, unsigned long now) {
+    if (distance == 0 || distance == EXT_DISTANCE_UNKNOWN) {
+        return;
+    }
+    DuckRoute* route = const_cast<DuckRoute*>(find(duid));
+    if (route != NULL) {
+        // a longer path is only taken once the shorter one was not heard for a while
+        if (distance <= route->distance || !isAlive(*route, now)) {
+            route->distance = distance;
+            route->lastHeard = now;
+        }
+        return;
+    }
+
+    // a free entry, or the route confirmed the longest time ago
+    for (int i = 0; i < CDPCFG_ROUTE_TABLE_SIZE; i++) {
+        DuckRoute* entry = &routes[i];
+        if (!entry->used) {
+            route = entry;
+            break;
+        }
+        if (route == NULL || now - entry->lastHeard > now - route->lastHeard) {
+            route = entry;
+        }
+    }
+    memcpy(route->duid, duid, DUID_LENGTH);
+    route->distance = distance;
+    route->lastHeard = now;
+    route->used = true;
+}
+
+byte DuckRouteTable::getDistance(const byte* duid, unsigned long now) const {
+    const DuckRoute* route = find(duid);
+    if (route == NULL || !isAlive(*route, now)) {
+        return EXT_DISTANCE_UNKNOWN;
+    }
+    return route->distance;
+}
+
+int DuckRouteTable::size() const {
+    int count = 0;
+    for (int i = 0; i < CDPCFG_ROUTE_TABLE_SIZE; i++) {
+        if (routes[i].used) {
+            count++;
+        }
+    }
+    return count;
+}
+
+const DuckRoute* DuckRouteTable::get(int index) const {
+    for (int i = 0; i < CDPCFG_ROUTE_TABLE_SIZE; i++) {
+        if (routes[i].used && index-- == 0) {
+            return &routes[i];
+        }
+    }
+    return NULL;
+}
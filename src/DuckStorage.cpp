@@ -0,0 +1,65 @@
+#include "include/DuckStorage.h"
+
+#include <string.h>
+
+#ifndef CDPCFG_SPARKFUN_APOLLO3
+#include <EEPROM.h>
+#endif
+
+int DuckRamStorage::read(int offset, byte* buffer, int length) {
+    if (offset < 0 || length < 0 || offset + length > (int) data.size()) {
+        return DUCK_ERR_STORAGE;
+    }
+    memcpy(buffer, data.data() + offset, length);
+    return DUCK_ERR_NONE;
+}
+
+int DuckRamStorage::write(int offset, const byte* buffer, int length) {
+    if (offset < 0 || length < 0 || offset + length > (int) data.size()) {
+        return DUCK_ERR_STORAGE;
+    }
+    memcpy(data.data() + offset, buffer, length);
+    bytesWritten += length;
+    return DUCK_ERR_NONE;
+}
+
+#ifndef CDPCFG_SPARKFUN_APOLLO3
+bool DuckEepromStorage::begin() {
+    // begun again by another user with a smaller size, the bytes written
+    // since the last commit are lost
+    if ((int) EEPROM.length() < this->offset + this->size) {
+        EEPROM.begin(this->offset + this->size);
+    }
+    return (int) EEPROM.length() >= this->offset + this->size;
+}
+
+int DuckEepromStorage::read(int offset, byte* data, int length) {
+    if (offset < 0 || length < 0 || offset + length > size || !begin()) {
+        return DUCK_ERR_STORAGE;
+    }
+    for (int i = 0; i < length; i++) {
+        data[i] = EEPROM.read(this->offset + offset + i);
+    }
+    return DUCK_ERR_NONE;
+}
+
+int DuckEepromStorage::write(int offset, const byte* data, int length) {
+    if (offset < 0 || length < 0 || offset + length > size || !begin()) {
+        return DUCK_ERR_STORAGE;
+    }
+    for (int i = 0; i < length; i++) {
+        int address = this->offset + offset + i;
+        if (EEPROM.read(address) != data[i]) {
+            EEPROM.write(address, data[i]);
+        }
+    }
+    return DUCK_ERR_NONE;
+}
+
+int DuckEepromStorage::commit() {
+    if ((int) EEPROM.length() < this->offset + this->size || !EEPROM.commit()) {
+        return DUCK_ERR_STORAGE;
+    }
+    return DUCK_ERR_NONE;
+}
+#endif
@@ -0,0 +1,91 @@
+#include "include/DuckTxQueue.h"
+#include "DuckError.h"
+#include <string.h>
+
+DuckTxQueue::DuckTxQueue() : nextSequence(0) {
+    for (int i = 0; i < CDPCFG_TX_QUEUE_SIZE; i++) {
+        slots[i].used = false;
+    }
+    memset(&stats, 0, sizeof(stats));
+}
+
+DuckTxQueue::Priority DuckTxQueue::getPriority(byte topic) {
+    switch (topic) {
+        case reservedTopic::ping:
+        case reservedTopic::pong:
+        case reservedTopic::ack:
+        case topics::alert:
+            return PRIORITY_HIGH;
+        case topics::status:
+        case topics::health:
+            return PRIORITY_LOW;
+        default:
+            return PRIORITY_NORMAL;
+    }
+}
+
+int DuckTxQueue::push(const byte* data, int length) {
+    if (length > PACKET_LENGTH) {
+        return DUCKLORA_ERR_MSG_TOO_LARGE;
+    }
+    for (int i = 0; i < CDPCFG_TX_QUEUE_SIZE; i++) {
+        DuckTxFrame* slot = &slots[i];
+        if (slot->used) {
+            continue;
+        }
+        memcpy(slot->frame, data, length);
+        slot->length = length;
+        slot->priority = length > TOPIC_POS ? getPriority(data[TOPIC_POS]) : PRIORITY_NORMAL;
+        slot->sequence = nextSequence++;
+        slot->queuedAt = millis();
+        slot->used = true;
+
+        stats.queued++;
+        stats.depth++;
+        if (stats.depth > stats.maxDepth) {
+            stats.maxDepth = stats.depth;
+        }
+        return DUCK_ERR_NONE;
+    }
+    stats.dropped++;
+    return DUCKLORA_ERR_TX_BUSY;
+}
+
+DuckTxFrame* DuckTxQueue::front() {
+    DuckTxFrame* best = NULL;
+    for (int i = 0; i < CDPCFG_TX_QUEUE_SIZE; i++) {
+        DuckTxFrame* slot = &slots[i];
+        if (!slot->used) {
+            continue;
+        }
+        // sequence numbers are compared as a difference so wrap around is harmless
+        if (best == NULL || slot->priority < best->priority
+            || (slot->priority == best->priority
+                && (long)(slot->sequence - best->sequence) < 0)) {
+            best = slot;
+        }
+    }
+    return best;
+}
+
+void DuckTxQueue::pop(DuckTxFrame* frame) {
+    if (frame == NULL || !frame->used) {
+        return;
+    }
+    frame->used = false;
+    unsigned long delay = millis() - frame->queuedAt;
+    stats.sent++;
+    stats.depth--;
+    stats.totalDelay += delay;
+    if (delay > stats.maxDelay) {
+        stats.maxDelay = delay;
+    }
+}
+
+void DuckTxQueue::discard(DuckTxFrame* frame) {
+    if (frame == NULL || !frame->used) {
+        return;
+    }
+    frame->used = false;
+    stats.depth--;
+}
@@ -1,3 +1,5 @@
+#define CDP_LOG_MODULE CDP_LOG_UTILS
+
 #include "include/DuckUtils.h"
 #include <iomanip>
 #include <sstream>
@@ -9,6 +11,14 @@ namespace duckutils {
 
   namespace {
     std::string cdpVersion = "3.0.4";
+
+    // on the ESP32 beginning the EEPROM again reloads it, a smaller size
+    // would also truncate the checkpoints on the next commit
+    void beginEeprom() {
+      if (EEPROM.length() < CDPCFG_EEPROM_CRED_SIZE) {
+        EEPROM.begin(CDPCFG_EEPROM_CRED_SIZE);
+      }
+    }
   }
 
 Timer<> duckTimer = timer_create_default();
@@ -75,7 +85,7 @@ uint32_t toUnit32(const byte* data) {
 }
 #ifndef CDPCFG_SPARKFUN_APOLLO3
 int saveWifiCredentials(String ssid, String password) {
-  EEPROM.begin(512);
+  beginEeprom();
 
   if (ssid.length() > 0 && password.length() > 0) {
     loginfo("Clearing EEPROM");
@@ -103,7 +113,7 @@ int saveWifiCredentials(String ssid, String password) {
 }
 
 String loadWifiSsid() {
-  EEPROM.begin(512); //Initialasing EEPROM
+  beginEeprom(); //Initialasing EEPROM
   String esid;
   // loop through saved SSID characters
   for (int i = 0; i < 32; ++i)
@@ -115,7 +125,7 @@ String loadWifiSsid() {
 }
 
 String loadWifiPassword() {
-  EEPROM.begin(512); //Initialasing EEPROM
+  beginEeprom(); //Initialasing EEPROM
   String epass = "";
   // loop through saved Password characters
   for (int i = 32; i < 96; ++i)
@@ -1,6 +1,8 @@
+#define CDP_LOG_MODULE CDP_LOG_DUCK
+
 #include "include/AgnoDuck.h"
 #include "../CdpPacket.h"
-#include "include/bloomfilter.h"
+#include "include/DuckDedup.h"
 
 const int MEMORY_LOW_THRESHOLD = PACKET_LENGTH + sizeof(CdpPacket);
 const int NUM_SECTORS = 312; //total desired bits divided by bits per sector
@@ -9,7 +11,10 @@ const int BITS_PER_SECTOR = 32; //size of unsigned int is 32 bits
 const int MAX_MESSAGES = 100;
 
 AgnoDuck::AgnoDuck(String name):
-        filter(NUM_SECTORS, NUM_HASH_FUNCS, BITS_PER_SECTOR, MAX_MESSAGES)
+#ifndef CDPCFG_DEDUP_MUID_CACHE
+        filter(NUM_SECTORS, NUM_HASH_FUNCS, BITS_PER_SECTOR, MAX_MESSAGES),
+#endif
+        adr(neighbors)
 {
     duckName = name;
 }
@@ -18,9 +23,6 @@ AgnoDuck::~AgnoDuck() {
     if (txPacket != NULL) {
         delete txPacket;
     }
-    if (rxPacket != NULL) {
-        delete rxPacket;
-    }
 }
 
 void AgnoDuck::setEncrypt(bool state) {
@@ -106,6 +108,11 @@ int AgnoDuck::setupRadio(float band, int ss, int rst, int di0, int di1,
     config.bw = bw;
     config.sf = sf;
     config.gain = gain;
+    config.cr = CDPCFG_RF_LORA_CR;
+    config.preamble = CDPCFG_RF_LORA_PREAMBLE;
+    config.csma = CDPCFG_CSMA_ENABLED;
+    config.csmaBackoff = CDPCFG_CSMA_BACKOFF_MS;
+    config.csmaMaxBackoffs = CDPCFG_CSMA_MAX_BACKOFFS;
     config.func = DuckRadio::onInterrupt;
     logwarn_f("~~ band: %d\n", band);
     logwarn_f("~~ config.band: %d\n", config.band);
@@ -124,8 +131,9 @@ int AgnoDuck::setupRadio(float band, int ss, int rst, int di0, int di1,
         return err;
     }
 
+    adr.setEnabled(CDPCFG_ADR_ENABLED, sf);
+
     txPacket = new DuckPacket(duid);
-    rxPacket = new DuckPacket();
     loginfo("setupRadio rc = " + String(DUCK_ERR_NONE));
 
     return DUCK_ERR_NONE;
@@ -139,71 +147,262 @@ void AgnoDuck::setChannel(int channelNum, bool isEU) {
     duckRadio.setChannel(channelNum, isEU);
 }
 
+void AgnoDuck::setCsma(bool enable, uint16_t backoff, uint8_t maxBackoffs) {
+    duckRadio.setCsma(enable, backoff, maxBackoffs);
+}
+
+void AgnoDuck::setAdaptiveDataRate(bool enable, unsigned long interval) {
+    adr.setEnabled(enable, duckRadio.getSpreadingFactor(), interval);
+}
+
+const DuckNeighbor* AgnoDuck::findNeighbor(const std::vector<byte> & duid) {
+    if (duid.size() != DUID_LENGTH) {
+        return NULL;
+    }
+    return neighbors.find(duid.data());
+}
+
+void AgnoDuck::updateNeighbors(const DuckRxFrame & frame) {
+    const CdpPacketView & packet = frame.packet.getView();
+    // only frames from the duck that sent them tell about a link
+    if (!packet.isValid() || packet.getHopCount() != 0) {
+        return;
+    }
+    unsigned long now = millis();
+    neighbors.update(packet.getSduid(), packet.getDuckType(), frame.rssi, frame.snr, now);
+
+    byte topic = packet.getTopic();
+    if ((topic == reservedTopic::ping || topic == reservedTopic::pong)
+        && packet.getDataLength() >= 1 + DUCK_ADR_REPORT_LENGTH) {
+        bool forUs = std::equal(duid.begin(), duid.end(), packet.getDduid());
+        adr.onReport(packet.getSduid(), DuckAdr::readReport(packet.getData() + 1), forUs, now);
+    }
+}
+
+byte AgnoDuck::getRouteDistance(const std::vector<byte> & duid) {
+    if (duid.size() != DUID_LENGTH) {
+        return EXT_DISTANCE_UNKNOWN;
+    }
+    return routes.getDistance(duid.data(), millis());
+}
+
+void AgnoDuck::updateRoutes(const DuckRxFrame & frame) {
+    const CdpPacketView & packet = frame.packet.getView();
+    if (!routing || !packet.isValid()) {
+        return;
+    }
+    int distance = packet.getHopCount() + 1;
+    // a link close to the floor loses frames, prefer a path with strong links
+    if (frame.snr < DuckAdr::getSnrFloor(duckRadio.getSpreadingFactor()) + CDPCFG_ROUTE_WEAK_LINK_DB) {
+        distance++;
+    }
+    if (distance < EXT_DISTANCE_UNKNOWN) {
+        routes.update(packet.getSduid(), distance, millis());
+    }
+}
+
+bool AgnoDuck::isUnicast(const byte* dduid) {
+    return !std::equal(ZERO_DUID.begin(), ZERO_DUID.end(), dduid)
+        && !std::equal(BROADCAST_DUID.begin(), BROADCAST_DUID.end(), dduid);
+}
+
+void AgnoDuck::serviceAdr() {
+    if (!adr.isEnabled()) {
+        return;
+    }
+    unsigned long now = millis();
+    adr.service(now);
+    if (adr.getSpreadingFactor() != duckRadio.getSpreadingFactor()) {
+        // retried on the next call while the radio is busy
+        duckRadio.setSpreadingFactor(adr.getSpreadingFactor());
+    }
+    if (adr.isBeaconDue(now)) {
+        int err = sendBeacon();
+        if (err != DUCK_ERR_NONE) {
+            logerr_f("ERROR failed to send link beacon. rc = %d\n", err);
+        }
+        adr.onBeaconSent(now);
+    }
+}
+
+
+int AgnoDuck::setCheckpointStorage(DuckStorage* storage) {
+    checkpointOffset = 0;
+    int err = checkpoint.setStorage(storage, filter.dedup_state_size());
+    if (err != DUCK_ERR_NONE) {
+        logerr_f("ERROR checkpoint storage too small, %d bytes needed\n",
+                 2 * (DUCK_CHECKPOINT_HEADER_LENGTH + filter.dedup_state_size()));
+    }
+    return err;
+}
+
+int AgnoDuck::restoreCheckpoint() {
+    int length = filter.dedup_state_size();
+    if (checkpoint.getLength() != length) {
+        loginfo("No checkpoint of the messages already seen");
+        return DUCK_ERR_NO_CHECKPOINT;
+    }
+    byte chunk[CDPCFG_CHECKPOINT_CHUNK];
+    int err = DUCK_ERR_NONE;
+    for (int offset = 0; offset < length && err == DUCK_ERR_NONE; offset += CDPCFG_CHECKPOINT_CHUNK) {
+        int n = std::min(CDPCFG_CHECKPOINT_CHUNK, length - offset);
+        err = checkpoint.read(offset, chunk, n);
+        if (err == DUCK_ERR_NONE) {
+            filter.dedup_load(offset, chunk, n);
+        }
+    }
+    // clears the filter if the checkpoint was not fully loaded
+    if (!filter.dedup_load_end() && err == DUCK_ERR_NONE) {
+        err = DUCK_ERR_NO_CHECKPOINT;
+    }
+    if (err != DUCK_ERR_NONE) {
+        logerr_f("ERROR failed to restore the messages already seen. rc = %d\n", err);
+        return err;
+    }
+    checkpointAdds = filter.dedup_adds();
+    lastCheckpoint = millis();
+    loginfo_f("Restored the messages already seen, checkpoint %lu\n",
+              (unsigned long) checkpoint.getStats().sequence);
+    return DUCK_ERR_NONE;
+}
+
+void AgnoDuck::serviceCheckpoint() {
+    if (!checkpoint.hasStorage()) {
+        return;
+    }
+    unsigned long now = millis();
+    int length = filter.dedup_state_size();
+    if (!checkpoint.isWriting()) {
+        if (now - lastCheckpoint < checkpointInterval || filter.dedup_adds() == checkpointAdds) {
+            return;
+        }
+        lastCheckpoint = now;
+        checkpointAdds = filter.dedup_adds();
+        checkpointOffset = 0;
+        if (checkpoint.begin(length) != DUCK_ERR_NONE) {
+            logerr("ERROR failed to start a checkpoint");
+        }
+        return;
+    }
 
-int AgnoDuck::sendData(byte topic, const String data,
-                       const std::vector<byte> targetDevice, std::vector<byte> * outgoingMuid)
+    int err;
+    if (checkpointOffset < length) {
+        byte chunk[CDPCFG_CHECKPOINT_CHUNK];
+        int n = std::min(CDPCFG_CHECKPOINT_CHUNK, length - checkpointOffset);
+        filter.dedup_save(checkpointOffset, chunk, n);
+        checkpointOffset += n;
+        err = checkpoint.write(chunk, n);
+    } else {
+        err = checkpoint.end();
+    }
+    if (err != DUCK_ERR_NONE) {
+        // retried after the interval
+        logerr_f("ERROR failed to write a checkpoint. rc = %d\n", err);
+    }
+}
+
+int AgnoDuck::sendData(byte topic, const String & data,
+                       const std::vector<byte> & targetDevice, std::vector<byte> * outgoingMuid,
+                       bool reliable)
 {
 
     const byte* buffer = (byte*)data.c_str();
-    int err = sendData(topic, buffer, data.length(), targetDevice, outgoingMuid);
+    int err = sendData(topic, buffer, data.length(), targetDevice, outgoingMuid, reliable);
     return err;
 }
 
-int AgnoDuck::sendData(byte topic, const std::string data,
-                       const std::vector<byte> targetDevice, std::vector<byte> * outgoingMuid)
+int AgnoDuck::sendData(byte topic, const std::string & data,
+                       const std::vector<byte> & targetDevice, std::vector<byte> * outgoingMuid,
+                       bool reliable)
 {
-    std::vector<byte> app_data;
-    app_data.insert(app_data.end(), data.begin(), data.end());
-    int err = sendData(topic, app_data, targetDevice, outgoingMuid);
+    const byte* buffer = (const byte*)data.data();
+    int err = sendData(topic, buffer, data.size(), targetDevice, outgoingMuid, reliable);
     return err;
 }
 
-int AgnoDuck::sendData(byte topic, const byte* data, int length,
-                       const std::vector<byte> targetDevice, std::vector<byte> * outgoingMuid)
+int AgnoDuck::sendData(byte topic, const std::vector<byte> & data,
+                       const std::vector<byte> & targetDevice, std::vector<byte> * outgoingMuid,
+                       bool reliable)
 {
-    std::vector<byte> app_data;
-    app_data.insert(app_data.end(), &data[0], &data[length]);
-    int err = sendData(topic, app_data, targetDevice, outgoingMuid);
+    int err = sendData(topic, data.data(), data.size(), targetDevice, outgoingMuid, reliable);
     return err;
 }
 
-int AgnoDuck::sendData(byte topic, std::vector<byte> data,
-                       const std::vector<byte> targetDevice, std::vector<byte> * outgoingMuid)
+int AgnoDuck::sendData(byte topic, const byte* data, int length,
+                       const std::vector<byte> & targetDevice, std::vector<byte> * outgoingMuid,
+                       bool reliable)
 {
     if (topic < reservedTopic::max_reserved) {
         logerr("ERROR send data failed, topic is reserved.");
         return DUCKPACKET_ERR_TOPIC_INVALID;
     }
-    if (data.size() > MAX_DATA_LENGTH) {
-        logerr("ERROR send data failed, message too large: " + String(data.size()) +
+    if (length > MAX_DATA_LENGTH) {
+        logerr("ERROR send data failed, message too large: " + String(length) +
                " bytes");
         return DUCKPACKET_ERR_SIZE_INVALID;
     }
-    int err = txPacket->prepareForSending(&filter, targetDevice, this->getType(), topic, data);
+    if (targetDevice.size() != DUID_LENGTH) {
+        logerr("ERROR send data failed, target device id is invalid");
+        return DUCK_ERR_ID_TOO_LONG;
+    }
+    if (reliable && length > EXT_MAX_FRAME_LENGTH - HEADER_LENGTH) {
+        // the frame could not be kept to send it again
+        logerr("ERROR send data failed, reliable message too large: " + String(length) +
+               " bytes");
+        return DUCKPACKET_ERR_SIZE_INVALID;
+    }
+    if (reliable && !inflight.canAddReliable()) {
+        logerr("ERROR send data failed, too many reliable messages waiting for their ack");
+        return DUCKPACKET_ERR_RELIABLE_FULL;
+    }
+    int err = txPacket->prepareForSending(&filter, targetDevice.data(), this->getType(), topic, data, length);
 
     if (err != DUCK_ERR_NONE) {
         return err;
     }
 
-    err = duckRadio.sendData(txPacket->getBuffer());
-
-    CdpPacket packet = CdpPacket(txPacket->getBuffer());
+    if (routeRecord) {
+        // an empty record, the relays fill it
+        if (txPacket->addExtension(EXT_ROUTE, NULL, 0) != DUCK_ERR_NONE) {
+            // no room left, the message is sent without a record
+            logdbg("sendData: no room for the route record");
+        }
+    }
 
-    if (err == DUCK_ERR_NONE) {
-        filter.bloom_add(packet.muid.data(), MUID_LENGTH);
+    if (routing && isUnicast(targetDevice.data())) {
+        // the relays closer to the target than we are take it from here
+        byte distance = routes.getDistance(targetDevice.data(), millis());
+        if (txPacket->addExtension(EXT_DISTANCE, &distance, 1) != DUCK_ERR_NONE) {
+            // no room left, the message is flooded
+            logdbg("sendData: no room for the distance");
+        }
     }
 
-    if (!lastMessageAck) {
-        loginfo("Previous `lastMessageMuid` " + duckutils::toString(lastMessageMuid) +
-                " was not acked. Overwriting `lastMessageMuid` with " +
-                duckutils::toString(packet.muid));
+    err = duckRadio.sendData(txPacket->getBuffer(), txPacket->getBufferLength());
+
+    CdpPacketView packet = txPacket->getView();
+    const byte* muid = packet.getMuid();
+
+    if (err == DUCK_ERR_NONE) {
+        filter.dedup_add(packet.getSduid(), muid);
+        if (inflight.pending() == CDPCFG_INFLIGHT_TABLE_SIZE) {
+            logwarn("No ack tracking entry left, forgetting the oldest message");
+        }
+        unsigned long now = millis();
+        if (reliable) {
+            if (inflight.addReliable(muid, txPacket->getBuffer(), txPacket->getBufferLength(),
+                                     now, now + reliableDeadline, now + getRetryDelay(0)) == NULL) {
+                // sent once, but it would never be sent again nor reported
+                logerr("ERROR reliable message sent but not tracked");
+                err = DUCKPACKET_ERR_RELIABLE_FULL;
+            }
+        } else {
+            inflight.add(muid, now);
+        }
     }
 
-    lastMessageAck = false;
-    lastMessageMuid.assign(packet.muid.begin(), packet.muid.end());
-    assert(lastMessageMuid.size() == MUID_LENGTH);
     if (outgoingMuid != NULL) {
-        outgoingMuid->assign(packet.muid.begin(), packet.muid.end());
+        outgoingMuid->assign(muid, muid + MUID_LENGTH);
         assert(outgoingMuid->size() == MUID_LENGTH);
     }
     txPacket->reset();
@@ -211,18 +410,57 @@ int AgnoDuck::sendData(byte topic, std::vector<byte> data,
     return err;
 }
 
-muidStatus AgnoDuck::getMuidStatus(const std::vector<byte> & muid) const {
-    if (duckutils::isEqual(muid, lastMessageMuid)) {
-        if (lastMessageAck) {
-            return muidStatus::acked;
-        } else {
-            return muidStatus::not_acked;
+unsigned long AgnoDuck::getRetryDelay(uint8_t retries) {
+    unsigned long delay = reliableBackoff;
+    for (int i = 0; i < retries && delay < CDPCFG_RELIABLE_MAX_BACKOFF_MS; i++) {
+        delay *= 2;
+    }
+    if (delay > CDPCFG_RELIABLE_MAX_BACKOFF_MS) {
+        delay = CDPCFG_RELIABLE_MAX_BACKOFF_MS;
+    }
+    // up to a quarter more, so that the ducks that lost the same ack do not
+    // all send again at the same time
+    return delay + random(delay / 4 + 1);
+}
+
+void AgnoDuck::serviceRetransmissions() {
+    unsigned long now = millis();
+    DuckInflight* message = inflight.nextDue(now);
+    if (message == NULL) {
+        return;
+    }
+    if ((long) (now - message->deadline) >= 0) {
+        inflight.expire(message);
+        logwarn("Reliable message " + duckutils::convertToHex(message->muid, MUID_LENGTH)
+                + " was not acked before its deadline");
+        if (deliveryDone != NULL) {
+            deliveryDone(std::vector<byte>(message->muid, message->muid + MUID_LENGTH),
+                         muidStatus::not_acked);
         }
-    } else if (muid.size() != MUID_LENGTH) {
-        return muidStatus::invalid;
+        return;
+    }
+
+    int length = 0;
+    const byte* frame = inflight.getFrame(*message, &length);
+    int err = duckRadio.sendData(frame, length);
+    if (err == DUCK_ERR_NONE) {
+        inflight.retried(message, now, now + getRetryDelay(message->retries + 1));
     } else {
+        // the radio is busy or out of duty cycle, not counted as a retransmission
+        logdbg_f("Reliable message retransmission deferred. rc = %d\n", err);
+        message->nextRetry = now + getRetryDelay(message->retries);
+    }
+}
+
+muidStatus AgnoDuck::getMuidStatus(const std::vector<byte> & muid) const {
+    if (muid.size() != MUID_LENGTH) {
+        return muidStatus::invalid;
+    }
+    const DuckInflight* message = inflight.find(muid.data());
+    if (message == NULL) {
         return muidStatus::unrecognized;
     }
+    return message->acked ? muidStatus::acked : muidStatus::not_acked;
 }
 
 // TODO: implement this using new packet format
@@ -254,31 +492,55 @@ int AgnoDuck::startReceive() {
     return err;
 }
 
-int AgnoDuck::sendPong() {
+int AgnoDuck::sendPong(const CdpPacketView & ping, float snr) {
     int err = DUCK_ERR_NONE;
-    std::vector<byte> data(1, 0);
-    err = txPacket->prepareForSending(&filter, ZERO_DUID, this->getType(), reservedTopic::pong, data);
+    byte data[1 + DUCK_ADR_REPORT_LENGTH] = {0};
+    int length = 1;
+    const byte* target = ZERO_DUID.data();
+    if (adr.isEnabled()) {
+        // the link report, for the duck that pinged
+        DuckAdr::writeReport(adr.getReport(snr, millis()), data + 1);
+        length = sizeof(data);
+        target = ping.getSduid();
+    }
+    err = txPacket->prepareForSending(&filter, target, this->getType(), reservedTopic::pong, data, length);
+    if (err != DUCK_ERR_NONE) {
+        logerr_f("ERROR Oops! failed to build pong packet, err = %d\n", err);
+        return err;
+    }
+    err = duckRadio.sendData(txPacket->getBuffer(), txPacket->getBufferLength());
     if (err != DUCK_ERR_NONE) {
-        logerr("ERROR Oops! failed to build pong packet, err = " + err);
+        logerr_f("ERROR Oops! Lora sendData failed, err = %d\n", err);
         return err;
     }
-    err = duckRadio.sendData(txPacket->getBuffer());
+    return err;
+}
+
+int AgnoDuck::sendBeacon() {
+    int err = DUCK_ERR_NONE;
+    byte data[1 + DUCK_ADR_REPORT_LENGTH] = {0};
+    DuckAdr::writeReport(adr.getReport(NAN, millis()), data + 1);
+    err = txPacket->prepareForSending(&filter, ZERO_DUID.data(), this->getType(), reservedTopic::ping, data, sizeof(data));
     if (err != DUCK_ERR_NONE) {
-        logerr("ERROR Oops! Lora sendData failed, err = " + err);
+        logerr_f("ERROR Failed to build beacon packet, err = %d\n", err);
         return err;
     }
+    err = duckRadio.sendData(txPacket->getBuffer(), txPacket->getBufferLength());
+    if (err != DUCK_ERR_NONE) {
+        logerr_f("ERROR Lora sendData failed, err = %d\n", err);
+    }
     return err;
 }
 
 int AgnoDuck::sendPing() {
     int err = DUCK_ERR_NONE;
-    std::vector<byte> data(1, 0);
-    err = txPacket->prepareForSending(&filter, ZERO_DUID, this->getType(), reservedTopic::ping, data);
+    byte data[1] = {0};
+    err = txPacket->prepareForSending(&filter, ZERO_DUID.data(), this->getType(), reservedTopic::ping, data, 1);
     if (err != DUCK_ERR_NONE) {
         logerr("ERROR Failed to build ping packet, err = " + err);
         return err;
     }
-    err = duckRadio.sendData(txPacket->getBuffer());
+    err = duckRadio.sendData(txPacket->getBuffer(), txPacket->getBufferLength());
     if (err != DUCK_ERR_NONE) {
         logerr("ERROR Lora sendData failed, err = " + err);
     }
@@ -299,6 +561,10 @@ String AgnoDuck::getErrorString(int error) {
             return errorStr + "Id length is invalid";
         case DUCK_ERR_OTA:
             return errorStr + "OTA update failure";
+        case DUCK_ERR_STORAGE:
+            return errorStr + "Persistent storage access failed";
+        case DUCK_ERR_NO_CHECKPOINT:
+            return errorStr + "No valid checkpoint in the persistent storage";
         case DUCKLORA_ERR_BEGIN:
             return errorStr + "Lora module initialization failed";
         case DUCKLORA_ERR_SETUP:
@@ -313,6 +579,12 @@ String AgnoDuck::getErrorString(int error) {
             return errorStr + "Lora moduled failed to handle RX data";
         case DUCKLORA_ERR_MSG_TOO_LARGE:
             return errorStr + "Attempted to send a message larger than 256 bytes";
+        case DUCKLORA_ERR_TX_BUSY:
+            return errorStr + "Lora module transmit queue is full";
+        case DUCKLORA_ERR_DUTY_CYCLE:
+            return errorStr + "Duty cycle budget exhausted";
+        case DUCKLORA_ERR_DWELL_TIME:
+            return errorStr + "Message time on air is longer than the dwell time";
 
         case DUCKWIFI_ERR_NOT_AVAILABLE:
             return errorStr + "Wifi network is not availble";
@@ -330,6 +602,8 @@ String AgnoDuck::getErrorString(int error) {
             return errorStr + "Duck packet topic field is invalid";
         case DUCKPACKET_ERR_MAX_HOPS:
             return errorStr + "Duck packet reached maximum allowed hops";
+        case DUCKPACKET_ERR_RELIABLE_FULL:
+            return errorStr + "Too many reliable messages waiting for their ack";
 
         case DUCK_INTERNET_ERR_SETUP:
             return errorStr + "Internet setup failed";
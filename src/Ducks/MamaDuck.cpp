@@ -1,6 +1,7 @@
 //
 // Created by Caden Keese on 3/6/22.
 //
+#define CDP_LOG_MODULE CDP_LOG_DUCK
 
 #include "../MamaDuck.h"
 #include "../MemoryFree.h"
@@ -31,29 +32,120 @@ int MamaDuck::setupWithDefaults(std::vector<byte> deviceId, float radioBand) {
 void MamaDuck::run() {
 
 
-    duckRadio.serviceInterruptFlags();
+    serviceRadio();
 
-    if (DuckRadio::getReceiveFlag()) {
+    // Drain the frames queued since the last call. Interrupts are serviced
+    // between frames so new receptions are queued rather than lost, and the
+    // loop is bounded so a busy channel cannot starve the sketch.
+    for (unsigned int i = 0; i < CDPCFG_RX_QUEUE_SIZE; i++) {
+        if (duckRadio.getReceivedFrame() == NULL) {
+            break;
+        }
         handleReceivedPacket();
-        rxPacket->reset();
+        duckRadio.releaseReceivedFrame();
+        // a full batch goes before the next frame can overflow it
+        sendDueAcks();
+        serviceRadio();
+    }
+
+    relayDuePackets();
+
+    sendDueAcks();
+
+    serviceRetransmissions();
+
+    serviceAdr();
+
+    // a chunk or the commit of a checkpoint, while no frame is waiting
+    if (duckRadio.getReceivedFrame() == NULL) {
+        serviceCheckpoint();
+    }
+
+#ifdef CDP_LOG_BINARY
+    // write the buffered log entries while there is nothing else to do
+    if (duckRadio.getReceivedFrame() == NULL) {
+        ducklog::drain();
+    }
+#endif
+}
+
+void MamaDuck::setRelaySuppression(uint8_t count, uint16_t window) {
+    relayScheduler.setSuppression(count, window);
+}
+
+void MamaDuck::setAckAggregation(uint8_t size, uint16_t deadline) {
+    ackAggregator.setBatch(size, deadline);
+}
+
+int MamaDuck::setTopicTtl(byte topic, byte ttl) {
+    if (ttl > MAX_HOPS) {
+        return DUCKPACKET_ERR_MAX_HOPS;
+    }
+    for (int i = 0; i < numTopicTtls; i++) {
+        if (topicTtls[i].topic == topic) {
+            topicTtls[i].ttl = ttl;
+            return DUCK_ERR_NONE;
+        }
+    }
+    if (numTopicTtls >= CDPCFG_TOPIC_TTL_SIZE) {
+        return DUCKPACKET_ERR_TOPIC_INVALID;
+    }
+    topicTtls[numTopicTtls].topic = topic;
+    topicTtls[numTopicTtls].ttl = ttl;
+    numTopicTtls++;
+    return DUCK_ERR_NONE;
+}
+
+byte MamaDuck::getTopicTtl(byte topic) {
+    for (int i = 0; i < numTopicTtls; i++) {
+        if (topicTtls[i].topic == topic) {
+            return topicTtls[i].ttl;
+        }
+    }
+    return MAX_HOPS;
+}
+
+void MamaDuck::relayDuePackets() {
+    DuckPendingRelay* relay;
+    while ((relay = relayScheduler.nextDue(millis())) != NULL) {
+        int err = duckRadio.relayPacket(&relay->packet);
+        relayScheduler.release(relay);
+        if (err != DUCK_ERR_NONE) {
+            logerr_f("====> ERROR relayDuePackets failed to relay. rc = %d\n", err);
+        } else {
+            loginfo("relayDuePackets: packet RELAY DONE");
+        }
     }
 }
 
 void MamaDuck::handleReceivedPacket() {
 
-    std::vector<byte> data;
     bool relay = false;
 
     loginfo("====> handleReceivedPacket: START");
 
-    int err = duckRadio.readReceivedData(&data);
-    if (err != DUCK_ERR_NONE) {
-        logerr("ERROR failed to get data from DuckRadio. rc = "+ String(err));
+    // the frame was read once into its receive queue slot and is relayed from there
+    DuckRxFrame* frame = duckRadio.getReceivedFrame();
+    if (frame == NULL) {
         return;
     }
-    logdbg("Got data from radio, prepare for relay. size: "+ String(data.size()));
+    DuckPacket* rxPacket = &frame->packet;
+    int err = DUCK_ERR_NONE;
+    logdbg_f("Got data from radio, prepare for relay. size: %d rssi: %d snr: %d\n",
+             rxPacket->getBufferLength(), (int) frame->rssi, (int) frame->snr);
 
-    relay = rxPacket->prepareForRelaying(&filter, data);
+    updateNeighbors(*frame);
+    updateRoutes(*frame);
+
+    relay = rxPacket->prepareForRelaying(&filter);
+    if (!relay && rxPacket->getView().isValid()) {
+        // an overheard copy of a packet we may still be waiting to relay
+        relayScheduler.onDuplicate(rxPacket->getView().getMuid());
+    }
+    if (ackAggregator.isEnabled() && rxPacket->getView().isValid()) {
+        // copies too: a retransmission means the sender did not get the ack
+        queueAck(rxPacket->getView());
+    }
     if (relay) {
         //TODO: this callback is causing an issue, needs to be fixed for mamaduck to get packet data
         //recvDataCallback(rxPacket->getBuffer());
@@ -63,54 +155,173 @@ void MamaDuck::handleReceivedPacket() {
         // packet being sent below will never be received, especially if the cluster is small
         // there are not many alternative paths to reach other mama ducks that could relay the packet.
         if (rxPacket->getTopic() == reservedTopic::ping) {
-            err = sendPong();
-            if (err != DUCK_ERR_NONE) {
-                logerr("ERROR failed to send pong message. rc = " + String(err));
+            // with the adaptive data rate, link beacons carry a report and
+            // are not answered
+            if (!adr.isEnabled() || rxPacket->getView().getDataLength() <= 1) {
+                err = sendPong(rxPacket->getView(), frame->snr);
+                if (err != DUCK_ERR_NONE) {
+                    logerr_f("ERROR failed to send pong message. rc = %d\n", err);
+                }
             }
             return;
         }
 
         if (rxPacket->getTopic() == reservedTopic::ack) {
-            CdpPacket packet = CdpPacket(rxPacket->getBuffer());
-            handleAck(packet);
+            handleAck(rxPacket->getView());
+        }
+
+        // the hop count was already incremented for this relay
+        byte hops = rxPacket->getView().getHopCount();
+        if (hops > getTopicTtl(rxPacket->getTopic())) {
+            droppedByTtl++;
+            loginfo_f("handleReceivedPacket: hop limit reached (%d), no relay\n", hops);
+            return;
+        }
+
+        if (routing && !routePacket(rxPacket)) {
+            return;
+        }
+        recordRoute(rxPacket);
+
+        if (relayScheduler.isEnabled() && relayScheduler.schedule(*rxPacket)) {
+            loginfo("handleReceivedPacket: packet RELAY SCHEDULED");
+            return;
         }
 
         err = duckRadio.relayPacket(rxPacket);
         if (err != DUCK_ERR_NONE) {
-            logerr("====> ERROR handleReceivedPacket failed to relay. rc = " + String(err));
+            logerr_f("====> ERROR handleReceivedPacket failed to relay. rc = %d\n", err);
         } else {
             loginfo("handleReceivedPacket: packet RELAY DONE");
         }
     }
 }
 
-void MamaDuck::handleAck(const CdpPacket & packet) {
-    if (duckutils::isEqual(duid, packet.dduid)
-        || duckutils::isEqual(BROADCAST_DUID, packet.dduid)
-            ) {
-        if (lastMessageMuid.size() == MUID_LENGTH) {
-            const byte numPairs = packet.data[0];
-            static const int NUM_PAIRS_LENGTH = 1;
-            static const int PAIR_LENGTH = DUID_LENGTH + MUID_LENGTH;
-            for (int i = 0; i < numPairs; i++) {
-                int pairOffset = NUM_PAIRS_LENGTH + i*PAIR_LENGTH;
-                std::vector<byte>::const_iterator duidOffset = packet.data.begin() + pairOffset;
-                std::vector<byte>::const_iterator muidOffset = packet.data.begin() + pairOffset + DUID_LENGTH;
-                if (std::equal(duid.begin(), duid.end(), duidOffset)
-                    && std::equal(lastMessageMuid.begin(), lastMessageMuid.end(), muidOffset)
-                        ) {
-                    loginfo("handleReceivedPacket: matched ack-MUID "
-                            + duckutils::toString(lastMessageMuid));
-                    lastMessageAck = true;
-                    break;
-                }
-            }
+void MamaDuck::queueAck(const CdpPacketView & packet) {
+    if (packet.getTopic() < reservedTopic::max_reserved) {
+        return;
+    }
+    const byte* dduid = packet.getDduid();
+    if (!std::equal(ZERO_DUID.begin(), ZERO_DUID.end(), dduid)
+        && !std::equal(duid.begin(), duid.end(), dduid)) {
+        return;
+    }
+    if (std::equal(duid.begin(), duid.end(), packet.getSduid())) {
+        return;
+    }
+    ackAggregator.add(packet.getSduid(), packet.getMuid(), millis());
+}
+
+void MamaDuck::sendDueAcks() {
+    if (!ackAggregator.isDue(millis())) {
+        return;
+    }
+    byte data[DUCK_ACK_MAX_DATA_LENGTH];
+    int length = ackAggregator.build(data);
+    int err = txPacket->prepareForSending(&filter, BROADCAST_DUID.data(), this->getType(),
+                                          reservedTopic::ack, data, length);
+    if (err == DUCK_ERR_NONE) {
+        err = duckRadio.sendData(txPacket->getBuffer(), txPacket->getBufferLength());
+    }
+    if (err != DUCK_ERR_NONE) {
+        // the batch is kept and sent on a later run()
+        logdbg_f("sendDueAcks: ack deferred. rc = %d\n", err);
+        txPacket->reset();
+        return;
+    }
+    // our own ack is not relayed back to us
+    filter.dedup_add(txPacket->getView().getSduid(), txPacket->getView().getMuid());
+    ackAggregator.sent(millis());
+    loginfo_f("sendDueAcks: acked %d messages\n", (int) data[0]);
+    txPacket->reset();
+}
+
+bool MamaDuck::routePacket(DuckPacket* packet) {
+    const byte* dduid = packet->getView().getDduid();
+    if (!isUnicast(dduid)) {
+        return true;
+    }
+    if (std::equal(duid.begin(), duid.end(), dduid)) {
+        // it arrived
+        return false;
+    }
+    int length = 0;
+    byte* previous = packet->findExtension(EXT_DISTANCE, &length);
+    byte distance = routes.getDistance(dduid, millis());
+    if (previous != NULL && length == 1 && *previous != EXT_DISTANCE_UNKNOWN) {
+        // the frame is on its way: only the ducks closer to the destination take it
+        if (distance >= *previous) {
+            routingStats.dropped++;
+            loginfo_f("routePacket: not on the way (%d >= %d), no relay\n", distance, *previous);
+            return false;
         }
+        routingStats.routed++;
+    } else {
+        routingStats.flooded++;
+    }
+    if (previous != NULL && length == 1) {
+        *previous = distance;
+    } else if (!packet->getView().hasExtensions()) {
+        // from a duck without extensions: the ducks after us may not read
+        // them either, a trailer would break the data CRC they check
+        logdbg("routePacket: frame without extensions, relayed as is");
+    } else if (packet->addExtension(EXT_DISTANCE, &distance, 1) != DUCK_ERR_NONE) {
+        // no room left, the frame keeps being flooded
+        logdbg("routePacket: no room for the distance");
+    }
+    return true;
+}
+
+void MamaDuck::recordRoute(DuckPacket* packet) {
+    int length = 0;
+    if (packet->findExtension(EXT_ROUTE, &length) == NULL) {
+        return;
+    }
+    uint16_t shortId = DuckPacket::getShortId(duid.data());
+    byte id[SHORT_ID_LENGTH] = {(byte) (shortId >> 8), (byte) (shortId & 0xFF)};
+    if (packet->appendToExtension(EXT_ROUTE, id, SHORT_ID_LENGTH) != DUCK_ERR_NONE) {
+        // the record stays shorter than the hop count
+        logdbg("recordRoute: no room left in the frame");
+    }
+}
 
-        // TODO[Rory Olsen: 2021-06-23]: The application may need to know about
-        //   acks. I recommend a callback specifically for acks, or
-        //   similar.
+void MamaDuck::handleAck(const CdpPacketView & packet) {
+    if (!std::equal(duid.begin(), duid.end(), packet.getDduid())
+        && !std::equal(BROADCAST_DUID.begin(), BROADCAST_DUID.end(), packet.getDduid())) {
+        return;
+    }
+    if (inflight.pending() == 0) {
+        return;
+    }
+    static const int NUM_PAIRS_LENGTH = 1;
+    static const int PAIR_LENGTH = DUID_LENGTH + MUID_LENGTH;
+    const byte* data = packet.getData();
+    int length = packet.getDataLength();
+    if (length < NUM_PAIRS_LENGTH) {
+        return;
     }
+    int numPairs = std::min((int) data[0], (length - NUM_PAIRS_LENGTH) / PAIR_LENGTH);
+    unsigned long now = millis();
+    // one pass over the pairs, an ack may carry several of our messages
+    for (int i = 0; i < numPairs; i++) {
+        const byte* pair = data + NUM_PAIRS_LENGTH + i * PAIR_LENGTH;
+        if (!std::equal(duid.begin(), duid.end(), pair)) {
+            continue;
+        }
+        const DuckInflight* message = inflight.ack(pair + DUID_LENGTH, now);
+        if (message != NULL) {
+            loginfo("handleReceivedPacket: matched ack-MUID "
+                    + duckutils::convertToHex((byte*) message->muid, MUID_LENGTH));
+            if (message->reliable && deliveryDone != NULL) {
+                deliveryDone(std::vector<byte>(message->muid, message->muid + MUID_LENGTH),
+                             muidStatus::acked);
+            }
+        }
+    }
+
+    // TODO[Rory Olsen: 2021-06-23]: The application may need to know about
+    //   acks. I recommend a callback specifically for acks, or
+    //   similar.
 }
 
 bool MamaDuck::getDetectState() { return duckutils::getDetectState(); }
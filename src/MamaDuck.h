@@ -10,6 +10,8 @@
 
 #include "include/AgnoDuck.h"
 #include "include/cdpcfg.h"
+#include "include/DuckAckAggregator.h"
+#include "include/DuckRelayScheduler.h"
 #include "include/DuckUtils.h"
 
 class MamaDuck : public AgnoDuck {
@@ -66,10 +68,151 @@ public:
      *
      * @param packet The a broadcast ack, which has topic type reservedTopic::ack
      */
-    void handleAck(const CdpPacket & packet);
+    void handleAck(const CdpPacketView & packet);
+
+    /**
+     * @brief Configure counter-based relay suppression.
+     *
+     * New packets are relayed after a random assessment delay of up to
+     * `window` ms, and the relay is cancelled if `count` copies of the packet
+     * (including the first one) are heard before then. In dense clusters this
+     * avoids every mama relaying every packet.
+     *
+     * @param count copies after which a relay is cancelled, 0 relays immediately
+     * (default: CDPCFG_RELAY_SUPPRESSION_COUNT)
+     * @param window assessment delay upper bound in ms
+     * (default: CDPCFG_RELAY_ASSESSMENT_DELAY_MS)
+     */
+    void setRelaySuppression(uint8_t count, uint16_t window = CDPCFG_RELAY_ASSESSMENT_DELAY_MS);
+
+    /**
+     * @brief Get the relay suppression counters.
+     *
+     * @returns the relay counters
+     */
+    DuckRelayStats getRelayStats() { return relayScheduler.getStats(); }
+
+    /**
+     * @brief Ack the messages received, for a mama acting as the gateway.
+     *
+     * The messages addressed to the gateway (ZERO_DUID) or to this duck are
+     * acked with broadcast acks of up to `size` DUID/MUID pairs. A batch is
+     * sent once full, or when its oldest message waited `deadline` ms. The
+     * copies of a message are acked once, unless a copy arrives more than
+     * CDPCFG_ACK_REPEAT_MS later: the sender did not get the ack.
+     *
+     * @param size messages acked per broadcast ack, at most MAX_MUID_PER_ACK,
+     * 0 disables acks (default: CDPCFG_ACK_BATCH_SIZE)
+     * @param deadline longest time a message waits for its ack in ms
+     * (default: CDPCFG_ACK_DEADLINE_MS)
+     */
+    void setAckAggregation(uint8_t size, uint16_t deadline = CDPCFG_ACK_DEADLINE_MS);
+
+    /**
+     * @brief Get the ack aggregation counters.
+     *
+     * @returns the ack counters
+     */
+    DuckAckStats getAckStats() { return ackAggregator.getStats(); }
+
+    /**
+     * @brief Limit how far packets of a topic travel in the mesh.
+     *
+     * A packet is not relayed once its hop count would exceed the topic TTL,
+     * e.g setTopicTtl(topics::health, 2) keeps health reports within 2 relays
+     * of their origin. Topics without a TTL are relayed up to MAX_HOPS times.
+     *
+     * @param topic the packet topic
+     * @param ttl maximum number of relays, at most MAX_HOPS
+     * @returns DUCK_ERR_NONE if successful, DUCKPACKET_ERR_MAX_HOPS if ttl is
+     * larger than MAX_HOPS, DUCKPACKET_ERR_TOPIC_INVALID if the TTL table is full.
+     */
+    int setTopicTtl(byte topic, byte ttl);
+
+    /**
+     * @brief Get the maximum number of relays of a topic.
+     *
+     * @param topic the packet topic
+     * @returns the topic TTL, MAX_HOPS if none was set
+     */
+    byte getTopicTtl(byte topic);
+
+    /**
+     * @brief Get the number of packets not relayed because of their hop limit.
+     *
+     * @returns the dropped by TTL count
+     */
+    unsigned long getDroppedByTtl() { return droppedByTtl; }
+
+    /**
+     * @brief Get the directed forwarding counters.
+     *
+     * @returns the directed forwarding counters
+     */
+    DuckRoutingStats getRoutingStats() { return routingStats; }
+
+protected:
+    /**
+     * @brief Queue the frame the radio received, if any, and handle the
+     * other radio events.
+     *
+     * run() calls it between the frames it handles. A subclass doing lengthy
+     * work in handleReceivedPacket() can call it too, so that the frames
+     * received meanwhile wait in the receive queue instead of being
+     * overwritten in the radio.
+     */
+    void serviceRadio() { duckRadio.serviceInterruptFlags(); }
 
 private :
+    /**
+     * @brief Send the scheduled relays whose assessment delay has expired.
+     *
+     */
+    void relayDuePackets();
+
+    /**
+     * @brief Add a received message to the ack batch if it is to be acked.
+     *
+     * @param packet the message, new or a copy
+     */
+    void queueAck(const CdpPacketView & packet);
+
+    /**
+     * @brief Send the ack batch if it is full or reached its deadline.
+     *
+     */
+    void sendDueAcks();
+
+    /**
+     * @brief Decide if a frame addressed to a single duck is relayed, and
+     * put our distance to its destination in it.
+     *
+     * @param packet the frame, prepared for relaying
+     * @returns true if the frame must be relayed
+     */
+    bool routePacket(DuckPacket* packet);
+
+    /**
+     * @brief Append our short ID to the route record of a frame, if its
+     * origin asked for one.
+     *
+     * @param packet the frame, prepared for relaying
+     */
+    void recordRoute(DuckPacket* packet);
+
     rxDoneCallback recvDataCallback;
+    DuckRelayScheduler relayScheduler;
+    DuckAckAggregator ackAggregator;
+
+    typedef struct {
+        byte topic;
+        byte ttl;
+    } TopicTtl;
+
+    TopicTtl topicTtls[CDPCFG_TOPIC_TTL_SIZE];
+    int numTopicTtls = 0;
+    unsigned long droppedByTtl = 0;
+    DuckRoutingStats routingStats = {0, 0, 0};
 };
 
 #endif //CLUSTERDUCK_PROTOCOL_MAMADUCK_H
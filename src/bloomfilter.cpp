@@ -1,18 +1,40 @@
+#define CDP_LOG_MODULE CDP_LOG_UTILS
+
 #include "include/bloomfilter.h"
 #include "DuckLogger.h"
+#include "include/DuckCheckpoint.h"
+
+namespace {
+  // version of the state saved by dedup_save()
+  const uint32_t STATE_VERSION = 1;
+}
 
 
 BloomFilter::BloomFilter(int numSectors, int numHashes, int bitsPerSector, int maxMsgs) {
     logdbg(numSectors);
-    this->numSectors = numSectors; 
-    logdbg("added to BF");
+    this->numSectors = numSectors;
     this->numHashes = numHashes;
-    logdbg("added to BF");
     this->bitsPerSector = bitsPerSector;
-    logdbg("added to BF");
     this->activeFilter = 1;
     this->maxMsgs = maxMsgs;
     this->nMsg = 0;
+    this->setBits1 = 0;
+    this->setBits2 = 0;
+    this->maxSetBits = 0;
+    this->rotations = 0;
+    this->lastGenerationMessages = 0;
+    this->adds = 0;
+    memset(&this->loaded, 0, sizeof(this->loaded));
+
+    this->sectorShift = 0;
+    while ((1 << (this->sectorShift + 1)) <= bitsPerSector && this->sectorShift < 5) {
+        this->sectorShift++;
+    }
+    if ((1 << this->sectorShift) != bitsPerSector) {
+        logerr_f("bitsPerSector must be a power of 2 up to 32, using %d\n", 1 << this->sectorShift);
+        this->bitsPerSector = 1 << this->sectorShift;
+    }
+    this->totalBits = (uint32_t) this->numSectors << this->sectorShift;
 
     logdbg("initialize bloom filter 1");
     // Initialize the bloom filters, fill with 0's
@@ -26,7 +48,7 @@ BloomFilter::BloomFilter(int numSectors, int numHashes, int bitsPerSector, int m
         this->filter1[n] = 0;
     }
     logdbg_f("Initialized BF1, %d slots, %d this->numSectors\n", numSectors, this->numSectors);
-    
+
     logdbg("initialize bloom filter 2");
     this->filter2 = new unsigned int[this->numSectors];
     logdbg_f("Filter 2 address %p\n", this->filter2);
@@ -39,175 +61,199 @@ BloomFilter::BloomFilter(int numSectors, int numHashes, int bitsPerSector, int m
     }
     logdbg_f("Initialized BF2, %d slots, %d this->numSectors\n", numSectors, this->numSectors);
 
-    logdbg("initialize random seeds");
-    //get random seeds for hash functions 
-    int* Seeds = new int[numHashes];
-    if (Seeds == NULL) {
-        logdbg("Memory allocation for seeds failed!\n");
-        exit(0);
-    }
+    logdbg("initialize random seed");
+    // A random seed so that two ducks do not have the same false positives.
     // for some reason on the apollo3 time does not give a very good random number generator
     // so you need to make sure to call it somewhere else with some good randomness
     // like a number made from reading the last byte of reading an unconnected analog in pin multiple times
 //    srand(time(NULL));
-
-    int i;
-    for (i = 0; i < numHashes; i++){
-        int r = rand();
-        if(r == 0){
-            logwarn("rand seems to be uninitialized, make sure you call srand");
-        }
-        // Ensure we have no repeat seeds
-        int seedCollision = 1;
-        while (seedCollision == 1) {
-            seedCollision = 0;
-            for (int i = 0; i < numHashes; i++){
-                if (Seeds[i] == r) {
-                    seedCollision = 1;
-                }
-            }
-            if (seedCollision == 1){
-                r = rand();
-            }
-        }
-        Seeds[i] = r;
+    int r1 = rand();
+    int r2 = rand();
+    if (r1 == 0 && r2 == 0) {
+        logwarn("rand seems to be uninitialized, make sure you call srand");
     }
-    for (i = 0; i < numHashes; i++){
-        logdbg_f("random seed %d: %d\n", i+1, Seeds[i]);
-    }
-    this->Seeds = Seeds;
+    this->seed = ((uint64_t) (unsigned int) r1 << 32) | (unsigned int) r2;
+    logdbg_f("random seed: %d %d\n", r1, r2);
 
     logdbg("bloom_init end");
 }
 
 BloomFilter::~BloomFilter()
 {
-    delete this->Seeds;
-    delete this->filter2;
-    delete this->filter1;
+    delete[] this->filter2;
+    delete[] this->filter1;
 }
 
-void BloomFilter::set_hash_results(unsigned char* msg, int msgSize,
-    std::unique_ptr<unsigned int[]> & hashResults
-) {
-    for (int i = 0; i < this->numHashes; i++){
-        unsigned int hashResult = djb2Hash(msg, this->Seeds[i], msgSize);
-        unsigned int totalBitSize = this->numSectors * this->bitsPerSector;
-        hashResult = hashResult % totalBitSize;
-
-        int hashCollision;
-        do { 
-            hashCollision = 0; 
-            for (int j = 0; j < i; j++){
-                if (hashResult == hashResults[j]) {
-                    hashCollision = 1;
-                } 
-            }
-            if (hashCollision == 1) {
-                hashResult = (hashResult + 1) % totalBitSize;
-            }
-        } while(hashCollision == 1);
-
-        hashResults[i] = hashResult;
+uint64_t BloomFilter::hash64(const unsigned char* msg, int msgSize, uint64_t seed) {
+    uint64_t hash = 0xcbf29ce484222325ULL ^ seed;
+    for (int i = 0; i < msgSize; i++) {
+        hash = (hash ^ msg[i]) * 0x100000001b3ULL;
     }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
 }
 
-int BloomFilter::bloom_check(unsigned char* msg, int msgSize) {
-
-    std::unique_ptr<unsigned int[]> hashResults(new unsigned int[this->numHashes]); 
-    set_hash_results(msg, msgSize, hashResults);
+int BloomFilter::is_collision(const unsigned int* filter, uint32_t h1, uint32_t h2) const {
+    for (int i = 0; i < this->numHashes; i++) {
+        uint32_t bit = bit_index(h1, h2, i);
+        if ((filter[bit >> this->sectorShift] & (1u << (bit & (this->bitsPerSector - 1)))) == 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
 
-    std::unique_ptr<int[]> sectors(new int[this->numHashes]);
-    std::unique_ptr<unsigned int[]> slots(new unsigned int[this->numHashes]);
-    set_sectors_and_slots(hashResults, sectors, slots);
+int BloomFilter::bloom_check(const unsigned char* msg, int msgSize) const {
+    uint64_t hash = hash64(msg, msgSize, this->seed);
+    uint32_t h1 = (uint32_t) hash;
+    // odd, so the k indices never collapse onto the same bit
+    uint32_t h2 = (uint32_t) (hash >> 32) | 1;
 
-    if (is_collision(filter1, sectors, slots)) {
+    if (is_collision(filter1, h1, h2)) {
         return 1;
     }
-    if (is_collision(filter2, sectors, slots)) {
+    if (is_collision(filter2, h1, h2)) {
         return 1;
     }
     return 0;
 }
 
-int BloomFilter::is_collision(const unsigned int* filter,
-    const std::unique_ptr<int[]> & sectors,
-    const std::unique_ptr<unsigned int[]> & slots
-) {
+void BloomFilter::bloom_add(const unsigned char* msg, int msgSize) {
+
+    this->nMsg += 1;
+    this->adds++;
+
+    uint64_t hash = hash64(msg, msgSize, this->seed);
+    uint32_t h1 = (uint32_t) hash;
+    uint32_t h2 = (uint32_t) (hash >> 32) | 1;
+
+    unsigned int* filter = this->activeFilter == 1 ? this->filter1 : this->filter2;
+    uint32_t & setBits = this->activeFilter == 1 ? this->setBits1 : this->setBits2;
     for (int i = 0; i < this->numHashes; i++) {
-        if ((filter[sectors[i]] & slots[i]) == 0) { //
-            return 0;
+        uint32_t bit = bit_index(h1, h2, i);
+        unsigned int mask = 1u << (bit & (this->bitsPerSector - 1));
+        unsigned int & sector = filter[bit >> this->sectorShift];
+        if ((sector & mask) == 0) {
+            sector |= mask;
+            setBits++;
         }
     }
-    return 1;
-}
-
-void BloomFilter::set_sectors_and_slots(const std::unique_ptr<unsigned int[]> & hashResults,
-    std::unique_ptr<int[]> & sectors, std::unique_ptr<unsigned int[]> & slots
-) {
-    for (int i = 0; i < this->numHashes; i++) {
-        sectors[i] = hashResults[i] / this->bitsPerSector;
-        int offset = hashResults[i] % this->bitsPerSector; 
 
-        unsigned int x = pow(2,(this->bitsPerSector)-1); 
-        slots[i] = x >> offset;
+    if ((this->maxMsgs > 0 && this->nMsg >= this->maxMsgs)
+        || (this->maxSetBits > 0 && setBits >= this->maxSetBits)) {
+        rotate();
     }
-}
 
-void BloomFilter::bloom_add(unsigned char* msg, int msgSize) {
+}
 
-    this->nMsg += 1;
+void BloomFilter::rotate() {
+    if (this->activeFilter == 1) {
+        logdbg("Freezing filter 1, switching to filter 2\n");
+        memset(this->filter2, 0, this->numSectors * sizeof(unsigned int));
+        this->setBits2 = 0;
+        this->activeFilter = 2;
+    } else {
+        logdbg("Freezing filter 2, switching to filter 1\n");
+        memset(this->filter1, 0, this->numSectors * sizeof(unsigned int));
+        this->setBits1 = 0;
+        this->activeFilter = 1;
+    }
+    this->lastGenerationMessages = this->nMsg;
+    this->nMsg = 0;
+    this->rotations++;
+}
 
-    std::unique_ptr<unsigned int[]> hashResults(new unsigned int[this->numHashes]);
-    set_hash_results(msg, msgSize, hashResults);
-
-    std::unique_ptr<int[]> sectors(new int[this->numHashes]);
-    std::unique_ptr<unsigned int[]> slots(new unsigned int[this->numHashes]);
-    set_sectors_and_slots(hashResults, sectors, slots);
-
-    for (int i = 0; i < this->numHashes; i++){
-      if (this->activeFilter == 1) {
-         this->filter1[sectors[i]] = this->filter1[sectors[i]] | slots[i];
-      }
-      else{
-         this->filter2[sectors[i]] = this->filter2[sectors[i]] | slots[i];
-      }
-    }
-      
-    if (this->nMsg >= this->maxMsgs) {
-        if (this->activeFilter == 1){
-            logdbg("Freezing filter 1, switching to filter 2\n");
-            for (int i = 0; i < (this->numSectors)/(this->bitsPerSector); i++) {
-                    this->filter2[i] = 0;
-            }
-            this->activeFilter = 2;
+void BloomFilter::set_max_fill_ratio(float ratio) {
+    if (ratio <= 0) {
+        this->maxSetBits = 0;
+    } else {
+        this->maxSetBits = ratio >= 1 ? this->totalBits : (uint32_t) (ratio * this->totalBits);
+        if (this->maxSetBits == 0) {
+            this->maxSetBits = 1;
         }
-        else{
-            logdbg("Freezing filter 2, switching to filter 1\n");
-            for (int i = 0; i < (this->numSectors)/(this->bitsPerSector); i++) {
-                    this->filter1[i] = 0;
-            }
-            this->activeFilter = 1;
-        }
-        this->nMsg = 0;
     }
-
 }
 
-unsigned int BloomFilter::djb2Hash(unsigned char* str, int seed, int msgSize){  // "version" of djb2Hash with seed
-    unsigned int hash = seed; 
-    int c;
+BloomFilterStats BloomFilter::bloom_stats() const {
+    BloomFilterStats stats;
+    uint32_t active = this->activeFilter == 1 ? this->setBits1 : this->setBits2;
+    uint32_t frozen = this->activeFilter == 1 ? this->setBits2 : this->setBits1;
+    stats.fillRatio = (float) active / this->totalBits;
+    stats.frozenFillRatio = (float) frozen / this->totalBits;
+    // a message is reported as seen if all of its bits are set in either filter
+    float activeFpr = powf(stats.fillRatio, this->numHashes);
+    float frozenFpr = powf(stats.frozenFillRatio, this->numHashes);
+    stats.estimatedFpr = 1 - (1 - activeFpr) * (1 - frozenFpr);
+    stats.rotations = this->rotations;
+    stats.messages = this->nMsg;
+    stats.lastGenerationMessages = this->lastGenerationMessages;
+    return stats;
+}
 
-   //TODO: test that for loop outputs the same value as while loop
-   //  while ((c = *str++))
-   //      hash = ((hash << 5) + hash) + c; // (hash * 33) + c 
+int BloomFilter::dedup_state_size() const {
+    return 2 * this->numSectors * sizeof(unsigned int) + sizeof(State);
+}
 
-   for(int i = 0; i < msgSize; i++) {
-      c = *str++;
-      hash = ((hash << 5) + hash) + c; // (hash * 33) + c
-   }
-    return hash;
+void BloomFilter::dedup_save(int offset, unsigned char* data, int length) const {
+    int filterSize = this->numSectors * sizeof(unsigned int);
+    duckcheckpoint::save(this->filter1, 0, filterSize, offset, data, length);
+    duckcheckpoint::save(this->filter2, filterSize, filterSize, offset, data, length);
+    if (offset + length > 2 * filterSize) {
+        State state;
+        memset(&state, 0, sizeof(state));
+        state.version = STATE_VERSION;
+        state.numSectors = this->numSectors;
+        state.numHashes = this->numHashes;
+        state.bitsPerSector = this->bitsPerSector;
+        state.seed = this->seed;
+        state.activeFilter = this->activeFilter;
+        state.nMsg = this->nMsg;
+        state.setBits1 = this->setBits1;
+        state.setBits2 = this->setBits2;
+        state.rotations = this->rotations;
+        state.lastGenerationMessages = this->lastGenerationMessages;
+        duckcheckpoint::save(&state, 2 * filterSize, sizeof(state), offset, data, length);
+    }
 }
 
-   
+void BloomFilter::dedup_load(int offset, const unsigned char* data, int length) {
+    if (offset == 0) {
+        memset(&this->loaded, 0, sizeof(this->loaded));
+    }
+    int filterSize = this->numSectors * sizeof(unsigned int);
+    duckcheckpoint::load(this->filter1, 0, filterSize, offset, data, length);
+    duckcheckpoint::load(this->filter2, filterSize, filterSize, offset, data, length);
+    duckcheckpoint::load(&this->loaded, 2 * filterSize, sizeof(State), offset, data, length);
+}
 
+bool BloomFilter::dedup_load_end() {
+    const State & state = this->loaded;
+    bool valid = state.version == STATE_VERSION
+                 && state.numSectors == this->numSectors
+                 && state.numHashes == this->numHashes
+                 && state.bitsPerSector == this->bitsPerSector
+                 && (state.activeFilter == 1 || state.activeFilter == 2);
+    if (!valid) {
+        logwarn("Saved bloom filter does not match, clearing it");
+        memset(this->filter1, 0, this->numSectors * sizeof(unsigned int));
+        memset(this->filter2, 0, this->numSectors * sizeof(unsigned int));
+        this->activeFilter = 1;
+        this->nMsg = 0;
+        this->setBits1 = 0;
+        this->setBits2 = 0;
+        return false;
+    }
+    // the bits were set with the hashes of the saved seed
+    this->seed = state.seed;
+    this->activeFilter = state.activeFilter;
+    this->nMsg = state.nMsg;
+    this->setBits1 = state.setBits1;
+    this->setBits2 = state.setBits2;
+    this->rotations = state.rotations;
+    this->lastGenerationMessages = state.lastGenerationMessages;
+    return true;
+}
@@ -19,10 +19,15 @@ enum muidStatus {
 };
 #include "DuckCrypto.h"
 #include "../DuckError.h"
-#include "bloomfilter.h"
+#include "DuckDedup.h"
 #include "cdpcfg.h"
+#include "DuckAdr.h"
+#include "DuckCheckpoint.h"
+#include "DuckInflightTable.h"
+#include "DuckNeighborTable.h"
 #include "DuckPacket.h"
 #include "DuckRadio.h"
+#include "DuckRouteTable.h"
 #include "DuckTypes.h"
 #include "DuckUtils.h"
 
@@ -108,6 +113,287 @@ public:
      */
     void setChannel(int channelNum, bool isEU);
 
+    /**
+     * @brief Get the radio receive queue counters.
+     *
+     * A non zero overflow count means CDPCFG_RX_QUEUE_SIZE is too small for
+     * the traffic this duck sees.
+     *
+     * @returns the receive queue counters
+     */
+    DuckRxQueueStats getRxQueueStats() { return duckRadio.getRxQueueStats(); }
+
+    /**
+     * @brief Get the radio transmit queue counters.
+     *
+     * The average queueing delay is totalDelay / sent.
+     *
+     * @returns the transmit queue counters
+     */
+    DuckTxQueueStats getTxQueueStats() { return duckRadio.getTxQueueStats(); }
+
+    /**
+     * @brief Enable or disable listen before talk (CSMA).
+     *
+     * Channel activity detection runs before every transmission, and while the
+     * channel is busy the transmission is delayed by a randomized exponential
+     * backoff. Recommended for dense clusters where relays collide.
+     *
+     * @param enable true to enable CSMA (default: CDPCFG_CSMA_ENABLED)
+     * @param backoff initial backoff window in ms
+     * @param maxBackoffs number of backoffs after which a frame is sent anyway
+     */
+    void setCsma(bool enable, uint16_t backoff = CDPCFG_CSMA_BACKOFF_MS,
+                 uint8_t maxBackoffs = CDPCFG_CSMA_MAX_BACKOFFS);
+
+    /**
+     * @brief Get the listen before talk counters.
+     *
+     * @returns the CSMA counters
+     */
+    DuckCsmaStats getCsmaStats() { return duckRadio.getCsmaStats(); }
+
+    /**
+     * @brief Limit the share of time the radio transmits.
+     *
+     * The time on air of the transmitted frames is summed over a sliding
+     * window. When a frame does not fit in what is left, status and health
+     * reports are dropped and other frames wait in the transmit queue until
+     * the window slides. Status and health reports are also dropped once less
+     * than CDPCFG_DUTY_CYCLE_RESERVE_PERCENT of the budget is left, to keep
+     * room for acks and alerts. setChannel() with isEU applies the 1% EU limit
+     * when no limit was set.
+     *
+     * @param permille share of the window the radio may transmit, 0 is unlimited
+     * (default: CDPCFG_DUTY_CYCLE_PERMILLE)
+     * @param window sliding window length in ms
+     */
+    void setDutyCycle(uint16_t permille, unsigned long window = CDPCFG_DUTY_CYCLE_WINDOW_MS) {
+        duckRadio.setDutyCycle(permille, window);
+    }
+
+    /**
+     * @brief Reject frames that stay on air longer than the given time, e.g.
+     * 400ms in the US 915MHz band.
+     *
+     * @param maxDwell maximum time on air in ms, 0 is unlimited
+     */
+    void setMaxDwell(uint16_t maxDwell) { duckRadio.setMaxDwell(maxDwell); }
+
+    /**
+     * @brief Get the time on air left in the duty cycle window.
+     *
+     * Sensors can use it to lower their reporting rate before their reports
+     * get dropped.
+     *
+     * @returns the time on air left in ms, ULONG_MAX when the duty cycle is not
+     * limited
+     */
+    unsigned long getDutyCycleRemaining() { return duckRadio.getDutyCycleRemaining(); }
+
+    /**
+     * @brief Get the duty cycle counters.
+     *
+     * @returns the duty cycle counters
+     */
+    DuckDutyCycleStats getDutyCycleStats() { return duckRadio.getDutyCycleStats(); }
+
+    /**
+     * @brief Get the time on air of a frame with the current radio settings.
+     *
+     * @param length frame length in bytes, CDP header included
+     * @returns the time on air in ms, rounded up
+     */
+    unsigned long getTimeOnAir(int length) { return duckRadio.getTimeOnAir(length); }
+
+    /**
+     * @brief Get the number of ducks heard directly.
+     *
+     * @returns the number of neighbors in the table, alive or not
+     */
+    int getNeighborCount() { return neighbors.size(); }
+
+    /**
+     * @brief Get a neighbor, for iterating over the neighbor table.
+     *
+     * The entry is only valid until the duck runs again.
+     *
+     * @param index the neighbor position, 0 to getNeighborCount() - 1
+     * @returns the neighbor, or NULL if the index is out of range
+     */
+    const DuckNeighbor* getNeighbor(int index) { return neighbors.get(index); }
+
+    /**
+     * @brief Find a neighbor by DUID.
+     *
+     * The entry is only valid until the duck runs again.
+     *
+     * @param duid the neighbor DUID
+     * @returns the neighbor, or NULL if it was not heard directly
+     */
+    const DuckNeighbor* findNeighbor(const std::vector<byte> & duid);
+
+    /**
+     * @brief Check that a neighbor was heard recently, e.g. to detect a dead
+     * mama without pinging it.
+     *
+     * @param neighbor the neighbor
+     * @returns true if the neighbor was heard within the neighbor timeout
+     */
+    bool isNeighborAlive(const DuckNeighbor & neighbor) { return neighbors.isAlive(neighbor, millis()); }
+
+    /**
+     * @brief Set the time after which a silent neighbor is considered gone.
+     *
+     * @param timeout the timeout in ms (default: CDPCFG_NEIGHBOR_TIMEOUT_MS)
+     */
+    void setNeighborTimeout(unsigned long timeout) { neighbors.setTimeout(timeout); }
+
+    /**
+     * @brief Enable or disable the adaptive data rate.
+     *
+     * The duck beacons its link quality every `interval` ms and the cluster
+     * moves to the lowest spreading factor, between CDPCFG_ADR_MIN_SF and
+     * CDPCFG_ADR_MAX_SF, that keeps CDPCFG_ADR_MARGIN_DB of SNR margin on every
+     * link. Every duck of the cluster must enable it: a duck without it keeps
+     * the cluster from going below its spreading factor, but is left behind
+     * when the cluster goes above it.
+     *
+     * @param enable true to enable (default: CDPCFG_ADR_ENABLED)
+     * @param interval link beacon interval in ms
+     */
+    void setAdaptiveDataRate(bool enable, unsigned long interval = CDPCFG_ADR_INTERVAL_MS);
+
+    /**
+     * @brief Get the adaptive data rate counters.
+     *
+     * @returns the adaptive data rate counters
+     */
+    DuckAdrStats getAdrStats() { return adr.getStats(); }
+
+    /**
+     * @brief Get the spreading factor the radio uses.
+     *
+     * @returns the spreading factor
+     */
+    uint8_t getSpreadingFactor() { return duckRadio.getSpreadingFactor(); }
+
+    /**
+     * @brief Get the counters of the filter of the messages already seen.
+     *
+     * @returns the bloom filter counters, or the message cache counters with
+     * CDPCFG_DEDUP_MUID_CACHE
+     */
+    DuckDedupStats getFilterStats() { return filter.dedup_stats(); }
+
+#ifdef CDPCFG_DEDUP_MUID_CACHE
+    /**
+     * @brief Set the time a message is remembered by the message cache.
+     *
+     * @param seconds the window in s (default: CDPCFG_DEDUP_WINDOW_S)
+     */
+    void setFilterWindow(uint16_t seconds) { filter.setWindow(seconds); }
+#else
+    /**
+     * @brief Also start a new generation of the filter of the messages already
+     * seen once it is filled up to a ratio, bounding its false positive rate
+     * (about ratio^2) when the cluster is busy.
+     *
+     * @param ratio share of the bits set, 0 to only rotate every MAX_MESSAGES messages
+     */
+    void setFilterMaxFillRatio(float ratio) { filter.set_max_fill_ratio(ratio); }
+#endif
+
+    /**
+     * @brief Enable or disable directed forwarding.
+     *
+     * The duck learns its distance to the ducks it hears from the hop count
+     * of their frames. Frames addressed to a duck then carry the distance of
+     * their transmitter to it, and a mama only relays them when it is closer.
+     * Frames to a duck nobody has a route to, and broadcast frames, are
+     * flooded as before.
+     *
+     * The distance is carried in an extension trailer, outside the data CRC.
+     * Ducks running firmware without extension support count the trailer in
+     * the data CRC and drop the frames carrying it, so every duck of the
+     * cluster must run firmware with extensions, and enable routing for
+     * the frames to be routed. Frames that arrive without a trailer,
+     * e.g from older ducks, are relayed unchanged and flooded.
+     *
+     * @param enable true to enable (default: CDPCFG_ROUTING_ENABLED)
+     */
+    void setRouting(bool enable) { routing = enable; }
+
+    bool isRouting() { return routing; }
+
+    /**
+     * @brief Get the distance to a duck.
+     *
+     * @param duid the duck DUID
+     * @returns the number of transmissions needed to reach it, or
+     * EXT_DISTANCE_UNKNOWN if there is no route
+     */
+    byte getRouteDistance(const std::vector<byte> & duid);
+
+    /**
+     * @brief Set the time after which a route that was not heard again is forgotten.
+     *
+     * @param timeout the timeout in ms (default: CDPCFG_ROUTE_TIMEOUT_MS)
+     */
+    void setRouteTimeout(unsigned long timeout) { routes.setTimeout(timeout); }
+
+    /**
+     * @brief Ask the relays to record the route of the frames this duck sends.
+     *
+     * Each relay appends its short ID (DuckPacket::getShortId()) to the
+     * frame, SHORT_ID_LENGTH bytes per hop, as long as there is room left. A
+     * message too large for the record is sent without it.
+     * The receiver reads the route with CdpPacketView::getRoute() or
+     * CdpPacket::path.
+     *
+     * @param enable true to enable (default: CDPCFG_ROUTE_RECORD)
+     */
+    void setRouteRecord(bool enable) { routeRecord = enable; }
+
+    /**
+     * @brief Save the messages already seen across reboots.
+     *
+     * A duck that reboots forgets the messages it already relayed, and relays
+     * them again when its neighbors repeat them. With a storage, the filter of
+     * the messages already seen is checkpointed when it changed, at most every
+     * CDPCFG_CHECKPOINT_INTERVAL_MS, and restored by setupWithDefaults(). A
+     * checkpoint is written by run() a chunk of CDPCFG_CHECKPOINT_CHUNK bytes
+     * at a time, the commit to flash in a call of its own. Call it before
+     * setupWithDefaults().
+     *
+     * @param storage the storage, e.g. a DuckEepromStorage, NULL to disable
+     * @returns DUCK_ERR_NONE if successful, DUCK_ERR_STORAGE if the storage
+     * cannot hold 2 checkpoints
+     */
+    int setCheckpointStorage(DuckStorage* storage);
+
+    /**
+     * @brief Set the shortest interval between two checkpoints.
+     *
+     * @param interval the interval in ms (default: CDPCFG_CHECKPOINT_INTERVAL_MS)
+     */
+    void setCheckpointInterval(unsigned long interval) { checkpointInterval = interval; }
+
+    /**
+     * @brief Restore the messages already seen from the newest checkpoint.
+     *
+     * @returns DUCK_ERR_NONE if successful, DUCK_ERR_NO_CHECKPOINT if there is
+     * no checkpoint of this filter, DUCK_ERR_STORAGE otherwise
+     */
+    int restoreCheckpoint();
+
+    /**
+     * @brief Get the checkpoint counters, including the time spent writing them.
+     *
+     * @returns the checkpoint counters
+     */
+    DuckCheckpointStats getCheckpointStats() { return checkpoint.getStats(); }
+
 
     /**
      * @brief Sends data into the mesh network.
@@ -116,10 +402,12 @@ public:
      * @param data a string representing the data
      * @param targetDevice the device UID to receive the message (default is no target device)
      * @param outgoingMuid Output parameter that returns the MUID of the sent packet. NULL is ignored.
+     * @param reliable true to send the message again until it is acked, see setReliableDelivery()
      * @return DUCK_ERR_NONE if the data was send successfully, an error code otherwise.
      */
-    int sendData(byte topic, const String data,
-                 const std::vector<byte> targetDevice = ZERO_DUID, std::vector<byte> * outgoingMuid = NULL);
+    int sendData(byte topic, const String & data,
+                 const std::vector<byte> & targetDevice = ZERO_DUID, std::vector<byte> * outgoingMuid = NULL,
+                 bool reliable = false);
 
     /**
      * @brief Sends data into the mesh network.
@@ -128,11 +416,13 @@ public:
      * @param data a vector of bytes representing the data to send
      * @param targetDevice the device UID to receive the message (default is no target device)
      * @param outgoingMuid Output parameter that returns the MUID of the sent packet. NULL is ignored.
+     * @param reliable true to send the message again until it is acked, see setReliableDelivery()
      * @return DUCK_ERR_NONE if the data was send successfully, an error code
      otherwise.
      */
-    int sendData(byte topic, std::vector<byte> bytes,
-                 const std::vector<byte> targetDevice = ZERO_DUID, std::vector<byte> * outgoingMuid = NULL);
+    int sendData(byte topic, const std::vector<byte> & bytes,
+                 const std::vector<byte> & targetDevice = ZERO_DUID, std::vector<byte> * outgoingMuid = NULL,
+                 bool reliable = false);
 
     /**
      * @brief Sends data into the mesh network.
@@ -141,11 +431,13 @@ public:
      * @param data a string representing the data to send
      * @param targetDevice the device UID to receive the message (default is no target device)
      * @param outgoingMuid Output parameter that returns the MUID of the sent packet. NULL is ignored.
+     * @param reliable true to send the message again until it is acked, see setReliableDelivery()
      * @return DUCK_ERR_NONE if the data was send successfully, an error code
      * otherwise.
      */
-    int sendData(byte topic, const std::string data,
-                 const std::vector<byte> targetDevice = ZERO_DUID, std::vector<byte> * outgoingMuid = NULL);
+    int sendData(byte topic, const std::string & data,
+                 const std::vector<byte> & targetDevice = ZERO_DUID, std::vector<byte> * outgoingMuid = NULL,
+                 bool reliable = false);
 
     /**
      * @brief Sends data into the mesh network.
@@ -155,17 +447,78 @@ public:
      * @param length the length of the byte buffer
      * @param targetDevice the device UID to receive the message (default is no target device)
      * @param outgoingMuid Output parameter that returns the MUID of the sent packet. NULL is ignored.
+     * @param reliable true to send the message again until it is acked, see setReliableDelivery()
      * @return DUCK_ERR_NONE if the data was send successfully, an error code
      * otherwise.
      */
     int sendData(byte topic, const byte* data, int length,
-                 const std::vector<byte> targetDevice = ZERO_DUID, std::vector<byte> * outgoingMuid = NULL);
+                 const std::vector<byte> & targetDevice = ZERO_DUID, std::vector<byte> * outgoingMuid = NULL,
+                 bool reliable = false);
+
+    /**
+     * @brief Configure the reliable messages, sent with sendData(..., true).
+     *
+     * A reliable message is sent again with the same MUID until a broadcast
+     * ack names it or its deadline passes: the relays that already have it
+     * drop the copy, those that missed it relay it. The delay before each
+     * retransmission doubles, up to CDPCFG_RELIABLE_MAX_BACKOFF_MS, with some
+     * jitter. Up to CDPCFG_RELIABLE_PENDING reliable messages wait for their
+     * ack at the same time. The data of a reliable message is at most
+     * EXT_MAX_FRAME_LENGTH - HEADER_LENGTH bytes, sendData() returns
+     * DUCKPACKET_ERR_SIZE_INVALID otherwise.
+     *
+     * @param deadline time after which a message is given up in ms
+     * (default: CDPCFG_RELIABLE_DEADLINE_MS)
+     * @param backoff delay before the first retransmission in ms
+     * (default: CDPCFG_RELIABLE_BACKOFF_MS)
+     */
+    void setReliableDelivery(unsigned long deadline, unsigned long backoff = CDPCFG_RELIABLE_BACKOFF_MS) {
+        reliableDeadline = deadline;
+        reliableBackoff = backoff;
+    }
+
+    using deliveryCallback = void (*)(std::vector<byte> muid, muidStatus status);
+    /**
+     * @brief Register a callback for the final status of the reliable messages.
+     *
+     * The callback is invoked with muidStatus::acked when the ack of a
+     * reliable message is received, or muidStatus::not_acked when it is
+     * given up at its deadline.
+     *
+     * @param cb a callback to handle the status of the reliable messages
+     */
+    void onDeliveryStatus(deliveryCallback cb) { this->deliveryDone = cb; }
 
     /**
      * @brief Get the status of an MUID
+     *
+     * The last CDPCFG_INFLIGHT_TABLE_SIZE messages sent are tracked, several
+     * of them can wait for their ack at the same time.
      */
     muidStatus getMuidStatus(const std::vector<byte> & muid) const;
 
+    /**
+     * @brief Get the number of messages sent that are waiting for their ack.
+     *
+     * @returns the number of messages not acked
+     */
+    int getPendingAcks() const { return inflight.pending(); }
+
+    /**
+     * @brief Get a tracked message by position, for iterating over them.
+     *
+     * @param index the message position
+     * @returns the message entry, or NULL if the index is out of range
+     */
+    const DuckInflight* getInflight(int index) const { return inflight.get(index); }
+
+    /**
+     * @brief Get the ack tracking counters.
+     *
+     * @returns the ack tracking counters
+     */
+    DuckInflightStats getInflightStats() const { return inflight.getStats(); }
+
     /**
      * @brief Get an error code description.
      *
@@ -245,21 +598,101 @@ protected:
     DuckRadio duckRadio;
 
     DuckPacket* txPacket = NULL;
-    DuckPacket* rxPacket = NULL;
-    std::vector<byte> lastMessageMuid;
 
-    bool lastMessageAck = true;
-    // Since this may be used to throttle outgoing packets, start out in a state
-    // that indicates we're not waiting for a ack
+    // messages sent, until acked or replaced
+    DuckInflightTable inflight;
+    unsigned long reliableDeadline = CDPCFG_RELIABLE_DEADLINE_MS;
+    unsigned long reliableBackoff = CDPCFG_RELIABLE_BACKOFF_MS;
+    deliveryCallback deliveryDone = NULL;
+
+    DuckDedupFilter filter;
 
-    BloomFilter filter;
+    DuckNeighborTable neighbors;
+    DuckAdr adr;
+
+    DuckRouteTable routes;
+    bool routing = CDPCFG_ROUTING_ENABLED;
+    bool routeRecord = CDPCFG_ROUTE_RECORD;
+
+    DuckCheckpoint checkpoint;
+    unsigned long checkpointInterval = CDPCFG_CHECKPOINT_INTERVAL_MS;
+    unsigned long lastCheckpoint = 0;
+    // filter additions when the last checkpoint was started
+    unsigned long checkpointAdds = 0;
+    // position of the next chunk of the checkpoint being written
+    int checkpointOffset = 0;
 
     /**
      * @brief sends a pong message
      *
+     * With the adaptive data rate enabled, the pong is addressed to the
+     * sender of the ping and carries the link report. Otherwise it is the
+     * one byte pong to ZERO_DUID older ducks expect.
+     *
+     * @param ping the ping to answer
+     * @param snr SNR of the ping in dB
      * @return DUCK_ERR_NONE if successfull. An error code otherwise
      */
-    int sendPong();
+    int sendPong(const CdpPacketView & ping, float snr);
+
+    /**
+     * @brief sends a link beacon, a ping carrying the link report of the
+     * adaptive data rate. Beacons are not answered.
+     *
+     * @return DUCK_ERR_NONE if successfull. An error code otherwise
+     */
+    int sendBeacon();
+
+    /**
+     * @brief Update the neighbor table and the adaptive data rate with a
+     * received frame.
+     *
+     * @param frame the received frame, before it is prepared for relaying
+     */
+    void updateNeighbors(const DuckRxFrame & frame);
+
+    /**
+     * @brief Update the route table with a received frame.
+     *
+     * @param frame the received frame, before it is prepared for relaying
+     */
+    void updateRoutes(const DuckRxFrame & frame);
+
+    /**
+     * @brief Check if a DDUID names a single duck, rather than every duck.
+     *
+     * @param dduid the destination DUID
+     * @returns true if the frame is addressed to a single duck
+     */
+    static bool isUnicast(const byte* dduid);
+
+    /**
+     * @brief Apply the adaptive data rate decisions and send the link beacons.
+     *
+     */
+    void serviceAdr();
+
+    /**
+     * @brief Write the next step of the checkpoint of the messages already
+     * seen: a chunk, or the commit. Starts a checkpoint when one is due.
+     *
+     */
+    void serviceCheckpoint();
+
+    /**
+     * @brief Send again the next reliable message that is due, or give it up
+     * at its deadline.
+     *
+     */
+    void serviceRetransmissions();
+
+    /**
+     * @brief Get the delay before a retransmission of a reliable message.
+     *
+     * @param retries the retransmissions already done
+     * @returns the delay in ms
+     */
+    unsigned long getRetryDelay(uint8_t retries);
 
     /**
      * @brief sends a ping message
@@ -297,6 +730,10 @@ protected:
         if (err != DUCK_ERR_NONE) {
             return err;
         }
+        if (checkpoint.hasStorage()) {
+            // not fatal, the duck then starts with an empty filter
+            restoreCheckpoint();
+        }
         return DUCK_ERR_NONE;
     }
 
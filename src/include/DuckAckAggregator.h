@@ -0,0 +1,147 @@
+/**
+ * @file DuckAckAggregator.h
+ * @brief This file is internal to CDP and batches the acks of the messages
+ * received by a gateway into broadcast acks.
+ * @version
+ * @date 2026-10-16
+ *
+ * @copyright
+ */
+
+#ifndef DUCKACKAGGREGATOR_H_
+#define DUCKACKAGGREGATOR_H_
+
+#include <Arduino.h>
+
+#include "../CdpPacket.h"
+#include "cdpcfg.h"
+
+/// Length of the data section of a broadcast ack holding MAX_MUID_PER_ACK pairs
+#define DUCK_ACK_MAX_DATA_LENGTH (1 + MAX_MUID_PER_ACK * (DUID_LENGTH + MUID_LENGTH))
+
+/**
+ * @brief A message to ack, or acked.
+ *
+ */
+typedef struct {
+    /// SDUID of the message
+    byte duid[DUID_LENGTH];
+    /// MUID of the message
+    byte muid[MUID_LENGTH];
+    /// millis() when the message was received, or when its ack was sent
+    unsigned long time;
+} DuckAckPair;
+
+/**
+ * @brief Ack aggregation counters.
+ *
+ */
+typedef struct {
+    /// messages added to a batch
+    unsigned long queued;
+    /// copies of messages already in a batch or acked a short time ago
+    unsigned long duplicates;
+    /// messages acked again, their first ack was probably lost
+    unsigned long reacked;
+    /// messages not acked because the batch was full
+    unsigned long overflows;
+    /// broadcast acks sent
+    unsigned long acks;
+    /// DUID/MUID pairs in the broadcast acks sent
+    unsigned long pairs;
+} DuckAckStats;
+
+/**
+ * @brief Batches the DUID/MUID pairs of the messages received into broadcast
+ * acks of up to MAX_MUID_PER_ACK pairs.
+ *
+ * A batch is sent once it holds the batch size pairs, or when its oldest
+ * pair waited for the deadline: one ack frame covers several messages
+ * instead of one each. The pairs sent are remembered in a small ring, so
+ * that the copies of a message relayed by several ducks are acked once. A
+ * copy received more than CDPCFG_ACK_REPEAT_MS after the ack was sent is a
+ * retransmission from a duck that did not get the ack, it is acked again.
+ *
+ */
+class DuckAckAggregator {
+public:
+    DuckAckAggregator();
+
+    /**
+     * @brief Configure the batches.
+     *
+     * @param size pairs after which a batch is sent, 1 to MAX_MUID_PER_ACK, 0
+     * disables acks
+     * @param deadline longest time a pair waits for its batch in ms
+     */
+    void setBatch(uint8_t size, uint16_t deadline);
+
+    bool isEnabled() const { return batchSize > 0; }
+
+    /**
+     * @brief Add a received message to the batch.
+     *
+     * @param duid the message SDUID
+     * @param muid the message MUID
+     * @param now current millis()
+     * @returns true if the message will be acked, false if it is a duplicate
+     * or the batch is full
+     */
+    bool add(const byte* duid, const byte* muid, unsigned long now);
+
+    /**
+     * @brief Check if the batch must be sent.
+     *
+     * @param now current millis()
+     * @returns true if the batch is full or its oldest pair reached the deadline
+     */
+    bool isDue(unsigned long now) const;
+
+    /**
+     * @brief Get the number of pairs waiting in the batch.
+     *
+     * @returns the number of pairs
+     */
+    int pending() const { return numPending; }
+
+    /**
+     * @brief Write the data section of the broadcast ack of the batch:
+     * | N | DUID | MUID | ... The batch is kept until sent() is called, so
+     * that it can be built again if the ack could not be sent.
+     *
+     * @param data buffer of at least DUCK_ACK_MAX_DATA_LENGTH bytes
+     * @returns the data length, 0 if the batch is empty
+     */
+    int build(byte* data) const;
+
+    /**
+     * @brief Record that the ack built by build() was sent, and start a new
+     * batch.
+     *
+     * @param now current millis()
+     */
+    void sent(unsigned long now);
+
+    DuckAckStats getStats() const { return stats; }
+
+    /**
+     * @brief Forget the batch and the pairs sent.
+     *
+     */
+    void clear();
+
+private:
+    static bool matches(const DuckAckPair & pair, const byte* duid, const byte* muid);
+
+    uint8_t batchSize;
+    uint16_t deadline;
+    DuckAckPair batch[MAX_MUID_PER_ACK];
+    int numPending;
+    // pairs sent, oldest overwritten first
+    DuckAckPair recent[CDPCFG_ACK_RECENT_SIZE];
+    int numRecent;
+    int nextRecent;
+    DuckAckStats stats;
+};
+
+#endif
@@ -0,0 +1,230 @@
+/**
+ * @file DuckAdr.h
+ * @brief This file is internal to CDP and provides the adaptive data rate of
+ * the cluster.
+ * @version
+ * @date 2026-10-16
+ *
+ * @copyright
+ */
+
+#ifndef DUCKADR_H_
+#define DUCKADR_H_
+
+#include <Arduino.h>
+
+#include "../CdpPacket.h"
+#include "cdpcfg.h"
+#include "DuckNeighborTable.h"
+
+/// Length of the link report carried by pings and pongs, after the legacy byte
+#define DUCK_ADR_REPORT_LENGTH 7
+/// Report SNR value of a beacon, which does not answer a ping
+#define DUCK_ADR_NO_SNR -128
+
+/**
+ * @brief Link report carried by pings and pongs.
+ *
+ * On the air, after the legacy 0 byte of the ping/pong data:
+ * | snr | sf | need | need hops | proposed sf | switch in (2 bytes, big endian) |
+ *
+ */
+typedef struct {
+    /// SNR of the answered ping in 0.25 dB steps, DUCK_ADR_NO_SNR in a beacon
+    int8_t snr;
+    /// spreading factor of the sender
+    uint8_t sf;
+    /// spreading factor the links of the cluster need, as known to the sender
+    uint8_t need;
+    /// hops from the duck whose links need it
+    uint8_t needHops;
+    /// spreading factor the cluster is about to switch to, 0 if none
+    uint8_t proposedSf;
+    /// time left before the switch in 100ms steps
+    uint16_t switchIn;
+} DuckAdrReport;
+
+/**
+ * @brief Adaptive data rate counters.
+ *
+ */
+typedef struct {
+    /// link beacons sent
+    unsigned long beacons;
+    /// spreading factor changes proposed by this duck
+    unsigned long proposals;
+    /// spreading factor changes applied
+    unsigned long switches;
+    /// lower spreading factors abandoned because a neighbor was lost
+    unsigned long rollbacks;
+} DuckAdrStats;
+
+/**
+ * @brief Cluster wide adaptive data rate.
+ *
+ * All the ducks of a cluster must use the same spreading factor to hear each
+ * other, so the spreading factor is chosen for the cluster and not per link:
+ * - the neighbor table holds the SNR of the frames the neighbors send
+ *   directly, and of our pings as reported in the pongs they send.
+ *   SNR does not depend on the spreading factor while the demodulation floor
+ *   drops 2.5dB per step, so the lowest spreading factor that closes every
+ *   link with CDPCFG_ADR_MARGIN_DB to spare is known without trying it;
+ * - link beacons (pings carrying a link report) gossip the highest spreading
+ *   factor any link needs, tagged with a hop count so stale needs die out
+ *   after MAX_HOPS beacon intervals;
+ * - a duck whose view differs from the current spreading factor proposes a
+ *   change, which floods with the beacons. Everyone switches when its
+ *   countdown expires, so the cluster changes at about the same time.
+ *   Raising wins over lowering;
+ * - after lowering, a duck that lost neighbors proposes to go back, and a
+ *   duck that lost all of them goes back on its own.
+ *
+ * Lowering needs CDPCFG_ADR_HYSTERESIS_DB more margin than staying, so the
+ * cluster does not flap around a threshold. Ducks without adaptive data rate
+ * advertise their spreading factor as a need: the cluster is never lowered
+ * below it, but it does not follow raises.
+ *
+ */
+class DuckAdr {
+public:
+    /**
+     * @brief Construct the adaptive data rate.
+     *
+     * @param neighbors the neighbor table the link qualities are taken from
+     */
+    explicit DuckAdr(DuckNeighborTable & neighbors);
+
+    /**
+     * @brief Enable or disable the adaptive data rate.
+     *
+     * @param enable true to enable
+     * @param sf the current spreading factor
+     * @param interval link beacon interval in ms
+     */
+    void setEnabled(bool enable, uint8_t sf, unsigned long interval = CDPCFG_ADR_INTERVAL_MS);
+
+    bool isEnabled() const { return enabled; }
+
+    /**
+     * @brief Set the current spreading factor, e.g. after setupRadio().
+     *
+     * @param sf the spreading factor the radio uses
+     */
+    void setSpreadingFactor(uint8_t sf) { this->sf = sf; }
+
+    /**
+     * @brief Get the spreading factor the radio should use.
+     *
+     * @returns the spreading factor
+     */
+    uint8_t getSpreadingFactor() const { return sf; }
+
+    /**
+     * @brief Handle the link report of a ping or pong a neighbor sent directly.
+     *
+     * The report is stored in the neighbor table entry of the sender, which
+     * is expected to be updated with the frame first.
+     *
+     * @param sduid the neighbor DUID
+     * @param report the link report
+     * @param forUs true if the report answers one of our pings
+     * @param now current millis()
+     * @returns true if a new proposal was adopted, a beacon is then scheduled
+     * to forward it
+     */
+    bool onReport(const byte* sduid, const DuckAdrReport & report, bool forUs, unsigned long now);
+
+    /**
+     * @brief Build the link report to send.
+     *
+     * @param snr SNR of the answered ping in dB, or NAN for a beacon
+     * @param now current millis()
+     * @returns the link report
+     */
+    DuckAdrReport getReport(float snr, unsigned long now);
+
+    /**
+     * @brief Run the periodic evaluation and the pending switch.
+     *
+     * @param now current millis()
+     * @returns true if the spreading factor changed
+     */
+    bool service(unsigned long now);
+
+    /**
+     * @brief Check if a link beacon is due.
+     *
+     * @param now current millis()
+     * @returns true if a beacon should be sent
+     */
+    bool isBeaconDue(unsigned long now) const;
+
+    /**
+     * @brief Schedule the next beacon after one was sent.
+     *
+     * @param now current millis()
+     */
+    void onBeaconSent(unsigned long now);
+
+    /**
+     * @brief Get the lowest spreading factor that closes the links of this duck.
+     *
+     * @param now current millis()
+     * @returns the spreading factor, the current one if no neighbor was heard
+     */
+    uint8_t getRequiredSf(unsigned long now) const;
+
+    /**
+     * @brief Get the highest spreading factor needed by the known links.
+     *
+     * @param now current millis()
+     * @param hops set to the distance of the duck that needs it
+     * @returns the spreading factor
+     */
+    uint8_t getClusterNeed(unsigned long now, uint8_t* hops = NULL) const;
+
+    DuckAdrStats getStats() const { return stats; }
+
+    /**
+     * @brief Demodulation floor of the SX127x.
+     *
+     * @param sf spreading factor, 6 to 12
+     * @returns the lowest SNR a frame can be received at in dB
+     */
+    static float getSnrFloor(uint8_t sf) { return -5.0f - 2.5f * (sf - 6); }
+
+    static void writeReport(const DuckAdrReport & report, byte* data);
+
+    static DuckAdrReport readReport(const byte* data);
+
+private:
+    bool isFresh(const DuckNeighbor & neighbor, unsigned long now) const;
+    void propose(uint8_t target, unsigned long now);
+    void scheduleBeacon(unsigned long now, unsigned long delay);
+    bool hasPending() const { return proposedSf != 0; }
+
+    bool enabled;
+    uint8_t sf;
+    unsigned long interval;
+    DuckNeighborTable & neighbors;
+
+    unsigned long lastEvaluation;
+    unsigned long nextBeacon;
+
+    // pending switch
+    uint8_t proposedSf;
+    unsigned long switchAt;
+
+    // confirmation of a lower spreading factor
+    uint8_t previousSf;
+    unsigned long switchedAt;
+    bool confirming;
+
+    // spreading factor advertised as a need after a rollback
+    uint8_t holdoffSf;
+    unsigned long holdoffUntil;
+
+    DuckAdrStats stats;
+};
+
+#endif
@@ -0,0 +1,38 @@
+/**
+ * @file DuckAirtime.h
+ * @brief This file is internal to CDP and provides the LoRa time on air of a
+ * frame.
+ *
+ * @version
+ * @date 2026-10-16
+ *
+ * @copyright
+ */
+
+#ifndef DUCKAIRTIME_H_
+#define DUCKAIRTIME_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace duckairtime {
+
+/**
+ * @brief Compute the time on air of a LoRa frame.
+ *
+ * Semtech AN1200.13 with an explicit header and a payload CRC, as used by
+ * CDP. Low data rate optimization is assumed when a symbol lasts more than
+ * 16ms (SF11 and SF12 at 125kHz), like RadioLib does.
+ *
+ * @param sf spreading factor, 6 to 12
+ * @param bw bandwidth in kHz
+ * @param cr coding rate denominator, 5 to 8 for 4/5 to 4/8
+ * @param preamble preamble length in symbols
+ * @param length frame length in bytes
+ * @returns the time on air in microseconds
+ */
+uint32_t getTimeOnAir(uint8_t sf, float bw, uint8_t cr, uint16_t preamble, size_t length);
+
+} // namespace duckairtime
+
+#endif
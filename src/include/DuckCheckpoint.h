@@ -0,0 +1,165 @@
+/**
+ * @file DuckCheckpoint.h
+ * @brief This file is internal to CDP and provides checkpoints
+ * of the duck state in a persistent storage.
+ * @version
+ * @date 2026-10-16
+ *
+ * @copyright
+ */
+
+#ifndef DUCKCHECKPOINT_H_
+#define DUCKCHECKPOINT_H_
+
+#include <Arduino.h>
+
+#include "cdpcfg.h"
+#include "DuckStorage.h"
+
+/// Length of the header of a checkpoint slot
+#define DUCK_CHECKPOINT_HEADER_LENGTH 12
+
+/**
+ * @brief Checkpoint counters.
+ *
+ */
+typedef struct {
+    /// checkpoints written
+    unsigned long saves;
+    /// checkpoints that could not be written
+    unsigned long failures;
+    /// sequence number of the last valid checkpoint, 0 if none
+    uint32_t sequence;
+    /// slots the storage holds
+    int slots;
+    /// storage time of the last checkpoint, all its steps (us)
+    unsigned long lastSaveTime;
+    /// longest single step: a chunk written or the commit (us)
+    unsigned long maxStepTime;
+} DuckCheckpointStats;
+
+/**
+ * @brief Checkpoints written in turn to the slots of a storage.
+ *
+ * A slot is a 12 byte header, | magic | length | sequence | CRC32 | (little
+ * endian), followed by the checkpoint. A checkpoint is written in chunks with
+ * begin(), write() and end(): the header is written last, and a checkpoint
+ * cut short by a reboot fails its CRC. The newest valid slot is the one read
+ * back, an older one if the newest is damaged. The storage must hold at
+ * least 2 slots: begin() invalidates the slot it writes, with a single slot
+ * a reboot during a checkpoint would lose the previous one. The slots do
+ * not level the wear: with DuckEepromStorage each commit stores the whole
+ * EEPROM, the wear is only bounded by CDPCFG_CHECKPOINT_INTERVAL_MS.
+ *
+ */
+class DuckCheckpoint {
+public:
+    DuckCheckpoint();
+
+    /**
+     * @brief Set the storage and find its newest valid checkpoint.
+     *
+     * @param storage the storage, NULL to stop checkpointing
+     * @param length largest checkpoint length, sets the slot size
+     * @returns DUCK_ERR_NONE if successful, DUCK_ERR_STORAGE if less than 2
+     * slots fit in the storage
+     */
+    int setStorage(DuckStorage* storage, int length);
+
+    bool hasStorage() const { return storage != NULL; }
+
+    /**
+     * @brief Get the length of the newest valid checkpoint.
+     *
+     * @returns the length in bytes, 0 if there is no valid checkpoint
+     */
+    int getLength() const { return length; }
+
+    /**
+     * @brief Read the newest valid checkpoint.
+     *
+     * @param offset position in the checkpoint
+     * @param data buffer to read into
+     * @param length number of bytes
+     * @returns DUCK_ERR_NONE if successful, DUCK_ERR_NO_CHECKPOINT if there is
+     * no valid checkpoint, DUCK_ERR_STORAGE otherwise
+     */
+    int read(int offset, byte* data, int length);
+
+    /**
+     * @brief Start a checkpoint in the slot after the newest one.
+     *
+     * @param length the checkpoint length
+     * @returns DUCK_ERR_NONE if successful, DUCK_ERR_STORAGE otherwise
+     */
+    int begin(int length);
+
+    /**
+     * @brief Write the next bytes of the checkpoint.
+     *
+     * @param data the bytes
+     * @param length number of bytes
+     * @returns DUCK_ERR_NONE if successful, DUCK_ERR_STORAGE otherwise
+     */
+    int write(const byte* data, int length);
+
+    /**
+     * @brief Write the header and commit the checkpoint.
+     *
+     * @returns DUCK_ERR_NONE if successful, DUCK_ERR_STORAGE otherwise
+     */
+    int end();
+
+    bool isWriting() const { return writeSlot >= 0; }
+
+    DuckCheckpointStats getStats() const { return stats; }
+
+private:
+    int readHeader(int slot, uint16_t* length, uint32_t* sequence, uint32_t* crc);
+    bool isValid(int slot, uint16_t length, uint32_t sequence, uint32_t crc);
+    int fail();
+    void addStepTime(unsigned long start);
+
+    DuckStorage* storage;
+    int slotSize;
+    // newest valid checkpoint
+    int slot;
+    int length;
+    // checkpoint being written, -1 if none
+    int writeSlot;
+    int writeLength;
+    int written;
+    uint32_t writeCrc;
+    DuckCheckpointStats stats;
+};
+
+namespace duckcheckpoint {
+
+/**
+ * @brief Copy the bytes of a region of a saved state that fall within
+ * [offset, offset + length) of the state, so that it can be saved in chunks.
+ *
+ * @param region the region
+ * @param start position of the region in the state
+ * @param size region size
+ * @param offset position of the chunk in the state
+ * @param data the chunk
+ * @param length chunk length
+ */
+void save(const void* region, int start, int size, int offset, byte* data, int length);
+
+/**
+ * @brief Copy the bytes of a chunk of a saved state that fall within a region.
+ *
+ * @param region the region
+ * @param start position of the region in the state
+ * @param size region size
+ * @param offset position of the chunk in the state
+ * @param data the chunk
+ * @param length chunk length
+ */
+void load(void* region, int start, int size, int offset, const byte* data, int length);
+
+} // namespace duckcheckpoint
+
+#endif
@@ -0,0 +1,45 @@
+/**
+ * @file DuckCrc.h
+ * @brief This file is internal to CDP and provides the CRC32 used to protect
+ * the packet data section.
+ *
+ * @version
+ * @date 2026-10-16
+ *
+ * @copyright
+ */
+
+#ifndef DUCKCRC_H_
+#define DUCKCRC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace duckcrc {
+
+/**
+ * @brief Compute the CRC32 (IEEE 802.3, reflected) of a buffer.
+ *
+ * Table driven, slice-by-4: four bytes are consumed per step. The result is
+ * bit-compatible with the CRC32 Arduino library previously used by CDP.
+ *
+ * @param data buffer to checksum
+ * @param length buffer length in bytes
+ * @returns the CRC32 of the buffer
+ */
+uint32_t crc32(const uint8_t* data, size_t length);
+
+/**
+ * @brief Continue a CRC32 over the next bytes of a buffer, to checksum it in
+ * pieces: crc32(b, lb, crc32(a, la)) is the CRC32 of a followed by b.
+ *
+ * @param data next bytes to checksum
+ * @param length number of bytes
+ * @param previous CRC32 of the bytes before, 0 for none
+ * @returns the CRC32 of all the bytes
+ */
+uint32_t crc32(const uint8_t* data, size_t length, uint32_t previous);
+
+} // namespace duckcrc
+
+#endif
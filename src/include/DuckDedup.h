@@ -0,0 +1,32 @@
+/**
+ * @file DuckDedup.h
+ * @brief This file is internal to CDP and selects how the messages already
+ * seen are detected.
+ * @version
+ * @date 2026-10-16
+ *
+ * @copyright
+ */
+
+#ifndef DUCKDEDUP_H_
+#define DUCKDEDUP_H_
+
+#include "cdpcfg.h"
+
+/*
+ * Both engines provide:
+ *   bool dedup_check(const byte* sduid, const byte* muid);
+ *   void dedup_add(const byte* sduid, const byte* muid);
+ *   DuckDedupStats dedup_stats() const;
+ */
+#ifdef CDPCFG_DEDUP_MUID_CACHE
+#include "DuckMuidCache.h"
+typedef DuckMuidCache DuckDedupFilter;
+typedef DuckMuidCacheStats DuckDedupStats;
+#else
+#include "bloomfilter.h"
+typedef BloomFilter DuckDedupFilter;
+typedef BloomFilterStats DuckDedupStats;
+#endif
+
+#endif
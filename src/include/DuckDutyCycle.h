@@ -0,0 +1,122 @@
+/**
+ * @file DuckDutyCycle.h
+ * @brief This file is internal to CDP and keeps track of the radio time on air
+ * against a regulatory duty cycle budget.
+ * @version
+ * @date 2026-10-16
+ *
+ * @copyright
+ */
+
+#ifndef DUCKDUTYCYCLE_H_
+#define DUCKDUTYCYCLE_H_
+
+#include <Arduino.h>
+
+#include "cdpcfg.h"
+
+/**
+ * @brief Duty cycle counters.
+ *
+ */
+typedef struct {
+    /// time on air of the transmitted frames in ms
+    unsigned long airtime;
+    /// frames held back until the budget allowed them
+    unsigned long deferred;
+    /// low priority frames dropped because the budget was exhausted
+    unsigned long dropped;
+    /// frames rejected because they exceed the maximum dwell time
+    unsigned long tooLong;
+} DuckDutyCycleStats;
+
+/**
+ * @brief Sliding window duty cycle accountant.
+ *
+ * The window is split in CDPCFG_DUTY_CYCLE_BUCKETS buckets holding the time
+ * on air of the frames started during that bucket. The window slides one
+ * bucket at a time: the budget is never overrun, and time on air is freed at
+ * most one bucket late.
+ *
+ */
+class DuckDutyCycle {
+public:
+    DuckDutyCycle();
+
+    /**
+     * @brief Set the duty cycle limit.
+     *
+     * The time on air already recorded is kept.
+     *
+     * @param permille share of the window the radio may transmit, 0 is unlimited
+     * @param window sliding window length in ms
+     */
+    void setLimit(uint16_t permille, unsigned long window = CDPCFG_DUTY_CYCLE_WINDOW_MS);
+
+    /**
+     * @brief Set the longest time on air allowed for a single frame.
+     *
+     * @param maxDwell maximum time on air in ms, 0 is unlimited
+     */
+    void setMaxDwell(uint16_t maxDwell) { this->maxDwell = maxDwell; }
+
+    bool isLimited() const { return permille > 0; }
+
+    uint16_t getLimit() const { return permille; }
+
+    /// time on air allowed per window in ms
+    unsigned long getBudget() const { return window / 1000 * permille + window % 1000 * permille / 1000; }
+
+    /**
+     * @brief Get the time on air left in the current window.
+     *
+     * @param now current millis()
+     * @returns the time on air left in ms, ULONG_MAX when unlimited
+     */
+    unsigned long getRemaining(unsigned long now);
+
+    /**
+     * @brief Check that a frame fits in the budget.
+     *
+     * @param airtime frame time on air in ms
+     * @param now current millis()
+     * @param reserve share of the budget (%) that must be left after the frame
+     * @returns true if the frame can be transmitted now
+     */
+    bool canTransmit(unsigned long airtime, unsigned long now, uint8_t reserve = 0);
+
+    /**
+     * @brief Check a frame against the maximum dwell time.
+     *
+     * @param airtime frame time on air in ms
+     * @returns true if the frame is too long to ever be transmitted
+     */
+    bool exceedsDwell(unsigned long airtime) const { return maxDwell > 0 && airtime > maxDwell; }
+
+    /**
+     * @brief Record a transmitted frame.
+     *
+     * @param airtime frame time on air in ms
+     * @param now current millis()
+     */
+    void record(unsigned long airtime, unsigned long now);
+
+    DuckDutyCycleStats & getStats() { return stats; }
+
+private:
+    void expire(unsigned long now);
+
+    uint16_t permille;
+    uint16_t maxDwell;
+    unsigned long window;
+    unsigned long bucketLength;
+    unsigned long bucketStart;
+    unsigned int current;
+    unsigned long used;
+    // one more bucket than the window: the oldest bucket is only recycled once
+    // all of it is out of the window
+    unsigned long buckets[CDPCFG_DUTY_CYCLE_BUCKETS + 1];
+    DuckDutyCycleStats stats;
+};
+
+#endif
@@ -0,0 +1,206 @@
+/**
+ * @file DuckInflightTable.h
+ * @brief This file is internal to CDP and keeps track of the messages sent
+ * by the duck until they are acked.
+ * @version
+ * @date 2026-10-16
+ *
+ * @copyright
+ */
+
+#ifndef DUCKINFLIGHTTABLE_H_
+#define DUCKINFLIGHTTABLE_H_
+
+#include <Arduino.h>
+
+#include "../CdpPacket.h"
+#include "cdpcfg.h"
+
+/**
+ * @brief A message sent by the duck.
+ *
+ */
+typedef struct {
+    /// message MUID
+    byte muid[MUID_LENGTH];
+    /// millis() when the message was first sent
+    unsigned long sentAt;
+    /// millis() when the message was last sent
+    unsigned long lastSent;
+    /// millis() when the message was acked
+    unsigned long ackedAt;
+    /// times the message was sent again
+    uint8_t retries;
+    /// true once an ack for the message was received
+    bool acked;
+    /// true when the entry holds a message
+    bool used;
+    /// true if the message is sent again until acked
+    bool reliable;
+    /// millis() after which a reliable message is given up
+    unsigned long deadline;
+    /// millis() when a reliable message is sent again
+    unsigned long nextRetry;
+    /// position of the frame kept to send the message again, -1 if none
+    int8_t frame;
+} DuckInflight;
+
+/**
+ * @brief Ack tracking counters.
+ *
+ */
+typedef struct {
+    /// messages added to the table
+    unsigned long sent;
+    /// messages acked while in the table
+    unsigned long acked;
+    /// messages forgotten before they were acked to make room
+    unsigned long evicted;
+    /// reliable messages sent again
+    unsigned long retransmissions;
+    /// reliable messages given up at their deadline
+    unsigned long expired;
+} DuckInflightStats;
+
+/**
+ * @brief Fixed size table of the messages sent, with their ack state.
+ *
+ * Several messages can wait for their ack at the same time. Acked messages
+ * are kept, so that their status can still be asked, until their entry is
+ * needed: a new message replaces the message acked the longest time ago,
+ * or when none was acked, the message sent the longest time ago.
+ *
+ * The frame of up to CDPCFG_RELIABLE_PENDING reliable messages is kept until
+ * they are acked or given up, to send them again. Their entry is not replaced
+ * before then.
+ *
+ */
+class DuckInflightTable {
+public:
+    DuckInflightTable();
+
+    /**
+     * @brief Record a message sent.
+     *
+     * @param muid the message MUID
+     * @param now current millis()
+     * @returns the message entry
+     */
+    DuckInflight* add(const byte* muid, unsigned long now);
+
+    /**
+     * @brief Record a reliable message sent, and keep its frame.
+     *
+     * @param muid the message MUID
+     * @param frame the frame sent
+     * @param length the frame length
+     * @param now current millis()
+     * @param deadline millis() after which the message is given up
+     * @param nextRetry millis() when the message is sent again
+     * @returns the message entry, or NULL if CDPCFG_RELIABLE_PENDING reliable
+     * messages are already waiting for their ack
+     */
+    DuckInflight* addReliable(const byte* muid, const byte* frame, int length,
+                              unsigned long now, unsigned long deadline, unsigned long nextRetry);
+
+    /**
+     * @brief Check if one more reliable message can be added.
+     *
+     * @returns true if a frame can be kept
+     */
+    bool canAddReliable() const;
+
+    /**
+     * @brief Get the frame kept for a reliable message.
+     *
+     * @param message the message entry
+     * @param length set to the frame length
+     * @returns the frame, or NULL if none is kept
+     */
+    const byte* getFrame(const DuckInflight & message, int* length) const;
+
+    /**
+     * @brief Get the next reliable message to send again or give up.
+     *
+     * @param now current millis()
+     * @returns a message whose retransmission or deadline is due, NULL if none
+     */
+    DuckInflight* nextDue(unsigned long now);
+
+    /**
+     * @brief Record a retransmission of a reliable message.
+     *
+     * @param message the message entry
+     * @param now current millis()
+     * @param nextRetry millis() when the message is sent again
+     */
+    void retried(DuckInflight* message, unsigned long now, unsigned long nextRetry);
+
+    /**
+     * @brief Give up a reliable message and free its frame. It stays in the
+     * table as not acked.
+     *
+     * @param message the message entry
+     */
+    void expire(DuckInflight* message);
+
+    /**
+     * @brief Find a message.
+     *
+     * @param muid the message MUID
+     * @returns the message entry, or NULL if it is not in the table
+     */
+    const DuckInflight* find(const byte* muid) const;
+
+    /**
+     * @brief Record the ack of a message. The frame of a reliable message is
+     * freed.
+     *
+     * @param muid the message MUID
+     * @param now current millis()
+     * @returns the message entry if it was waiting for this ack, NULL otherwise
+     */
+    DuckInflight* ack(const byte* muid, unsigned long now);
+
+    /**
+     * @brief Get the number of messages waiting for their ack.
+     *
+     * @returns the number of messages not acked
+     */
+    int pending() const;
+
+    /**
+     * @brief Get the number of messages in the table, acked ones included.
+     *
+     * @returns the number of messages
+     */
+    int size() const;
+
+    /**
+     * @brief Get a message by table position, for iterating over the table.
+     *
+     * @param index the position, 0 to size() - 1
+     * @returns the message entry, or NULL if the index is out of range
+     */
+    const DuckInflight* get(int index) const;
+
+    DuckInflightStats getStats() const { return stats; }
+
+    /**
+     * @brief Forget all messages.
+     *
+     */
+    void clear();
+
+private:
+    DuckInflight* replace(unsigned long now);
+    void release(DuckInflight* message);
+
+    DuckInflight entries[CDPCFG_INFLIGHT_TABLE_SIZE];
+    DuckInflightStats stats;
+    // frames of the reliable messages, length 0 when free
+    byte frames[CDPCFG_RELIABLE_PENDING][EXT_MAX_FRAME_LENGTH];
+    int frameLengths[CDPCFG_RELIABLE_PENDING];
+};
+
+#endif
@@ -0,0 +1,136 @@
+/**
+ * @file DuckLogBuffer.h
+ * @brief This file is internal to CDP and provides the binary log mode: log
+ * statements record compact entries in a RAM ring buffer instead of formatting
+ * and printing text.
+ *
+ * Enabled with -DCDP_LOG_BINARY. The entries are written to Serial in idle time
+ * (or on demand with ducklog::dump()) as short "#L" lines, which
+ * tools/cdp_log_decode.py turns back into readable messages using the sources.
+ *
+ * @version
+ * @date 2026-10-16
+ *
+ * @copyright
+ */
+
+#ifndef DUCKLOGBUFFER_H_
+#define DUCKLOGBUFFER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+/// Number of entries kept in RAM (must be a power of 2)
+#ifndef CDP_LOG_BUFFER_SIZE
+#define CDP_LOG_BUFFER_SIZE 64
+#endif
+/// Maximum number of integer arguments recorded per entry
+#ifndef CDP_LOG_MAX_ARGS
+#define CDP_LOG_MAX_ARGS 4
+#endif
+/// Number of entries written to Serial per idle pass
+#ifndef CDP_LOG_DRAIN_PER_RUN
+#define CDP_LOG_DRAIN_PER_RUN 4
+#endif
+
+/**
+ * @brief A recorded log statement.
+ *
+ */
+typedef struct {
+    /// log site id, see ducklog::siteId()
+    uint32_t id;
+    /// millis() when the statement ran
+    uint32_t timestamp;
+    /// log level (CDP_LOG_LEVEL_*)
+    uint8_t level;
+    /// number of valid args
+    uint8_t numArgs;
+    /// integer arguments of the _f statements
+    int32_t args[CDP_LOG_MAX_ARGS];
+} DuckLogEntry;
+
+namespace ducklog {
+
+/// Start of the file name in a path
+constexpr const char* baseName(const char* path, const char* last) {
+    return *path == '\0' ? last
+           : (*path == '/' || *path == '\\') ? baseName(path + 1, path + 1)
+           : baseName(path + 1, last);
+}
+
+/// 32 bit FNV-1a hash
+constexpr uint32_t fnv1a(const char* s, uint32_t hash) {
+    return *s == '\0' ? hash : fnv1a(s + 1, (hash ^ (uint8_t) *s) * 16777619u);
+}
+
+/**
+ * @brief Id of a log site: FNV-1a of the file name, mixed with the line.
+ *
+ * Must be kept in sync with site_id() in tools/cdp_log_decode.py.
+ */
+constexpr uint32_t siteId(const char* file, int line) {
+    return (fnv1a(baseName(file, file), 2166136261u) ^ (uint32_t) line) * 16777619u;
+}
+
+/**
+ * @brief Record a log entry, dropped if the buffer is full.
+ *
+ * @param level log level
+ * @param id log site id
+ * @param args integer arguments, may be NULL
+ * @param numArgs number of arguments, only the first CDP_LOG_MAX_ARGS are kept
+ */
+void record(uint8_t level, uint32_t id, const int32_t* args, int numArgs);
+
+/**
+ * @brief Remove the oldest entry from the buffer.
+ *
+ * @param entry set to the oldest entry
+ * @returns true if an entry was returned, false if the buffer is empty
+ */
+bool pop(DuckLogEntry* entry);
+
+/**
+ * @brief Write up to maxEntries entries to Serial.
+ *
+ * @param maxEntries maximum number of entries to write
+ * @returns the number of entries written
+ */
+int drain(int maxEntries = CDP_LOG_DRAIN_PER_RUN);
+
+/**
+ * @brief Write all the buffered entries to Serial.
+ *
+ */
+void dump();
+
+/**
+ * @brief Get the number of entries lost because the buffer was full.
+ *
+ */
+unsigned long getDropped();
+
+// Only integers are recorded, other arguments are recorded as 0.
+template <typename T>
+inline typename std::enable_if<std::is_arithmetic<T>::value || std::is_enum<T>::value, int32_t>::type
+toArg(T value) { return (int32_t) value; }
+
+template <typename T>
+inline typename std::enable_if<!std::is_arithmetic<T>::value && !std::is_enum<T>::value, int32_t>::type
+toArg(const T &) { return 0; }
+
+inline void recordf(uint8_t level, uint32_t id, const char*) {
+    record(level, id, NULL, 0);
+}
+
+template <typename... Args>
+inline void recordf(uint8_t level, uint32_t id, const char*, Args... args) {
+    int32_t values[] = {toArg(args)...};
+    record(level, id, values, sizeof...(Args));
+}
+
+} // namespace ducklog
+
+#endif
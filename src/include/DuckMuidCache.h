@@ -0,0 +1,160 @@
+/**
+ * @file DuckMuidCache.h
+ * @brief This file is internal to CDP and provides an exact, time windowed
+ * cache of the messages already seen.
+ * @version
+ * @date 2026-10-16
+ *
+ * @copyright
+ */
+
+#ifndef DUCKMUIDCACHE_H_
+#define DUCKMUIDCACHE_H_
+
+#include <Arduino.h>
+
+#include "../CdpPacket.h"
+#include "cdpcfg.h"
+
+/**
+ * @brief Message cache counters.
+ *
+ */
+typedef struct {
+    /// messages in the cache, expired ones excluded
+    int entries;
+    /// messages added
+    unsigned long added;
+    /// messages found in the cache
+    unsigned long hits;
+    /// messages forgotten before their time to make room, a later copy of
+    /// them is relayed again
+    unsigned long evicted;
+} DuckMuidCacheStats;
+
+/**
+ * @brief Fixed size open addressing hash set of the messages already seen.
+ *
+ * A message is identified by its MUID and a 16 bit hash of its SDUID, and
+ * remembered for CDPCFG_DEDUP_WINDOW_S seconds after it was first seen. An
+ * entry takes 8 bytes. Unlike the bloom filter there are no false positives
+ * and a message is forgotten after a known time rather than after a number
+ * of other messages.
+ *
+ * A message is looked for in the few slots after its home slot. When none
+ * of them is free or expired, the oldest entry is evicted: a busy cluster
+ * forgets its oldest messages early, it never drops a new one.
+ *
+ * The ages are 16 bit seconds and wrap around every 18 hours. The expired
+ * entries are cleared when probed and by a sweep of the cache once per
+ * window, so that an entry nobody overwrote never comes back to life.
+ *
+ */
+class DuckMuidCache {
+public:
+    DuckMuidCache();
+
+    /**
+     * @brief Check if a message was already seen.
+     *
+     * @param sduid the message SDUID (DUID_LENGTH bytes)
+     * @param muid the message MUID (MUID_LENGTH bytes)
+     * @returns true if the message was seen within the window
+     */
+    bool dedup_check(const byte* sduid, const byte* muid);
+
+    /**
+     * @brief Remember a message.
+     *
+     * @param sduid the message SDUID (DUID_LENGTH bytes)
+     * @param muid the message MUID (MUID_LENGTH bytes)
+     */
+    void dedup_add(const byte* sduid, const byte* muid);
+
+    /**
+     * @brief Set the time a message is remembered.
+     *
+     * @param seconds the window in s, 1 to 16383
+     */
+    void setWindow(uint16_t seconds);
+
+    uint16_t getWindow() const { return window; }
+
+    DuckMuidCacheStats dedup_stats() const;
+
+    /**
+     * @brief Number of messages added since the cache was created, to tell
+     * whether it changed.
+     */
+    unsigned long dedup_adds() const { return stats.added; }
+
+    /**
+     * @brief Length of the cache state: the entries and the time it was saved.
+     */
+    int dedup_state_size() const;
+
+    /**
+     * @brief Copy a chunk of the cache state, to save it across reboots.
+     *
+     * @param offset position of the chunk in the state
+     * @param data buffer to copy the chunk to
+     * @param length chunk length
+     */
+    void dedup_save(int offset, byte* data, int length) const;
+
+    /**
+     * @brief Load a chunk of a cache state saved by dedup_save(). The ages of
+     * the entries are corrected by dedup_load_end().
+     */
+    void dedup_load(int offset, const byte* data, int length);
+
+    /**
+     * @brief Apply the state loaded by dedup_load(). The time the duck was
+     * off is not known, the entries keep the age they had when saved.
+     *
+     * @returns true if it was saved by a cache of the same size, otherwise the
+     * cache is cleared
+     */
+    bool dedup_load_end();
+
+    /**
+     * @brief Forget all messages.
+     *
+     */
+    void clear();
+
+private:
+    typedef struct {
+        byte muid[MUID_LENGTH];
+        /// 16 bit SDUID hash, 0 for a free slot
+        uint16_t sduidHash;
+        /// seconds() when the message was first seen
+        uint16_t firstSeen;
+    } Entry;
+
+    static uint16_t hashSduid(const byte* sduid);
+    static uint16_t seconds();
+    uint32_t home(uint16_t sduidHash, const byte* muid) const;
+    bool isLive(const Entry & entry, uint16_t now) const;
+    bool allExpired() const;
+    void sweep();
+    Entry* find(uint16_t sduidHash, const byte* muid, uint16_t now);
+
+    // saved after the entries by dedup_save()
+    typedef struct {
+        uint32_t version;
+        int32_t size;
+        /// seconds() when the state was saved
+        uint16_t savedAt;
+    } State;
+
+    Entry entries[CDPCFG_DEDUP_CACHE_SIZE];
+    uint16_t window;
+    // millis() of the last sweep of the expired entries
+    unsigned long lastSweep;
+    DuckMuidCacheStats stats;
+    // state read by dedup_load(), applied by dedup_load_end()
+    State loaded;
+};
+
+#endif
@@ -0,0 +1,126 @@
+/**
+ * @file DuckNeighborTable.h
+ * @brief This file is internal to CDP and keeps track of the ducks in radio
+ * range and of the quality of their links.
+ * @version
+ * @date 2026-10-16
+ *
+ * @copyright
+ */
+
+#ifndef DUCKNEIGHBORTABLE_H_
+#define DUCKNEIGHBORTABLE_H_
+
+#include <Arduino.h>
+
+#include "../CdpPacket.h"
+#include "cdpcfg.h"
+
+/**
+ * @brief A duck heard directly.
+ *
+ */
+typedef struct {
+    /// neighbor DUID
+    byte duid[DUID_LENGTH];
+    /// duck type of its last frame, see DuckType
+    byte duckType;
+    /// smoothed RSSI of its frames in dBm
+    float rssi;
+    /// smoothed SNR of its frames in dB
+    float snr;
+    /// SNR of our frames as reported by the neighbor in dB, NAN if unknown
+    float reportedSnr;
+    /// spreading factor the neighbor last advertised the cluster needs, 0 if none
+    uint8_t need;
+    /// hops between the neighbor and the duck that needs it
+    uint8_t needHops;
+    /// frames heard from it
+    unsigned long packets;
+    /// millis() when it was first heard
+    unsigned long firstHeard;
+    /// millis() when it was last heard
+    unsigned long lastHeard;
+    /// true when the entry holds a neighbor
+    bool used;
+} DuckNeighbor;
+
+/**
+ * @brief Fixed size table of the ducks in radio range.
+ *
+ * Only frames with a hop count of 0 are recorded: a relayed frame carries
+ * the DUID of its origin, not of the duck that relayed it. When the table is
+ * full, a new neighbor replaces the one heard the longest time ago.
+ *
+ */
+class DuckNeighborTable {
+public:
+    DuckNeighborTable();
+
+    /**
+     * @brief Record a frame heard directly from a neighbor.
+     *
+     * @param duid the neighbor DUID
+     * @param duckType the duck type of the frame
+     * @param rssi frame RSSI in dBm
+     * @param snr frame SNR in dB
+     * @param now current millis()
+     * @returns the neighbor entry
+     */
+    DuckNeighbor* update(const byte* duid, byte duckType, float rssi, float snr, unsigned long now);
+
+    /**
+     * @brief Find a neighbor.
+     *
+     * @param duid the neighbor DUID
+     * @returns the neighbor entry, or NULL if it is not in the table
+     */
+    DuckNeighbor* find(const byte* duid);
+
+    /**
+     * @brief Get the number of neighbors in the table.
+     *
+     * @returns the number of neighbors
+     */
+    int size() const;
+
+    /**
+     * @brief Get a neighbor by table position, for iterating over the table.
+     *
+     * @param index the position, 0 to size() - 1
+     * @returns the neighbor entry, or NULL if the index is out of range
+     */
+    const DuckNeighbor* get(int index) const;
+
+    /**
+     * @brief Set the time after which a silent neighbor is considered gone.
+     *
+     * @param timeout the timeout in ms
+     */
+    void setTimeout(unsigned long timeout) { this->timeout = timeout; }
+
+    unsigned long getTimeout() const { return timeout; }
+
+    /**
+     * @brief Check that a neighbor was heard recently.
+     *
+     * @param neighbor the neighbor entry
+     * @param now current millis()
+     * @returns true if the neighbor was heard within the timeout
+     */
+    bool isAlive(const DuckNeighbor & neighbor, unsigned long now) const {
+        return neighbor.used && now - neighbor.lastHeard < timeout;
+    }
+
+    /**
+     * @brief Forget all neighbors.
+     *
+     */
+    void clear();
+
+private:
+    DuckNeighbor neighbors[CDPCFG_NEIGHBOR_TABLE_SIZE];
+    unsigned long timeout;
+};
+
+#endif
@@ -5,9 +5,10 @@
 #include "Arduino.h"
 #include "DuckUtils.h"
 #include "cdpcfg.h"
-#include "bloomfilter.h"
-#include <CRC32.h>
+#include "DuckDedup.h"
 #include <WString.h>
+#include <algorithm>
+#include <string.h>
 #include <vector>
 
 static std::vector<byte> ZERO_DUID = {0x00, 0x00, 0x00, 0x00,
@@ -21,6 +22,8 @@ static std::vector<byte> BROADCAST_DUID = {0xFF, 0xFF, 0xFF, 0xFF,
  * 
  */
 class DuckPacket {
+    // The radio reads received frames straight into the packet buffer
+    friend class DuckRadio;
 
 public:
 
@@ -28,13 +31,13 @@ public:
      * @brief Construct a new Duck Packet object.
      * 
      */
-    DuckPacket() {}
+    DuckPacket() : length(0) { memset(duid, 0, DUID_LENGTH); }
     /**
      * @brief Construct a new Duck Packet object.
      * 
      * @param duid a duck device unique id
      */
-    DuckPacket(std::vector<byte> duid) { this->duid = duid; }
+    DuckPacket(const std::vector<byte> & duid) : length(0) { setDeviceId(duid); }
 
     ~DuckPacket() {}
     /**
@@ -42,7 +45,10 @@ public:
      *
      * @param duid a duck device unique id
      */
-    void setDeviceId(std::vector<byte> duid) { this->duid = duid; }
+    void setDeviceId(const std::vector<byte> & duid) {
+      memset(this->duid, 0, DUID_LENGTH);
+      memcpy(this->duid, duid.data(), std::min((int) duid.size(), DUID_LENGTH));
+    }
 
     /**
      * @brief Build a packet from the given topic and provided byte buffer.
@@ -52,44 +58,124 @@ public:
      * @param app_data a byte buffer that contains the packet data section
      * @returns DUCK_ERR_NONE if the operation was successful, otherwise an error code.
      */
-    int prepareForSending(BloomFilter *filter, const std::vector<byte> targetDevice,
-                          byte duckType, byte topic, std::vector<byte> app_data);
+    int prepareForSending(DuckDedupFilter *filter, const std::vector<byte> & targetDevice,
+                          byte duckType, byte topic, const std::vector<byte> & app_data);
+
+    /**
+     * @brief Build a packet from the given topic and provided byte buffer.
+     *
+     * The packet is serialized straight into the internal frame buffer, no heap
+     * allocation is done.
+     *
+     * @param targetDevice the target device DUID (DUID_LENGTH bytes) to receive the message
+     * @param topic a message topic
+     * @param app_data a byte buffer that contains the packet data section
+     * @param app_data_length length of app_data in bytes
+     * @returns DUCK_ERR_NONE if the operation was successful, otherwise an error code.
+     */
+    int prepareForSending(DuckDedupFilter *filter, const byte* targetDevice,
+                          byte duckType, byte topic, const byte* app_data, int app_data_length);
 
     /**
      * @brief Update a received packet if it needs to be relayed in the mesh.
      * 
-     * @param filter The bloom filter describing what packets have already been seen
+     * @param filter The filter describing what packets have already been seen
      * @param dataBuffer buffer containing the packet data
      * @returns true if the packet needs to be relayed
      * @returns false if the packet does not need to be replayed
      */
-    bool prepareForRelaying(BloomFilter *filter, std::vector<byte> dataBuffer);
+    bool prepareForRelaying(DuckDedupFilter *filter, const std::vector<byte> & dataBuffer);
+
+    /**
+     * @brief Update the packet in place if it needs to be relayed in the mesh.
+     *
+     * The frame must already be in the packet buffer, e.g read by
+     * DuckRadio::readReceivedData(DuckPacket*). Only the hop count is modified.
+     *
+     * @param filter The filter describing what packets have already been seen
+     * @returns true if the packet needs to be relayed
+     * @returns false if the packet does not need to be replayed
+     */
+    bool prepareForRelaying(DuckDedupFilter *filter);
     
     /**
-     * @brief Get the Cdp Packet byte vector.
+     * @brief Append an extension to the trailer of the frame.
+     *
+     * The frame must already be built or received, the data section and its
+     * CRC are not changed.
+     *
+     * @param type the extension type (EXT_*)
+     * @param value the extension value
+     * @param valueLength length of value in bytes
+     * @returns DUCK_ERR_NONE if the operation was successful, otherwise an error code.
+     */
+    int addExtension(byte type, const byte* value, int valueLength);
+
+    /**
+     * @brief Append bytes to the value of an extension, the extension is
+     * added if the frame does not carry it.
+     *
+     * @param type the extension type (EXT_*)
+     * @param value the bytes to append
+     * @param valueLength length of value in bytes
+     * @returns DUCK_ERR_NONE if the operation was successful, otherwise an error code.
+     */
+    int appendToExtension(byte type, const byte* value, int valueLength);
+
+    /**
+     * @brief Get the short ID of a duck, as found in route records.
+     *
+     * @param duid the duck DUID (DUID_LENGTH bytes)
+     * @returns the short ID
+     */
+    static uint16_t getShortId(const byte* duid);
+
+    /**
+     * @brief Find an extension so that it can be rewritten in place.
+     *
+     * @param type the extension type (EXT_*)
+     * @param valueLength set to the length of the value
+     * @returns the value, or NULL if the frame does not carry the extension
+     */
+    byte* findExtension(byte type, int* valueLength) {
+      return const_cast<byte*>(getView().findExtension(type, valueLength));
+    }
+
+    /**
+     * @brief Get the Cdp Packet frame.
      * 
-     * @returns a vector of bytes representing the cdp packet 
+     * @returns a pointer to the frame bytes, valid until the packet is rebuilt
+     */
+    const byte* getBuffer() const { return buffer; }
+
+    /**
+     * @brief Get the length of the Cdp Packet frame.
+     *
+     * @returns the number of valid bytes returned by getBuffer()
      */
-    std::vector<byte> getBuffer() { return buffer;}
+    int getBufferLength() const { return length; }
+
+    /**
+     * @brief Get a read-only view of the Cdp Packet frame.
+     */
+    CdpPacketView getView() const { return CdpPacketView(buffer, length); }
 
     /**
      * @brief Resets the packet byte buffer.
      *
      */
-    void reset() {
-      std::vector<byte>().swap(buffer);
-    }
+    void reset() { length = 0; }
 
     byte getTopic() { return buffer[TOPIC_POS]; }
 
 
   private: 
-    std::vector<byte> duid;
-    std::vector<byte> buffer;
+    byte duid[DUID_LENGTH];
+    byte buffer[PACKET_LENGTH];
+    int length;
 
-    static void getUniqueMessageId(BloomFilter * filter, byte message_id[MUID_LENGTH]);
+    static void getUniqueMessageId(DuckDedupFilter * filter, const byte* sduid, byte message_id[MUID_LENGTH]);
 
 };
 
 #endif
-
@@ -16,9 +16,17 @@
 #include "../DuckError.h"
 #include "../DuckLogger.h"
 #include "cdpcfg.h"
+#include "DuckDutyCycle.h"
 #include "DuckPacket.h"
+#include "DuckRingBuffer.h"
+#include "DuckTxQueue.h"
 #include "LoraPacket.h"
 
+#ifdef CDPCFG_LORA_CLASS
+// RadioLib driver class, only used through a pointer here
+class CDPCFG_LORA_CLASS;
+#endif
+
 /**
  * @brief Internal structure to hold the LoRa module configuration
  * 
@@ -42,11 +50,65 @@ typedef struct {
     uint8_t sf;
     /// gain
     uint8_t gain;
+    /// coding rate denominator, 5 to 8 for 4/5 to 4/8
+    uint8_t cr;
+    /// preamble length in symbols
+    uint16_t preamble;
+    /// run channel activity detection before every transmission (CSMA)
+    bool csma;
+    /// initial CSMA backoff window in ms, doubled every time the channel is busy
+    uint16_t csmaBackoff;
+    /// number of CSMA backoffs after which a frame is transmitted anyway
+    uint8_t csmaMaxBackoffs;
 
     /// interrupt service routine function when di0 activates
     void (*func)(void);
 } LoraConfigParams;
 
+/**
+ * @brief A received frame waiting in the receive queue, with its reception
+ * metadata.
+ *
+ */
+typedef struct {
+    /// the received frame
+    DuckPacket packet;
+    /// packet RSSI in dBm
+    float rssi;
+    /// packet SNR in dB
+    float snr;
+    /// millis() when the frame was read from the radio
+    unsigned long timestamp;
+} DuckRxFrame;
+
+/**
+ * @brief Receive queue counters, used to size CDPCFG_RX_QUEUE_SIZE per board.
+ *
+ */
+typedef struct {
+    /// frames queued since setup
+    unsigned long received;
+    /// frames dropped because the queue was full
+    unsigned long overflows;
+    /// highest number of frames queued at the same time
+    unsigned int highWater;
+} DuckRxQueueStats;
+
+/**
+ * @brief Listen before talk counters.
+ *
+ */
+typedef struct {
+    /// channel activity detections started
+    unsigned long scans;
+    /// times the channel was busy and the transmission was delayed
+    unsigned long backoffs;
+    /// frames transmitted on a busy channel after CSMA_MAX_BACKOFFS backoffs
+    unsigned long forced;
+    /// sum of the backoff delays in ms
+    unsigned long totalBackoff;
+} DuckCsmaStats;
+
 /**
  * @brief Internal Radio chip abstraction.
  *
@@ -68,6 +130,8 @@ private:
 
     DuckRadio();
 
+    ~DuckRadio();
+
     /**
      * @brief Initialize the LoRa chip.
      *
@@ -90,15 +154,15 @@ private:
      * @param length length of the byte buffer
      * @return int
      */
-    int sendData(byte *data, int length);
+    int sendData(const byte *data, int length);
 
     /**
      * @brief Send packet data out into the mesh network
      *
      * @param data byte vector to send
-     * @returns DUCK_ERR_NONE if the message was sent successfully, an error code otherwise.
+     * @returns DUCK_ERR_NONE if the message was queued successfully, an error code otherwise.
      */
-    int sendData(std::vector<byte> data);
+    int sendData(const std::vector<byte> & data);
 
     /**
      * @brief Set the Duck to be ready to recieve LoRa packets.
@@ -108,13 +172,118 @@ private:
     int startReceive();
 
     /**
-     * @brief Set the Duck to be ready to transmit packets.
+     * @brief Queue packet data for transmission.
+     *
+     * The call does not wait for the transmission to complete: the frame is
+     * started right away if the radio is idle, otherwise it is sent from
+     * serviceInterruptFlags() once the frames ahead of it are done.
      *
      * @param data data to transmit
      * @param length data length in bytes
      * @returns DUCK_ERR_NONE if the call was successful, an error code otherwise.
      */
-    int startTransmitData(byte *data, int length);
+    int startTransmitData(const byte *data, int length);
+
+    /**
+     * @brief Start transmitting the next queued frame.
+     *
+     * @returns DUCK_ERR_NONE if the transmission was started or nothing is
+     * queued, an error code otherwise.
+     */
+    int transmitNext();
+
+    /**
+     * @brief Handle the end of a transmission.
+     *
+     */
+    void onTransmitDone();
+
+    /**
+     * @brief Start the next queued frame when the radio is idle and recover
+     * from a missed TX done interrupt.
+     *
+     */
+    void serviceTransmitQueue();
+
+    DuckTxQueueStats getTxQueueStats() const { return txQueue.getStats(); }
+
+    /**
+     * @brief Enable or disable listen before talk.
+     *
+     * When enabled, channel activity detection runs before every transmission
+     * and the transmission is delayed by a randomized exponential backoff while
+     * the channel is busy.
+     *
+     * @param enable true to enable CSMA
+     * @param backoff initial backoff window in ms
+     * @param maxBackoffs number of backoffs after which a frame is sent anyway
+     */
+    void setCsma(bool enable, uint16_t backoff = CDPCFG_CSMA_BACKOFF_MS,
+                 uint8_t maxBackoffs = CDPCFG_CSMA_MAX_BACKOFFS);
+
+    DuckCsmaStats getCsmaStats() const { return csmaStats; }
+
+    /**
+     * @brief Start channel activity detection for the next queued frame.
+     *
+     * @returns DUCK_ERR_NONE if the scan was started, an error code otherwise.
+     */
+    int startChannelScan();
+
+    /**
+     * @brief Handle the end of a channel activity detection.
+     *
+     * @param busy true if LoRa activity was detected
+     */
+    void onChannelScanDone(bool busy);
+
+    /**
+     * @brief Set the duty cycle budget.
+     *
+     * @param permille share of the window the radio may transmit, 0 is unlimited
+     * @param window sliding window length in ms
+     */
+    void setDutyCycle(uint16_t permille, unsigned long window = CDPCFG_DUTY_CYCLE_WINDOW_MS) {
+        dutyCycle.setLimit(permille, window);
+    }
+
+    void setMaxDwell(uint16_t maxDwell) { dutyCycle.setMaxDwell(maxDwell); }
+
+    unsigned long getDutyCycleRemaining() { return dutyCycle.getRemaining(millis()); }
+
+    DuckDutyCycleStats getDutyCycleStats() { return dutyCycle.getStats(); }
+
+    /**
+     * @brief Change the spreading factor.
+     *
+     * @param sf spreading factor, 6 to 12
+     * @returns DUCK_ERR_NONE if the spreading factor was changed,
+     * DUCKLORA_ERR_TX_BUSY if the radio is transmitting or scanning the
+     * channel, DUCKLORA_ERR_SETUP if the spreading factor is invalid.
+     */
+    int setSpreadingFactor(uint8_t sf);
+
+    uint8_t getSpreadingFactor() const { return sf; }
+
+    /**
+     * @brief Get the time on air of a frame with the current radio settings.
+     *
+     * @param length frame length in bytes
+     * @returns the time on air in ms, rounded up
+     */
+    unsigned long getTimeOnAir(int length) const;
+
+    /**
+     * @brief Apply the duty cycle budget to the front of the transmit queue.
+     *
+     * Low priority frames that do not fit in the budget, or that would eat
+     * into the reserve kept for the other frames, are dropped. Other frames
+     * are deferred until the window slides.
+     *
+     * @returns the frame to transmit now, or NULL if the queue is empty or the
+     * front frame is deferred
+     */
+    DuckTxFrame* nextAllowedFrame();
 
     /**
     * @brief change the duck channel.
@@ -171,26 +340,117 @@ public:
  */
     int readReceivedData(std::vector<byte> *packetBytes);
 
+/**
+ * @brief Read the data received from the radio straight into a packet buffer
+ *
+ * This is the copy free receive path: the frame is read once from the radio
+ * and its data CRC is checked in place.
+ *
+ * @param  packet packet that receives the frame
+ * @return DUCK_ERR_NONE if a valid packet was read, an error code otherwise.
+ */
+    int readReceivedData(DuckPacket *packet);
+
 /**
  * @brief Send packet data out into the mesh network
  *
  * @param packet Duckpacket object that contains the data to send
- * @return DUCK_ERR_NONE if the message was sent successfully, an error code otherwise.
+ * @return DUCK_ERR_NONE if the message was queued successfully, an error code otherwise.
  */
     int relayPacket(DuckPacket *packet);
 
 private:
-    static volatile uint16_t interruptFlags;
+#ifdef CDPCFG_LORA_CLASS
+    CDPCFG_LORA_CLASS* lora;
+#endif
 
+    // radio that onInterrupt() forwards to, set by setupRadio()
+    static DuckRadio* interruptTarget;
+
+    volatile uint16_t interruptFlags;
+    // Apollo3: an interrupt happened, the flags are not available
+    volatile bool interruptFired;
+    // if the radio is receiving a message
+    volatile bool radio_receiving;
+    // if the radio is sending a message
+    volatile bool radio_sending;
+
+    /**
+     * @brief Handle the radio events signaled since the last call.
+     *
+     * With CDPCFG_RADIO_POLL_IRQ the flags are read from the radio here
+     * instead of from the interrupt handler.
+     */
     void serviceInterruptFlags();
 
     static void onInterrupt();
 
-    static volatile bool receivedFlag;
+    /**
+     * @brief Read the received frame into the given buffer and restart reception.
+     *
+     * @param frame buffer of at least PACKET_LENGTH bytes
+     * @param length set to the frame length
+     * @returns DUCK_ERR_NONE if a valid packet was read, an error code otherwise.
+     */
+    int readReceivedFrame(byte *frame, int *length);
 
-    static void setReceiveFlag(bool value) { receivedFlag = value; }
+    /**
+     * @brief Move a completed reception into the receive queue and restart
+     * reception right away, so back to back frames are not missed while the
+     * duck is busy handling earlier ones.
+     *
+     */
+    void queueReceivedFrame();
+
+    /**
+     * @brief Get the oldest frame in the receive queue.
+     *
+     * The frame stays valid, and may be modified in place, until
+     * releaseReceivedFrame() is called.
+     *
+     * @returns the oldest received frame, or NULL if the queue is empty
+     */
+    DuckRxFrame* getReceivedFrame() { return rxQueue.peek(); }
+
+    /**
+     * @brief Release the frame returned by getReceivedFrame().
+     *
+     */
+    void releaseReceivedFrame() { rxQueue.pop(); }
+
+    DuckRxQueueStats getRxQueueStats() const { return rxStats; }
+
+    DuckRingBuffer<DuckRxFrame, CDPCFG_RX_QUEUE_SIZE> rxQueue;
+    DuckRxQueueStats rxStats;
+
+    DuckTxQueue txQueue;
+    unsigned long txStartedAt;
+
+    enum CadState {
+        CAD_IDLE,
+        CAD_SCANNING,
+        CAD_BACKOFF
+    };
+
+    bool csma;
+    uint16_t csmaBackoff;
+    uint8_t csmaMaxBackoffs;
+    CadState cadState;
+    uint8_t cadAttempts;
+    unsigned long cadStartedAt;
+    unsigned long backoffUntil;
+    DuckCsmaStats csmaStats;
+
+    // modulation, for the time on air
+    float bw;
+    uint8_t sf;
+    uint8_t cr;
+    uint16_t preamble;
 
-    static bool getReceiveFlag() { return receivedFlag; }
+    DuckDutyCycle dutyCycle;
+    // sequence of the last frame counted as deferred
+    bool deferring;
+    unsigned long deferredSequence;
 
     DuckRadio(DuckRadio const &) = delete;
 
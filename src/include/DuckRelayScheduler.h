@@ -0,0 +1,112 @@
+/**
+ * @file DuckRelayScheduler.h
+ * @brief This file is internal to CDP and provides counter-based broadcast
+ * suppression for relayed packets.
+ * @version
+ * @date 2026-10-16
+ *
+ * @copyright
+ */
+
+#ifndef DUCKRELAYSCHEDULER_H_
+#define DUCKRELAYSCHEDULER_H_
+
+#include <Arduino.h>
+
+#include "cdpcfg.h"
+#include "DuckPacket.h"
+
+/**
+ * @brief A relay waiting for its assessment delay to expire.
+ *
+ */
+typedef struct {
+    /// the packet to relay, ready to be sent
+    DuckPacket packet;
+    /// millis() after which the packet is relayed
+    unsigned long due;
+    /// number of copies of the packet heard so far, including the first one
+    uint8_t copies;
+    /// true when the entry holds a pending relay
+    bool used;
+} DuckPendingRelay;
+
+/**
+ * @brief Relay suppression counters.
+ *
+ */
+typedef struct {
+    /// relays delayed by an assessment delay
+    unsigned long scheduled;
+    /// relays cancelled because enough copies were overheard
+    unsigned long suppressed;
+    /// relays sent immediately because the pending table was full
+    unsigned long overflows;
+} DuckRelayStats;
+
+/**
+ * @brief Counter-based flooding suppression.
+ *
+ * Instead of relaying a new packet right away, the relay is held for a random
+ * assessment delay. Every copy of the same MUID overheard in the meantime is
+ * counted and the relay is cancelled once the count reaches the threshold:
+ * the neighbors have already been covered by other relays. In sparse areas
+ * fewer copies are heard and the packet is still relayed.
+ *
+ */
+class DuckRelayScheduler {
+public:
+    DuckRelayScheduler();
+
+    /**
+     * @brief Configure the suppression.
+     *
+     * @param threshold number of copies after which a relay is cancelled, 0
+     * disables suppression
+     * @param window upper bound of the random assessment delay in ms
+     */
+    void setSuppression(uint8_t threshold, uint16_t window);
+
+    bool isEnabled() const { return threshold > 0; }
+
+    /**
+     * @brief Hold a packet for a random assessment delay.
+     *
+     * @param packet the packet to relay
+     * @returns true if the relay was scheduled, false if the pending table is
+     * full and the packet must be relayed immediately.
+     */
+    bool schedule(const DuckPacket & packet);
+
+    /**
+     * @brief Count a copy of an already seen packet.
+     *
+     * @param muid MUID of the overheard packet
+     */
+    void onDuplicate(const byte* muid);
+
+    /**
+     * @brief Get a pending relay whose assessment delay has expired.
+     *
+     * @param now the current millis()
+     * @returns a due relay to send then release(), or NULL if there is none
+     */
+    DuckPendingRelay* nextDue(unsigned long now);
+
+    /**
+     * @brief Release a relay returned by nextDue().
+     *
+     * @param relay the relay to release
+     */
+    void release(DuckPendingRelay* relay) { relay->used = false; }
+
+    DuckRelayStats getStats() const { return stats; }
+
+private:
+    DuckPendingRelay pending[CDPCFG_RELAY_PENDING_SIZE];
+    uint8_t threshold;
+    uint16_t window;
+    DuckRelayStats stats;
+};
+
+#endif
@@ -0,0 +1,90 @@
+/**
+ * @file DuckRingBuffer.h
+ * @brief This file is internal to CDP and provides a fixed size, lock-free
+ * single-producer/single-consumer ring buffer.
+ * @version
+ * @date 2026-10-16
+ *
+ * @copyright
+ */
+
+#ifndef DUCKRINGBUFFER_H_
+#define DUCKRINGBUFFER_H_
+
+#include <atomic>
+
+/**
+ * @brief Fixed size single-producer/single-consumer ring of preallocated slots.
+ *
+ * Slots are filled and read in place: the producer fills the slot returned by
+ * acquire() then publishes it with commit(), the consumer reads the slot
+ * returned by peek() then releases it with pop(). One side may run in an
+ * interrupt context as long as each side only calls its own methods.
+ *
+ * @tparam T slot type
+ * @tparam Size number of slots, must be a power of 2
+ */
+template <typename T, unsigned int Size>
+class DuckRingBuffer {
+    static_assert(Size > 0 && (Size & (Size - 1)) == 0, "DuckRingBuffer size must be a power of 2");
+
+public:
+    DuckRingBuffer() : head(0), tail(0) {}
+
+    /**
+     * @brief Get the next free slot (producer side).
+     *
+     * @returns a slot to fill, or NULL if the ring is full
+     */
+    T* acquire() {
+        unsigned int h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= Size) {
+            return NULL;
+        }
+        return &slots[h & (Size - 1)];
+    }
+
+    /**
+     * @brief Publish the slot returned by acquire() (producer side).
+     */
+    void commit() {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Get the oldest published slot (consumer side).
+     *
+     * @returns the oldest slot, or NULL if the ring is empty
+     */
+    T* peek() {
+        unsigned int t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) {
+            return NULL;
+        }
+        return &slots[t & (Size - 1)];
+    }
+
+    /**
+     * @brief Release the slot returned by peek() (consumer side).
+     */
+    void pop() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /// Number of published slots
+    unsigned int size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    bool isEmpty() const { return size() == 0; }
+
+    static unsigned int capacity() { return Size; }
+
+private:
+    T slots[Size];
+    // free running indexes, wrap around is handled by unsigned arithmetic
+    std::atomic<unsigned int> head;
+    std::atomic<unsigned int> tail;
+};
+
+#endif
@@ -0,0 +1,119 @@
+/**
+ * @file DuckRouteTable.h
+ * @brief This file is internal to CDP and keeps track of the distance to the
+ * ducks heard, directly or through relays, for directed forwarding.
+ * @version
+ * @date 2026-10-16
+ *
+ * @copyright
+ */
+
+#ifndef DUCKROUTETABLE_H_
+#define DUCKROUTETABLE_H_
+
+#include <Arduino.h>
+
+#include "../CdpPacket.h"
+#include "cdpcfg.h"
+
+/**
+ * @brief Distance to a duck.
+ *
+ */
+typedef struct {
+    /// duck DUID
+    byte duid[DUID_LENGTH];
+    /// transmissions needed to reach it, 1 for a neighbor
+    byte distance;
+    /// millis() when the distance was last confirmed
+    unsigned long lastHeard;
+    /// true when the entry holds a route
+    bool used;
+} DuckRoute;
+
+/**
+ * @brief Directed forwarding counters.
+ *
+ */
+typedef struct {
+    /// addressed frames relayed because this duck is closer to the destination
+    unsigned long routed;
+    /// addressed frames relayed without a route, as any broadcast frame
+    unsigned long flooded;
+    /// addressed frames not relayed because a closer duck relays them
+    unsigned long dropped;
+} DuckRoutingStats;
+
+/**
+ * @brief Fixed size table of the distance to the ducks heard.
+ *
+ * Every frame tells the distance to its origin: the hop count of the frame
+ * plus one, and one more when it was received close to the demodulation
+ * floor so that strong links are preferred. The shortest distance is kept
+ * until it was not heard again for the timeout. When the table is full, a new
+ * route replaces the one confirmed the longest time ago.
+ *
+ */
+class DuckRouteTable {
+public:
+    DuckRouteTable();
+
+    /**
+     * @brief Record the distance to a duck a frame came from.
+     *
+     * @param duid the origin of the frame
+     * @param distance the distance the frame travelled
+     * @param now current millis()
+     */
+    void update(const byte* duid, byte distance, unsigned long now);
+
+    /**
+     * @brief Get the distance to a duck.
+     *
+     * @param duid the duck DUID
+     * @param now current millis()
+     * @returns the distance, or EXT_DISTANCE_UNKNOWN if there is no route
+     */
+    byte getDistance(const byte* duid, unsigned long now) const;
+
+    /**
+     * @brief Get the number of routes in the table, expired ones included.
+     *
+     * @returns the number of routes
+     */
+    int size() const;
+
+    /**
+     * @brief Get a route by table position, for iterating over the table.
+     *
+     * @param index the position, 0 to size() - 1
+     * @returns the route entry, or NULL if the index is out of range
+     */
+    const DuckRoute* get(int index) const;
+
+    /**
+     * @brief Set the time after which a route that was not heard again is forgotten.
+     *
+     * @param timeout the timeout in ms
+     */
+    void setTimeout(unsigned long timeout) { this->timeout = timeout; }
+
+    unsigned long getTimeout() const { return timeout; }
+
+    /**
+     * @brief Forget all routes.
+     *
+     */
+    void clear();
+
+private:
+    const DuckRoute* find(const byte* duid) const;
+    bool isAlive(const DuckRoute & route, unsigned long now) const {
+        return route.used && now - route.lastHeard < timeout;
+    }
+
+    DuckRoute routes[CDPCFG_ROUTE_TABLE_SIZE];
+    unsigned long timeout;
+};
+
+#endif
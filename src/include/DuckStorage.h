@@ -0,0 +1,123 @@
+/**
+ * @file DuckStorage.h
+ * @brief This file is internal to CDP and provides the persistent storage
+ * the duck state is checkpointed to.
+ * @version
+ * @date 2026-10-16
+ *
+ * @copyright
+ */
+
+#ifndef DUCKSTORAGE_H_
+#define DUCKSTORAGE_H_
+
+#include <Arduino.h>
+#include <vector>
+
+#include "cdpcfg.h"
+#include "../DuckError.h"
+
+/**
+ * @brief Byte addressed persistent storage.
+ *
+ * Writes may be buffered until commit(), a backend on flash only wears it
+ * on commit.
+ *
+ */
+class DuckStorage {
+public:
+    virtual ~DuckStorage() {}
+
+    /**
+     * @brief Get the storage size.
+     *
+     * @returns the size in bytes
+     */
+    virtual int getSize() = 0;
+
+    /**
+     * @brief Read bytes from the storage.
+     *
+     * @param offset position of the first byte
+     * @param data buffer to read into
+     * @param length number of bytes
+     * @returns DUCK_ERR_NONE if successful, DUCK_ERR_STORAGE otherwise
+     */
+    virtual int read(int offset, byte* data, int length) = 0;
+
+    /**
+     * @brief Write bytes to the storage.
+     *
+     * @param offset position of the first byte
+     * @param data bytes to write
+     * @param length number of bytes
+     * @returns DUCK_ERR_NONE if successful, DUCK_ERR_STORAGE otherwise
+     */
+    virtual int write(int offset, const byte* data, int length) = 0;
+
+    /**
+     * @brief Make the bytes written so far persistent.
+     *
+     * @returns DUCK_ERR_NONE if successful, DUCK_ERR_STORAGE otherwise
+     */
+    virtual int commit() = 0;
+};
+
+/**
+ * @brief Storage kept in RAM, it survives a duck object but not a power
+ * cycle. Used by the host tests, and counts the bytes written and commits to
+ * measure the wear.
+ *
+ */
+class DuckRamStorage : public DuckStorage {
+public:
+    DuckRamStorage(int size) : data(size, 0xFF) {}
+
+    int getSize() { return data.size(); }
+    int read(int offset, byte* buffer, int length);
+    int write(int offset, const byte* buffer, int length);
+    int commit() { commits++; return DUCK_ERR_NONE; }
+
+    /// Bytes written since the storage was created
+    unsigned long getBytesWritten() const { return bytesWritten; }
+    /// Calls to commit() since the storage was created
+    unsigned long getCommits() const { return commits; }
+
+private:
+    std::vector<byte> data;
+    unsigned long bytesWritten = 0;
+    unsigned long commits = 0;
+};
+
+#ifndef CDPCFG_SPARKFUN_APOLLO3
+/**
+ * @brief Storage in an area of the EEPROM (flash backed on the ESP32).
+ *
+ * The EEPROM is begun with offset + size bytes on first use, the
+ * credentials of saveWifiCredentials() keep the first offset bytes and do
+ * not begin it again. Only the bytes that change are written to the buffer,
+ * but on the ESP32 the EEPROM is a single NVS blob and each commit stores
+ * all its offset + size bytes, whatever slot changed. A commit fails while
+ * the EEPROM is begun with a size too small for the area.
+ *
+ */
+class DuckEepromStorage : public DuckStorage {
+public:
+    DuckEepromStorage(int offset = CDPCFG_CHECKPOINT_EEPROM_OFFSET,
+                      int size = CDPCFG_CHECKPOINT_EEPROM_SIZE)
+        : offset(offset), size(size) {}
+
+    int getSize() { return size; }
+    int read(int offset, byte* data, int length);
+    int write(int offset, const byte* data, int length);
+    int commit();
+
+private:
+    bool begin();
+
+    int offset;
+    int size;
+};
+#endif
+
+#endif
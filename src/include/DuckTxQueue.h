@@ -0,0 +1,131 @@
+/**
+ * @file DuckTxQueue.h
+ * @brief This file is internal to CDP and provides the prioritized queue of
+ * frames waiting to be transmitted by the radio.
+ * @version
+ * @date 2026-10-16
+ *
+ * @copyright
+ */
+
+#ifndef DUCKTXQUEUE_H_
+#define DUCKTXQUEUE_H_
+
+#include <Arduino.h>
+
+#include "../CdpPacket.h"
+#include "cdpcfg.h"
+
+/**
+ * @brief A frame waiting in the transmit queue.
+ *
+ */
+typedef struct {
+    /// the frame to transmit
+    byte frame[PACKET_LENGTH];
+    /// frame length in bytes
+    int length;
+    /// transmit priority, see DuckTxQueue::Priority
+    byte priority;
+    /// true when the slot holds a frame
+    bool used;
+    /// push order, used to keep frames of the same priority in FIFO order
+    unsigned long sequence;
+    /// millis() when the frame was queued
+    unsigned long queuedAt;
+} DuckTxFrame;
+
+/**
+ * @brief Transmit queue counters.
+ *
+ */
+typedef struct {
+    /// frames queued since setup
+    unsigned long queued;
+    /// frames handed to the radio since setup
+    unsigned long sent;
+    /// frames rejected because the queue was full
+    unsigned long dropped;
+    /// frames currently queued
+    unsigned int depth;
+    /// highest number of frames queued at the same time
+    unsigned int maxDepth;
+    /// sum of the queueing delays of the sent frames in ms
+    unsigned long totalDelay;
+    /// longest queueing delay in ms
+    unsigned long maxDelay;
+} DuckTxQueueStats;
+
+/**
+ * @brief Fixed size queue of frames waiting for the radio.
+ *
+ * Frames are served highest priority first and in FIFO order within a
+ * priority. The priority is derived from the packet topic so that acks and
+ * alerts are not stuck behind periodic status reports.
+ *
+ */
+class DuckTxQueue {
+public:
+    enum Priority {
+        /// acks, alerts and mesh management messages
+        PRIORITY_HIGH = 0,
+        /// application data
+        PRIORITY_NORMAL,
+        /// periodic status and health reports
+        PRIORITY_LOW,
+    };
+
+    DuckTxQueue();
+
+    /**
+     * @brief Copy a frame into the queue.
+     *
+     * @param data frame to transmit
+     * @param length frame length in bytes
+     * @returns DUCK_ERR_NONE if the frame was queued, DUCKLORA_ERR_TX_BUSY if the
+     * queue is full, DUCKLORA_ERR_MSG_TOO_LARGE if the frame is too large.
+     */
+    int push(const byte* data, int length);
+
+    /**
+     * @brief Get the next frame to transmit.
+     *
+     * @returns the highest priority, oldest frame or NULL if the queue is empty
+     */
+    DuckTxFrame* front();
+
+    /**
+     * @brief Release a frame returned by front() once it was handed to the radio.
+     *
+     * @param frame the frame to release
+     */
+    void pop(DuckTxFrame* frame);
+
+    /**
+     * @brief Release a frame returned by front() without transmitting it.
+     *
+     * @param frame the frame to release
+     */
+    void discard(DuckTxFrame* frame);
+
+    unsigned int size() const { return stats.depth; }
+
+    bool isEmpty() const { return stats.depth == 0; }
+
+    DuckTxQueueStats getStats() const { return stats; }
+
+    /**
+     * @brief Get the transmit priority of a packet topic.
+     *
+     * @param topic the packet topic
+     * @returns the topic priority
+     */
+    static Priority getPriority(byte topic);
+
+private:
+    DuckTxFrame slots[CDPCFG_TX_QUEUE_SIZE];
+    unsigned long nextSequence;
+    DuckTxQueueStats stats;
+};
+
+#endif
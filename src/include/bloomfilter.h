@@ -3,45 +3,99 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <time.h>
 #include <string.h>
 #include <math.h>
 #include <memory>
 
+/**
+ * @brief Bloom filter counters.
+ *
+ */
+typedef struct {
+  /// share of the bits set in the filter messages are added to, 0 to 1
+  float fillRatio;
+  /// share of the bits set in the frozen filter, 0 to 1
+  float frozenFillRatio;
+  /// chance that a message never added is reported as seen
+  float estimatedFpr;
+  /// times the filters were swapped
+  unsigned long rotations;
+  /// messages added since the last rotation
+  int messages;
+  /// messages added to the frozen filter before it was frozen
+  int lastGenerationMessages;
+} BloomFilterStats;
+
+// length of the MUIDs given to dedup_check() and dedup_add(), as in CdpPacket.h
+#ifndef MUID_LENGTH
+#define MUID_LENGTH 4
+#endif
+
 // two-phase bloom filter
 class BloomFilter {
 private:
 
   unsigned int* filter1;
   unsigned int* filter2;
-  int activeFilter; // 1 or 2 
-  int numSectors; // power of 2
-  int numHashes;  
-  int bitsPerSector; //power of 2, smaller than numSectors
+  int activeFilter; // 1 or 2
+  int numSectors;
+  int numHashes;
+  int bitsPerSector; //power of 2, at most 32
+  int sectorShift; // log2(bitsPerSector)
+  uint32_t totalBits;
   int nMsg;
   int maxMsgs;
-  int* Seeds;
+  uint64_t seed;
+  // bits set in filter1 and filter2
+  uint32_t setBits1;
+  uint32_t setBits2;
+  // rotate once this many bits of the active filter are set, 0 is never
+  uint32_t maxSetBits;
+  unsigned long rotations;
+  int lastGenerationMessages;
+  // messages added since the filter was created
+  unsigned long adds;
 
-  static unsigned int djb2Hash(unsigned char* str, int seed, int msgSize);
+  // saved after the two filters by dedup_save()
+  struct State {
+    uint32_t version;
+    int32_t numSectors;
+    int32_t numHashes;
+    int32_t bitsPerSector;
+    uint64_t seed;
+    int32_t activeFilter;
+    int32_t nMsg;
+    uint32_t setBits1;
+    uint32_t setBits2;
+    uint32_t rotations;
+    int32_t lastGenerationMessages;
+  };
+  // state read by dedup_load(), applied by dedup_load_end()
+  State loaded;
 
   /**
-   * Generates a unique unsigned int index for each hash
-   * 
-   * @param msg, The message being hashed and converted into an index
-   * @param msgSize, The size of msg
-   * @param hashResults, Output as the bit index within the filter
+   * Seeded 64 bit hash of a message, FNV-1a followed by the murmur3 finalizer
+   * so that every bit of the result depends on every byte of the message.
    */
-  void set_hash_results(unsigned char* msg, int msgSize,
-    std::unique_ptr<unsigned int[]> & hashResults);
+  static uint64_t hash64(const unsigned char* msg, int msgSize, uint64_t seed);
 
-  void set_sectors_and_slots(const std::unique_ptr<unsigned int[]> & hashResults,
-    std::unique_ptr<int[]> & sectors, std::unique_ptr<unsigned int[]> & slots
-  );
+  /**
+   * Bit index of the i-th hash function, from the two halves of the message
+   * hash (Kirsch-Mitzenmacher double hashing). The index is mapped onto the
+   * filter with a multiply and a shift instead of a modulo.
+   */
+  uint32_t bit_index(uint32_t h1, uint32_t h2, int i) const {
+    return (uint32_t) (((uint64_t) (h1 + i * h2) * totalBits) >> 32);
+  }
 
-  int is_collision(const unsigned int* filter,
-    const std::unique_ptr<int[]> & sectors,
-    const std::unique_ptr<unsigned int[]> & slots
-  );
+  int is_collision(const unsigned int* filter, uint32_t h1, uint32_t h2) const;
+
+  /**
+   * Freeze the active filter and start adding to the other one, cleared.
+   */
+  void rotate();
 
 public:
 
@@ -49,11 +103,12 @@ public:
 
   /**
   * @brief Initialize a bloom filter
-  * 
+  *
   * @param numSectors, The number of sectors in filter
   * @param numHashes, The number of hash functions
-  * @param bitsPerSector, The size of a sector in bits
-  * @param maxMsgs, The maximum number of messages until the next filter is used.
+  * @param bitsPerSector, The size of a sector in bits, a power of 2 up to 32
+  * @param maxMsgs, The maximum number of messages until the next filter is used,
+  * 0 to only rotate on the fill ratio (see set_max_fill_ratio()).
   */
   BloomFilter(int numSectors, int numHashes, int bitsPerSector, int maxMsgs);
 
@@ -62,9 +117,75 @@ public:
   /**
    * @return 1 if we (possibly) found word; for a new word returns 0
    */
-  int bloom_check(unsigned char* msg, int msgSize);
+  int bloom_check(const unsigned char* msg, int msgSize) const;
+
+  void bloom_add(const unsigned char* msg, int msgSize);
+
+  /**
+   * @brief Also rotate once the active filter is filled up to a ratio.
+   *
+   * The false positive rate of a filter with k hash functions is about
+   * fillRatio^k, so this bounds it whatever the message rate.
+   *
+   * @param ratio share of the bits set that triggers a rotation, 0 to disable
+   */
+  void set_max_fill_ratio(float ratio);
+
+  BloomFilterStats bloom_stats() const;
+
+  /**
+   * @brief Check if a message was (possibly) already seen, the interface
+   * shared with DuckMuidCache. The filter only looks at the MUID.
+   */
+  bool dedup_check(const unsigned char* /*sduid*/, const unsigned char* muid) const {
+    return bloom_check(muid, MUID_LENGTH);
+  }
+
+  /**
+   * @brief Remember a message, the interface shared with DuckMuidCache.
+   */
+  void dedup_add(const unsigned char* /*sduid*/, const unsigned char* muid) {
+    bloom_add(muid, MUID_LENGTH);
+  }
+
+  BloomFilterStats dedup_stats() const { return bloom_stats(); }
+
+  /**
+   * @brief Number of messages added since the filter was created, to tell
+   * whether it changed.
+   */
+  unsigned long dedup_adds() const { return adds; }
+
+  /**
+   * @brief Length of the filter state: both filters, the seed and the counters.
+   */
+  int dedup_state_size() const;
 
-  void bloom_add(unsigned char* msg, int msgSize);
+  /**
+   * @brief Copy a chunk of the filter state, to save it across reboots.
+   *
+   * The filter may change between two chunks: a message added meanwhile is
+   * only missing from the saved filters if its chunk was copied before.
+   *
+   * @param offset position of the chunk in the state
+   * @param data buffer to copy the chunk to
+   * @param length chunk length
+   */
+  void dedup_save(int offset, unsigned char* data, int length) const;
+
+  /**
+   * @brief Load a chunk of a filter state saved by dedup_save(). The filters
+   * are overwritten, the seed and counters are applied by dedup_load_end().
+   */
+  void dedup_load(int offset, const unsigned char* data, int length);
+
+  /**
+   * @brief Apply the state loaded by dedup_load().
+   *
+   * @return true if it was saved by a filter of the same size, otherwise the
+   * filter is cleared
+   */
+  bool dedup_load_end();
 
 };
 
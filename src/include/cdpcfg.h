@@ -342,6 +342,27 @@
 // actualy missing
 #define CDPCFG_PIN_LORA_DIO1 -1
 
+/*
+ * Native host build (Linux), see test/CMakeLists.txt
+ * The radio is the in-memory RadioLib mock of test/shim/RadioLib.h
+ */
+#elif defined(CDPCFG_HOST)
+
+// Lora configurations, the mock ignores the pins
+#define CDPCFG_PIN_LORA_CS 0
+#define CDPCFG_PIN_LORA_DIO0 1
+#define CDPCFG_PIN_LORA_DIO1 2
+#define CDPCFG_PIN_LORA_RST 3
+
+// there is no interrupt line, the radio flags are polled from the duck loop
+#define CDPCFG_RADIO_POLL_IRQ
+
+// Oled Display settings
+#define CDPCFG_OLED_NONE
+
+// Wifi module
+#define CDPCFG_WIFI_NONE
+
 #else // Default to WIFI_LORA_32_V2 board
 
 #if !defined(ARDUINO_HELTEC_WIFI_LORA_32_V2)
@@ -388,6 +409,9 @@
 #define CDPCFG_UPDATE_USERNAME "user"
 #define CDPCFG_UPDATE_PASSWORD "pass"
 
+/// EEPROM size begun for the credentials, a larger EEPROM begun by a
+/// DuckEepromStorage is kept
+#define CDPCFG_EEPROM_CRED_SIZE 512
 #define CDPCFG_EEPROM_CRED_MAX 32
 #define CDPCFG_EEPROM_WIFI_USERNAME 0
 #define CDPCFG_EEPROM_WIFI_PASSWORD 32
@@ -419,9 +443,222 @@
 #define CDPCFG_RF_LORA_TXPOW 20
 /// Antenna Gain correction
 #define CDPCFG_RF_LORA_GAIN 0
+/// Coding rate denominator (4/5 to 4/8), RadioLib default
+#ifndef CDPCFG_RF_LORA_CR
+#define CDPCFG_RF_LORA_CR 7
+#endif
+/// Preamble length in symbols, RadioLib default
+#ifndef CDPCFG_RF_LORA_PREAMBLE
+#define CDPCFG_RF_LORA_PREAMBLE 8
+#endif
 
 /// CDP message buffer max length
 #define CDPCFG_CDP_BUFSIZE 256
+/// Number of received frames the radio can queue (must be a power of 2)
+#ifndef CDPCFG_RX_QUEUE_SIZE
+#define CDPCFG_RX_QUEUE_SIZE 4
+#endif
+/// Number of frames that can wait for the radio to transmit them
+#ifndef CDPCFG_TX_QUEUE_SIZE
+#define CDPCFG_TX_QUEUE_SIZE 4
+#endif
+/// Time after which a transmission without TX done interrupt is abandoned (ms)
+#ifndef CDPCFG_TX_TIMEOUT_MS
+#define CDPCFG_TX_TIMEOUT_MS 10000
+#endif
+/// Listen before talk: run channel activity detection before every transmission
+#ifndef CDPCFG_CSMA_ENABLED
+#define CDPCFG_CSMA_ENABLED false
+#endif
+/// Initial CSMA backoff window (ms), doubled every time the channel is busy
+#ifndef CDPCFG_CSMA_BACKOFF_MS
+#define CDPCFG_CSMA_BACKOFF_MS 100
+#endif
+/// Number of CSMA backoffs after which a frame is transmitted anyway
+#ifndef CDPCFG_CSMA_MAX_BACKOFFS
+#define CDPCFG_CSMA_MAX_BACKOFFS 5
+#endif
+/// Time after which a channel scan without CAD done interrupt is abandoned (ms)
+#ifndef CDPCFG_CAD_TIMEOUT_MS
+#define CDPCFG_CAD_TIMEOUT_MS 500
+#endif
+/// Copies of a packet after which a mama cancels its relay, 0 disables suppression
+#ifndef CDPCFG_RELAY_SUPPRESSION_COUNT
+#define CDPCFG_RELAY_SUPPRESSION_COUNT 0
+#endif
+/// Upper bound of the random delay before a mama relays a packet (ms)
+#ifndef CDPCFG_RELAY_ASSESSMENT_DELAY_MS
+#define CDPCFG_RELAY_ASSESSMENT_DELAY_MS 500
+#endif
+/// Number of relays that can wait for their assessment delay
+#ifndef CDPCFG_RELAY_PENDING_SIZE
+#define CDPCFG_RELAY_PENDING_SIZE 4
+#endif
+/// Number of topics that can be given their own relay hop limit
+#ifndef CDPCFG_TOPIC_TTL_SIZE
+#define CDPCFG_TOPIC_TTL_SIZE 8
+#endif
+/// Share of the time the radio may transmit in per mille, 0 disables the budget
+#ifndef CDPCFG_DUTY_CYCLE_PERMILLE
+#define CDPCFG_DUTY_CYCLE_PERMILLE 0
+#endif
+/// Duty cycle enforced by setChannel() on the EU channels, 1% (ETSI EN 300 220)
+#ifndef CDPCFG_DUTY_CYCLE_EU_PERMILLE
+#define CDPCFG_DUTY_CYCLE_EU_PERMILLE 10
+#endif
+/// Sliding window over which the duty cycle is measured (ms)
+#ifndef CDPCFG_DUTY_CYCLE_WINDOW_MS
+#define CDPCFG_DUTY_CYCLE_WINDOW_MS 3600000
+#endif
+/// Number of buckets of the sliding window, the window slides one bucket at a time
+#ifndef CDPCFG_DUTY_CYCLE_BUCKETS
+#define CDPCFG_DUTY_CYCLE_BUCKETS 60
+#endif
+/// Share of the budget (%) kept for high and normal priority frames: low
+/// priority frames are dropped once less is left
+#ifndef CDPCFG_DUTY_CYCLE_RESERVE_PERCENT
+#define CDPCFG_DUTY_CYCLE_RESERVE_PERCENT 20
+#endif
+/// Longest time on air of a single frame (ms), 400 for US FCC dwell time, 0 is unlimited
+#ifndef CDPCFG_MAX_DWELL_MS
+#define CDPCFG_MAX_DWELL_MS 0
+#endif
+/// Number of ducks in radio range whose link quality is tracked
+#ifndef CDPCFG_NEIGHBOR_TABLE_SIZE
+#define CDPCFG_NEIGHBOR_TABLE_SIZE 16
+#endif
+/// Time after which a silent neighbor is considered gone (ms)
+#ifndef CDPCFG_NEIGHBOR_TIMEOUT_MS
+#define CDPCFG_NEIGHBOR_TIMEOUT_MS 3600000
+#endif
+/// Directed forwarding: frames addressed to a duck are only relayed towards it.
+/// Every duck of the cluster needs firmware with extension trailers, see AgnoDuck::setRouting()
+#ifndef CDPCFG_ROUTING_ENABLED
+#define CDPCFG_ROUTING_ENABLED false
+#endif
+/// Number of ducks the distance to is remembered for directed forwarding
+#ifndef CDPCFG_ROUTE_TABLE_SIZE
+#define CDPCFG_ROUTE_TABLE_SIZE 32
+#endif
+/// Time after which a route that was not heard again is forgotten (ms)
+#ifndef CDPCFG_ROUTE_TIMEOUT_MS
+#define CDPCFG_ROUTE_TIMEOUT_MS 600000
+#endif
+/// A frame received with less SNR margin than this (dB) counts as an extra hop
+#ifndef CDPCFG_ROUTE_WEAK_LINK_DB
+#define CDPCFG_ROUTE_WEAK_LINK_DB 5
+#endif
+/// Route record: the frames this duck sends collect the short ID of each relay
+#ifndef CDPCFG_ROUTE_RECORD
+#define CDPCFG_ROUTE_RECORD false
+#endif
+/// Adaptive data rate: the cluster moves to the lowest spreading factor its links allow
+#ifndef CDPCFG_ADR_ENABLED
+#define CDPCFG_ADR_ENABLED false
+#endif
+/// Lowest spreading factor used by the adaptive data rate
+#ifndef CDPCFG_ADR_MIN_SF
+#define CDPCFG_ADR_MIN_SF 7
+#endif
+/// Highest spreading factor used by the adaptive data rate
+#ifndef CDPCFG_ADR_MAX_SF
+#define CDPCFG_ADR_MAX_SF 12
+#endif
+/// SNR margin above the demodulation floor every link must keep (dB)
+#ifndef CDPCFG_ADR_MARGIN_DB
+#define CDPCFG_ADR_MARGIN_DB 10
+#endif
+/// Extra margin required to lower the spreading factor (dB)
+#ifndef CDPCFG_ADR_HYSTERESIS_DB
+#define CDPCFG_ADR_HYSTERESIS_DB 3
+#endif
+/// Interval between link beacons (ms), neighbors not heard for 3 intervals are forgotten
+#ifndef CDPCFG_ADR_INTERVAL_MS
+#define CDPCFG_ADR_INTERVAL_MS 60000
+#endif
+/// Delay between a spreading factor change proposal and the change (ms)
+#ifndef CDPCFG_ADR_SWITCH_DELAY_MS
+#define CDPCFG_ADR_SWITCH_DELAY_MS 10000
+#endif
+/// Define to detect the messages already seen with an exact, time windowed
+/// cache (DuckMuidCache, 8 bytes per entry) instead of the bloom filter
+//#define CDPCFG_DEDUP_MUID_CACHE
+/// Entries of the message cache, a power of 2
+#ifndef CDPCFG_DEDUP_CACHE_SIZE
+#define CDPCFG_DEDUP_CACHE_SIZE 512
+#endif
+/// Time a message is remembered by the message cache (s), at most 16383
+#ifndef CDPCFG_DEDUP_WINDOW_S
+#define CDPCFG_DEDUP_WINDOW_S 600
+#endif
+/// Messages sent by the duck whose ack is tracked, see AgnoDuck::getMuidStatus()
+#ifndef CDPCFG_INFLIGHT_TABLE_SIZE
+#define CDPCFG_INFLIGHT_TABLE_SIZE 8
+#endif
+/// Reliable messages waiting for their ack at the same time, their frame is
+/// kept to send them again. Less than CDPCFG_INFLIGHT_TABLE_SIZE
+#ifndef CDPCFG_RELIABLE_PENDING
+#define CDPCFG_RELIABLE_PENDING 4
+#endif
+/// Time after which a reliable message that was not acked is given up (ms)
+#ifndef CDPCFG_RELIABLE_DEADLINE_MS
+#define CDPCFG_RELIABLE_DEADLINE_MS 60000
+#endif
+/// Delay before the first retransmission of a reliable message, doubled after each one (ms)
+#ifndef CDPCFG_RELIABLE_BACKOFF_MS
+#define CDPCFG_RELIABLE_BACKOFF_MS 4000
+#endif
+/// Longest delay between two retransmissions of a reliable message (ms)
+#ifndef CDPCFG_RELIABLE_MAX_BACKOFF_MS
+#define CDPCFG_RELIABLE_MAX_BACKOFF_MS 30000
+#endif
+/// Messages acked per broadcast ack by a gateway, at most MAX_MUID_PER_ACK.
+/// 0 leaves acks off, see MamaDuck::setAckAggregation()
+#ifndef CDPCFG_ACK_BATCH_SIZE
+#define CDPCFG_ACK_BATCH_SIZE 0
+#endif
+/// Longest time a received message waits for its broadcast ack (ms)
+#ifndef CDPCFG_ACK_DEADLINE_MS
+#define CDPCFG_ACK_DEADLINE_MS 1000
+#endif
+/// Messages acked recently whose copies are not acked again
+#ifndef CDPCFG_ACK_RECENT_SIZE
+#define CDPCFG_ACK_RECENT_SIZE 32
+#endif
+/// Time after which a copy of a message already acked is acked again (ms).
+/// Shorter than CDPCFG_RELIABLE_BACKOFF_MS, so that retransmissions are acked
+#ifndef CDPCFG_ACK_REPEAT_MS
+#define CDPCFG_ACK_REPEAT_MS 3000
+#endif
+/// Interval between two checkpoints of the messages already seen (ms), see
+/// AgnoDuck::setCheckpointStorage()
+#ifndef CDPCFG_CHECKPOINT_INTERVAL_MS
+#define CDPCFG_CHECKPOINT_INTERVAL_MS 300000
+#endif
+/// Checkpoint slots written in turn, an older checkpoint is read back if the
+/// newest one is damaged. At least 2
+#ifndef CDPCFG_CHECKPOINT_SLOTS
+#define CDPCFG_CHECKPOINT_SLOTS 2
+#endif
+/// Bytes of a checkpoint written per call to run()
+#ifndef CDPCFG_CHECKPOINT_CHUNK
+#define CDPCFG_CHECKPOINT_CHUNK 128
+#endif
+/// Start of the checkpoints in the EEPROM, after the WiFi credentials
+#ifndef CDPCFG_CHECKPOINT_EEPROM_OFFSET
+#define CDPCFG_CHECKPOINT_EEPROM_OFFSET 512
+#endif
+/// Size of the checkpoints area in the EEPROM, the slots that do not fit are not
+/// used. It must hold 2 slots of a 12 byte header and the state of the filter of
+/// the messages already seen: 2544 bytes for the bloom filter, the entries and
+/// a few bytes for the message cache
+#ifndef CDPCFG_CHECKPOINT_EEPROM_SIZE
+#ifdef CDPCFG_DEDUP_MUID_CACHE
+#define CDPCFG_CHECKPOINT_EEPROM_SIZE (2 * (8 * CDPCFG_DEDUP_CACHE_SIZE + 32))
+#else
+#define CDPCFG_CHECKPOINT_EEPROM_SIZE 6144
+#endif
+#endif
 /// CDP UUID generator max length
 #define CDPCFG_UUID_LEN 8
 
@@ -0,0 +1,225 @@
+/**
+ * @file bench_bloomfilter.cpp
+ * @brief Host benchmark of the BloomFilter against the implementation it
+ * replaces.
+ *
+ * The previous filter is kept below, without its logging: djb2 per seed,
+ * three heap arrays per call, pow() per hash and a quadratic dedup of the
+ * bit indices. Both filters see the same MUIDs, a relay checks then adds
+ * each of them. Heap allocations are counted by replacing the global
+ * operator new, the new filter must not allocate.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "include/bloomfilter.h"
+
+static unsigned long allocations = 0;
+
+void* operator new(size_t size) {
+  allocations++;
+  void* p = malloc(size ? size : 1);
+  if (p == NULL) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new[](size_t size) {
+  allocations++;
+  void* p = malloc(size ? size : 1);
+  if (p == NULL) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+
+namespace {
+
+class LegacyBloomFilter {
+public:
+  LegacyBloomFilter(int numSectors, int numHashes, int bitsPerSector, int maxMsgs)
+    : numSectors(numSectors), numHashes(numHashes), bitsPerSector(bitsPerSector),
+      nMsg(0), maxMsgs(maxMsgs), activeFilter(1) {
+    filter1 = new unsigned int[numSectors]();
+    filter2 = new unsigned int[numSectors]();
+    seeds = new int[numHashes];
+    for (int i = 0; i < numHashes; i++) {
+      seeds[i] = rand();
+    }
+  }
+
+  ~LegacyBloomFilter() {
+    delete[] seeds;
+    delete[] filter2;
+    delete[] filter1;
+  }
+
+  int bloom_check(unsigned char* msg, int msgSize) {
+    std::unique_ptr<unsigned int[]> hashResults(new unsigned int[numHashes]);
+    set_hash_results(msg, msgSize, hashResults);
+    std::unique_ptr<int[]> sectors(new int[numHashes]);
+    std::unique_ptr<unsigned int[]> slots(new unsigned int[numHashes]);
+    set_sectors_and_slots(hashResults, sectors, slots);
+    return is_collision(filter1, sectors, slots) || is_collision(filter2, sectors, slots);
+  }
+
+  void bloom_add(unsigned char* msg, int msgSize) {
+    nMsg += 1;
+    std::unique_ptr<unsigned int[]> hashResults(new unsigned int[numHashes]);
+    set_hash_results(msg, msgSize, hashResults);
+    std::unique_ptr<int[]> sectors(new int[numHashes]);
+    std::unique_ptr<unsigned int[]> slots(new unsigned int[numHashes]);
+    set_sectors_and_slots(hashResults, sectors, slots);
+    unsigned int* filter = activeFilter == 1 ? filter1 : filter2;
+    for (int i = 0; i < numHashes; i++) {
+      filter[sectors[i]] |= slots[i];
+    }
+    if (nMsg >= maxMsgs) {
+      unsigned int* next = activeFilter == 1 ? filter2 : filter1;
+      for (int i = 0; i < numSectors / bitsPerSector; i++) {
+        next[i] = 0;
+      }
+      activeFilter = activeFilter == 1 ? 2 : 1;
+      nMsg = 0;
+    }
+  }
+
+private:
+  static unsigned int djb2Hash(unsigned char* str, int seed, int msgSize) {
+    unsigned int hash = seed;
+    for (int i = 0; i < msgSize; i++) {
+      hash = ((hash << 5) + hash) + *str++;
+    }
+    return hash;
+  }
+
+  void set_hash_results(unsigned char* msg, int msgSize,
+                        std::unique_ptr<unsigned int[]> & hashResults) {
+    for (int i = 0; i < numHashes; i++) {
+      unsigned int totalBitSize = numSectors * bitsPerSector;
+      unsigned int hashResult = djb2Hash(msg, seeds[i], msgSize) % totalBitSize;
+      int hashCollision;
+      do {
+        hashCollision = 0;
+        for (int j = 0; j < i; j++) {
+          if (hashResult == hashResults[j]) {
+            hashCollision = 1;
+          }
+        }
+        if (hashCollision == 1) {
+          hashResult = (hashResult + 1) % totalBitSize;
+        }
+      } while (hashCollision == 1);
+      hashResults[i] = hashResult;
+    }
+  }
+
+  void set_sectors_and_slots(const std::unique_ptr<unsigned int[]> & hashResults,
+                             std::unique_ptr<int[]> & sectors,
+                             std::unique_ptr<unsigned int[]> & slots) {
+    for (int i = 0; i < numHashes; i++) {
+      sectors[i] = hashResults[i] / bitsPerSector;
+      int offset = hashResults[i] % bitsPerSector;
+      unsigned int x = pow(2, bitsPerSector - 1);
+      slots[i] = x >> offset;
+    }
+  }
+
+  int is_collision(const unsigned int* filter, const std::unique_ptr<int[]> & sectors,
+                   const std::unique_ptr<unsigned int[]> & slots) {
+    for (int i = 0; i < numHashes; i++) {
+      if ((filter[sectors[i]] & slots[i]) == 0) {
+        return 0;
+      }
+    }
+    return 1;
+  }
+
+  unsigned int* filter1;
+  unsigned int* filter2;
+  int* seeds;
+  int numSectors;
+  int numHashes;
+  int bitsPerSector;
+  int nMsg;
+  int maxMsgs;
+  int activeFilter;
+};
+
+// Same settings as AgnoDuck.cpp
+const int NUM_SECTORS = 312;
+const int BITS_PER_SECTOR = 32;
+const int MAX_MESSAGES = 100;
+
+const int ITERATIONS = 200000;
+
+struct Result {
+  double nsPerOp;
+  double allocsPerOp;
+};
+
+template<typename F>
+Result measure(F op) {
+  unsigned long before = allocations;
+  std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+  for (int i = 0; i < ITERATIONS; i++) {
+    op(i);
+  }
+  std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+  Result r;
+  r.nsPerOp = std::chrono::duration<double, std::nano>(t2 - t1).count() / ITERATIONS;
+  r.allocsPerOp = (double) (allocations - before) / ITERATIONS;
+  return r;
+}
+
+} // namespace
+
+int main() {
+  // random MUIDs, some of them seen twice as a relay would
+  srand(1);
+  std::vector<unsigned char> muids(ITERATIONS * 4);
+  for (size_t i = 0; i < muids.size(); i++) {
+    muids[i] = rand() & 0xFF;
+  }
+  for (int i = 1; i < ITERATIONS; i += 3) {
+    for (int j = 0; j < 4; j++) {
+      muids[i * 4 + j] = muids[(i - 1) * 4 + j];
+    }
+  }
+
+  printf("BloomFilter benchmark (%d check+add, %d sectors)\n", ITERATIONS, NUM_SECTORS);
+  int numHashes[] = {2, 4, 8};
+  for (int k = 0; k < 3; k++) {
+    LegacyBloomFilter legacy(NUM_SECTORS, numHashes[k], BITS_PER_SECTOR, MAX_MESSAGES);
+    Result before = measure([&](int i) {
+      if (!legacy.bloom_check(&muids[i * 4], 4)) {
+        legacy.bloom_add(&muids[i * 4], 4);
+      }
+    });
+    BloomFilter filter(NUM_SECTORS, numHashes[k], BITS_PER_SECTOR, MAX_MESSAGES);
+    Result after = measure([&](int i) {
+      if (!filter.bloom_check(&muids[i * 4], 4)) {
+        filter.bloom_add(&muids[i * 4], 4);
+      }
+    });
+    printf("  k=%d legacy: %7.1f ns/op %5.2f allocs/op  new: %7.1f ns/op %5.2f allocs/op  (x%.1f)\n",
+           numHashes[k], before.nsPerOp, before.allocsPerOp, after.nsPerOp, after.allocsPerOp,
+           before.nsPerOp / after.nsPerOp);
+    if (after.allocsPerOp > 0) {
+      printf("FAIL: BloomFilter allocates on the check/add path\n");
+      return 1;
+    }
+  }
+  return 0;
+}
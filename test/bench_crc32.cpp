@@ -0,0 +1,63 @@
+/**
+ * @file bench_crc32.cpp
+ * @brief Host benchmark of the slice-by-4 duckcrc::crc32 against the CRC32
+ * library call it replaces.
+ *
+ * The results must be identical for every length, the timings are reported
+ * for a full size data section.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include <CRC32.h>
+
+#include "include/DuckCrc.h"
+#include "CdpPacket.h"
+
+const int ITERATIONS = 20000;
+
+template<typename F>
+double measure(F op) {
+  std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+  for (int i = 0; i < ITERATIONS; i++) {
+    op(i);
+  }
+  std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(t2 - t1).count() / ITERATIONS;
+}
+
+int main() {
+  uint8_t data[PACKET_LENGTH];
+  srand(1);
+  for (int i = 0; i < PACKET_LENGTH; i++) {
+    data[i] = rand() & 0xFF;
+  }
+
+  // well known check value of the CRC-32/ISO-HDLC parameters
+  assert(duckcrc::crc32((const uint8_t*) "123456789", 9) == 0xCBF43926);
+
+  // every length and every alignment of the tail loop
+  for (int offset = 0; offset < 4; offset++) {
+    for (int length = 0; length <= PACKET_LENGTH - offset; length++) {
+      assert(duckcrc::crc32(data + offset, length) == CRC32::calculate(data + offset, length));
+    }
+  }
+
+  volatile uint32_t sink = 0;
+  double library = measure([&](int i) {
+    data[0] = i;
+    sink = sink ^ CRC32::calculate(data, MAX_DATA_LENGTH);
+  });
+  double sliced = measure([&](int i) {
+    data[0] = i;
+    sink = sink ^ duckcrc::crc32(data, MAX_DATA_LENGTH);
+  });
+
+  printf("CRC32 benchmark (%d iterations, %d byte data section)\n", ITERATIONS, MAX_DATA_LENGTH);
+  printf("  CRC32::calculate : %8.1f ns/op\n", library);
+  printf("  duckcrc::crc32   : %8.1f ns/op  (x%.1f)\n", sliced, library / sliced);
+  return 0;
+}
@@ -0,0 +1,132 @@
+/**
+ * @file bench_duckpacket.cpp
+ * @brief Host benchmark of the DuckPacket send and relay preparation.
+ *
+ * Every heap allocation is counted by replacing the global operator new. The
+ * BloomFilter is measured on its own so that the allocations done by the
+ * DuckPacket frame handling can be reported separately.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <new>
+#include <vector>
+
+#include "include/DuckPacket.h"
+
+static unsigned long allocations = 0;
+
+void* operator new(size_t size) {
+  allocations++;
+  void* p = malloc(size ? size : 1);
+  if (p == NULL) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new[](size_t size) {
+  allocations++;
+  void* p = malloc(size ? size : 1);
+  if (p == NULL) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+
+// Same settings as AgnoDuck.cpp
+const int NUM_SECTORS = 312;
+const int NUM_HASH_FUNCS = 2;
+const int BITS_PER_SECTOR = 32;
+const int MAX_MESSAGES = 100;
+
+const int ITERATIONS = 100000;
+const int PAYLOAD_LENGTH = 32;
+
+struct Result {
+  double nsPerOp;
+  double allocsPerOp;
+};
+
+template<typename F>
+Result measure(F op) {
+  unsigned long before = allocations;
+  std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+  for (int i = 0; i < ITERATIONS; i++) {
+    op(i);
+  }
+  std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+  Result r;
+  r.nsPerOp = std::chrono::duration<double, std::nano>(t2 - t1).count() / ITERATIONS;
+  r.allocsPerOp = (double) (allocations - before) / ITERATIONS;
+  return r;
+}
+
+int main() {
+  std::vector<byte> duid(DUID_LENGTH, 'D');
+  DuckPacket packet(duid);
+  byte payload[PAYLOAD_LENGTH];
+  for (int i = 0; i < PAYLOAD_LENGTH; i++) {
+    payload[i] = 'a' + (i % 26);
+  }
+
+  // Frames to relay, built before anything is measured.
+  std::vector<std::vector<byte> > frames(ITERATIONS);
+  {
+    BloomFilter scratch(NUM_SECTORS, NUM_HASH_FUNCS, BITS_PER_SECTOR, MAX_MESSAGES);
+    for (int i = 0; i < ITERATIONS; i++) {
+      int err = packet.prepareForSending(&scratch, ZERO_DUID.data(), DuckType::LINK,
+                                         topics::status, payload, PAYLOAD_LENGTH);
+      assert(err == DUCK_ERR_NONE);
+      frames[i].assign(packet.getBuffer(), packet.getBuffer() + packet.getBufferLength());
+    }
+  }
+
+  BloomFilter sendFilter(NUM_SECTORS, NUM_HASH_FUNCS, BITS_PER_SECTOR, MAX_MESSAGES);
+  Result send = measure([&](int) {
+    packet.prepareForSending(&sendFilter, ZERO_DUID.data(), DuckType::MAMA,
+                             topics::status, payload, PAYLOAD_LENGTH);
+  });
+  // prepareForSending does one bloom_check per generated MUID
+  Result sendFilterOnly = measure([&](int i) {
+    sendFilter.bloom_check(&frames[i][MUID_POS], MUID_LENGTH);
+  });
+
+  // Both filters draw the same seeds so they make the same decisions.
+  srand(1);
+  BloomFilter relayFilter(NUM_SECTORS, NUM_HASH_FUNCS, BITS_PER_SECTOR, MAX_MESSAGES);
+  Result relay = measure([&](int i) {
+    packet.prepareForRelaying(&relayFilter, frames[i]);
+  });
+  srand(1);
+  BloomFilter relayFilterOnly(NUM_SECTORS, NUM_HASH_FUNCS, BITS_PER_SECTOR, MAX_MESSAGES);
+  Result relayFilterCost = measure([&](int i) {
+    if (!relayFilterOnly.bloom_check(&frames[i][MUID_POS], MUID_LENGTH)) {
+      relayFilterOnly.bloom_add(&frames[i][MUID_POS], MUID_LENGTH);
+    }
+  });
+
+  double sendPacketAllocs = send.allocsPerOp - sendFilterOnly.allocsPerOp;
+  double relayPacketAllocs = relay.allocsPerOp - relayFilterCost.allocsPerOp;
+
+  printf("DuckPacket benchmark (%d iterations, %d byte payload)\n", ITERATIONS, PAYLOAD_LENGTH);
+  printf("  send : %8.1f ns/op  %5.2f allocs/op (BloomFilter %5.2f, DuckPacket %5.2f)\n",
+         send.nsPerOp, send.allocsPerOp, sendFilterOnly.allocsPerOp, sendPacketAllocs);
+  printf("  relay: %8.1f ns/op  %5.2f allocs/op (BloomFilter %5.2f, DuckPacket %5.2f)\n",
+         relay.nsPerOp, relay.allocsPerOp, relayFilterCost.allocsPerOp, relayPacketAllocs);
+
+  if (sendPacketAllocs > 0 || relayPacketAllocs > 0) {
+    printf("FAIL: DuckPacket allocates on the send/relay path\n");
+    return 1;
+  }
+  if (sendFilterOnly.allocsPerOp > 0 || relayFilterCost.allocsPerOp > 0) {
+    printf("FAIL: BloomFilter allocates on the send/relay path\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,71 @@
+/**
+ * @file bench_logging.cpp
+ * @brief Host benchmark of the relay path cost with logging compiled in at a
+ * given level.
+ *
+ * The benchmark is built once per CDP_LOG_LEVEL. The CPU time is measured on
+ * the host, the time spent blocked on the serial port is projected from the
+ * number of bytes logged at 115200 baud (10 bits per byte).
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+
+#include "include/DuckPacket.h"
+
+// Same settings as AgnoDuck.cpp
+const int NUM_SECTORS = 312;
+const int NUM_HASH_FUNCS = 2;
+const int BITS_PER_SECTOR = 32;
+const int MAX_MESSAGES = 100;
+
+const int ITERATIONS = 10000;
+const int PAYLOAD_LENGTH = 32;
+const double SERIAL_BAUD = 115200.0;
+
+static const char* LEVEL_NAMES[] = {"none", "error", "warn", "info", "debug"};
+
+int main() {
+  std::vector<byte> duid(DUID_LENGTH, 'D');
+  DuckPacket packet(duid);
+  byte payload[PAYLOAD_LENGTH];
+  for (int i = 0; i < PAYLOAD_LENGTH; i++) {
+    payload[i] = 'a' + (i % 26);
+  }
+
+  std::vector<std::vector<byte> > frames(ITERATIONS);
+  {
+    BloomFilter scratch(NUM_SECTORS, NUM_HASH_FUNCS, BITS_PER_SECTOR, MAX_MESSAGES);
+    for (int i = 0; i < ITERATIONS; i++) {
+      int err = packet.prepareForSending(&scratch, ZERO_DUID.data(), DuckType::LINK,
+                                         topics::status, payload, PAYLOAD_LENGTH);
+      assert(err == DUCK_ERR_NONE);
+      frames[i].assign(packet.getBuffer(), packet.getBuffer() + packet.getBufferLength());
+    }
+  }
+
+  BloomFilter filter(NUM_SECTORS, NUM_HASH_FUNCS, BITS_PER_SECTOR, MAX_MESSAGES);
+  Serial.resetBytesWritten();
+  std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+  for (int i = 0; i < ITERATIONS; i++) {
+    packet.prepareForRelaying(&filter, frames[i]);
+  }
+  std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+
+  double cpuUs = std::chrono::duration<double, std::micro>(t2 - t1).count() / ITERATIONS;
+  double bytesPerOp = (double) Serial.getBytesWritten() / ITERATIONS;
+  double serialUs = bytesPerOp * 10.0 / SERIAL_BAUD * 1e6;
+
+  printf("Relay path with logging at level %d (%s), %d iterations\n",
+         CDP_LOG_LEVEL, LEVEL_NAMES[CDP_LOG_LEVEL], ITERATIONS);
+  printf("  cpu %8.2f us/op  serial %7.1f bytes/op  -> %8.1f us/op blocked at 115200 baud\n",
+         cpuUs, bytesPerOp, serialUs);
+
+  if (CDP_LOG_LEVEL == CDP_LOG_LEVEL_NONE && Serial.getBytesWritten() != 0) {
+    printf("FAIL: logging disabled but bytes were written to Serial\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,42 @@
+/**
+ * @file AES.h
+ * @brief Host shim of the rweather/Crypto AES256 block cipher.
+ *
+ * NOT a real AES implementation: it derives a keyed pseudo random block so
+ * that CTR mode round-trips on the host. Never use it outside host builds.
+ */
+
+#ifndef CDP_HOST_AES_H
+#define CDP_HOST_AES_H
+
+#include "Crypto.h"
+#include <string.h>
+
+class AES256 {
+public:
+  size_t blockSize() const { return 16; }
+  size_t keySize() const { return 32; }
+
+  bool setKey(const uint8_t* k, size_t len) {
+    if (len != 32) {
+      return false;
+    }
+    memcpy(key, k, 32);
+    return true;
+  }
+
+  void encryptBlock(uint8_t* output, const uint8_t* input) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < 16; i++) {
+      h = (h ^ input[i] ^ key[i] ^ key[i + 16]) * 16777619u;
+      output[i] = (uint8_t) (h >> 24);
+    }
+  }
+
+  void clear() { memset(key, 0, sizeof(key)); }
+
+private:
+  uint8_t key[32] = {0};
+};
+
+#endif
@@ -0,0 +1,85 @@
+#include "Arduino.h"
+#include "EEPROM.h"
+
+#include <chrono>
+#include <random>
+#include <thread>
+
+HardwareSerial Serial;
+EEPROMClass EEPROM;
+
+namespace cdphost {
+
+namespace {
+  bool wallClock = true;
+  uint64_t simMicros = 0;
+  std::mt19937 rng(5489u);
+
+  uint64_t wallMicros() {
+    static const std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start).count();
+  }
+}
+
+void useWallClock(bool enable) { wallClock = enable; }
+void setMicros(uint64_t us) { simMicros = us; }
+void advanceMicros(uint64_t us) { simMicros += us; }
+uint64_t nowMicros() { return wallClock ? wallMicros() : simMicros; }
+
+void sleepMicros(uint64_t us) {
+  if (wallClock) {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+  } else {
+    simMicros += us;
+  }
+}
+
+long randomRange(long min, long max) {
+  if (max <= min) {
+    return min;
+  }
+  std::uniform_int_distribution<long> dist(min, max - 1);
+  return dist(rng);
+}
+
+void seed(unsigned long value) { rng.seed(value); }
+
+} // namespace cdphost
+
+unsigned long millis() { return (unsigned long) (cdphost::nowMicros() / 1000); }
+unsigned long micros() { return (unsigned long) cdphost::nowMicros(); }
+
+void delay(unsigned long ms) { delayMicroseconds(ms * 1000); }
+
+void delayMicroseconds(unsigned int us) { cdphost::sleepMicros(us); }
+
+long random(long max) { return cdphost::randomRange(0, max); }
+long random(long min, long max) { return cdphost::randomRange(min, max); }
+void randomSeed(unsigned long seed) { cdphost::seed(seed); }
+
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+int digitalRead(uint8_t) { return LOW; }
+int analogRead(uint8_t) { return 0; }
+
+size_t HardwareSerial::write(const char* str, size_t size) {
+  bytesWritten += size;
+  if (echo) {
+    fwrite(str, 1, size, stdout);
+  }
+  return size;
+}
+
+size_t HardwareSerial::printf(const char* format, ...) {
+  char buf[256];
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+  if (n < 0) {
+    return 0;
+  }
+  return write(buf, n < (int) sizeof(buf) ? n : sizeof(buf) - 1);
+}
@@ -0,0 +1,61 @@
+/**
+ * @file Arduino.h
+ * @brief Minimal Arduino core shim used to build the CDP library on a host
+ * (Linux) machine. Only the parts of the Arduino API used by the library are
+ * provided.
+ */
+
+#ifndef CDP_HOST_ARDUINO_H
+#define CDP_HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <algorithm>
+
+#include "WString.h"
+#include "HardwareSerial.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x0
+#define OUTPUT 0x1
+
+namespace cdphost {
+
+/**
+ * @brief Host clock used by millis() and micros().
+ *
+ * By default the clock follows the wall clock. Simulations can freeze it and
+ * drive it explicitly with setMicros()/advanceMicros().
+ */
+void useWallClock(bool enable);
+void setMicros(uint64_t us);
+void advanceMicros(uint64_t us);
+uint64_t nowMicros();
+void sleepMicros(uint64_t us);
+long randomRange(long min, long max);
+void seed(unsigned long value);
+
+} // namespace cdphost
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+
+#endif
@@ -0,0 +1,56 @@
+/**
+ * @file CRC32.h
+ * @brief Host shim of the bakercp/CRC32 Arduino library.
+ *
+ * Mirrors the upstream implementation (a 16 entry nibble table, one byte at a
+ * time) so that host benchmarks compare against what runs on the boards.
+ */
+
+#ifndef CDP_HOST_CRC32_H
+#define CDP_HOST_CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+class CRC32 {
+public:
+  CRC32() { reset(); }
+
+  void reset() { state = ~0L; }
+
+  void update(const uint8_t & data) {
+    static const uint32_t crc32_table[] = {
+      0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+      0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+      0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+      0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+    };
+    uint8_t tbl_idx = 0;
+    tbl_idx = state ^ (data >> (0 * 4));
+    state = crc32_table[(tbl_idx & 0x0f)] ^ (state >> 4);
+    tbl_idx = state ^ (data >> (1 * 4));
+    state = crc32_table[(tbl_idx & 0x0f)] ^ (state >> 4);
+  }
+
+  template <typename Type>
+  void update(const Type* data, size_t size) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size * sizeof(Type); i++) {
+      update(bytes[i]);
+    }
+  }
+
+  uint32_t finalize() const { return ~state; }
+
+  template <typename Type>
+  static uint32_t calculate(const Type* data, size_t size) {
+    CRC32 crc;
+    crc.update(data, size);
+    return crc.finalize();
+  }
+
+private:
+  uint32_t state;
+};
+
+#endif
@@ -0,0 +1,63 @@
+/**
+ * @file CTR.h
+ * @brief Host shim of the rweather/Crypto CTR mode template.
+ */
+
+#ifndef CDP_HOST_CTR_H
+#define CDP_HOST_CTR_H
+
+#include "Crypto.h"
+#include <string.h>
+
+template <typename T>
+class CTR {
+public:
+  void clear() {
+    cipher.clear();
+    memset(counter, 0, sizeof(counter));
+    posn = 16;
+  }
+
+  bool setKey(const uint8_t* key, size_t len) { return cipher.setKey(key, len); }
+
+  bool setIV(const uint8_t* iv, size_t len) {
+    if (len != 16) {
+      return false;
+    }
+    memcpy(counter, iv, 16);
+    posn = 16;
+    return true;
+  }
+
+  bool setCounterSize(size_t size) {
+    counterSize = size;
+    return size >= 1 && size <= 16;
+  }
+
+  void encrypt(uint8_t* output, const uint8_t* input, size_t len) {
+    while (len > 0) {
+      if (posn >= 16) {
+        cipher.encryptBlock(state, counter);
+        posn = 0;
+        for (size_t i = 16; i > 16 - counterSize; i--) {
+          if (++counter[i - 1] != 0) {
+            break;
+          }
+        }
+      }
+      *output++ = *input++ ^ state[posn++];
+      len--;
+    }
+  }
+
+  void decrypt(uint8_t* output, const uint8_t* input, size_t len) { encrypt(output, input, len); }
+
+private:
+  T cipher;
+  uint8_t counter[16] = {0};
+  uint8_t state[16] = {0};
+  size_t counterSize = 4;
+  size_t posn = 16;
+};
+
+#endif
@@ -0,0 +1,12 @@
+/**
+ * @file Crypto.h
+ * @brief Host shim of the rweather/Crypto library headers used by DuckCrypto.
+ */
+
+#ifndef CDP_HOST_CRYPTO_H
+#define CDP_HOST_CRYPTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#endif
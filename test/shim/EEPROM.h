@@ -0,0 +1,60 @@
+/**
+ * @file EEPROM.h
+ * @brief Host shim of the ESP32 flash-backed EEPROM class, kept in RAM.
+ *
+ * Like the ESP32 one, begin() loads the stored EEPROM into a buffer of the
+ * size given, larger or smaller than the stored one, and commit() stores the
+ * whole buffer: a smaller size truncates the EEPROM on the next commit.
+ */
+
+#ifndef CDP_HOST_EEPROM_H
+#define CDP_HOST_EEPROM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+class EEPROMClass {
+public:
+  bool begin(size_t size) {
+    if (size == 0) {
+      return false;
+    }
+    if (size != data.size()) {
+      data = flash;
+      data.resize(size, 0xFF);
+    }
+    return true;
+  }
+  void end() { data.clear(); }
+  uint8_t read(int address) { return address < (int) data.size() ? data[address] : 0; }
+  void write(int address, uint8_t value) {
+    if (address < (int) data.size()) {
+      data[address] = value;
+    }
+  }
+  bool commit() {
+    if (data.empty()) {
+      return false;
+    }
+    flash = data;
+    commits++;
+    bytesCommitted += flash.size();
+    return true;
+  }
+  size_t length() const { return data.size(); }
+
+  /// Number of commit() calls, for host tests.
+  unsigned long commits = 0;
+  /// Bytes stored by the commit() calls, for host tests.
+  unsigned long bytesCommitted = 0;
+
+private:
+  // the buffer written to, and the stored EEPROM
+  std::vector<uint8_t> data;
+  std::vector<uint8_t> flash;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
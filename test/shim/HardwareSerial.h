@@ -0,0 +1,63 @@
+/**
+ * @file HardwareSerial.h
+ * @brief Host shim of the Arduino Serial port.
+ *
+ * Output is discarded unless echo is enabled, but every byte is counted so
+ * that host benchmarks can estimate the time a real UART would block.
+ */
+
+#ifndef CDP_HOST_HARDWARESERIAL_H
+#define CDP_HOST_HARDWARESERIAL_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "WString.h"
+
+class HardwareSerial {
+public:
+  void begin(unsigned long baud) { baudRate = baud; }
+  operator bool() const { return true; }
+  int available() { return 0; }
+  int read() { return -1; }
+
+  size_t write(const char* str, size_t size);
+  size_t write(uint8_t c) { return write((const char*) &c, 1); }
+
+  size_t print(const String & s) { return write(s.c_str(), s.length()); }
+  size_t print(const char* s) { return write(s, strlen(s)); }
+  size_t print(char c) { return write((const char*) &c, 1); }
+  template<typename T>
+  size_t print(T value) { return print(String(value)); }
+  template<typename T>
+  size_t print(T value, int base) { return print(String(value, base)); }
+
+  size_t println() { return write("\r\n", 2); }
+  template<typename T>
+  size_t println(T value) { size_t n = print(value); return n + println(); }
+  template<typename T>
+  size_t println(T value, int base) { size_t n = print(value, base); return n + println(); }
+
+  size_t printf(const char* format, ...);
+
+  void flush() {}
+
+  /// Echo everything written to stdout.
+  void setEcho(bool enable) { echo = enable; }
+  /// Number of bytes written since the last reset.
+  unsigned long getBytesWritten() const { return bytesWritten; }
+  void resetBytesWritten() { bytesWritten = 0; }
+  unsigned long getBaudRate() const { return baudRate; }
+
+private:
+  bool echo = false;
+  unsigned long baudRate = 115200;
+  unsigned long bytesWritten = 0;
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,231 @@
+#include "RadioLib.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+namespace {
+  BroadcastMedium broadcastMedium;
+  RadioMedium* defaultMedium = &broadcastMedium;
+}
+
+void RadioMedium::setDefault(RadioMedium* medium) {
+  defaultMedium = medium != NULL ? medium : &broadcastMedium;
+}
+
+RadioMedium* RadioMedium::getDefault() { return defaultMedium; }
+
+void BroadcastMedium::attach(SX1276* radio) { radios.push_back(radio); }
+
+void BroadcastMedium::detach(SX1276* radio) {
+  radios.erase(std::remove(radios.begin(), radios.end(), radio), radios.end());
+}
+
+void BroadcastMedium::transmit(SX1276* radio, const uint8_t* data, size_t length) {
+  transmitted++;
+  for (size_t i = 0; i < radios.size(); i++) {
+    if (radios[i] != radio && radios[i]->sameChannel(*radio) &&
+        radios[i]->deliver(data, length)) {
+      delivered++;
+    }
+  }
+  radio->transmitDone();
+}
+
+void BroadcastMedium::channelScan(SX1276* radio) { radio->channelScanDone(false); }
+
+SX1276::SX1276(Module* module)
+  : module(module), medium(NULL), mode(MODE_STANDBY), irqFlags(0),
+    frequency(434.0), bandwidth(125.0), spreadingFactor(9), codingRate(7),
+    preambleLength(8), outputPower(10), syncWord(0x12), rxLength(0), rssi(0),
+    snr(0) {}
+
+SX1276::~SX1276() {
+  if (medium != NULL) {
+    medium->detach(this);
+  }
+}
+
+SX1276 & SX1276::operator=(const SX1276 & other) {
+  module = other.module;
+  return *this;
+}
+
+int SX1276::begin() {
+  if (medium == NULL) {
+    medium = RadioMedium::getDefault();
+    medium->attach(this);
+  }
+  mode = MODE_STANDBY;
+  irqFlags = 0;
+  return RADIOLIB_ERR_NONE;
+}
+
+int SX1276::setFrequency(float freq) {
+  if (freq < 137.0 || freq > 1020.0) {
+    return RADIOLIB_ERR_INVALID_FREQUENCY;
+  }
+  frequency = freq;
+  return RADIOLIB_ERR_NONE;
+}
+
+int SX1276::setBandwidth(float bw) {
+  static const float valid[] = {7.8, 10.4, 15.6, 20.8, 31.25, 41.7, 62.5, 125.0, 250.0, 500.0};
+  for (size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); i++) {
+    if (bw > valid[i] - 0.01 && bw < valid[i] + 0.01) {
+      bandwidth = valid[i];
+      return RADIOLIB_ERR_NONE;
+    }
+  }
+  return RADIOLIB_ERR_INVALID_BANDWIDTH;
+}
+
+int SX1276::setSpreadingFactor(uint8_t sf) {
+  if (sf < 6 || sf > 12) {
+    return RADIOLIB_ERR_INVALID_SPREADING_FACTOR;
+  }
+  spreadingFactor = sf;
+  return RADIOLIB_ERR_NONE;
+}
+
+int SX1276::setCodingRate(uint8_t cr) {
+  if (cr < 5 || cr > 8) {
+    return RADIOLIB_ERR_INVALID_CODING_RATE;
+  }
+  codingRate = cr;
+  return RADIOLIB_ERR_NONE;
+}
+
+int SX1276::setPreambleLength(uint16_t length) {
+  if (length < 6) {
+    return RADIOLIB_ERR_INVALID_PREAMBLE_LENGTH;
+  }
+  preambleLength = length;
+  return RADIOLIB_ERR_NONE;
+}
+
+int SX1276::setOutputPower(int8_t power) {
+  if (power < -3 || power > 20) {
+    return RADIOLIB_ERR_INVALID_OUTPUT_POWER;
+  }
+  outputPower = power;
+  return RADIOLIB_ERR_NONE;
+}
+
+int SX1276::setGain(uint8_t gain) {
+  return gain > 6 ? RADIOLIB_ERR_INVALID_GAIN : RADIOLIB_ERR_NONE;
+}
+
+int SX1276::setSyncWord(uint8_t word) {
+  syncWord = word;
+  return RADIOLIB_ERR_NONE;
+}
+
+int SX1276::startReceive() {
+  if (medium == NULL) {
+    return RADIOLIB_ERR_CHIP_NOT_FOUND;
+  }
+  irqFlags = 0;
+  mode = MODE_RX;
+  return RADIOLIB_ERR_NONE;
+}
+
+int SX1276::startTransmit(const uint8_t* data, size_t length) {
+  if (medium == NULL) {
+    return RADIOLIB_ERR_CHIP_NOT_FOUND;
+  }
+  if (length > RADIOLIB_SX127X_MAX_PACKET_LENGTH) {
+    return RADIOLIB_ERR_PACKET_TOO_LONG;
+  }
+  irqFlags = 0;
+  mode = MODE_TX;
+  medium->transmit(this, data, length);
+  return RADIOLIB_ERR_NONE;
+}
+
+int SX1276::transmit(const uint8_t* data, size_t length) {
+  int rc = startTransmit(data, length);
+  if (rc != RADIOLIB_ERR_NONE) {
+    return rc;
+  }
+  if (mode == MODE_TX) {
+    // a blocking transmit needs a medium that completes synchronously
+    standby();
+    return RADIOLIB_ERR_TX_TIMEOUT;
+  }
+  irqFlags = 0;
+  return RADIOLIB_ERR_NONE;
+}
+
+int SX1276::startChannelScan() {
+  if (medium == NULL) {
+    return RADIOLIB_ERR_CHIP_NOT_FOUND;
+  }
+  irqFlags = 0;
+  mode = MODE_CAD;
+  medium->channelScan(this);
+  return RADIOLIB_ERR_NONE;
+}
+
+int SX1276::standby() {
+  irqFlags = 0;
+  mode = MODE_STANDBY;
+  return RADIOLIB_ERR_NONE;
+}
+
+int SX1276::sleep() {
+  irqFlags = 0;
+  mode = MODE_SLEEP;
+  return RADIOLIB_ERR_NONE;
+}
+
+size_t SX1276::getPacketLength(bool update) {
+  (void) update;
+  return rxLength;
+}
+
+int SX1276::readData(uint8_t* data, size_t length) {
+  if (length == 0 || length > rxLength) {
+    length = rxLength;
+  }
+  memcpy(data, rxBuffer, length);
+  irqFlags = 0;
+  return RADIOLIB_ERR_NONE;
+}
+
+bool SX1276::deliver(const uint8_t* data, size_t length, float rssi, float snr) {
+  if (mode != MODE_RX || length > sizeof(rxBuffer)) {
+    return false;
+  }
+  // continuous receive mode: a new frame overwrites the FIFO
+  memcpy(rxBuffer, data, length);
+  rxLength = length;
+  this->rssi = rssi;
+  this->snr = snr;
+  raise(RADIOLIB_SX127X_CLEAR_IRQ_FLAG_VALID_HEADER | RADIOLIB_SX127X_CLEAR_IRQ_FLAG_RX_DONE);
+  return true;
+}
+
+void SX1276::transmitDone() {
+  if (mode != MODE_TX) {
+    return;
+  }
+  mode = MODE_STANDBY;
+  raise(RADIOLIB_SX127X_CLEAR_IRQ_FLAG_TX_DONE);
+}
+
+void SX1276::channelScanDone(bool busy) {
+  if (mode != MODE_CAD) {
+    return;
+  }
+  mode = MODE_STANDBY;
+  raise(RADIOLIB_SX127X_CLEAR_IRQ_FLAG_CAD_DONE |
+        (busy ? RADIOLIB_SX127X_CLEAR_IRQ_FLAG_CAD_DETECTED : 0));
+}
+
+bool SX1276::sameChannel(const SX1276 & other) const {
+  return frequency == other.frequency && bandwidth == other.bandwidth &&
+         spreadingFactor == other.spreadingFactor && syncWord == other.syncWord;
+}
+
+void SX1276::raise(uint16_t flags) { irqFlags |= flags; }
@@ -0,0 +1,207 @@
+/**
+ * @file RadioLib.h
+ * @brief Host shim of the RadioLib SX1276 driver.
+ *
+ * The radio is an in-memory mock: transmitted frames are handed to a
+ * RadioMedium which decides which radios receive them and when. The default
+ * medium is a BroadcastMedium where every radio instantly hears every other
+ * radio tuned on the same channel. Tests and simulations install their own
+ * medium to model range, airtime or collisions.
+ *
+ * There is no interrupt line on the host: the duck polls getIRQFlags() from
+ * its loop (CDPCFG_RADIO_POLL_IRQ).
+ */
+
+#ifndef CDP_HOST_RADIOLIB_H
+#define CDP_HOST_RADIOLIB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#define RADIOLIB_ERR_NONE 0
+#define RADIOLIB_ERR_UNKNOWN -1
+#define RADIOLIB_ERR_CHIP_NOT_FOUND -2
+#define RADIOLIB_ERR_PACKET_TOO_LONG -4
+#define RADIOLIB_ERR_TX_TIMEOUT -5
+#define RADIOLIB_ERR_RX_TIMEOUT -6
+#define RADIOLIB_ERR_CRC_MISMATCH -7
+#define RADIOLIB_ERR_INVALID_BANDWIDTH -8
+#define RADIOLIB_ERR_INVALID_SPREADING_FACTOR -9
+#define RADIOLIB_ERR_INVALID_CODING_RATE -10
+#define RADIOLIB_ERR_INVALID_FREQUENCY -12
+#define RADIOLIB_ERR_INVALID_OUTPUT_POWER -13
+#define RADIOLIB_ERR_INVALID_GAIN -14
+#define RADIOLIB_ERR_INVALID_PREAMBLE_LENGTH -18
+
+#define RADIOLIB_SX127X_CLEAR_IRQ_FLAG_RX_TIMEOUT 0b10000000
+#define RADIOLIB_SX127X_CLEAR_IRQ_FLAG_RX_DONE 0b01000000
+#define RADIOLIB_SX127X_CLEAR_IRQ_FLAG_PAYLOAD_CRC_ERROR 0b00100000
+#define RADIOLIB_SX127X_CLEAR_IRQ_FLAG_VALID_HEADER 0b00010000
+#define RADIOLIB_SX127X_CLEAR_IRQ_FLAG_TX_DONE 0b00001000
+#define RADIOLIB_SX127X_CLEAR_IRQ_FLAG_CAD_DONE 0b00000100
+#define RADIOLIB_SX127X_CLEAR_IRQ_FLAG_FHSS_CHANGE_CHANNEL 0b00000010
+#define RADIOLIB_SX127X_CLEAR_IRQ_FLAG_CAD_DETECTED 0b00000001
+
+#define RADIOLIB_SX127X_MAX_PACKET_LENGTH 255
+
+class Module {
+public:
+  Module(int cs, int irq, int rst, int gpio = -1)
+    : cs(cs), irq(irq), rst(rst), gpio(gpio) {}
+
+  int cs;
+  int irq;
+  int rst;
+  int gpio;
+};
+
+class SX1276;
+
+/**
+ * @brief Shared channel the mock radios transmit on.
+ *
+ * A medium must eventually call SX1276::transmitDone() for every frame passed
+ * to transmit() and SX1276::channelScanDone() for every channelScan().
+ */
+class RadioMedium {
+public:
+  virtual ~RadioMedium() {}
+
+  /// A radio was started with begin()
+  virtual void attach(SX1276* radio) = 0;
+  /// A radio is destroyed
+  virtual void detach(SX1276* radio) = 0;
+  /// A radio started transmitting a frame
+  virtual void transmit(SX1276* radio, const uint8_t* data, size_t length) = 0;
+  /// A radio started a channel activity detection
+  virtual void channelScan(SX1276* radio) = 0;
+
+  /// Medium used by the radios started from now on, NULL restores the default
+  static void setDefault(RadioMedium* medium);
+  static RadioMedium* getDefault();
+};
+
+/**
+ * @brief Ideal medium: a frame is received right away by every other radio
+ * listening on the same channel and the channel is never busy.
+ */
+class BroadcastMedium : public RadioMedium {
+public:
+  void attach(SX1276* radio);
+  void detach(SX1276* radio);
+  void transmit(SX1276* radio, const uint8_t* data, size_t length);
+  void channelScan(SX1276* radio);
+
+  const std::vector<SX1276*> & getRadios() const { return radios; }
+
+  /// Frames transmitted on this medium
+  unsigned long transmitted = 0;
+  /// Frame receptions, one transmission counts once per receiver
+  unsigned long delivered = 0;
+
+private:
+  std::vector<SX1276*> radios;
+};
+
+class SX1276 {
+public:
+  enum Mode {
+    MODE_SLEEP,
+    MODE_STANDBY,
+    MODE_RX,
+    MODE_TX,
+    MODE_CAD
+  };
+
+  SX1276(Module* module);
+  ~SX1276();
+
+  // RadioLib assigns a freshly constructed driver to change the pins, the
+  // running radio keeps its state and its medium
+  SX1276 & operator=(const SX1276 & other);
+  SX1276(const SX1276 &) = delete;
+
+  // RadioLib API subset used by DuckRadio
+  int begin();
+  int setFrequency(float freq);
+  int setBandwidth(float bw);
+  int setSpreadingFactor(uint8_t sf);
+  int setCodingRate(uint8_t cr);
+  int setPreambleLength(uint16_t length);
+  int setOutputPower(int8_t power);
+  int setGain(uint8_t gain);
+  int setSyncWord(uint8_t syncWord);
+  // there is no interrupt line, the handler is never called
+  void setDio0Action(void (*func)(void)) { (void) func; }
+
+  int startReceive();
+  int startTransmit(const uint8_t* data, size_t length);
+  int transmit(const uint8_t* data, size_t length);
+  int startChannelScan();
+  int standby();
+  int sleep();
+
+  size_t getPacketLength(bool update = true);
+  int readData(uint8_t* data, size_t length);
+  float getRSSI() { return rssi; }
+  float getSNR() { return snr; }
+  float getFrequencyError(bool autoCorrect = false) { (void) autoCorrect; return 0; }
+
+  uint16_t getIRQFlags() { return irqFlags; }
+  /// Not public in RadioLib, the host duck acknowledges polled flags with it
+  void clearIRQFlags() { irqFlags = 0; }
+
+  // Medium side of the mock
+
+  /**
+   * @brief Hand a frame to the radio.
+   *
+   * @returns true if the radio was listening and received the frame
+   */
+  bool deliver(const uint8_t* data, size_t length, float rssi = -60, float snr = 9);
+  /// End the current transmission
+  void transmitDone();
+  /// End the current channel activity detection
+  void channelScanDone(bool busy);
+  /// The medium the radio transmits on
+  RadioMedium* getMedium() const { return medium; }
+
+  Mode getMode() const { return mode; }
+  const Module* getModule() const { return module; }
+  float getFrequency() const { return frequency; }
+  float getBandwidth() const { return bandwidth; }
+  uint8_t getSpreadingFactor() const { return spreadingFactor; }
+  uint8_t getCodingRate() const { return codingRate; }
+  uint16_t getPreambleLength() const { return preambleLength; }
+  int8_t getOutputPower() const { return outputPower; }
+  uint8_t getSyncWord() const { return syncWord; }
+
+  /// Radios on the same channel can hear each other
+  bool sameChannel(const SX1276 & other) const;
+
+private:
+  void raise(uint16_t flags);
+
+  Module* module;
+  RadioMedium* medium;
+
+  Mode mode;
+  uint16_t irqFlags;
+
+  float frequency;
+  float bandwidth;
+  uint8_t spreadingFactor;
+  uint8_t codingRate;
+  uint16_t preambleLength;
+  int8_t outputPower;
+  uint8_t syncWord;
+
+  uint8_t rxBuffer[RADIOLIB_SX127X_MAX_PACKET_LENGTH + 1];
+  size_t rxLength;
+  float rssi;
+  float snr;
+};
+
+#endif
@@ -0,0 +1,78 @@
+/**
+ * @file WString.h
+ * @brief Host shim of the Arduino String class, backed by std::string.
+ */
+
+#ifndef CDP_HOST_WSTRING_H
+#define CDP_HOST_WSTRING_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+class String {
+public:
+  String() {}
+  String(const char* cstr) : s(cstr ? cstr : "") {}
+  String(const std::string & str) : s(str) {}
+  explicit String(char c) : s(1, c) {}
+  explicit String(unsigned char value, unsigned char base = DEC) { fromInteger(value, base); }
+  explicit String(int value, unsigned char base = DEC) { fromInteger(value, base); }
+  explicit String(unsigned int value, unsigned char base = DEC) { fromInteger(value, base); }
+  explicit String(long value, unsigned char base = DEC) { fromInteger(value, base); }
+  explicit String(unsigned long value, unsigned char base = DEC) { fromInteger(value, base); }
+  explicit String(long long value, unsigned char base = DEC) { fromInteger(value, base); }
+  explicit String(unsigned long long value, unsigned char base = DEC) { fromInteger(value, base); }
+  explicit String(float value, unsigned char decimals = 2) { fromFloat(value, decimals); }
+  explicit String(double value, unsigned char decimals = 2) { fromFloat(value, decimals); }
+
+  const char* c_str() const { return s.c_str(); }
+  unsigned int length() const { return s.length(); }
+  bool reserve(unsigned int size) { s.reserve(size); return true; }
+  char operator[](unsigned int index) const { return s[index]; }
+  char & operator[](unsigned int index) { return s[index]; }
+  bool operator==(const String & rhs) const { return s == rhs.s; }
+  bool operator!=(const String & rhs) const { return s != rhs.s; }
+  bool equals(const String & rhs) const { return s == rhs.s; }
+  int toInt() const { return atoi(s.c_str()); }
+
+  String & operator+=(const String & rhs) { s += rhs.s; return *this; }
+  String & operator+=(const char* rhs) { s += rhs; return *this; }
+  String & operator+=(char c) { s += c; return *this; }
+
+  friend String operator+(const String & lhs, const String & rhs) { return String(lhs.s + rhs.s); }
+  friend String operator+(const String & lhs, const char* rhs) { return String(lhs.s + rhs); }
+  friend String operator+(const char* lhs, const String & rhs) { return String(lhs + rhs.s); }
+  friend String operator+(const String & lhs, char rhs) { return String(lhs.s + rhs); }
+
+private:
+  std::string s;
+
+  template<typename T>
+  void fromInteger(T value, unsigned char base) {
+    char buf[72];
+    if (base == HEX) {
+      snprintf(buf, sizeof(buf), "%llx", (unsigned long long) value);
+    } else if (base == OCT) {
+      snprintf(buf, sizeof(buf), "%llo", (unsigned long long) value);
+    } else if (value < 0) {
+      snprintf(buf, sizeof(buf), "%lld", (long long) value);
+    } else {
+      snprintf(buf, sizeof(buf), "%llu", (unsigned long long) value);
+    }
+    s = buf;
+  }
+
+  void fromFloat(double value, unsigned char decimals) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+    s = buf;
+  }
+};
+
+#endif
@@ -0,0 +1,76 @@
+/**
+ * @file arduino-timer.h
+ * @brief Host shim of the contrem/arduino-timer library.
+ */
+
+#ifndef CDP_HOST_ARDUINO_TIMER_H
+#define CDP_HOST_ARDUINO_TIMER_H
+
+#include <Arduino.h>
+
+template <size_t max_tasks = 16, unsigned long (*time_func)() = millis, typename T = void*>
+class Timer {
+public:
+  typedef uintptr_t Task;
+  typedef bool (*handler_t)(T opaque);
+
+  Timer() {
+    for (size_t i = 0; i < max_tasks; i++) {
+      tasks[i].handler = NULL;
+    }
+  }
+
+  Task in(unsigned long delay, handler_t h, T opaque = T()) { return add(delay, h, opaque, false); }
+  Task every(unsigned long interval, handler_t h, T opaque = T()) { return add(interval, h, opaque, true); }
+
+  void cancel(Task & task) {
+    if (task != 0 && task <= max_tasks) {
+      tasks[task - 1].handler = NULL;
+    }
+    task = 0;
+  }
+
+  unsigned long tick() {
+    unsigned long now = time_func();
+    for (size_t i = 0; i < max_tasks; i++) {
+      struct task & t = tasks[i];
+      if (t.handler == NULL || now - t.start < t.expires) {
+        continue;
+      }
+      bool again = t.handler(t.opaque);
+      if (t.repeat && again) {
+        t.start = now;
+      } else {
+        t.handler = NULL;
+      }
+    }
+    return 0;
+  }
+
+private:
+  struct task {
+    handler_t handler;
+    T opaque;
+    unsigned long start;
+    unsigned long expires;
+    bool repeat;
+  } tasks[max_tasks];
+
+  Task add(unsigned long delay, handler_t h, T opaque, bool repeat) {
+    for (size_t i = 0; i < max_tasks; i++) {
+      if (tasks[i].handler == NULL) {
+        tasks[i].handler = h;
+        tasks[i].opaque = opaque;
+        tasks[i].start = time_func();
+        tasks[i].expires = delay;
+        tasks[i].repeat = repeat;
+        return i + 1;
+      }
+    }
+    return 0;
+  }
+};
+
+inline Timer<> timer_create_default() { return Timer<>(); }
+
+#endif
@@ -0,0 +1,197 @@
+#include "SimMedium.h"
+
+#include <math.h>
+
+#include <Arduino.h>
+
+#include "include/DuckAirtime.h"
+
+namespace {
+  // SNR required to demodulate, SX1276 datasheet, SF6 to SF12
+  const float SNR_FLOOR[] = {-5, -7.5, -10, -12.5, -15, -17.5, -20};
+}
+
+SimMedium::SimMedium(const SimRadioModel & model)
+  : model(model), nextTransmission(0), nextSequence(0) {}
+
+void SimMedium::attach(SX1276* radio) {
+  nodes[radio] = radios.size();
+  radios.push_back(radio);
+  x.push_back(0);
+  y.push_back(0);
+  SimRadioStats empty = {0, 0, 0, 0, 0};
+  stats.push_back(empty);
+}
+
+void SimMedium::detach(SX1276* radio) {
+  // the simulation tears every radio down at once, keep the numbering
+  std::unordered_map<const SX1276*, int>::iterator it = nodes.find(radio);
+  if (it != nodes.end()) {
+    radios[it->second] = NULL;
+    nodes.erase(it);
+  }
+}
+
+void SimMedium::setPosition(int node, float px, float py) {
+  x[node] = px;
+  y[node] = py;
+}
+
+float SimMedium::rssi(int from, int to) const {
+  const SX1276* radio = radios[from];
+  float dx = x[from] - x[to];
+  float dy = y[from] - y[to];
+  float distance = sqrtf(dx * dx + dy * dy);
+  if (distance < 1) {
+    distance = 1;
+  }
+  // free space loss at 1m, then log-distance
+  float loss = 20 * log10f(radio->getFrequency()) - 27.55f +
+               10 * model.pathLossExponent * log10f(distance);
+  return radio->getOutputPower() - loss;
+}
+
+float SimMedium::snr(int from, int to) const {
+  float noise = -174 + 10 * log10f(radios[to]->getBandwidth() * 1000) + model.noiseFigure;
+  return rssi(from, to) - noise;
+}
+
+bool SimMedium::canDemodulate(int from, int to) const {
+  if (from == to || radios[from] == NULL || radios[to] == NULL ||
+      !radios[from]->sameChannel(*radios[to])) {
+    return false;
+  }
+  uint8_t sf = radios[from]->getSpreadingFactor();
+  return snr(from, to) >= SNR_FLOOR[sf - 6];
+}
+
+bool SimMedium::inRange(int from, int to) const { return canDemodulate(from, to); }
+
+uint64_t SimMedium::getTimeOnAir(const SX1276 & radio, size_t length) {
+  return duckairtime::getTimeOnAir(radio.getSpreadingFactor(), radio.getBandwidth(),
+                                   radio.getCodingRate(), radio.getPreambleLength(), length);
+}
+
+void SimMedium::schedule(uint64_t time, bool scan, uint64_t id) {
+  Event event = {time, nextSequence++, scan, id};
+  events.push(event);
+}
+
+void SimMedium::transmit(SX1276* radio, const uint8_t* data, size_t length) {
+  int from = nodes[radio];
+  uint64_t now = cdphost::nowMicros();
+  uint64_t airtime = getTimeOnAir(*radio, length);
+
+  Transmission & tx = transmissions[nextTransmission];
+  tx.from = from;
+  tx.start = now;
+  tx.end = now + airtime;
+  tx.data.assign(data, data + length);
+  tx.done = false;
+  for (int i = 0; i < (int) radios.size(); i++) {
+    if (canDemodulate(from, i) && radios[i]->getMode() == SX1276::MODE_RX) {
+      tx.listeners.push_back(i);
+    }
+  }
+  schedule(tx.end, false, nextTransmission);
+  nextTransmission++;
+
+  stats[from].transmitted++;
+  stats[from].airtime += airtime;
+}
+
+void SimMedium::channelScan(SX1276* radio) {
+  // a channel activity detection lasts about two symbols
+  uint64_t symbol = (uint64_t) (1 << radio->getSpreadingFactor()) * 1000 / radio->getBandwidth();
+  schedule(cdphost::nowMicros() + 2 * symbol, true, nodes[radio]);
+}
+
+void SimMedium::processEvents(uint64_t now) {
+  while (!events.empty() && events.top().time <= now) {
+    Event event = events.top();
+    events.pop();
+    cdphost::setMicros(event.time);
+    if (!event.scan) {
+      endTransmission(event.id);
+      continue;
+    }
+    int node = (int) event.id;
+    if (radios[node] == NULL) {
+      continue;
+    }
+    bool busy = false;
+    std::unordered_map<uint64_t, Transmission>::const_iterator it;
+    for (it = transmissions.begin(); it != transmissions.end() && !busy; ++it) {
+      busy = it->second.start <= event.time && it->second.end > event.time &&
+             canDemodulate(it->second.from, node);
+    }
+    radios[node]->channelScanDone(busy);
+  }
+  cdphost::setMicros(now);
+}
+
+void SimMedium::endTransmission(uint64_t id) {
+  std::unordered_map<uint64_t, Transmission>::iterator found = transmissions.find(id);
+  if (found == transmissions.end()) {
+    return;
+  }
+  Transmission & tx = found->second;
+  tx.done = true;
+
+  for (size_t i = 0; i < tx.listeners.size(); i++) {
+    int to = tx.listeners[i];
+    SX1276* radio = radios[to];
+    if (radio == NULL) {
+      continue;
+    }
+    bool heard = radio->getMode() == SX1276::MODE_RX;
+    bool collision = false;
+    float signal = rssi(tx.from, to);
+    std::unordered_map<uint64_t, Transmission>::const_iterator it;
+    for (it = transmissions.begin(); it != transmissions.end() && heard; ++it) {
+      const Transmission & other = it->second;
+      if (it->first == id || other.end <= tx.start || other.start >= tx.end) {
+        continue;
+      }
+      if (other.from == to) {
+        // half duplex: the radio talked during the frame
+        heard = false;
+      } else if (radios[other.from] != NULL &&
+                 rssi(other.from, to) > signal - model.captureThreshold) {
+        collision = true;
+      }
+    }
+    if (!heard) {
+      stats[to].missed++;
+    } else if (collision) {
+      stats[to].collisions++;
+    } else if (radio->deliver(tx.data.data(), tx.data.size(), signal, snr(tx.from, to))) {
+      stats[to].received++;
+      if (receiveHandler) {
+        receiveHandler(to, tx.data.data(), tx.data.size());
+      }
+    }
+  }
+  if (radios[tx.from] != NULL) {
+    radios[tx.from]->transmitDone();
+  }
+  forgetTransmissions();
+}
+
+void SimMedium::forgetTransmissions() {
+  // a frame is kept as long as it overlaps a frame still on the air
+  uint64_t oldest = cdphost::nowMicros();
+  std::unordered_map<uint64_t, Transmission>::iterator it;
+  for (it = transmissions.begin(); it != transmissions.end(); ++it) {
+    if (!it->second.done && it->second.start < oldest) {
+      oldest = it->second.start;
+    }
+  }
+  for (it = transmissions.begin(); it != transmissions.end();) {
+    if (it->second.done && it->second.end <= oldest) {
+      it = transmissions.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
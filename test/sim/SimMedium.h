@@ -0,0 +1,138 @@
+/**
+ * @file SimMedium.h
+ * @brief Radio medium of the mesh simulator.
+ *
+ * Radios have a position. A frame is heard when its SNR at the receiver is
+ * above the demodulation floor of its spreading factor, with a log-distance
+ * path loss model. A frame occupies the channel for its LoRa time on air and
+ * is lost at a receiver that is not listening for the whole frame or when an
+ * overlapping frame is received less than the capture threshold below it.
+ *
+ * Transmissions end, and channel activity detections complete, from events
+ * processed in time order by processEvents(), the caller drives the ducks and
+ * the host clock between events.
+ */
+
+#ifndef CDP_SIM_MEDIUM_H
+#define CDP_SIM_MEDIUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+#include <RadioLib.h>
+
+/**
+ * @brief Propagation and receiver parameters.
+ */
+typedef struct {
+  /// path loss exponent, 2 in free space, 2.7 to 4 for ground level nodes
+  float pathLossExponent;
+  /// receiver noise figure in dB
+  float noiseFigure;
+  /// a frame survives an overlapping frame received this many dB weaker
+  float captureThreshold;
+} SimRadioModel;
+
+/**
+ * @brief Per radio counters.
+ */
+typedef struct {
+  /// frames transmitted
+  unsigned long transmitted;
+  /// sum of the time on air of the transmitted frames in us
+  uint64_t airtime;
+  /// frames received
+  unsigned long received;
+  /// frames lost to an overlapping frame
+  unsigned long collisions;
+  /// frames lost because the radio was not listening
+  unsigned long missed;
+} SimRadioStats;
+
+class SimMedium : public RadioMedium {
+public:
+  explicit SimMedium(const SimRadioModel & model);
+
+  void attach(SX1276* radio);
+  void detach(SX1276* radio);
+  void transmit(SX1276* radio, const uint8_t* data, size_t length);
+  void channelScan(SX1276* radio);
+
+  /// Place a radio, radios are numbered in the order they are started
+  void setPosition(int node, float x, float y);
+
+  /**
+   * @brief Process the events due at or before now, the host clock is set to
+   * the time of each event while it is processed.
+   */
+  void processEvents(uint64_t now);
+
+  /// Radios that hear each other, for connectivity statistics
+  bool inRange(int from, int to) const;
+
+  /// Called for every frame received by the given radio
+  void setReceiveHandler(std::function<void(int node, const uint8_t* data, size_t length)> handler) {
+    receiveHandler = handler;
+  }
+
+  int size() const { return (int) radios.size(); }
+  SX1276* getRadio(int node) const { return radios[node]; }
+  const SimRadioStats & getStats(int node) const { return stats[node]; }
+
+  /// LoRa time on air of a frame sent with the settings of the radio, in us
+  static uint64_t getTimeOnAir(const SX1276 & radio, size_t length);
+
+private:
+  typedef struct {
+    int from;
+    uint64_t start;
+    uint64_t end;
+    std::vector<uint8_t> data;
+    // the end of the frame was processed
+    bool done;
+    // radios listening when the frame started
+    std::vector<int> listeners;
+  } Transmission;
+
+  typedef struct {
+    uint64_t time;
+    uint64_t sequence;
+    bool scan;
+    // transmission id, or radio for a channel scan
+    uint64_t id;
+  } Event;
+
+  struct EventOrder {
+    bool operator()(const Event & a, const Event & b) const {
+      return a.time != b.time ? a.time > b.time : a.sequence > b.sequence;
+    }
+  };
+
+  float rssi(int from, int to) const;
+  float snr(int from, int to) const;
+  bool canDemodulate(int from, int to) const;
+  void endTransmission(uint64_t id);
+  void forgetTransmissions();
+  void schedule(uint64_t time, bool scan, uint64_t id);
+
+  SimRadioModel model;
+  std::vector<SX1276*> radios;
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<SimRadioStats> stats;
+  std::unordered_map<const SX1276*, int> nodes;
+
+  std::unordered_map<uint64_t, Transmission> transmissions;
+  uint64_t nextTransmission;
+  std::priority_queue<Event, std::vector<Event>, EventOrder> events;
+  uint64_t nextSequence;
+
+  std::function<void(int, const uint8_t*, size_t)> receiveHandler;
+};
+
+#endif
@@ -0,0 +1,354 @@
+/**
+ * @file cdp_sim.cpp
+ * @brief Discrete-event simulation of a ClusterDuck network.
+ *
+ * Runs the real MamaDuck code for every node against SimMedium. A papa duck
+ * sits in the middle of the area and only listens, every mama sends messages
+ * at random times and the simulation reports how many reach the papa, how
+ * fast and at which cost in transmissions and airtime.
+ *
+ *   cdp_sim --nodes 200 --area 6000 --duration 1800 --interval 600
+ *
+ * Run with --help for the list of options.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "MamaDuck.h"
+#include "SimMedium.h"
+
+namespace {
+
+typedef struct {
+  int nodes;
+  float area;
+  double duration;
+  double drain;
+  double interval;
+  int payload;
+  double step;
+  int sf;
+  float bw;
+  int txPower;
+  int suppression;
+  int suppressionWindow;
+  bool csma;
+  unsigned long seed;
+  double minDelivery;
+  const char* csv;
+  SimRadioModel model;
+} SimOptions;
+
+typedef struct {
+  int sender;
+  uint64_t sentAt;
+  uint64_t deliveredAt;
+  int hops;
+  bool delivered;
+} SimMessage;
+
+void usage() {
+  printf("usage: cdp_sim [options]\n"
+         "  --nodes N            mama ducks, the papa is added, below 10000000 (200)\n"
+         "  --area M             side of the square area in meters (6000)\n"
+         "  --duration S         seconds during which messages are sent (1800)\n"
+         "  --drain S            extra seconds to let messages arrive (60)\n"
+         "  --interval S         mean seconds between messages of a duck (600)\n"
+         "  --payload B          message size in bytes (32)\n"
+         "  --step MS            duck loop period in ms (1)\n"
+         "  --sf SF --bw KHZ     LoRa settings (7, 125)\n"
+         "  --tx-power DBM       transmit power (20)\n"
+         "  --path-loss N        path loss exponent (3.5)\n"
+         "  --capture DB         capture threshold (6)\n"
+         "  --suppression K      relay suppression copies, 0 is off (0)\n"
+         "  --window MS          relay suppression assessment delay (500)\n"
+         "  --csma               listen before talk\n"
+         "  --seed S             random seed (1)\n"
+         "  --min-delivery R     exit with an error below this delivery ratio\n"
+         "  --csv FILE           per node statistics\n");
+}
+
+bool parse(int argc, char** argv, SimOptions & opt) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--help") {
+      return false;
+    }
+    if (arg == "--csma") {
+      opt.csma = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      fprintf(stderr, "missing value for %s\n", arg.c_str());
+      return false;
+    }
+    const char* value = argv[++i];
+    if (arg == "--nodes") opt.nodes = atoi(value);
+    else if (arg == "--area") opt.area = atof(value);
+    else if (arg == "--duration") opt.duration = atof(value);
+    else if (arg == "--drain") opt.drain = atof(value);
+    else if (arg == "--interval") opt.interval = atof(value);
+    else if (arg == "--payload") opt.payload = atoi(value);
+    else if (arg == "--step") opt.step = atof(value);
+    else if (arg == "--sf") opt.sf = atoi(value);
+    else if (arg == "--bw") opt.bw = atof(value);
+    else if (arg == "--tx-power") opt.txPower = atoi(value);
+    else if (arg == "--path-loss") opt.model.pathLossExponent = atof(value);
+    else if (arg == "--capture") opt.model.captureThreshold = atof(value);
+    else if (arg == "--suppression") opt.suppression = atoi(value);
+    else if (arg == "--window") opt.suppressionWindow = atoi(value);
+    else if (arg == "--seed") opt.seed = strtoul(value, NULL, 10);
+    else if (arg == "--min-delivery") opt.minDelivery = atof(value);
+    else if (arg == "--csv") opt.csv = value;
+    else {
+      fprintf(stderr, "unknown option %s\n", arg.c_str());
+      return false;
+    }
+  }
+  // the DUIDs have room for 7 digits
+  return opt.nodes > 0 && opt.nodes < 10000000 && opt.step > 0 && opt.interval > 0;
+}
+
+// DUID of a node, M followed by its id on 7 digits, NUL terminated
+void simDuid(int id, char* out) {
+  char name[16];
+  snprintf(name, sizeof(name), "M%07d", id);
+  memcpy(out, name, DUID_LENGTH);
+  out[DUID_LENGTH] = '\0';
+}
+
+std::string messageKey(const uint8_t* sduid, const uint8_t* muid) {
+  std::string key((const char*) sduid, DUID_LENGTH);
+  key.append((const char*) muid, MUID_LENGTH);
+  return key;
+}
+
+double percentile(std::vector<double> & values, double p) {
+  if (values.empty()) {
+    return 0;
+  }
+  size_t index = (size_t) (p * (values.size() - 1) + 0.5);
+  std::nth_element(values.begin(), values.begin() + index, values.end());
+  return values[index];
+}
+
+// nodes that have a multi-hop path to the papa
+int countConnected(const SimMedium & medium, int papa) {
+  std::vector<bool> seen(medium.size(), false);
+  std::vector<int> todo(1, papa);
+  seen[papa] = true;
+  int count = 0;
+  while (!todo.empty()) {
+    int node = todo.back();
+    todo.pop_back();
+    for (int i = 0; i < medium.size(); i++) {
+      if (!seen[i] && medium.inRange(i, node)) {
+        seen[i] = true;
+        count++;
+        todo.push_back(i);
+      }
+    }
+  }
+  return count;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  SimOptions opt;
+  opt.nodes = 200;
+  opt.area = 6000;
+  opt.duration = 1800;
+  opt.drain = 60;
+  opt.interval = 600;
+  opt.payload = 32;
+  opt.step = 1;
+  opt.sf = CDPCFG_RF_LORA_SF;
+  opt.bw = CDPCFG_RF_LORA_BW;
+  opt.txPower = CDPCFG_RF_LORA_TXPOW;
+  opt.suppression = 0;
+  opt.suppressionWindow = CDPCFG_RELAY_ASSESSMENT_DELAY_MS;
+  opt.csma = false;
+  opt.seed = 1;
+  opt.minDelivery = 0;
+  opt.csv = NULL;
+  opt.model.pathLossExponent = 3.5;
+  opt.model.noiseFigure = 6;
+  opt.model.captureThreshold = 6;
+  if (!parse(argc, argv, opt)) {
+    usage();
+    return 2;
+  }
+
+  cdphost::useWallClock(false);
+  cdphost::setMicros(0);
+  cdphost::seed(opt.seed);
+  std::mt19937 rng(opt.seed);
+  std::uniform_real_distribution<float> position(0, opt.area);
+  std::exponential_distribution<double> nextMessage(1.0 / opt.interval);
+
+  SimMedium medium(opt.model);
+  RadioMedium::setDefault(&medium);
+
+  // the papa only listens, it is node 0
+  Module papaModule(0, 0, 0);
+  SX1276 papa(&papaModule);
+  papa.begin();
+  papa.setFrequency(CDPCFG_RF_LORA_FREQ);
+  papa.setBandwidth(opt.bw);
+  papa.setSpreadingFactor(opt.sf);
+  papa.setSyncWord(CDPCFG_DEFAULT_SYNC_WORD);
+  papa.startReceive();
+  std::vector<float> x(1, opt.area / 2);
+  std::vector<float> y(1, opt.area / 2);
+  medium.setPosition(0, x[0], y[0]);
+
+  std::vector<MamaDuck*> ducks;
+  std::vector<uint64_t> nextSend;
+  for (int i = 0; i < opt.nodes; i++) {
+    char name[DUID_LENGTH + 1];
+    simDuid(i + 1, name);
+    MamaDuck* duck = new MamaDuck(name);
+    // the radio settings of setupWithDefaults() cannot be changed
+    int err = duck->setDeviceId(std::vector<byte>(name, name + DUID_LENGTH));
+    if (err == DUCK_ERR_NONE) {
+      err = duck->setupRadio(CDPCFG_RF_LORA_FREQ, CDPCFG_PIN_LORA_CS, CDPCFG_PIN_LORA_RST,
+                             CDPCFG_PIN_LORA_DIO0, CDPCFG_PIN_LORA_DIO1, opt.txPower,
+                             opt.bw, opt.sf);
+    }
+    if (err != DUCK_ERR_NONE) {
+      fprintf(stderr, "failed to setup duck %d: %d\n", i, err);
+      return 1;
+    }
+    duck->setRelaySuppression(opt.suppression, opt.suppressionWindow);
+    duck->setCsma(opt.csma);
+    ducks.push_back(duck);
+    nextSend.push_back((uint64_t) (nextMessage(rng) * 1e6));
+    x.push_back(position(rng));
+    y.push_back(position(rng));
+    medium.setPosition(i + 1, x.back(), y.back());
+  }
+  std::map<std::string, SimMessage> messages;
+  unsigned long sendFailures = 0;
+  medium.setReceiveHandler([&](int node, const uint8_t* data, size_t length) {
+    if (node != 0 || length < MIN_PACKET_LENGTH) {
+      return;
+    }
+    std::map<std::string, SimMessage>::iterator it =
+      messages.find(messageKey(&data[SDUID_POS], &data[MUID_POS]));
+    if (it != messages.end() && !it->second.delivered) {
+      it->second.delivered = true;
+      it->second.deliveredAt = cdphost::nowMicros();
+      it->second.hops = data[HOP_COUNT_POS];
+    }
+    medium.getRadio(0)->clearIRQFlags();
+  });
+
+  std::vector<byte> payload(opt.payload, 'q');
+  uint64_t step = (uint64_t) (opt.step * 1000);
+  uint64_t sendUntil = (uint64_t) (opt.duration * 1e6);
+  uint64_t end = (uint64_t) ((opt.duration + opt.drain) * 1e6);
+  for (uint64_t now = 0; now <= end; now += step) {
+    medium.processEvents(now);
+    for (size_t i = 0; i < ducks.size(); i++) {
+      if (now >= nextSend[i] && now < sendUntil) {
+        std::vector<byte> muid;
+        int err = ducks[i]->sendData(topics::status, payload, ZERO_DUID, &muid);
+        if (err == DUCK_ERR_NONE) {
+          char name[DUID_LENGTH + 1];
+          simDuid((int) i + 1, name);
+          SimMessage message = {(int) i + 1, now, 0, 0, false};
+          messages[messageKey((const uint8_t*) name, muid.data())] = message;
+        } else {
+          sendFailures++;
+        }
+        nextSend[i] = now + (uint64_t) (nextMessage(rng) * 1e6);
+      }
+      ducks[i]->run();
+    }
+  }
+
+  // report
+  std::vector<double> latencies;
+  unsigned long hops = 0;
+  std::map<std::string, SimMessage>::const_iterator it;
+  for (it = messages.begin(); it != messages.end(); ++it) {
+    if (it->second.delivered) {
+      latencies.push_back((it->second.deliveredAt - it->second.sentAt) / 1000.0);
+      hops += it->second.hops;
+    }
+  }
+  unsigned long delivered = latencies.size();
+  unsigned long transmissions = 0;
+  unsigned long collisions = 0;
+  unsigned long missed = 0;
+  uint64_t maxAirtime = 0;
+  int busiest = 0;
+  uint64_t totalAirtime = 0;
+  for (int i = 1; i < medium.size(); i++) {
+    const SimRadioStats & stats = medium.getStats(i);
+    transmissions += stats.transmitted;
+    totalAirtime += stats.airtime;
+    collisions += stats.collisions;
+    missed += stats.missed;
+    if (stats.airtime > maxAirtime) {
+      maxAirtime = stats.airtime;
+      busiest = i;
+    }
+  }
+  double ratio = messages.empty() ? 0 : (double) delivered / messages.size();
+  double seconds = opt.duration + opt.drain;
+
+  printf("nodes                  %d (%d connected to the papa)\n", opt.nodes,
+         countConnected(medium, 0));
+  printf("lora                   SF%d BW%.1f, %llu ms on air for %d bytes\n", opt.sf, opt.bw,
+         (unsigned long long) SimMedium::getTimeOnAir(papa, DATA_POS + opt.payload) / 1000,
+         opt.payload);
+  printf("messages               %lu sent, %lu not queued\n", (unsigned long) messages.size(),
+         sendFailures);
+  printf("delivery ratio         %.3f (%lu delivered)\n", ratio, delivered);
+  printf("latency ms             p50 %.0f p90 %.0f p99 %.0f max %.0f\n",
+         percentile(latencies, 0.5), percentile(latencies, 0.9), percentile(latencies, 0.99),
+         percentile(latencies, 1.0));
+  printf("mean hops              %.2f\n", delivered ? (double) hops / delivered : 0.0);
+  printf("transmissions          %lu, %.1f per delivered message\n", transmissions,
+         delivered ? (double) transmissions / delivered : 0.0);
+  printf("receptions lost        %lu collisions, %lu not listening\n", collisions, missed);
+  printf("airtime per node       mean %.1f s (%.2f%%), max %.1f s (%.2f%%, node %d)\n",
+         totalAirtime / 1e6 / opt.nodes, 100.0 * totalAirtime / 1e6 / opt.nodes / seconds,
+         maxAirtime / 1e6, 100.0 * maxAirtime / 1e6 / seconds, busiest);
+
+  if (opt.csv != NULL) {
+    FILE* file = fopen(opt.csv, "w");
+    if (file == NULL) {
+      fprintf(stderr, "cannot write %s\n", opt.csv);
+      return 1;
+    }
+    fprintf(file, "node,x,y,transmitted,airtime_ms,received,collisions,missed\n");
+    for (int i = 0; i < medium.size(); i++) {
+      const SimRadioStats & stats = medium.getStats(i);
+      fprintf(file, "%d,%.0f,%.0f,%lu,%.1f,%lu,%lu,%lu\n", i, x[i], y[i], stats.transmitted,
+              stats.airtime / 1000.0, stats.received, stats.collisions, stats.missed);
+    }
+    fclose(file);
+  }
+
+  for (size_t i = 0; i < ducks.size(); i++) {
+    delete ducks[i];
+  }
+  RadioMedium::setDefault(NULL);
+
+  if (ratio < opt.minDelivery) {
+    fprintf(stderr, "delivery ratio %.3f below %.3f\n", ratio, opt.minDelivery);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,123 @@
+/**
+ * @file test_ackaggregator.cpp
+ * @brief Host tests of the batching of acks into broadcast acks.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "include/DuckAckAggregator.h"
+
+#include "test_helpers.h"
+
+void test_batch() {
+  DuckAckAggregator acks;
+  assert(!acks.isEnabled());
+  acks.setBatch(3, 500);
+  assert(acks.isEnabled());
+
+  byte duid[DUID_LENGTH];
+  byte muid[MUID_LENGTH];
+  byte data[DUCK_ACK_MAX_DATA_LENGTH];
+  assert(acks.build(data) == 0);
+  assert(!acks.isDue(0));
+
+  // sent when full
+  for (int i = 0; i < 3; i++) {
+    makePair(duid, muid, i);
+    assert(acks.add(duid, muid, 100 + i));
+    assert(acks.isDue(100 + i) == (i == 2));
+  }
+  assert(acks.build(data) == 1 + 3 * (DUID_LENGTH + MUID_LENGTH));
+  assert(data[0] == 3);
+  makePair(duid, muid, 1);
+  const byte* pair = data + 1 + DUID_LENGTH + MUID_LENGTH;
+  assert(memcmp(pair, duid, DUID_LENGTH) == 0);
+  assert(memcmp(pair + DUID_LENGTH, muid, MUID_LENGTH) == 0);
+  // still there until sent
+  assert(acks.pending() == 3);
+  acks.sent(110);
+  assert(acks.pending() == 0);
+  assert(!acks.isDue(110));
+
+  // or when the oldest waited for the deadline
+  makePair(duid, muid, 3);
+  assert(acks.add(duid, muid, 1000));
+  makePair(duid, muid, 4);
+  assert(acks.add(duid, muid, 1400));
+  assert(!acks.isDue(1499));
+  assert(acks.isDue(1500));
+  acks.sent(1500);
+
+  DuckAckStats stats = acks.getStats();
+  assert(stats.queued == 5);
+  assert(stats.acks == 2);
+  assert(stats.pairs == 5);
+}
+
+void test_duplicates() {
+  DuckAckAggregator acks;
+  acks.setBatch(MAX_MUID_PER_ACK, 500);
+  byte duid[DUID_LENGTH];
+  byte muid[MUID_LENGTH];
+
+  // copies relayed by other ducks while waiting, and after the ack
+  makePair(duid, muid, 0);
+  assert(acks.add(duid, muid, 0));
+  assert(!acks.add(duid, muid, 10));
+  acks.sent(500);
+  assert(!acks.add(duid, muid, 500 + CDPCFG_ACK_REPEAT_MS - 1));
+  assert(acks.getStats().duplicates == 2);
+
+  // the same MUID from another duck is another message
+  byte other[DUID_LENGTH];
+  byte unused[MUID_LENGTH];
+  makePair(other, unused, 1);
+  assert(acks.add(other, muid, 600));
+  acks.sent(1100);
+
+  // a retransmission: the sender did not get the ack
+  assert(acks.add(duid, muid, 500 + CDPCFG_ACK_REPEAT_MS));
+  assert(acks.getStats().reacked == 1);
+  acks.sent(4000);
+  assert(!acks.add(duid, muid, 4000 + CDPCFG_ACK_REPEAT_MS - 1));
+
+  // only the recent acks are remembered
+  for (int i = 0; i < CDPCFG_ACK_RECENT_SIZE; i++) {
+    makePair(other, muid, 100 + i);
+    assert(acks.add(other, muid, 5000));
+    acks.sent(5000);
+  }
+  makePair(duid, muid, 0);
+  assert(acks.add(duid, muid, 5001));
+}
+
+void test_overflow() {
+  DuckAckAggregator acks;
+  acks.setBatch(2 * MAX_MUID_PER_ACK, 500);
+  byte duid[DUID_LENGTH];
+  byte muid[MUID_LENGTH];
+  for (int i = 0; i < MAX_MUID_PER_ACK; i++) {
+    makePair(duid, muid, i);
+    assert(acks.add(duid, muid, 0));
+  }
+  // the batch size is capped to what a broadcast ack holds
+  assert(acks.isDue(0));
+  makePair(duid, muid, MAX_MUID_PER_ACK);
+  assert(!acks.add(duid, muid, 0));
+  assert(acks.getStats().overflows == 1);
+
+  byte data[DUCK_ACK_MAX_DATA_LENGTH];
+  assert(acks.build(data) == DUCK_ACK_MAX_DATA_LENGTH);
+  assert(DUCK_ACK_MAX_DATA_LENGTH <= MAX_DATA_LENGTH);
+}
+
+int main() {
+  test_batch();
+  test_duplicates();
+  test_overflow();
+
+  printf("test_ackaggregator: OK\n");
+  return 0;
+}
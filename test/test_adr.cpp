@@ -0,0 +1,249 @@
+/**
+ * @file test_adr.cpp
+ * @brief Host tests of the adaptive data rate.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+
+#include <RadioLib.h>
+
+#include "MamaDuck.h"
+#include "include/DuckAdr.h"
+#include "include/DuckNeighborTable.h"
+
+static const byte DUID_A[DUID_LENGTH] = {'D', 'U', 'C', 'K', '0', '0', '0', 'A'};
+static const byte DUID_B[DUID_LENGTH] = {'D', 'U', 'C', 'K', '0', '0', '0', 'B'};
+
+static DuckAdrReport makeReport(uint8_t sf, uint8_t need, uint8_t hops) {
+  DuckAdrReport report = {DUCK_ADR_NO_SNR, sf, need, hops, 0, 0};
+  return report;
+}
+
+void test_report_encoding() {
+  DuckAdrReport report = {-30, 9, 11, 2, 8, 1234};
+  byte data[DUCK_ADR_REPORT_LENGTH];
+  DuckAdr::writeReport(report, data);
+  DuckAdrReport decoded = DuckAdr::readReport(data);
+  assert(decoded.snr == -30);
+  assert(decoded.sf == 9);
+  assert(decoded.need == 11);
+  assert(decoded.needHops == 2);
+  assert(decoded.proposedSf == 8);
+  assert(decoded.switchIn == 1234);
+
+  DuckNeighborTable table;
+  DuckAdr adr(table);
+  adr.setEnabled(true, 9, 1000);
+  assert(adr.getReport(NAN, 0).snr == DUCK_ADR_NO_SNR);
+  assert(adr.getReport(-7.5, 0).snr == -30);
+  assert(adr.getReport(-40, 0).snr == -127);
+}
+
+void test_required_sf() {
+  DuckNeighborTable table;
+  DuckAdr adr(table);
+  adr.setEnabled(true, 10, 1000);
+  // nothing heard: stay
+  assert(adr.getRequiredSf(0) == 10);
+
+  // 5dB: SF7 has 12.5dB of margin, short of the 13dB needed to go down to it
+  table.update(DUID_A, DuckType::MAMA, -80, 5, 0);
+  assert(adr.getRequiredSf(0) == 8);
+
+  // hysteresis: 10.5dB of margin keeps SF7 but is not enough to move to it
+  DuckNeighborTable lowTable;
+  DuckAdr low(lowTable);
+  low.setEnabled(true, 7, 1000);
+  lowTable.update(DUID_A, DuckType::MAMA, -80, 3, 0);
+  assert(low.getRequiredSf(0) == 7);
+  low.setSpreadingFactor(8);
+  assert(low.getRequiredSf(0) == 8);
+
+  // the neighbor hears our pings at -2dB: the link is as good as that
+  DuckAdrReport report = makeReport(10, 10, 0);
+  report.snr = -8;
+  adr.onReport(DUID_A, report, true, 0);
+  assert(adr.getRequiredSf(0) == 10);
+
+  // a report meant for another duck tells nothing about our link
+  DuckNeighborTable otherTable;
+  DuckAdr other(otherTable);
+  other.setEnabled(true, 10, 1000);
+  otherTable.update(DUID_A, DuckType::MAMA, -80, 5, 0);
+  other.onReport(DUID_A, report, false, 0);
+  assert(other.getRequiredSf(0) == 8);
+
+  // neighbors not heard for 3 intervals are forgotten
+  assert(other.getRequiredSf(2999) == 8);
+  assert(other.getRequiredSf(3000) == 10);
+}
+
+void test_cluster_need() {
+  DuckNeighborTable table;
+  DuckAdr adr(table);
+  adr.setEnabled(true, 10, 1000);
+  table.update(DUID_A, DuckType::MAMA, -80, 9, 0);
+  uint8_t hops = 0xFF;
+  assert(adr.getClusterNeed(0, &hops) == 7);
+  assert(hops == 0);
+
+  // a duck two hops away needs SF11
+  table.update(DUID_B, DuckType::MAMA, -80, 9, 0);
+  adr.onReport(DUID_B, makeReport(10, 11, 1), false, 0);
+  assert(adr.getClusterNeed(0, &hops) == 11);
+  assert(hops == 2);
+  // an echo that went around too many times is ignored
+  adr.onReport(DUID_B, makeReport(10, 11, MAX_HOPS), false, 0);
+  assert(adr.getClusterNeed(0) == 7);
+
+  // without adaptive data rate a duck needs its own spreading factor
+  DuckNeighborTable fixedTable;
+  DuckAdr fixed(fixedTable);
+  fixed.setSpreadingFactor(9);
+  fixedTable.update(DUID_A, DuckType::MAMA, -80, 9, 0);
+  assert(fixed.getReport(NAN, 0).need == 9);
+}
+
+void test_proposal_and_switch() {
+  cdphost::setMicros(0);
+  DuckNeighborTable table;
+  DuckAdr adr(table);
+  adr.setEnabled(true, 10, 1000);
+  table.update(DUID_A, DuckType::MAMA, -80, 9, 0);
+
+  // evaluated once per interval
+  assert(!adr.service(999));
+  assert(adr.getReport(NAN, 999).proposedSf == 0);
+  assert(!adr.service(1000));
+  DuckAdrReport report = adr.getReport(NAN, 1000);
+  assert(report.proposedSf == 7);
+  assert(report.switchIn == CDPCFG_ADR_SWITCH_DELAY_MS / 100);
+  assert(adr.getStats().proposals == 1);
+  // a beacon forwards the proposal right away
+  assert(adr.isBeaconDue(2000));
+
+  // a neighbor adopts it, with the time left
+  DuckNeighborTable neighborTable;
+  DuckAdr neighbor(neighborTable);
+  neighbor.setEnabled(true, 10, 1000);
+  report.switchIn = 50;
+  assert(neighbor.onReport(DUID_A, report, false, 1000));
+  assert(!neighbor.onReport(DUID_A, report, false, 1000));
+  assert(neighbor.getReport(NAN, 3000).switchIn == 30);
+
+  // raising wins over lowering
+  DuckAdrReport raise = makeReport(10, 11, 0);
+  raise.proposedSf = 11;
+  raise.switchIn = 80;
+  assert(neighbor.onReport(DUID_B, raise, false, 1000));
+  assert(!neighbor.onReport(DUID_A, report, false, 1000));
+  assert(!neighbor.service(8999));
+  assert(neighbor.service(9000));
+  assert(neighbor.getSpreadingFactor() == 11);
+
+  // everyone switches when the countdown expires
+  assert(!adr.service(1000 + CDPCFG_ADR_SWITCH_DELAY_MS - 1));
+  assert(adr.service(1000 + CDPCFG_ADR_SWITCH_DELAY_MS));
+  assert(adr.getSpreadingFactor() == 7);
+  assert(adr.getStats().switches == 1);
+}
+
+void test_rollback() {
+  DuckNeighborTable table;
+  DuckAdr adr(table);
+  adr.setEnabled(true, 10, 1000);
+  table.update(DUID_A, DuckType::MAMA, -80, 9, 0);
+  table.update(DUID_B, DuckType::MAMA, -80, 9, 0);
+  DuckAdrReport report = makeReport(10, 7, 0);
+  report.proposedSf = 7;
+  report.switchIn = 5;
+  adr.onReport(DUID_A, report, false, 0);
+  assert(adr.service(500));
+  assert(adr.getSpreadingFactor() == 7);
+
+  // A is heard at SF7, B is not: the cluster goes back
+  table.update(DUID_A, DuckType::MAMA, -80, 9, 1000);
+  assert(!adr.service(2500));
+  assert(adr.getReport(NAN, 2500).proposedSf == 10);
+  assert(adr.getStats().rollbacks == 1);
+  assert(adr.service(2500 + CDPCFG_ADR_SWITCH_DELAY_MS));
+  assert(adr.getSpreadingFactor() == 10);
+  // and stays there for a while even though the links look good
+  assert(adr.getClusterNeed(2500 + CDPCFG_ADR_SWITCH_DELAY_MS) == 10);
+
+  // a duck that hears nobody after the switch goes back on its own
+  DuckNeighborTable aloneTable;
+  DuckAdr alone(aloneTable);
+  alone.setEnabled(true, 10, 1000);
+  aloneTable.update(DUID_A, DuckType::MAMA, -80, 9, 0);
+  alone.onReport(DUID_A, report, false, 0);
+  assert(alone.service(500));
+  assert(alone.service(2500));
+  assert(alone.getSpreadingFactor() == 10);
+}
+
+static std::vector<byte> makeDuid(char id) {
+  std::vector<byte> duid(DUID_LENGTH, '0');
+  duid[DUID_LENGTH - 1] = id;
+  return duid;
+}
+
+void test_cluster_converges() {
+  cdphost::setMicros(0);
+  BroadcastMedium medium;
+  RadioMedium::setDefault(&medium);
+  {
+    MamaDuck ducks[3];
+    for (int i = 0; i < 3; i++) {
+      assert(ducks[i].setDeviceId(makeDuid('A' + i)) == DUCK_ERR_NONE);
+      assert(ducks[i].setupRadio(CDPCFG_RF_LORA_FREQ, CDPCFG_PIN_LORA_CS, CDPCFG_PIN_LORA_RST,
+                                 CDPCFG_PIN_LORA_DIO0, CDPCFG_PIN_LORA_DIO1,
+                                 CDPCFG_RF_LORA_TXPOW, CDPCFG_RF_LORA_BW, 10) == DUCK_ERR_NONE);
+      assert(ducks[i].getSpreadingFactor() == 10);
+      ducks[i].setAdaptiveDataRate(true, 1000);
+    }
+
+    // the mock radio reports 9dB of SNR: SF7 closes every link
+    for (int t = 0; t < 30000; t += 10) {
+      for (int i = 0; i < 3; i++) {
+        ducks[i].run();
+      }
+      cdphost::advanceMicros(10000);
+    }
+    for (int i = 0; i < 3; i++) {
+      assert(ducks[i].getSpreadingFactor() == 7);
+      assert(ducks[i].getAdrStats().switches == 1);
+      assert(ducks[i].getAdrStats().rollbacks == 0);
+      assert(ducks[i].getAdrStats().beacons > 0);
+    }
+    assert(medium.getRadios()[0]->getSpreadingFactor() == 7);
+
+    // and still hear each other
+    unsigned long received = ducks[2].getRxQueueStats().received;
+    assert(ducks[0].sendData(topics::status, String("quack")) == DUCK_ERR_NONE);
+    for (int r = 0; r < 10; r++) {
+      for (int i = 0; i < 3; i++) {
+        ducks[i].run();
+      }
+    }
+    assert(ducks[2].getRxQueueStats().received > received);
+  }
+  RadioMedium::setDefault(NULL);
+}
+
+int main() {
+  cdphost::useWallClock(false);
+  cdphost::setMicros(0);
+
+  test_report_encoding();
+  test_required_sf();
+  test_cluster_need();
+  test_proposal_and_switch();
+  test_rollback();
+  test_cluster_converges();
+
+  printf("test_adr: OK\n");
+  return 0;
+}
@@ -0,0 +1,294 @@
+/**
+ * @file test_checkpoint.cpp
+ * @brief Host tests of the checkpoints of the messages already seen.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "include/DuckCheckpoint.h"
+#include "include/DuckMuidCache.h"
+#include "include/DuckUtils.h"
+#include "include/bloomfilter.h"
+
+#include "test_helpers.h"
+
+// a checkpoint of length bytes, all set to value
+static void save(DuckCheckpoint & checkpoint, int length, byte value) {
+  std::vector<byte> data(length, value);
+  assert(checkpoint.begin(length) == DUCK_ERR_NONE);
+  assert(checkpoint.write(data.data(), length / 2) == DUCK_ERR_NONE);
+  assert(checkpoint.write(data.data() + length / 2, length - length / 2) == DUCK_ERR_NONE);
+  assert(checkpoint.end() == DUCK_ERR_NONE);
+}
+
+static byte readFirst(DuckCheckpoint & checkpoint) {
+  byte value = 0;
+  assert(checkpoint.read(0, &value, 1) == DUCK_ERR_NONE);
+  return value;
+}
+
+template<typename Filter>
+static void saveFilter(DuckCheckpoint & checkpoint, const Filter & filter) {
+  int length = filter.dedup_state_size();
+  byte chunk[CDPCFG_CHECKPOINT_CHUNK];
+  assert(checkpoint.begin(length) == DUCK_ERR_NONE);
+  for (int offset = 0; offset < length; offset += CDPCFG_CHECKPOINT_CHUNK) {
+    int n = length - offset < CDPCFG_CHECKPOINT_CHUNK ? length - offset : CDPCFG_CHECKPOINT_CHUNK;
+    filter.dedup_save(offset, chunk, n);
+    assert(checkpoint.write(chunk, n) == DUCK_ERR_NONE);
+  }
+  assert(checkpoint.end() == DUCK_ERR_NONE);
+}
+
+template<typename Filter>
+static bool loadFilter(DuckCheckpoint & checkpoint, Filter & filter) {
+  int length = filter.dedup_state_size();
+  assert(checkpoint.getLength() == length);
+  // odd sized chunks, the state is not read the way it was written
+  byte chunk[37];
+  for (int offset = 0; offset < length; offset += sizeof(chunk)) {
+    int n = length - offset < (int) sizeof(chunk) ? length - offset : sizeof(chunk);
+    assert(checkpoint.read(offset, chunk, n) == DUCK_ERR_NONE);
+    filter.dedup_load(offset, chunk, n);
+  }
+  return filter.dedup_load_end();
+}
+
+void test_slots() {
+  const int length = 100;
+  DuckRamStorage storage(3 * (DUCK_CHECKPOINT_HEADER_LENGTH + length));
+  DuckCheckpoint checkpoint;
+  assert(!checkpoint.hasStorage());
+  assert(checkpoint.read(0, NULL, 0) == DUCK_ERR_NO_CHECKPOINT);
+  assert(checkpoint.setStorage(&storage, length) == DUCK_ERR_NONE);
+  assert(checkpoint.getStats().slots == CDPCFG_CHECKPOINT_SLOTS);
+  assert(checkpoint.getLength() == 0);
+  assert(checkpoint.read(0, NULL, 0) == DUCK_ERR_NO_CHECKPOINT);
+
+  for (int i = 1; i <= 5; i++) {
+    save(checkpoint, length, i);
+    assert(checkpoint.getLength() == length);
+    assert(readFirst(checkpoint) == i);
+  }
+  assert(checkpoint.getStats().saves == 5);
+  assert(checkpoint.getStats().sequence == 5);
+  assert(storage.getCommits() == 5);
+
+  // found again after a reboot
+  DuckCheckpoint restarted;
+  assert(restarted.setStorage(&storage, length) == DUCK_ERR_NONE);
+  assert(restarted.getLength() == length);
+  assert(restarted.getStats().sequence == 5);
+  assert(readFirst(restarted) == 5);
+
+  // the next one goes to the other slot
+  save(restarted, length, 6);
+  assert(restarted.getStats().sequence == 6);
+
+  // damaged: the previous checkpoint, still in the other slot, is used
+  int newest = (5 % CDPCFG_CHECKPOINT_SLOTS) * (DUCK_CHECKPOINT_HEADER_LENGTH + length);
+  byte damage = 0xAA;
+  assert(storage.write(newest + DUCK_CHECKPOINT_HEADER_LENGTH + 10, &damage, 1) == DUCK_ERR_NONE);
+  DuckCheckpoint fallback;
+  assert(fallback.setStorage(&storage, length) == DUCK_ERR_NONE);
+  assert(fallback.getStats().sequence == 5);
+  assert(readFirst(fallback) == 5);
+}
+
+void test_interrupted() {
+  const int length = 64;
+  DuckRamStorage storage(CDPCFG_CHECKPOINT_SLOTS * (DUCK_CHECKPOINT_HEADER_LENGTH + length));
+  DuckCheckpoint checkpoint;
+  assert(checkpoint.setStorage(&storage, length) == DUCK_ERR_NONE);
+  save(checkpoint, length, 1);
+
+  // a reboot in the middle of the next checkpoint
+  byte data[length / 2];
+  memset(data, 2, sizeof(data));
+  assert(checkpoint.begin(length) == DUCK_ERR_NONE);
+  assert(checkpoint.isWriting());
+  assert(checkpoint.write(data, sizeof(data)) == DUCK_ERR_NONE);
+  DuckCheckpoint restarted;
+  assert(restarted.setStorage(&storage, length) == DUCK_ERR_NONE);
+  assert(restarted.getStats().sequence == 1);
+  assert(readFirst(restarted) == 1);
+
+  // longer than announced, or ended early
+  assert(checkpoint.write(data, sizeof(data)) == DUCK_ERR_NONE);
+  assert(checkpoint.write(data, 1) == DUCK_ERR_STORAGE);
+  assert(!checkpoint.isWriting());
+  assert(checkpoint.begin(length) == DUCK_ERR_NONE);
+  assert(checkpoint.end() == DUCK_ERR_STORAGE);
+  assert(checkpoint.getStats().failures == 2);
+  assert(checkpoint.begin(length + 1) == DUCK_ERR_STORAGE);
+
+  // too small for a single slot
+  DuckRamStorage small(length);
+  assert(checkpoint.setStorage(&small, length) == DUCK_ERR_STORAGE);
+  assert(!checkpoint.hasStorage());
+
+  // or for a second one, the only checkpoint would be lost by the next
+  DuckRamStorage single(2 * (DUCK_CHECKPOINT_HEADER_LENGTH + length) - 1);
+  assert(checkpoint.setStorage(&single, length) == DUCK_ERR_STORAGE);
+  assert(!checkpoint.hasStorage());
+}
+
+void test_eeprom_storage() {
+  const int length = 2000;
+  const int eepromSize = CDPCFG_CHECKPOINT_EEPROM_OFFSET + CDPCFG_CHECKPOINT_EEPROM_SIZE;
+
+  // without checkpoints the credentials keep a small EEPROM
+  unsigned long stored = EEPROM.bytesCommitted;
+  assert(duckutils::saveWifiCredentials("duck", "quack") == DUCK_ERR_NONE);
+  assert(EEPROM.length() == CDPCFG_EEPROM_CRED_SIZE);
+  assert(EEPROM.bytesCommitted - stored == CDPCFG_EEPROM_CRED_SIZE);
+
+  DuckEepromStorage storage;
+  DuckCheckpoint checkpoint;
+  assert(checkpoint.setStorage(&storage, length) == DUCK_ERR_NONE);
+  save(checkpoint, length, 1);
+
+  // the WiFi credentials share the EEPROM, they must not truncate it
+  assert(duckutils::saveWifiCredentials("duck", "quack") == DUCK_ERR_NONE);
+  assert(strcmp(duckutils::loadWifiSsid().c_str(), "duck") == 0);
+  assert((int) EEPROM.length() == eepromSize);
+  EEPROM.end();
+  DuckCheckpoint kept;
+  assert(kept.setStorage(&storage, length) == DUCK_ERR_NONE);
+  assert(kept.getStats().sequence == 1);
+  assert(readFirst(kept) == 1);
+  stored = EEPROM.bytesCommitted;
+  save(checkpoint, length, 2);
+  // the whole EEPROM is stored, whatever slot changed
+  printf("  eeprom checkpoint: %d bytes, %lu bytes stored by the commit\n",
+         length, EEPROM.bytesCommitted - stored);
+  assert((int) (EEPROM.bytesCommitted - stored) == eepromSize);
+  assert(strcmp(duckutils::loadWifiPassword().c_str(), "quack") == 0);
+
+  // begun again with a smaller size in the middle of a checkpoint: the
+  // chunks written before are lost, the checkpoint fails its CRC
+  byte data[length / 2];
+  memset(data, 3, sizeof(data));
+  assert(checkpoint.begin(length) == DUCK_ERR_NONE);
+  assert(checkpoint.write(data, sizeof(data)) == DUCK_ERR_NONE);
+  EEPROM.begin(CDPCFG_CHECKPOINT_EEPROM_OFFSET);
+  assert(checkpoint.write(data, sizeof(data)) == DUCK_ERR_NONE);
+  assert(checkpoint.end() == DUCK_ERR_NONE);
+
+  // after a reboot
+  EEPROM.end();
+  DuckEepromStorage rebooted;
+  DuckCheckpoint restarted;
+  assert(restarted.setStorage(&rebooted, length) == DUCK_ERR_NONE);
+  assert(restarted.getStats().sequence == 2);
+  assert(readFirst(restarted) == 2);
+  assert(strcmp(duckutils::loadWifiSsid().c_str(), "duck") == 0);
+}
+
+void test_bloomfilter_state() {
+  BloomFilter filter(312, 2, 32, 100);
+  DuckRamStorage storage(CDPCFG_CHECKPOINT_EEPROM_SIZE);
+  DuckCheckpoint checkpoint;
+  assert(checkpoint.setStorage(&storage, filter.dedup_state_size()) == DUCK_ERR_NONE);
+
+  // both generations in use
+  byte muid[MUID_LENGTH];
+  for (int i = 0; i < 150; i++) {
+    makeMuid(muid, i * 2654435761u);
+    filter.dedup_add(NULL, muid);
+  }
+  assert(filter.dedup_adds() == 150);
+  // timed on the host clock, the steps are what run() would do
+  cdphost::useWallClock(true);
+  saveFilter(checkpoint, filter);
+  cdphost::useWallClock(false);
+  DuckCheckpointStats stats = checkpoint.getStats();
+  printf("  bloom filter checkpoint: %d bytes, %lu us, longest step %lu us\n",
+         filter.dedup_state_size(), stats.lastSaveTime, stats.maxStepTime);
+
+  // another seed: only the same answers if the seed was restored too
+  srand(12345);
+  BloomFilter restored(312, 2, 32, 100);
+  assert(loadFilter(checkpoint, restored));
+  for (int i = 0; i < 150; i++) {
+    makeMuid(muid, i * 2654435761u);
+    assert(restored.dedup_check(NULL, muid));
+  }
+  for (int i = 0; i < 10000; i++) {
+    makeMuid(muid, 0x80000000u + i);
+    assert(restored.dedup_check(NULL, muid) == filter.dedup_check(NULL, muid));
+  }
+  BloomFilterStats before = filter.bloom_stats();
+  BloomFilterStats after = restored.bloom_stats();
+  assert(after.fillRatio == before.fillRatio);
+  assert(after.frozenFillRatio == before.frozenFillRatio);
+  assert(after.rotations == 1);
+  assert(after.messages == 50);
+  assert(after.lastGenerationMessages == 100);
+
+  // same size, other hash functions: not usable
+  BloomFilter other(312, 3, 32, 100);
+  assert(!loadFilter(checkpoint, other));
+  assert(other.bloom_stats().fillRatio == 0);
+  makeMuid(muid, 0);
+  assert(!other.dedup_check(NULL, muid));
+}
+
+void test_muidcache_state() {
+  cdphost::setMicros(0);
+  DuckMuidCache cache;
+  cache.setWindow(60);
+  DuckRamStorage storage(2 * CDPCFG_CHECKPOINT_EEPROM_SIZE);
+  DuckCheckpoint checkpoint;
+  assert(checkpoint.setStorage(&storage, cache.dedup_state_size()) == DUCK_ERR_NONE);
+
+  byte sduid[DUID_LENGTH];
+  memset(sduid, 'A', DUID_LENGTH);
+  byte old[MUID_LENGTH];
+  byte recent[MUID_LENGTH];
+  makeMuid(old, 1);
+  makeMuid(recent, 2);
+  cdphost::setMicros(1000 * 1000000ULL);
+  cache.dedup_add(sduid, old);
+  cdphost::advanceMicros(40 * 1000000ULL);
+  cache.dedup_add(sduid, recent);
+  cdphost::advanceMicros(10 * 1000000ULL);
+  saveFilter(checkpoint, cache);
+
+  // the clock restarts at 0 after a reboot, the entries keep their age
+  cdphost::setMicros(0);
+  DuckMuidCache restored;
+  restored.setWindow(60);
+  assert(loadFilter(checkpoint, restored));
+  assert(restored.dedup_stats().entries == 2);
+  cdphost::setMicros(5 * 1000000ULL);
+  assert(restored.dedup_check(sduid, old));
+  assert(restored.dedup_check(sduid, recent));
+  cdphost::setMicros(15 * 1000000ULL);
+  assert(!restored.dedup_check(sduid, old));
+  assert(restored.dedup_check(sduid, recent));
+  cdphost::setMicros(55 * 1000000ULL);
+  assert(!restored.dedup_check(sduid, recent));
+
+  // entries that expired while saved are dropped
+  cdphost::setMicros(0);
+  DuckMuidCache shorter;
+  shorter.setWindow(20);
+  assert(loadFilter(checkpoint, shorter));
+  assert(shorter.dedup_stats().entries == 1);
+}
+
+int main() {
+  cdphost::useWallClock(false);
+
+  test_slots();
+  test_interrupted();
+  test_eeprom_storage();
+  test_bloomfilter_state();
+  test_muidcache_state();
+
+  printf("test_checkpoint: OK\n");
+  return 0;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file test_dutycycle.cpp
+ * @brief Host tests of the time on air calculator and the duty cycle budget.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+
+#include <RadioLib.h>
+
+#include "MamaDuck.h"
+#include "include/DuckAirtime.h"
+#include "include/DuckDutyCycle.h"
+
+void test_time_on_air() {
+  // reference values from the Semtech LoRa calculator
+  assert(duckairtime::getTimeOnAir(7, 125.0, 5, 8, 10) == 41216);
+  assert(duckairtime::getTimeOnAir(7, 125.0, 5, 8, 51) == 102656);
+  assert(duckairtime::getTimeOnAir(9, 125.0, 7, 8, 32) == 312320);
+  // low data rate optimization
+  assert(duckairtime::getTimeOnAir(12, 125.0, 5, 8, 10) == 991232);
+  assert(duckairtime::getTimeOnAir(7, 500.0, 5, 8, 10) == 10304);
+}
+
+void test_sliding_window() {
+  DuckDutyCycle dutyCycle;
+  assert(!dutyCycle.isLimited());
+  assert(dutyCycle.canTransmit(100000, 0));
+  assert(dutyCycle.getRemaining(0) == ULONG_MAX);
+
+  // 1% of 60s: 600ms, in 1s buckets
+  dutyCycle.setLimit(10, 60000);
+  assert(dutyCycle.getBudget() == 600);
+  dutyCycle.record(400, 500);
+  dutyCycle.record(100, 30500);
+  assert(dutyCycle.getRemaining(30500) == 100);
+  assert(dutyCycle.canTransmit(100, 30500));
+  assert(!dutyCycle.canTransmit(101, 30500));
+  // the reserve is kept out of reach
+  assert(!dutyCycle.canTransmit(1, 30500, 20));
+
+  // the first frame leaves the window one bucket after it is 60s old
+  assert(dutyCycle.getRemaining(60500) == 100);
+  assert(dutyCycle.getRemaining(61000) == 500);
+  assert(dutyCycle.getRemaining(91000) == 600);
+
+  // idle for longer than the window
+  dutyCycle.record(600, 100000);
+  assert(dutyCycle.getRemaining(100000) == 0);
+  assert(dutyCycle.getRemaining(500000) == 600);
+  assert(dutyCycle.getStats().airtime == 1100);
+
+  dutyCycle.setMaxDwell(400);
+  assert(dutyCycle.exceedsDwell(401));
+  assert(!dutyCycle.exceedsDwell(400));
+}
+
+static std::vector<byte> makeDuid(char id) {
+  std::vector<byte> duid(DUID_LENGTH, '0');
+  duid[DUID_LENGTH - 1] = id;
+  return duid;
+}
+
+static void run(MamaDuck & duck, int rounds) {
+  for (int r = 0; r < rounds; r++) {
+    duck.run();
+    cdphost::advanceMicros(1000);
+  }
+}
+
+void test_budget_enforcement() {
+  BroadcastMedium medium;
+  RadioMedium::setDefault(&medium);
+  {
+    MamaDuck duck;
+    assert(duck.setupWithDefaults(makeDuid('A'), CDPCFG_RF_LORA_FREQ) == DUCK_ERR_NONE);
+    // a "quack" frame: 32 bytes at SF7 4/7, 93ms on air
+    unsigned long airtime = duck.getTimeOnAir(DATA_POS + 5);
+    assert(airtime == 93);
+
+    // 600ms per minute, status reports keep 120ms for the rest
+    duck.setDutyCycle(10, 60000);
+    assert(duck.getDutyCycleRemaining() == 600);
+    for (int i = 0; i < 5; i++) {
+      assert(duck.sendData(topics::status, String("quack")) == DUCK_ERR_NONE);
+      run(duck, 2);
+    }
+    assert(duck.getDutyCycleRemaining() == 600 - 5 * airtime);
+    assert(duck.sendData(topics::status, String("quack")) == DUCKLORA_ERR_DUTY_CYCLE);
+    assert(medium.transmitted == 5);
+    assert(duck.getDutyCycleStats().dropped == 1);
+
+    // alerts use the reserve, then wait for the window to slide
+    assert(duck.sendData(topics::alert, String("quack")) == DUCK_ERR_NONE);
+    run(duck, 2);
+    assert(medium.transmitted == 6);
+    assert(duck.sendData(topics::alert, String("quack")) == DUCK_ERR_NONE);
+    run(duck, 100);
+    assert(medium.transmitted == 6);
+    assert(duck.getTxQueueStats().depth == 1);
+    assert(duck.getDutyCycleStats().deferred == 1);
+
+    // a minute later, plus the one bucket granularity
+    cdphost::advanceMicros(61000000ULL);
+    run(duck, 2);
+    assert(medium.transmitted == 7);
+    assert(duck.getTxQueueStats().depth == 0);
+    assert(duck.getDutyCycleStats().airtime == 7 * airtime);
+
+    // 93ms does not fit in a 50ms dwell time
+    duck.setMaxDwell(50);
+    assert(duck.sendData(topics::alert, String("quack")) == DUCKLORA_ERR_DWELL_TIME);
+    assert(duck.getDutyCycleStats().tooLong == 1);
+  }
+  RadioMedium::setDefault(NULL);
+}
+
+int main() {
+  cdphost::useWallClock(false);
+  cdphost::setMicros(0);
+
+  test_time_on_air();
+  test_sliding_window();
+  test_budget_enforcement();
+
+  printf("test_dutycycle: OK\n");
+  return 0;
+}
@@ -0,0 +1,36 @@
+/**
+ * @file test_helpers.h
+ * @brief DUIDs and MUIDs made from a number, shared by the host tests.
+ */
+
+#ifndef CDP_TEST_HELPERS_H
+#define CDP_TEST_HELPERS_H
+
+#include <string.h>
+
+#include <Arduino.h>
+
+#include "CdpPacket.h"
+
+// a DUID of '0's ending with two letters, 676 different ones
+static inline void makeDuid(byte* duid, int id) {
+  memset(duid, '0', DUID_LENGTH);
+  duid[DUID_LENGTH - 2] = 'A' + id / 26;
+  duid[DUID_LENGTH - 1] = 'A' + id % 26;
+}
+
+// a MUID holding the id, big endian
+static inline void makeMuid(byte* muid, uint32_t id) {
+  muid[0] = id >> 24;
+  muid[1] = id >> 16;
+  muid[2] = id >> 8;
+  muid[3] = id;
+}
+
+// a message of one of 4 ducks, the MUID made from the id
+static inline void makePair(byte* duid, byte* muid, int id) {
+  makeDuid(duid, id % 4);
+  makeMuid(muid, id);
+}
+
+#endif
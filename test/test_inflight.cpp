@@ -0,0 +1,161 @@
+/**
+ * @file test_inflight.cpp
+ * @brief Host tests of the table of the messages waiting for their ack.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "include/DuckInflightTable.h"
+
+#include "test_helpers.h"
+
+void test_add_and_ack() {
+  DuckInflightTable table;
+  byte muid[MUID_LENGTH];
+  makeMuid(muid, 0);
+  assert(table.size() == 0);
+  assert(table.find(muid) == NULL);
+  assert(table.ack(muid, 10) == NULL);
+
+  DuckInflight* message = table.add(muid, 100);
+  assert(table.find(muid) == message);
+  assert(table.get(0) == message);
+  assert(table.get(1) == NULL);
+  assert(message->sentAt == 100);
+  assert(message->lastSent == 100);
+  assert(message->retries == 0);
+  assert(!message->acked);
+  assert(table.pending() == 1);
+
+  // several messages wait at the same time
+  byte other[MUID_LENGTH];
+  makeMuid(other, 1);
+  table.add(other, 200);
+  assert(table.pending() == 2);
+
+  assert(table.ack(muid, 300) == message);
+  assert(message->acked);
+  assert(message->ackedAt == 300);
+  // a repeated ack is not counted twice
+  assert(table.ack(muid, 400) == NULL);
+  assert(table.pending() == 1);
+  assert(table.size() == 2);
+
+  DuckInflightStats stats = table.getStats();
+  assert(stats.sent == 2);
+  assert(stats.acked == 1);
+  assert(stats.evicted == 0);
+
+  table.clear();
+  assert(table.size() == 0);
+  assert(table.find(other) == NULL);
+}
+
+void test_replacement() {
+  DuckInflightTable table;
+  byte muid[MUID_LENGTH];
+  for (int i = 0; i < CDPCFG_INFLIGHT_TABLE_SIZE; i++) {
+    makeMuid(muid, i);
+    table.add(muid, 100 + i);
+  }
+  assert(table.pending() == CDPCFG_INFLIGHT_TABLE_SIZE);
+
+  // acked messages make room first, the oldest ack first
+  makeMuid(muid, 3);
+  table.ack(muid, 500);
+  makeMuid(muid, 5);
+  table.ack(muid, 400);
+  makeMuid(muid, 100);
+  table.add(muid, 600);
+  makeMuid(muid, 5);
+  assert(table.find(muid) == NULL);
+  makeMuid(muid, 3);
+  assert(table.find(muid) != NULL);
+  assert(table.getStats().evicted == 0);
+
+  makeMuid(muid, 101);
+  table.add(muid, 700);
+  makeMuid(muid, 3);
+  assert(table.find(muid) == NULL);
+  assert(table.getStats().evicted == 0);
+
+  // then the message sent the longest time ago
+  makeMuid(muid, 102);
+  table.add(muid, 800);
+  makeMuid(muid, 0);
+  assert(table.find(muid) == NULL);
+  makeMuid(muid, 1);
+  assert(table.find(muid) != NULL);
+  assert(table.getStats().evicted == 1);
+  assert(table.size() == CDPCFG_INFLIGHT_TABLE_SIZE);
+}
+
+void test_reliable() {
+  DuckInflightTable table;
+  byte muid[MUID_LENGTH];
+  const byte frame[] = {1, 2, 3, 4, 5};
+  int length = 0;
+
+  makeMuid(muid, 0);
+  DuckInflight* message = table.addReliable(muid, frame, sizeof(frame), 100, 10100, 1100);
+  assert(message != NULL);
+  assert(message->reliable);
+  const byte* kept = table.getFrame(*message, &length);
+  assert(length == (int) sizeof(frame));
+  assert(std::equal(frame, frame + sizeof(frame), kept));
+
+  // due at its retry time
+  assert(table.nextDue(1099) == NULL);
+  assert(table.nextDue(1100) == message);
+  table.retried(message, 1100, 3100);
+  assert(message->retries == 1);
+  assert(message->lastSent == 1100);
+  assert(table.nextDue(3000) == NULL);
+  assert(table.getStats().retransmissions == 1);
+
+  // the ack frees the frame
+  assert(table.ack(muid, 2000) == message);
+  assert(table.getFrame(*message, &length) == NULL);
+  assert(table.nextDue(5000) == NULL);
+
+  // and so does the deadline
+  makeMuid(muid, 1);
+  message = table.addReliable(muid, frame, sizeof(frame), 100, 1000, 5000);
+  assert(table.nextDue(999) == NULL);
+  assert(table.nextDue(1000) == message);
+  table.expire(message);
+  assert(table.nextDue(6000) == NULL);
+  assert(!message->acked);
+  assert(table.getStats().expired == 1);
+
+  // a bounded number of frames kept
+  for (int i = 0; i < CDPCFG_RELIABLE_PENDING; i++) {
+    assert(table.canAddReliable());
+    makeMuid(muid, 10 + i);
+    assert(table.addReliable(muid, frame, sizeof(frame), 200 + i, 10000, 5000) != NULL);
+  }
+  assert(!table.canAddReliable());
+  makeMuid(muid, 20);
+  assert(table.addReliable(muid, frame, sizeof(frame), 300, 10000, 5000) == NULL);
+
+  // other messages never replace the messages whose frame is kept
+  for (int i = 0; i < 3 * CDPCFG_INFLIGHT_TABLE_SIZE; i++) {
+    makeMuid(muid, 30 + i);
+    table.add(muid, 400 + i);
+  }
+  for (int i = 0; i < CDPCFG_RELIABLE_PENDING; i++) {
+    makeMuid(muid, 10 + i);
+    assert(table.find(muid) != NULL);
+  }
+}
+
+int main() {
+  test_add_and_ack();
+  test_replacement();
+  test_reliable();
+
+  printf("test_inflight: OK\n");
+  return 0;
+}
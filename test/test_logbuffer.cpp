@@ -0,0 +1,76 @@
+/**
+ * @file test_logbuffer.cpp
+ * @brief Host tests of the binary log mode (built with CDP_LOG_BINARY).
+ *
+ * The entries are finally written to stdout so that the output can be checked
+ * through tools/cdp_log_decode.py.
+ */
+
+#include <assert.h>
+
+#include <Arduino.h>
+
+#include "DuckLogger.h"
+
+static void logSomething(int value) {
+  loginfo_f("value is %d, twice is %d\n", value, 2 * value);
+}
+
+void test_record_and_pop() {
+  DuckLogEntry entry;
+  while (ducklog::pop(&entry)) {
+  }
+
+  cdphost::setMicros(1234000);
+  logSomething(21);
+  logerr("this message is not formatted: " + String(42));
+
+  assert(ducklog::pop(&entry));
+  assert(entry.level == CDP_LOG_LEVEL_INFO);
+  assert(entry.timestamp == 1234);
+  assert(entry.numArgs == 2);
+  assert(entry.args[0] == 21 && entry.args[1] == 42);
+
+  // the id only depends on the file name and the line
+  uint32_t id = entry.id;
+  logSomething(1);
+  assert(ducklog::pop(&entry));
+  assert(entry.id != id);
+  assert(ducklog::pop(&entry));
+  assert(entry.id == id);
+  assert(entry.numArgs == 2 && entry.args[0] == 1);
+
+  assert(!ducklog::pop(&entry));
+}
+
+void test_siteid() {
+  static_assert(ducklog::siteId("a/b/test.cpp", 7) == ducklog::siteId("test.cpp", 7),
+                "the site id must not depend on the build directory");
+  static_assert(ducklog::siteId("test.cpp", 7) != ducklog::siteId("test.cpp", 8),
+                "lines must have different ids");
+}
+
+void test_overflow() {
+  unsigned long dropped = ducklog::getDropped();
+  for (int i = 0; i < CDP_LOG_BUFFER_SIZE + 3; i++) {
+    logdbg_f("filling %d\n", i);
+  }
+  assert(ducklog::getDropped() == dropped + 3);
+  ducklog::dump();
+  DuckLogEntry entry;
+  assert(!ducklog::pop(&entry));
+}
+
+int main() {
+  cdphost::useWallClock(false);
+  test_record_and_pop();
+  test_siteid();
+  test_overflow();
+
+  // decoded by the test_logbuffer_decode test
+  Serial.setEcho(true);
+  logSomething(7);
+  logwarn("plain message");
+  ducklog::dump();
+  return 0;
+}
@@ -0,0 +1,969 @@
+/**
+ * @file test_mamaduck.cpp
+ * @brief Host tests of MamaDucks talking through the in-memory radio.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <RadioLib.h>
+
+#include "MamaDuck.h"
+
+/**
+ * @brief Ducks on a line, each radio only hears its direct neighbors.
+ * Records the hop count of every transmitted frame.
+ */
+class LineMedium : public BroadcastMedium {
+public:
+  void transmit(SX1276* radio, const uint8_t* data, size_t length) {
+    const std::vector<SX1276*> & radios = getRadios();
+    int from = std::find(radios.begin(), radios.end(), radio) - radios.begin();
+    senders.push_back(from);
+    hops.push_back(data[HOP_COUNT_POS]);
+    frames.push_back(std::vector<byte>(data, data + length));
+    for (int i = from - 1; i <= from + 1; i += 2) {
+      if (i >= 0 && i < (int) radios.size()) {
+        radios[i]->deliver(data, length);
+      }
+    }
+    radio->transmitDone();
+  }
+
+  std::vector<int> senders;
+  std::vector<int> hops;
+  std::vector<std::vector<byte> > frames;
+};
+
+/**
+ * @brief Ducks on a graph, each radio only hears the radios it has an edge
+ * with. Records the sender of every transmitted frame.
+ */
+class GraphMedium : public BroadcastMedium {
+public:
+  void link(int a, int b) {
+    edges.push_back(std::make_pair(a, b));
+    edges.push_back(std::make_pair(b, a));
+  }
+
+  void transmit(SX1276* radio, const uint8_t* data, size_t length) {
+    const std::vector<SX1276*> & radios = getRadios();
+    int from = std::find(radios.begin(), radios.end(), radio) - radios.begin();
+    senders.push_back(from);
+    frames.push_back(std::vector<byte>(data, data + length));
+    for (size_t i = 0; i < edges.size(); i++) {
+      if (edges[i].first == from) {
+        radios[edges[i].second]->deliver(data, length);
+      }
+    }
+    radio->transmitDone();
+  }
+
+  std::vector<std::pair<int, int> > edges;
+  std::vector<int> senders;
+  std::vector<std::vector<byte> > frames;
+};
+
+static std::vector<byte> makeDuid(char id) {
+  std::vector<byte> duid(DUID_LENGTH, '0');
+  duid[DUID_LENGTH - 1] = id;
+  return duid;
+}
+
+static void setup(MamaDuck* ducks, int count) {
+  for (int i = 0; i < count; i++) {
+    int err = ducks[i].setupWithDefaults(makeDuid('A' + i), CDPCFG_RF_LORA_FREQ);
+    assert(err == DUCK_ERR_NONE);
+  }
+}
+
+static void runAll(MamaDuck* ducks, int count, int rounds) {
+  for (int r = 0; r < rounds; r++) {
+    for (int i = 0; i < count; i++) {
+      ducks[i].run();
+    }
+    cdphost::advanceMicros(1000);
+  }
+}
+
+void test_send_and_relay() {
+  BroadcastMedium medium;
+  RadioMedium::setDefault(&medium);
+  {
+    MamaDuck ducks[3];
+    setup(ducks, 3);
+    assert(medium.getRadios().size() == 3);
+
+    int err = ducks[0].sendData(topics::status, String("quack"));
+    assert(err == DUCK_ERR_NONE);
+    runAll(ducks, 3, 10);
+
+    // the message and one relay by each of the two other ducks, every other
+    // copy is a duplicate
+    assert(medium.transmitted == 3);
+    assert(ducks[0].getTxQueueStats().sent == 1);
+    assert(ducks[1].getTxQueueStats().sent == 1);
+    assert(ducks[2].getTxQueueStats().sent == 1);
+    // like the real radio the mock holds a single frame: the relay of the
+    // second duck replaced the message before the third duck read it
+    assert(ducks[1].getRxQueueStats().received == 2);
+    assert(ducks[2].getRxQueueStats().received == 1);
+  }
+  assert(medium.getRadios().empty());
+  RadioMedium::setDefault(NULL);
+}
+
+void test_multi_hop() {
+  LineMedium medium;
+  RadioMedium::setDefault(&medium);
+  {
+    MamaDuck ducks[4];
+    setup(ducks, 4);
+
+    int err = ducks[0].sendData(topics::status, String("quack"));
+    assert(err == DUCK_ERR_NONE);
+    runAll(ducks, 4, 10);
+
+    // the message walks down the line, one hop per relay
+    assert(medium.senders.size() == 4);
+    for (int i = 0; i < 4; i++) {
+      assert(medium.senders[i] == i);
+      assert(medium.hops[i] == i);
+    }
+    assert(ducks[3].getRxQueueStats().received == 1);
+  }
+  RadioMedium::setDefault(NULL);
+}
+
+// a ping from a duck out of the test, with `length` data bytes
+static void deliverPing(SX1276* radio, int length) {
+  std::vector<byte> data(length, 0);
+#ifdef CDPCFG_DEDUP_MUID_CACHE
+  DuckMuidCache filter;
+#else
+  BloomFilter filter(312, 2, 32, 100);
+#endif
+  DuckPacket ping(makeDuid('P'));
+  assert(ping.prepareForSending(&filter, ZERO_DUID.data(), DuckType::MAMA, reservedTopic::ping,
+                                data.data(), data.size()) == DUCK_ERR_NONE);
+  assert(radio->deliver(ping.getBuffer(), ping.getBufferLength()));
+}
+
+// the pongs sent since the given frame
+static std::vector<CdpPacketView> pongsSince(const LineMedium & medium, size_t first) {
+  std::vector<CdpPacketView> pongs;
+  for (size_t i = first; i < medium.frames.size(); i++) {
+    if (medium.frames[i][TOPIC_POS] == reservedTopic::pong) {
+      pongs.push_back(CdpPacketView(medium.frames[i]));
+    }
+  }
+  return pongs;
+}
+
+void test_pong() {
+  LineMedium medium;
+  RadioMedium::setDefault(&medium);
+  {
+    MamaDuck ducks[1];
+    setup(ducks, 1);
+    SX1276* radio = medium.getRadios()[0];
+
+    // without the adaptive data rate: the one byte pong to ZERO_DUID, for
+    // every ping
+    deliverPing(radio, 1);
+    runAll(ducks, 1, 10);
+    deliverPing(radio, 1 + DUCK_ADR_REPORT_LENGTH);
+    runAll(ducks, 1, 10);
+    std::vector<CdpPacketView> pongs = pongsSince(medium, 0);
+    assert(pongs.size() == 2);
+    for (size_t i = 0; i < pongs.size(); i++) {
+      assert(std::equal(ZERO_DUID.begin(), ZERO_DUID.end(), pongs[i].getDduid()));
+      assert(pongs[i].getDataLength() == 1);
+    }
+
+    // with it: the link report to the duck that pinged, beacons not answered
+    ducks[0].setAdaptiveDataRate(true);
+    size_t first = medium.frames.size();
+    deliverPing(radio, 1);
+    runAll(ducks, 1, 10);
+    deliverPing(radio, 1 + DUCK_ADR_REPORT_LENGTH);
+    runAll(ducks, 1, 10);
+    pongs = pongsSince(medium, first);
+    assert(pongs.size() == 1);
+    std::vector<byte> pinger = makeDuid('P');
+    assert(std::equal(pinger.begin(), pinger.end(), pongs[0].getDduid()));
+    assert(pongs[0].getDataLength() == 1 + DUCK_ADR_REPORT_LENGTH);
+  }
+  RadioMedium::setDefault(NULL);
+}
+
+/**
+ * @brief A mama that is slow to handle its first frame: a burst of frames
+ * arrives meanwhile.
+ */
+class SlowMama : public MamaDuck {
+public:
+  void handleReceivedPacket() {
+    while (!burst.empty()) {
+      assert(radio->deliver(burst.front().data(), burst.front().size()));
+      burst.erase(burst.begin());
+      serviceRadio();
+    }
+    MamaDuck::handleReceivedPacket();
+  }
+
+  SX1276* radio = NULL;
+  std::vector<std::vector<byte> > burst;
+};
+
+// status messages from a duck out of the test
+static std::vector<std::vector<byte> > makeMessages(int count) {
+#ifdef CDPCFG_DEDUP_MUID_CACHE
+  DuckMuidCache filter;
+#else
+  BloomFilter filter(312, 2, 32, 100);
+#endif
+  DuckPacket packet(makeDuid('Z'));
+  std::vector<std::vector<byte> > frames;
+  for (int i = 0; i < count; i++) {
+    byte data = i;
+    assert(packet.prepareForSending(&filter, ZERO_DUID.data(), DuckType::MAMA, topics::status,
+                                    &data, 1) == DUCK_ERR_NONE);
+    filter.dedup_add(packet.getView().getSduid(), packet.getView().getMuid());
+    frames.push_back(std::vector<byte>(packet.getBuffer(), packet.getBuffer() + packet.getBufferLength()));
+  }
+  return frames;
+}
+
+void test_rx_queue_overflow() {
+  LineMedium medium;
+  RadioMedium::setDefault(&medium);
+  {
+    SlowMama duck;
+    assert(duck.setupWithDefaults(makeDuid('A'), CDPCFG_RF_LORA_FREQ) == DUCK_ERR_NONE);
+    duck.radio = medium.getRadios()[0];
+
+    // the first frame holds a slot while the burst arrives: the queue takes
+    // CDPCFG_RX_QUEUE_SIZE - 1 frames of the burst, the others are dropped
+    const int dropped = 3;
+    std::vector<std::vector<byte> > frames = makeMessages(CDPCFG_RX_QUEUE_SIZE + dropped);
+    duck.burst.assign(frames.begin() + 1, frames.end());
+    assert(duck.radio->deliver(frames[0].data(), frames[0].size()));
+    runAll(&duck, 1, 10);
+
+    DuckRxQueueStats stats = duck.getRxQueueStats();
+    assert(stats.received == CDPCFG_RX_QUEUE_SIZE);
+    assert(stats.overflows == (unsigned long) dropped);
+    assert(stats.highWater == CDPCFG_RX_QUEUE_SIZE);
+
+    // the queued frames are relayed in the order they arrived
+    assert(medium.frames.size() == CDPCFG_RX_QUEUE_SIZE);
+    for (int i = 0; i < CDPCFG_RX_QUEUE_SIZE; i++) {
+      assert(std::equal(frames[i].begin() + MUID_POS, frames[i].begin() + MUID_POS + MUID_LENGTH,
+                        medium.frames[i].begin() + MUID_POS));
+    }
+  }
+  RadioMedium::setDefault(NULL);
+}
+
+/**
+ * @brief A channel that is busy for a number of scans, or a radio that
+ * never signals the end of a scan.
+ */
+class CsmaMedium : public BroadcastMedium {
+public:
+  void channelScan(SX1276* radio) {
+    scans++;
+    if (silent) {
+      return;
+    }
+    if (busyScans > 0) {
+      busyScans--;
+      radio->channelScanDone(true);
+    } else {
+      radio->channelScanDone(false);
+    }
+  }
+
+  int busyScans = 0;
+  bool silent = false;
+  int scans = 0;
+};
+
+// run until the medium carries `frames` frames, returns the rounds it took
+static int runUntilSent(MamaDuck* duck, CsmaMedium & medium, unsigned long frames, int maxRounds) {
+  for (int i = 0; i < maxRounds; i++) {
+    if (medium.transmitted >= frames) {
+      return i;
+    }
+    runAll(duck, 1, 1);
+  }
+  return maxRounds;
+}
+
+void test_csma() {
+  CsmaMedium medium;
+  RadioMedium::setDefault(&medium);
+  {
+    MamaDuck ducks[1];
+    setup(ducks, 1);
+    ducks[0].setCsma(true, 100, 3);
+
+    // clear channel: one scan, sent right away
+    assert(ducks[0].sendData(topics::status, String("quack")) == DUCK_ERR_NONE);
+    runUntilSent(ducks, medium, 1, 10);
+    assert(medium.transmitted == 1);
+    DuckCsmaStats stats = ducks[0].getCsmaStats();
+    assert(stats.scans == 1);
+    assert(stats.backoffs == 0);
+
+    // busy twice: two backoffs within windows of 100 then 200ms
+    medium.busyScans = 2;
+    assert(ducks[0].sendData(topics::status, String("quack")) == DUCK_ERR_NONE);
+    int rounds = runUntilSent(ducks, medium, 2, 1000);
+    assert(medium.transmitted == 2);
+    stats = ducks[0].getCsmaStats();
+    assert(stats.scans == 1 + 3);
+    assert(stats.backoffs == 2);
+    assert(stats.forced == 0);
+    assert(stats.totalBackoff >= 2 && stats.totalBackoff <= 100 + 200);
+    assert(rounds >= (int) stats.totalBackoff);
+
+    // still busy after maxBackoffs: sent anyway
+    medium.busyScans = 100;
+    assert(ducks[0].sendData(topics::status, String("quack")) == DUCK_ERR_NONE);
+    runUntilSent(ducks, medium, 3, 2000);
+    assert(medium.transmitted == 3);
+    stats = ducks[0].getCsmaStats();
+    assert(stats.scans == 4 + 4);
+    assert(stats.backoffs == 2 + 3);
+    assert(stats.forced == 1);
+
+    // no CAD done: sent without CAD once the scan times out
+    medium.busyScans = 0;
+    medium.silent = true;
+    assert(ducks[0].sendData(topics::status, String("quack")) == DUCK_ERR_NONE);
+    runAll(ducks, 1, CDPCFG_CAD_TIMEOUT_MS - 10);
+    assert(medium.transmitted == 3);
+    runUntilSent(ducks, medium, 4, 100);
+    assert(medium.transmitted == 4);
+    assert(ducks[0].getCsmaStats().scans == 8 + 1);
+
+    // and the next frame scans again
+    medium.silent = false;
+    assert(ducks[0].sendData(topics::status, String("quack")) == DUCK_ERR_NONE);
+    runUntilSent(ducks, medium, 5, 10);
+    assert(medium.transmitted == 5);
+    assert(ducks[0].getCsmaStats().scans == 9 + 1);
+  }
+  RadioMedium::setDefault(NULL);
+}
+
+void test_topic_ttl() {
+  LineMedium medium;
+  RadioMedium::setDefault(&medium);
+  {
+    MamaDuck ducks[4];
+    setup(ducks, 4);
+    for (int i = 0; i < 4; i++) {
+      assert(ducks[i].setTopicTtl(topics::status, 1) == DUCK_ERR_NONE);
+    }
+
+    int err = ducks[0].sendData(topics::status, String("quack"));
+    assert(err == DUCK_ERR_NONE);
+    runAll(ducks, 4, 10);
+
+    // relayed once, the second relay would exceed the TTL
+    assert(medium.senders.size() == 2);
+    assert(ducks[2].getDroppedByTtl() == 1);
+    assert(ducks[3].getRxQueueStats().received == 0);
+  }
+  RadioMedium::setDefault(NULL);
+}
+
+void test_neighbor_table() {
+  LineMedium medium;
+  RadioMedium::setDefault(&medium);
+  {
+    MamaDuck ducks[4];
+    setup(ducks, 4);
+
+    assert(ducks[0].sendData(topics::status, String("quack")) == DUCK_ERR_NONE);
+    runAll(ducks, 4, 10);
+
+    // the second duck heard the first duck's message directly
+    assert(ducks[1].getNeighborCount() == 1);
+    const DuckNeighbor* neighbor = ducks[1].findNeighbor(makeDuid('A'));
+    assert(neighbor != NULL);
+    assert(ducks[1].getNeighbor(0) == neighbor);
+    assert(neighbor->duckType == DuckType::MAMA);
+    assert(neighbor->packets == 1);
+    assert(neighbor->rssi == -60);
+    assert(neighbor->snr == 9);
+    assert(ducks[1].isNeighborAlive(*neighbor));
+
+    // a relay carries the DUID of the origin, not of the relaying duck
+    assert(ducks[0].getNeighborCount() == 0);
+    assert(ducks[2].getNeighborCount() == 0);
+
+    assert(ducks[2].sendData(topics::status, String("quack")) == DUCK_ERR_NONE);
+    runAll(ducks, 4, 10);
+    assert(ducks[1].getNeighborCount() == 2);
+    assert(ducks[3].findNeighbor(makeDuid('C')) != NULL);
+
+    ducks[1].setNeighborTimeout(1000);
+    cdphost::advanceMicros(1000000);
+    assert(!ducks[1].isNeighborAlive(*neighbor));
+  }
+  RadioMedium::setDefault(NULL);
+}
+
+void test_extensions() {
+#ifdef CDPCFG_DEDUP_MUID_CACHE
+  DuckMuidCache filter;
+#else
+  BloomFilter filter(312, 2, 32, 100);
+#endif
+  DuckPacket packet(makeDuid('A'));
+  const byte data[] = {1, 2, 3};
+  assert(packet.prepareForSending(&filter, makeDuid('B').data(), DuckType::MAMA,
+                                  topics::status, data, sizeof(data)) == DUCK_ERR_NONE);
+  int length = 0;
+  assert(!packet.getView().hasExtensions());
+  assert(packet.findExtension(EXT_DISTANCE, &length) == NULL);
+
+  byte distance = 4;
+  const byte path[] = {0xAB, 0xCD};
+  assert(packet.addExtension(EXT_DISTANCE, &distance, 1) == DUCK_ERR_NONE);
+  assert(packet.addExtension(0x7F, path, sizeof(path)) == DUCK_ERR_NONE);
+  CdpPacketView view = packet.getView();
+  assert(view.isValid());
+  assert(view.getFrameLength() == HEADER_LENGTH + 3 + 3 + 4 + 1);
+  assert(view.getDuckType() == DuckType::MAMA);
+  assert(view.getDataLength() == 3);
+  assert(std::equal(data, data + 3, view.getData()));
+  const byte* value = view.findExtension(0x7F, &length);
+  assert(value != NULL && length == 2 && value[1] == 0xCD);
+
+  // rewritten in place
+  *packet.findExtension(EXT_DISTANCE, &length) = 3;
+  assert(*view.findExtension(EXT_DISTANCE, &length) == 3 && length == 1);
+
+  // a trailer longer than the frame
+  byte frame[PACKET_LENGTH];
+  memcpy(frame, packet.getBuffer(), packet.getBufferLength());
+  frame[packet.getBufferLength() - 1] = 200;
+  assert(!CdpPacketView(frame, packet.getBufferLength()).isValid());
+}
+
+void test_route_record() {
+  LineMedium medium;
+  RadioMedium::setDefault(&medium);
+  {
+    MamaDuck ducks[4];
+    setup(ducks, 4);
+    ducks[0].setRouteRecord(true);
+
+    assert(ducks[0].sendData(topics::status, String("quack")) == DUCK_ERR_NONE);
+    runAll(ducks, 4, 10);
+    assert(medium.frames.size() == 4);
+
+    // the last relay carries the short ID of every relay, in order
+    CdpPacketView view(medium.frames[3]);
+    int hops = 0;
+    const byte* route = view.getRoute(&hops);
+    assert(route != NULL && hops == 3);
+    for (int i = 0; i < hops; i++) {
+      uint16_t id = (route[i * SHORT_ID_LENGTH] << 8) | route[i * SHORT_ID_LENGTH + 1];
+      assert(id == DuckPacket::getShortId(makeDuid('B' + i).data()));
+    }
+    assert(view.getDataLength() == 5);
+
+    CdpPacket packet(medium.frames[3]);
+    assert(packet.path.size() == 3 * SHORT_ID_LENGTH);
+    assert(std::equal(packet.path.begin(), packet.path.end(), route));
+    assert(packet.path_offset == route - view.getFrame());
+    assert(packet.data.size() == 5);
+
+    // without a request, nothing is recorded
+    medium.frames.clear();
+    ducks[1].setRouteRecord(false);
+    assert(ducks[1].sendData(topics::status, String("quack")) == DUCK_ERR_NONE);
+    runAll(ducks, 4, 10);
+    assert(medium.frames.size() == 4);
+    assert(CdpPacketView(medium.frames[3]).getRoute(&hops) == NULL && hops == 0);
+
+    // the record stops growing when the frame is full
+    medium.frames.clear();
+    std::vector<byte> big(EXT_MAX_FRAME_LENGTH - HEADER_LENGTH - EXT_TLV_HEADER_LENGTH - 1 - SHORT_ID_LENGTH, 'q');
+    assert(ducks[0].sendData(topics::status, big) == DUCK_ERR_NONE);
+    runAll(ducks, 4, 10);
+    assert(medium.frames.size() == 4);
+    assert(CdpPacketView(medium.frames[3]).getRoute(&hops) != NULL && hops == 1);
+    assert(medium.frames[3].size() == EXT_MAX_FRAME_LENGTH);
+
+    // no room for the record: sent without it
+    medium.frames.clear();
+    std::vector<byte> full(EXT_MAX_FRAME_LENGTH - HEADER_LENGTH, 'q');
+    assert(ducks[0].sendData(topics::status, full) == DUCK_ERR_NONE);
+    runAll(ducks, 4, 10);
+    assert(medium.frames.size() == 4);
+    assert(CdpPacketView(medium.frames[3]).getRoute(&hops) == NULL && hops == 0);
+  }
+  RadioMedium::setDefault(NULL);
+}
+
+void test_directed_forwarding() {
+  //        C
+  //        |
+  //  A --- B --- D --- F
+  //        |
+  //        E
+  GraphMedium medium;
+  medium.link(0, 1);
+  medium.link(1, 2);
+  medium.link(1, 3);
+  medium.link(1, 4);
+  medium.link(3, 5);
+  RadioMedium::setDefault(&medium);
+  {
+    MamaDuck ducks[6];
+    setup(ducks, 6);
+    for (int i = 0; i < 6; i++) {
+      ducks[i].setRouting(true);
+    }
+
+    // without a route the command is flooded
+    assert(ducks[0].sendData(topics::status, String("go"), makeDuid('F')) == DUCK_ERR_NONE);
+    runAll(ducks, 6, 10);
+    assert(medium.senders.size() == 5);
+    assert(ducks[1].getRoutingStats().flooded == 1);
+
+    // F talks, everyone learns how far it is
+    assert(ducks[5].sendData(topics::status, String("quack")) == DUCK_ERR_NONE);
+    runAll(ducks, 6, 10);
+    assert(ducks[3].getRouteDistance(makeDuid('F')) == 1);
+    assert(ducks[1].getRouteDistance(makeDuid('F')) == 2);
+    assert(ducks[0].getRouteDistance(makeDuid('F')) == 3);
+    assert(ducks[2].getRouteDistance(makeDuid('F')) == 3);
+    assert(ducks[0].getRouteDistance(makeDuid('G')) == EXT_DISTANCE_UNKNOWN);
+
+    // the command now only takes the path to F: A, B and D transmit
+    medium.senders.clear();
+    assert(ducks[0].sendData(topics::status, String("go"), makeDuid('F')) == DUCK_ERR_NONE);
+    runAll(ducks, 6, 10);
+    assert(medium.senders.size() == 3);
+    assert(medium.senders[0] == 0 && medium.senders[1] == 1 && medium.senders[2] == 3);
+    assert(ducks[1].getRoutingStats().routed == 1);
+    assert(ducks[3].getRoutingStats().routed == 1);
+    assert(ducks[2].getRoutingStats().dropped == 1);
+    assert(ducks[4].getRoutingStats().dropped == 1);
+
+    // no room for the distance: sent without it, and flooded
+    medium.senders.clear();
+    medium.frames.clear();
+    std::vector<byte> full(EXT_MAX_FRAME_LENGTH - HEADER_LENGTH, 'x');
+    assert(ducks[0].sendData(topics::status, full, makeDuid('F')) == DUCK_ERR_NONE);
+    runAll(ducks, 6, 10);
+    assert(medium.senders.size() == 5);
+    assert(!CdpPacketView(medium.frames[0]).hasExtensions());
+
+    // a frame without extensions, from an older duck, is flooded unchanged
+#ifdef CDPCFG_DEDUP_MUID_CACHE
+    DuckMuidCache filter;
+#else
+    BloomFilter filter(312, 2, 32, 100);
+#endif
+    DuckPacket legacy(makeDuid('Z'));
+    byte data = 'x';
+    assert(legacy.prepareForSending(&filter, makeDuid('F').data(), DuckType::MAMA, topics::status,
+                                    &data, 1) == DUCK_ERR_NONE);
+    medium.senders.clear();
+    medium.frames.clear();
+    assert(medium.getRadios()[1]->deliver(legacy.getBuffer(), legacy.getBufferLength()));
+    runAll(ducks, 6, 10);
+    assert(medium.senders.size() == 5);
+    for (size_t i = 0; i < medium.frames.size(); i++) {
+      assert(!CdpPacketView(medium.frames[i]).hasExtensions());
+      assert((int) medium.frames[i].size() == legacy.getBufferLength());
+    }
+
+    // broadcasts are still flooded
+    medium.senders.clear();
+    assert(ducks[0].sendData(topics::status, String("all")) == DUCK_ERR_NONE);
+    runAll(ducks, 6, 10);
+    assert(medium.senders.size() == 6);
+
+    // routes expire
+    ducks[1].setRouteTimeout(1000);
+    cdphost::advanceMicros(1000000);
+    assert(ducks[1].getRouteDistance(makeDuid('F')) == EXT_DISTANCE_UNKNOWN);
+  }
+  RadioMedium::setDefault(NULL);
+}
+
+void test_checkpoint_restore() {
+  LineMedium medium;
+  RadioMedium::setDefault(&medium);
+  // the default EEPROM area holds 2 checkpoints of either filter
+  DuckRamStorage storage(CDPCFG_CHECKPOINT_EEPROM_SIZE);
+  {
+    MamaDuck sender;
+    MamaDuck* relay = new MamaDuck();
+    assert(relay->setCheckpointStorage(&storage) == DUCK_ERR_NONE);
+    assert(relay->getCheckpointStats().slots == 2);
+    assert(sender.setupWithDefaults(makeDuid('A'), CDPCFG_RF_LORA_FREQ) == DUCK_ERR_NONE);
+    assert(relay->setupWithDefaults(makeDuid('B'), CDPCFG_RF_LORA_FREQ) == DUCK_ERR_NONE);
+    relay->setCheckpointInterval(1000);
+
+    assert(sender.sendData(topics::status, String("quack")) == DUCK_ERR_NONE);
+    for (int i = 0; i < 10; i++) {
+      sender.run();
+      relay->run();
+      cdphost::advanceMicros(1000);
+    }
+    assert(medium.senders.size() == 2);
+    std::vector<byte> frame = medium.frames[0];
+
+    // once the interval elapsed, a chunk or the commit per call to run()
+    cdphost::advanceMicros(1000000);
+    int calls = 0;
+    while (relay->getCheckpointStats().saves == 0) {
+      unsigned long written = storage.getBytesWritten();
+      unsigned long commits = storage.getCommits();
+      relay->run();
+      assert(storage.getBytesWritten() - written <= CDPCFG_CHECKPOINT_CHUNK);
+      assert(storage.getCommits() - commits <= 1);
+      calls++;
+      assert(calls < 1000);
+    }
+    printf("  checkpoint: %d calls to run(), %lu bytes written\n", calls, storage.getBytesWritten());
+    assert(calls > 2);
+    assert(storage.getCommits() == 1);
+
+    // nothing new, no checkpoint
+    cdphost::advanceMicros(2000000);
+    for (int i = 0; i < 10; i++) {
+      relay->run();
+    }
+    assert(relay->getCheckpointStats().saves == 1);
+
+    // another message, the next checkpoint starts right away
+    assert(sender.sendData(topics::status, String("again")) == DUCK_ERR_NONE);
+    for (int i = 0; i < 5; i++) {
+      sender.run();
+      relay->run();
+    }
+    assert(medium.senders.size() == 4);
+    assert(relay->getCheckpointStats().saves == 1);
+
+    // after a reboot in the middle of it, the relay still knows the first
+    // message when a neighbor repeats it
+    delete relay;
+    relay = new MamaDuck();
+    assert(relay->setCheckpointStorage(&storage) == DUCK_ERR_NONE);
+    assert(relay->setupWithDefaults(makeDuid('B'), CDPCFG_RF_LORA_FREQ) == DUCK_ERR_NONE);
+    assert(relay->getCheckpointStats().sequence == 1);
+    assert(medium.getRadios()[1]->deliver(frame.data(), frame.size()));
+    for (int i = 0; i < 10; i++) {
+      relay->run();
+      cdphost::advanceMicros(1000);
+    }
+    assert(medium.senders.size() == 4);
+    delete relay;
+
+    // it relays it again without the checkpoint
+    relay = new MamaDuck();
+    assert(relay->setupWithDefaults(makeDuid('B'), CDPCFG_RF_LORA_FREQ) == DUCK_ERR_NONE);
+    assert(medium.getRadios()[1]->deliver(frame.data(), frame.size()));
+    for (int i = 0; i < 10; i++) {
+      relay->run();
+      cdphost::advanceMicros(1000);
+    }
+    assert(medium.senders.size() == 5);
+    delete relay;
+  }
+  RadioMedium::setDefault(NULL);
+}
+
+void test_ack_tracking() {
+  BroadcastMedium medium;
+  RadioMedium::setDefault(&medium);
+  {
+    MamaDuck ducks[2];
+    setup(ducks, 2);
+
+    // several messages wait for their ack at the same time
+    std::vector<byte> muids[3];
+    for (int i = 0; i < 3; i++) {
+      assert(ducks[0].sendData(topics::status, String("quack"), ZERO_DUID, &muids[i]) == DUCK_ERR_NONE);
+      runAll(ducks, 2, 10);
+      assert(ducks[0].getMuidStatus(muids[i]) == muidStatus::not_acked);
+    }
+    assert(ducks[0].getPendingAcks() == 3);
+    assert(ducks[0].getMuidStatus(std::vector<byte>(MUID_LENGTH, 'X')) == muidStatus::unrecognized);
+    assert(ducks[0].getMuidStatus(std::vector<byte>(2, 'X')) == muidStatus::invalid);
+
+    // one broadcast ack for the first and third messages, and for a message
+    // of another duck with the MUID of the second one
+    const std::vector<byte> duids[] = {makeDuid('A'), makeDuid('B'), makeDuid('A')};
+    std::vector<byte> data(1, 3);
+    for (int i = 0; i < 3; i++) {
+      data.insert(data.end(), duids[i].begin(), duids[i].end());
+      data.insert(data.end(), muids[i].begin(), muids[i].end());
+    }
+#ifdef CDPCFG_DEDUP_MUID_CACHE
+    DuckMuidCache filter;
+#else
+    BloomFilter filter(312, 2, 32, 100);
+#endif
+    DuckPacket ack(makeDuid('P'));
+    assert(ack.prepareForSending(&filter, BROADCAST_DUID.data(), DuckType::PAPA, reservedTopic::ack,
+                                 data.data(), data.size()) == DUCK_ERR_NONE);
+    assert(medium.getRadios()[0]->deliver(ack.getBuffer(), ack.getBufferLength()));
+    runAll(ducks, 2, 10);
+
+    assert(ducks[0].getMuidStatus(muids[0]) == muidStatus::acked);
+    assert(ducks[0].getMuidStatus(muids[1]) == muidStatus::not_acked);
+    assert(ducks[0].getMuidStatus(muids[2]) == muidStatus::acked);
+    assert(ducks[0].getPendingAcks() == 1);
+    DuckInflightStats stats = ducks[0].getInflightStats();
+    assert(stats.sent == 3);
+    assert(stats.acked == 2);
+    assert(stats.evicted == 0);
+  }
+  RadioMedium::setDefault(NULL);
+}
+
+static std::vector<std::pair<std::vector<byte>, muidStatus> > deliveries;
+
+static void onDelivery(std::vector<byte> muid, muidStatus status) {
+  deliveries.push_back(std::make_pair(muid, status));
+}
+
+static void sendAck(SX1276* radio, const std::vector<byte> & duid, const std::vector<byte> & muid) {
+  std::vector<byte> data(1, 1);
+  data.insert(data.end(), duid.begin(), duid.end());
+  data.insert(data.end(), muid.begin(), muid.end());
+#ifdef CDPCFG_DEDUP_MUID_CACHE
+  DuckMuidCache filter;
+#else
+  BloomFilter filter(312, 2, 32, 100);
+#endif
+  DuckPacket ack(makeDuid('P'));
+  assert(ack.prepareForSending(&filter, BROADCAST_DUID.data(), DuckType::PAPA, reservedTopic::ack,
+                               data.data(), data.size()) == DUCK_ERR_NONE);
+  assert(radio->deliver(ack.getBuffer(), ack.getBufferLength()));
+}
+
+void test_reliable_delivery() {
+  GraphMedium medium;
+  RadioMedium::setDefault(&medium);
+  deliveries.clear();
+  {
+    MamaDuck ducks[2];
+    setup(ducks, 2);
+    ducks[0].onDeliveryStatus(onDelivery);
+    ducks[0].setReliableDelivery(20000, 1000);
+
+    // nobody hears the first transmission
+    std::vector<byte> muid;
+    assert(ducks[0].sendData(topics::alert, String("fire"), ZERO_DUID, &muid, true) == DUCK_ERR_NONE);
+    runAll(ducks, 2, 10);
+    assert(medium.senders.size() == 1);
+
+    // sent again with the same MUID after the backoff, and relayed this time
+    medium.link(0, 1);
+    for (int i = 0; i < 13 && medium.senders.size() == 1; i++) {
+      runAll(ducks, 2, 100);
+    }
+    assert(medium.senders.size() == 3);
+    assert(medium.senders[1] == 0 && medium.senders[2] == 1);
+    assert(ducks[0].getInflightStats().retransmissions == 1);
+
+    // a second copy is not relayed again by the duck that has it
+    for (int i = 0; i < 30 && ducks[0].getInflightStats().retransmissions == 1; i++) {
+      runAll(ducks, 2, 100);
+    }
+    assert(ducks[0].getInflightStats().retransmissions == 2);
+    assert(medium.senders.size() == 4);
+
+    // acked: reported once, no more retransmissions
+    sendAck(medium.getRadios()[0], makeDuid('A'), muid);
+    runAll(ducks, 2, 10);
+    assert(deliveries.size() == 1);
+    assert(deliveries[0].first == muid);
+    assert(deliveries[0].second == muidStatus::acked);
+    assert(ducks[0].getMuidStatus(muid) == muidStatus::acked);
+    size_t sent = medium.senders.size();
+    for (int i = 0; i < 100; i++) {
+      runAll(ducks, 2, 100);
+    }
+    assert(medium.senders.size() == sent);
+
+    // never acked: given up at the deadline after 1 + 2 + 4 + 8 s
+    std::vector<byte> lost;
+    assert(ducks[0].sendData(topics::alert, String("fire"), ZERO_DUID, &lost, true) == DUCK_ERR_NONE);
+    for (int i = 0; i < 250; i++) {
+      runAll(ducks, 2, 100);
+    }
+    assert(deliveries.size() == 2);
+    assert(deliveries[1].first == lost);
+    assert(deliveries[1].second == muidStatus::not_acked);
+    assert(ducks[0].getMuidStatus(lost) == muidStatus::not_acked);
+    DuckInflightStats stats = ducks[0].getInflightStats();
+    assert(stats.retransmissions == 2 + 4);
+    assert(stats.expired == 1);
+
+    // a frame too long to be kept is not sent, the longest one that fits is
+    sent = medium.senders.size();
+    std::vector<byte> large(MAX_DATA_LENGTH, 'x');
+    assert(ducks[0].sendData(topics::alert, large, ZERO_DUID, NULL, true) == DUCKPACKET_ERR_SIZE_INVALID);
+    runAll(ducks, 2, 10);
+    assert(medium.senders.size() == sent);
+    large.resize(EXT_MAX_FRAME_LENGTH - HEADER_LENGTH);
+    std::vector<byte> fits;
+    assert(ducks[0].sendData(topics::alert, large, ZERO_DUID, &fits, true) == DUCK_ERR_NONE);
+    runAll(ducks, 2, 10);
+    assert(ducks[0].getMuidStatus(fits) == muidStatus::not_acked);
+    sendAck(medium.getRadios()[0], makeDuid('A'), fits);
+    runAll(ducks, 2, 10);
+    assert(ducks[0].getMuidStatus(fits) == muidStatus::acked);
+    assert(deliveries.size() == 3);
+
+    // a routine message is not sent again
+    sent = medium.senders.size();
+    assert(ducks[0].sendData(topics::status, String("quack")) == DUCK_ERR_NONE);
+    for (int i = 0; i < 100; i++) {
+      runAll(ducks, 2, 100);
+    }
+    assert(medium.senders.size() == sent + 2);
+
+    // bounded number of reliable messages waiting
+    for (int i = 0; i < CDPCFG_RELIABLE_PENDING; i++) {
+      assert(ducks[0].sendData(topics::alert, String("fire"), ZERO_DUID, NULL, true) == DUCK_ERR_NONE);
+      runAll(ducks, 2, 10);
+    }
+    assert(ducks[0].sendData(topics::alert, String("fire"), ZERO_DUID, NULL, true)
+           == DUCKPACKET_ERR_RELIABLE_FULL);
+    assert(ducks[0].sendData(topics::status, String("quack")) == DUCK_ERR_NONE);
+  }
+  RadioMedium::setDefault(NULL);
+}
+
+// messages from the ducks around a gateway, acked in batches of batchSize
+static void ackMessages(uint8_t batchSize, int messages, unsigned long* ackAirtime,
+                        unsigned long* acked) {
+  const int count = 1 + 7;
+  GraphMedium medium;
+  RadioMedium::setDefault(&medium);
+  {
+    MamaDuck ducks[count];
+    setup(ducks, count);
+    for (int i = 1; i < count; i++) {
+      medium.link(0, i);
+    }
+    ducks[0].setAckAggregation(batchSize, 1000);
+
+    std::vector<std::vector<byte> > muids(messages);
+    for (int m = 0; m < messages; m++) {
+      int from = 1 + m % (count - 1);
+      assert(ducks[from].sendData(topics::status, String("quack"), ZERO_DUID, &muids[m]) == DUCK_ERR_NONE);
+      // back to receive before the gateway answers, the mock radio has no time on air
+      ducks[from].run();
+      runAll(ducks, count, 50);
+    }
+    runAll(ducks, count, 1100);
+
+    *ackAirtime = 0;
+    for (size_t i = 0; i < medium.frames.size(); i++) {
+      if (medium.senders[i] == 0 && medium.frames[i][TOPIC_POS] == reservedTopic::ack) {
+        *ackAirtime += ducks[0].getTimeOnAir(medium.frames[i].size());
+      }
+    }
+    *acked = 0;
+    for (int m = 0; m < messages; m++) {
+      int from = 1 + m % (count - 1);
+      if (ducks[from].getMuidStatus(muids[m]) == muidStatus::acked) {
+        (*acked)++;
+      }
+    }
+    DuckAckStats stats = ducks[0].getAckStats();
+    assert(stats.queued == (unsigned long) messages);
+    assert(stats.pairs == (unsigned long) messages);
+    assert(stats.acks == (unsigned long) (messages + batchSize - 1) / batchSize);
+  }
+  RadioMedium::setDefault(NULL);
+}
+
+void test_ack_aggregation() {
+  // every message acked, by 56 acks of one pair or by 4 acks of 14 pairs
+  const int messages = 4 * MAX_MUID_PER_ACK;
+  unsigned long single = 0;
+  unsigned long batched = 0;
+  unsigned long acked = 0;
+  ackMessages(1, messages, &single, &acked);
+  assert(acked == (unsigned long) messages);
+  ackMessages(MAX_MUID_PER_ACK, messages, &batched, &acked);
+  assert(acked == (unsigned long) messages);
+  // the header and preamble are paid once per 14 messages
+  assert(batched * 3 < single);
+  printf("  acks per airtime second: %.1f one per frame, %.1f batched by %d\n",
+         messages * 1000.0 / single, messages * 1000.0 / batched, MAX_MUID_PER_ACK);
+
+  GraphMedium medium;
+  RadioMedium::setDefault(&medium);
+  {
+    MamaDuck ducks[2];
+    setup(ducks, 2);
+    ducks[0].setAckAggregation(MAX_MUID_PER_ACK, 1000);
+    ducks[1].setReliableDelivery(60000, CDPCFG_RELIABLE_BACKOFF_MS);
+
+    // the gateway hears the duck, but its acks do not reach it
+    medium.edges.push_back(std::make_pair(1, 0));
+    std::vector<byte> muid;
+    assert(ducks[1].sendData(topics::alert, String("fire"), ZERO_DUID, &muid, true) == DUCK_ERR_NONE);
+    runAll(ducks, 2, 1100);
+    assert(ducks[0].getAckStats().acks == 1);
+
+    // a retransmission is acked again, and this time the ack gets through
+    medium.edges.push_back(std::make_pair(0, 1));
+    for (int i = 0; i < 100 && ducks[1].getMuidStatus(muid) != muidStatus::acked; i++) {
+      runAll(ducks, 2, 100);
+    }
+    assert(ducks[1].getMuidStatus(muid) == muidStatus::acked);
+    DuckAckStats stats = ducks[0].getAckStats();
+    assert(stats.acks == 2);
+    assert(stats.reacked == 1);
+    assert(stats.duplicates == 0);
+
+    // broadcasts are not acked
+    assert(ducks[1].sendData(topics::status, String("quack"), BROADCAST_DUID) == DUCK_ERR_NONE);
+    runAll(ducks, 2, 1100);
+    assert(ducks[0].getAckStats().queued == stats.queued);
+  }
+  RadioMedium::setDefault(NULL);
+}
+
+int main() {
+  cdphost::useWallClock(false);
+  cdphost::setMicros(0);
+
+  test_send_and_relay();
+  test_multi_hop();
+  test_topic_ttl();
+  test_pong();
+  test_rx_queue_overflow();
+  test_csma();
+  test_neighbor_table();
+  test_extensions();
+  test_route_record();
+  test_directed_forwarding();
+  test_checkpoint_restore();
+  test_ack_tracking();
+  test_reliable_delivery();
+  test_ack_aggregation();
+
+  printf("test_mamaduck: OK\n");
+  return 0;
+}
@@ -0,0 +1,182 @@
+/**
+ * @file test_muidcache.cpp
+ * @brief Host tests of the time windowed message cache.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "include/DuckMuidCache.h"
+
+#include "test_helpers.h"
+
+void test_check_and_add() {
+  cdphost::setMicros(0);
+  DuckMuidCache cache;
+  byte a[DUID_LENGTH];
+  byte b[DUID_LENGTH];
+  byte muid[MUID_LENGTH];
+  makeDuid(a, 0);
+  makeDuid(b, 1);
+  makeMuid(muid, 0x12345678);
+
+  assert(!cache.dedup_check(a, muid));
+  cache.dedup_add(a, muid);
+  assert(cache.dedup_check(a, muid));
+  // another duck that drew the same MUID
+  assert(!cache.dedup_check(b, muid));
+  cache.dedup_add(b, muid);
+  assert(cache.dedup_check(b, muid));
+
+  // adding again does not take another slot
+  cache.dedup_add(a, muid);
+  DuckMuidCacheStats stats = cache.dedup_stats();
+  assert(stats.entries == 2);
+  assert(stats.added == 2);
+  assert(stats.hits == 2);
+  assert(stats.evicted == 0);
+
+  cache.clear();
+  assert(!cache.dedup_check(a, muid));
+  assert(cache.dedup_stats().entries == 0);
+}
+
+void test_no_false_positives() {
+  cdphost::setMicros(0);
+  DuckMuidCache cache;
+  byte duid[DUID_LENGTH];
+  byte muid[MUID_LENGTH];
+  makeDuid(duid, 2);
+  // half of the cache, well below the point where entries get evicted
+  const int count = CDPCFG_DEDUP_CACHE_SIZE / 2;
+  for (int i = 0; i < count; i++) {
+    makeMuid(muid, i * 2654435761u);
+    cache.dedup_add(duid, muid);
+  }
+  for (int i = 0; i < count; i++) {
+    makeMuid(muid, i * 2654435761u);
+    assert(cache.dedup_check(duid, muid));
+    makeMuid(muid, i * 2654435761u + 1);
+    assert(!cache.dedup_check(duid, muid));
+  }
+  assert(cache.dedup_stats().evicted == 0);
+}
+
+void test_window() {
+  cdphost::setMicros(0);
+  DuckMuidCache cache;
+  assert(cache.getWindow() == CDPCFG_DEDUP_WINDOW_S);
+  cache.setWindow(0);
+  assert(cache.getWindow() == 1);
+  cache.setWindow(0xFFFF);
+  assert(cache.getWindow() == 0x3FFF);
+  cache.setWindow(60);
+  assert(cache.getWindow() == 60);
+
+  byte duid[DUID_LENGTH];
+  byte first[MUID_LENGTH];
+  byte second[MUID_LENGTH];
+  makeDuid(duid, 3);
+  makeMuid(first, 1);
+  makeMuid(second, 2);
+  cache.dedup_add(duid, first);
+  cdphost::advanceMicros(30 * 1000000ULL);
+  cache.dedup_add(duid, second);
+  // seen again, still forgotten 60 s after it was first seen
+  cache.dedup_add(duid, first);
+
+  cdphost::advanceMicros(29 * 1000000ULL);
+  assert(cache.dedup_check(duid, first));
+  cdphost::advanceMicros(1000000);
+  assert(!cache.dedup_check(duid, first));
+  assert(cache.dedup_check(duid, second));
+  assert(cache.dedup_stats().entries == 1);
+  cdphost::advanceMicros(30 * 1000000ULL);
+  assert(!cache.dedup_check(duid, second));
+  assert(cache.dedup_stats().entries == 0);
+
+  // an expired slot is reused
+  cache.dedup_add(duid, first);
+  assert(cache.dedup_check(duid, first));
+  assert(cache.dedup_stats().evicted == 0);
+}
+
+void test_age_wrap() {
+  cdphost::setMicros(0);
+  DuckMuidCache cache;
+  cache.setWindow(600);
+  byte duid[DUID_LENGTH];
+  byte quiet[MUID_LENGTH];
+  byte muid[MUID_LENGTH];
+  makeDuid(duid, 5);
+  makeMuid(quiet, 1);
+
+  // nothing heard for 18 hours: the 16 bit age of the entry wrapped around
+  cache.dedup_add(duid, quiet);
+  cdphost::advanceMicros(65546 * 1000000ULL);
+  assert(cache.dedup_stats().entries == 0);
+  assert(!cache.dedup_check(duid, quiet));
+
+  // other messages meanwhile, the entry was never overwritten
+  cache.dedup_add(duid, quiet);
+  for (int i = 0; i < 656; i++) {
+    cdphost::advanceMicros(100 * 1000000ULL);
+    makeMuid(muid, 1000 + i);
+    cache.dedup_add(duid, muid);
+  }
+  assert(!cache.dedup_check(duid, quiet));
+  DuckMuidCacheStats stats = cache.dedup_stats();
+  assert(stats.entries == 6);
+  assert(stats.evicted == 0);
+}
+
+void test_eviction() {
+  cdphost::setMicros(0);
+  DuckMuidCache cache;
+  byte duid[DUID_LENGTH];
+  byte muid[MUID_LENGTH];
+  makeDuid(duid, 4);
+
+  // three times the cache size, one second apart
+  const int count = CDPCFG_DEDUP_CACHE_SIZE * 3;
+  for (int i = 0; i < count; i++) {
+    makeMuid(muid, i * 2654435761u);
+    cache.dedup_add(duid, muid);
+    cdphost::advanceMicros(1000000);
+  }
+  DuckMuidCacheStats stats = cache.dedup_stats();
+  assert(stats.added == (unsigned long) count);
+  assert(stats.evicted > 0);
+  assert(stats.entries <= CDPCFG_DEDUP_CACHE_SIZE);
+
+  // the newest message is always remembered, the oldest ones make room
+  makeMuid(muid, (count - 1) * 2654435761u);
+  assert(cache.dedup_check(duid, muid));
+  int recent = 0;
+  for (int i = count - 64; i < count; i++) {
+    makeMuid(muid, i * 2654435761u);
+    recent += cache.dedup_check(duid, muid);
+  }
+  int old = 0;
+  for (int i = 0; i < 64; i++) {
+    makeMuid(muid, i * 2654435761u);
+    old += cache.dedup_check(duid, muid);
+  }
+  printf("  eviction: %d/64 recent and %d/64 oldest messages remembered\n", recent, old);
+  assert(recent == 64);
+  assert(old < recent);
+}
+
+int main() {
+  cdphost::useWallClock(false);
+
+  test_check_and_add();
+  test_no_false_positives();
+  test_window();
+  test_age_wrap();
+  test_eviction();
+
+  printf("test_muidcache: OK\n");
+  return 0;
+}
@@ -0,0 +1,89 @@
+/**
+ * @file test_neighbors.cpp
+ * @brief Host tests of the neighbor table.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+
+#include "include/DuckNeighborTable.h"
+#include "include/DuckTypes.h"
+
+#include "test_helpers.h"
+
+void test_update() {
+  DuckNeighborTable table;
+  byte duid[DUID_LENGTH];
+  makeDuid(duid, 0);
+  assert(table.size() == 0);
+  assert(table.find(duid) == NULL);
+  assert(table.get(0) == NULL);
+
+  DuckNeighbor* neighbor = table.update(duid, DuckType::MAMA, -80, 8, 100);
+  assert(table.size() == 1);
+  assert(table.find(duid) == neighbor);
+  assert(table.get(0) == neighbor);
+  assert(neighbor->duckType == DuckType::MAMA);
+  assert(neighbor->rssi == -80);
+  assert(neighbor->snr == 8);
+  assert(isnan(neighbor->reportedSnr));
+  assert(neighbor->packets == 1);
+  assert(neighbor->firstHeard == 100);
+
+  // smoothed, a single bad frame only moves the average a quarter of the way
+  table.update(duid, DuckType::LINK, -100, 0, 200);
+  assert(table.size() == 1);
+  assert(neighbor->rssi == -85);
+  assert(neighbor->snr == 6);
+  assert(neighbor->duckType == DuckType::LINK);
+  assert(neighbor->packets == 2);
+  assert(neighbor->firstHeard == 100);
+  assert(neighbor->lastHeard == 200);
+}
+
+void test_alive() {
+  DuckNeighborTable table;
+  byte duid[DUID_LENGTH];
+  makeDuid(duid, 0);
+  table.setTimeout(1000);
+  const DuckNeighbor* neighbor = table.update(duid, DuckType::MAMA, -80, 8, 0);
+  assert(table.isAlive(*neighbor, 999));
+  assert(!table.isAlive(*neighbor, 1000));
+  // a dead neighbor stays in the table until it is replaced
+  assert(table.find(duid) != NULL);
+}
+
+void test_eviction() {
+  DuckNeighborTable table;
+  byte duid[DUID_LENGTH];
+  for (int i = 0; i < CDPCFG_NEIGHBOR_TABLE_SIZE; i++) {
+    makeDuid(duid, i);
+    table.update(duid, DuckType::MAMA, -80, 8, i * 10);
+  }
+  assert(table.size() == CDPCFG_NEIGHBOR_TABLE_SIZE);
+
+  // the first neighbor is heard again, the second one is now the oldest
+  makeDuid(duid, 0);
+  table.update(duid, DuckType::MAMA, -80, 8, 1000);
+  makeDuid(duid, CDPCFG_NEIGHBOR_TABLE_SIZE);
+  table.update(duid, DuckType::MAMA, -80, 8, 1010);
+  assert(table.size() == CDPCFG_NEIGHBOR_TABLE_SIZE);
+  assert(table.find(duid) != NULL);
+  makeDuid(duid, 1);
+  assert(table.find(duid) == NULL);
+  makeDuid(duid, 0);
+  assert(table.find(duid) != NULL);
+
+  table.clear();
+  assert(table.size() == 0);
+}
+
+int main() {
+  test_update();
+  test_alive();
+  test_eviction();
+
+  printf("test_neighbors: OK\n");
+  return 0;
+}
@@ -0,0 +1,92 @@
+/**
+ * @file test_relayscheduler.cpp
+ * @brief Host tests of the counter-based relay suppression.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "include/DuckRelayScheduler.h"
+
+static const byte DATA[] = {'q', 'u', 'a', 'c', 'k'};
+
+static DuckPacket makePacket(BloomFilter & filter, byte topic) {
+  DuckPacket packet(ZERO_DUID);
+  int err = packet.prepareForSending(&filter, ZERO_DUID.data(), DuckType::LINK, topic,
+                                     DATA, sizeof(DATA));
+  assert(err == DUCK_ERR_NONE);
+  return packet;
+}
+
+void test_disabled_by_default() {
+  DuckRelayScheduler scheduler;
+  assert(scheduler.isEnabled() == (CDPCFG_RELAY_SUPPRESSION_COUNT > 0));
+}
+
+void test_relay_after_delay() {
+  BloomFilter filter(312, 2, 32, 100);
+  DuckRelayScheduler scheduler;
+  scheduler.setSuppression(3, 200);
+  cdphost::setMicros(0);
+
+  DuckPacket packet = makePacket(filter, topics::status);
+  assert(scheduler.schedule(packet));
+  // one copy short of the threshold: the relay still goes out
+  scheduler.onDuplicate(packet.getView().getMuid());
+
+  assert(scheduler.nextDue(201) != NULL);
+  DuckPendingRelay* relay = scheduler.nextDue(201);
+  assert(relay->copies == 2);
+  assert(relay->packet.getBufferLength() == packet.getBufferLength());
+  scheduler.release(relay);
+  assert(scheduler.nextDue(201) == NULL);
+  assert(scheduler.getStats().scheduled == 1);
+  assert(scheduler.getStats().suppressed == 0);
+}
+
+void test_suppressed_by_copies() {
+  BloomFilter filter(312, 2, 32, 100);
+  DuckRelayScheduler scheduler;
+  scheduler.setSuppression(3, 200);
+  cdphost::setMicros(0);
+
+  DuckPacket packet = makePacket(filter, topics::status);
+  DuckPacket other = makePacket(filter, topics::status);
+  assert(scheduler.schedule(packet));
+  assert(scheduler.schedule(other));
+
+  scheduler.onDuplicate(packet.getView().getMuid());
+  scheduler.onDuplicate(packet.getView().getMuid());
+
+  // only the other packet is left
+  DuckPendingRelay* relay = scheduler.nextDue(201);
+  assert(relay != NULL);
+  assert(std::equal(relay->packet.getView().getMuid(),
+                    relay->packet.getView().getMuid() + MUID_LENGTH,
+                    other.getView().getMuid()));
+  scheduler.release(relay);
+  assert(scheduler.nextDue(201) == NULL);
+  assert(scheduler.getStats().suppressed == 1);
+}
+
+void test_full_table() {
+  BloomFilter filter(312, 2, 32, 100);
+  DuckRelayScheduler scheduler;
+  scheduler.setSuppression(2, 200);
+
+  for (int i = 0; i < CDPCFG_RELAY_PENDING_SIZE; i++) {
+    assert(scheduler.schedule(makePacket(filter, topics::status)));
+  }
+  assert(!scheduler.schedule(makePacket(filter, topics::status)));
+  assert(scheduler.getStats().overflows == 1);
+}
+
+int main() {
+  srand(1);
+  cdphost::useWallClock(false);
+  test_disabled_by_default();
+  test_relay_after_delay();
+  test_suppressed_by_copies();
+  test_full_table();
+  return 0;
+}
@@ -0,0 +1,91 @@
+/**
+ * @file test_ringbuffer.cpp
+ * @brief Host tests of the ring buffer of the received frames.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "include/DuckRingBuffer.h"
+
+typedef DuckRingBuffer<int, 4> Ring;
+
+static bool push(Ring & ring, int value) {
+  int* slot = ring.acquire();
+  if (slot == NULL) {
+    return false;
+  }
+  *slot = value;
+  ring.commit();
+  return true;
+}
+
+static int pop(Ring & ring) {
+  int* slot = ring.peek();
+  assert(slot != NULL);
+  int value = *slot;
+  ring.pop();
+  return value;
+}
+
+void test_empty() {
+  Ring ring;
+  assert(Ring::capacity() == 4);
+  assert(ring.isEmpty());
+  assert(ring.size() == 0);
+  assert(ring.peek() == NULL);
+
+  // a slot acquired but not committed is not seen by the consumer
+  assert(ring.acquire() != NULL);
+  assert(ring.peek() == NULL);
+}
+
+void test_full() {
+  Ring ring;
+  for (int i = 0; i < 4; i++) {
+    assert(push(ring, i));
+  }
+  assert(ring.size() == 4);
+  assert(ring.acquire() == NULL);
+  assert(!push(ring, 4));
+
+  // released oldest first, a released slot can be filled again
+  assert(pop(ring) == 0);
+  assert(ring.size() == 3);
+  assert(push(ring, 4));
+  assert(ring.acquire() == NULL);
+  for (int i = 1; i <= 4; i++) {
+    assert(pop(ring) == i);
+  }
+  assert(ring.isEmpty());
+  assert(ring.peek() == NULL);
+}
+
+void test_wrap_around() {
+  Ring ring;
+  int next = 0;
+  int expected = 0;
+  // fill levels that do not divide the capacity, so that the slots in use
+  // cross the end of the array in every position
+  for (int round = 0; round < 100; round++) {
+    int count = 1 + round % 3;
+    for (int i = 0; i < count; i++) {
+      assert(push(ring, next++));
+    }
+    assert(ring.size() == (unsigned int) count);
+    for (int i = 0; i < count; i++) {
+      assert(pop(ring) == expected++);
+    }
+    assert(ring.isEmpty());
+  }
+  assert(next == expected);
+}
+
+int main() {
+  test_empty();
+  test_full();
+  test_wrap_around();
+
+  printf("test_ringbuffer: OK\n");
+  return 0;
+}
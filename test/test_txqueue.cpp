@@ -0,0 +1,74 @@
+/**
+ * @file test_txqueue.cpp
+ * @brief Host tests of the transmit queue ordering and counters.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "DuckError.h"
+#include "include/DuckTxQueue.h"
+
+static int pushTopic(DuckTxQueue & queue, byte topic, byte tag) {
+  byte frame[MIN_PACKET_LENGTH];
+  memset(frame, 0, sizeof(frame));
+  frame[TOPIC_POS] = topic;
+  frame[DATA_POS] = tag;
+  return queue.push(frame, sizeof(frame));
+}
+
+static byte popTag(DuckTxQueue & queue) {
+  DuckTxFrame* frame = queue.front();
+  assert(frame != NULL);
+  byte tag = frame->frame[DATA_POS];
+  queue.pop(frame);
+  return tag;
+}
+
+void test_priority_order() {
+  DuckTxQueue queue;
+  assert(queue.isEmpty());
+  assert(queue.front() == NULL);
+
+  assert(pushTopic(queue, topics::status, 1) == DUCK_ERR_NONE);
+  assert(pushTopic(queue, topics::location, 2) == DUCK_ERR_NONE);
+  assert(pushTopic(queue, topics::alert, 3) == DUCK_ERR_NONE);
+  assert(pushTopic(queue, reservedTopic::ack, 4) == DUCK_ERR_NONE);
+  assert(queue.size() == 4);
+
+  // high priority first in FIFO order, then normal, then low
+  assert(popTag(queue) == 3);
+  assert(popTag(queue) == 4);
+  assert(popTag(queue) == 2);
+  assert(popTag(queue) == 1);
+  assert(queue.isEmpty());
+}
+
+void test_full_queue() {
+  DuckTxQueue queue;
+  for (int i = 0; i < CDPCFG_TX_QUEUE_SIZE; i++) {
+    assert(pushTopic(queue, topics::status, i) == DUCK_ERR_NONE);
+  }
+  assert(pushTopic(queue, topics::alert, 99) == DUCKLORA_ERR_TX_BUSY);
+
+  // a released slot is reused and FIFO order is kept
+  assert(popTag(queue) == 0);
+  assert(pushTopic(queue, topics::status, 42) == DUCK_ERR_NONE);
+  for (int i = 1; i < CDPCFG_TX_QUEUE_SIZE; i++) {
+    assert(popTag(queue) == i);
+  }
+  assert(popTag(queue) == 42);
+
+  DuckTxQueueStats stats = queue.getStats();
+  assert(stats.queued == CDPCFG_TX_QUEUE_SIZE + 1);
+  assert(stats.sent == CDPCFG_TX_QUEUE_SIZE + 1);
+  assert(stats.dropped == 1);
+  assert(stats.depth == 0);
+  assert(stats.maxDepth == CDPCFG_TX_QUEUE_SIZE);
+}
+
+int main() {
+  test_priority_order();
+  test_full_queue();
+  return 0;
+}
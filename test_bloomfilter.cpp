@@ -7,12 +7,12 @@
 class BloomFilterTester{
 public:
 
-  static void SetSeed(BloomFilter & filter, unsigned seedIndex, int seed) {
-    filter.Seeds[seedIndex] = seed;
+  static void SetSeed(BloomFilter & filter, uint64_t seed) {
+    filter.seed = seed;
   }
 
-  static unsigned int djb2Hash(unsigned char* str, int seed, int msgSize) {
-    return BloomFilter::djb2Hash(str, seed, msgSize);
+  static uint64_t hash64(const unsigned char* msg, int msgSize, uint64_t seed) {
+    return BloomFilter::hash64(msg, msgSize, seed);
   }
 
   static unsigned int* filter1(BloomFilter & filter) {
@@ -47,12 +47,159 @@ public:
     return filter.maxMsgs;
   }
 
-  static int* Seeds(BloomFilter & filter) {
-    return filter.Seeds;
+  static uint64_t seed(BloomFilter & filter) {
+    return filter.seed;
   }
 
 };
 
+// Measured false positive rate against (1 - e^(-kn/m))^k, the filter never rotates.
+void test_false_positive_rate(int numSectors, int numHashes, int numMsgs) {
+  const int BITS_PER_SECTOR = 32;
+  const int QUERIES = 20000;
+  BloomFilter filter(numSectors, numHashes, BITS_PER_SECTOR, numMsgs + 1);
+
+  unsigned char muid[MUID_LENGTH];
+  for (int i = 0; i < numMsgs; i++) {
+    muid[0] = i >> 24; muid[1] = i >> 16; muid[2] = i >> 8; muid[3] = i;
+    filter.bloom_add(muid, MUID_LENGTH);
+  }
+  int falsePositives = 0;
+  for (int i = 0; i < numMsgs + QUERIES; i++) {
+    muid[0] = i >> 24; muid[1] = i >> 16; muid[2] = i >> 8; muid[3] = i;
+    int found = filter.bloom_check(muid, MUID_LENGTH);
+    if (i < numMsgs) {
+      // never a false negative
+      assert(found);
+    } else {
+      falsePositives += found;
+    }
+  }
+
+  double bits = (double) numSectors * BITS_PER_SECTOR;
+  double expected = pow(1 - exp(-numHashes * numMsgs / bits), numHashes);
+  double measured = (double) falsePositives / QUERIES;
+  printf("%5d sectors k=%d n=%5d: FPR %.4f, expected %.4f\n",
+         numSectors, numHashes, numMsgs, measured, expected);
+  assert(measured <= expected * 1.25 + 0.002);
+}
+
+// Unique MUIDs streamed through a relay's check+add for a long time: the
+// false positive rate must stay where two generations of messages put it.
+void test_long_run_false_positive_rate() {
+  const int NUM_SECTORS = 312;
+  const int NUM_HASH_FUNCS = 2;
+  const int BITS_PER_SECTOR = 32;
+  const int MAX_MESSAGES = 100;
+  const int WINDOW = 10000;
+  BloomFilter filter(NUM_SECTORS, NUM_HASH_FUNCS, BITS_PER_SECTOR, MAX_MESSAGES);
+
+  unsigned char muid[MUID_LENGTH];
+  int falsePositives = 0;
+  int added = 0;
+  double worst = 0;
+  for (int i = 0; i < 50 * WINDOW; i++) {
+    muid[0] = i >> 24; muid[1] = i >> 16; muid[2] = i >> 8; muid[3] = i;
+    if (filter.bloom_check(muid, MUID_LENGTH)) {
+      falsePositives++;
+    } else {
+      filter.bloom_add(muid, MUID_LENGTH);
+      added++;
+    }
+    if ((i + 1) % WINDOW == 0) {
+      double rate = (double) falsePositives / WINDOW;
+      worst = rate > worst ? rate : worst;
+      falsePositives = 0;
+    }
+  }
+
+  // at most 2 * MAX_MESSAGES messages in the filters
+  double bits = NUM_SECTORS * BITS_PER_SECTOR;
+  double fill = 1 - exp(-NUM_HASH_FUNCS * MAX_MESSAGES / bits);
+  double bound = 2 * pow(fill, NUM_HASH_FUNCS);
+  printf("long run: worst FPR %.5f, bound %.5f\n", worst, bound);
+  assert(worst <= bound * 1.5 + 0.001);
+
+  BloomFilterStats stats = filter.bloom_stats();
+  assert(stats.rotations == (unsigned long) (added / MAX_MESSAGES));
+  assert(stats.lastGenerationMessages == MAX_MESSAGES);
+  // every message sets at most k bits
+  assert(stats.fillRatio <= NUM_HASH_FUNCS * MAX_MESSAGES / bits);
+  assert(stats.frozenFillRatio <= NUM_HASH_FUNCS * MAX_MESSAGES / bits);
+  assert(stats.estimatedFpr <= bound);
+}
+
+void test_rotation_and_stats() {
+  const int NUM_SECTORS = 64;
+  const int BITS_PER_SECTOR = 32;
+  BloomFilter filter(NUM_SECTORS, 2, BITS_PER_SECTOR, 10);
+  BloomFilterStats stats = filter.bloom_stats();
+  assert(stats.fillRatio == 0 && stats.estimatedFpr == 0 && stats.rotations == 0);
+
+  unsigned char muid[MUID_LENGTH] = {0, 0, 0, 0};
+  for (int i = 0; i < 10; i++) {
+    muid[3] = i;
+    filter.bloom_add(muid, MUID_LENGTH);
+    if (i < 9) {
+      assert(filter.bloom_stats().messages == i + 1);
+    }
+  }
+  // the first generation is frozen, the fresh filter is empty
+  stats = filter.bloom_stats();
+  assert(stats.rotations == 1);
+  assert(stats.messages == 0);
+  assert(stats.lastGenerationMessages == 10);
+  assert(stats.fillRatio == 0);
+  assert(stats.frozenFillRatio > 0 && stats.frozenFillRatio <= 20.0 / (NUM_SECTORS * BITS_PER_SECTOR));
+  assert(stats.estimatedFpr > 0);
+  unsigned int* active = BloomFilterTester::filter2(filter);
+  for (int i = 0; i < NUM_SECTORS; i++) {
+    assert(active[i] == 0);
+  }
+
+  // two rotations later the first generation is forgotten, every sector of it
+  for (int i = 10; i < 20; i++) {
+    muid[3] = i;
+    filter.bloom_add(muid, MUID_LENGTH);
+  }
+  assert(filter.bloom_stats().rotations == 2);
+  assert(filter.bloom_stats().fillRatio == 0);
+  unsigned int* cleared = BloomFilterTester::filter1(filter);
+  for (int i = 0; i < NUM_SECTORS; i++) {
+    assert(cleared[i] == 0);
+  }
+  muid[3] = 0;
+  assert(!filter.bloom_check(muid, MUID_LENGTH));
+}
+
+void test_fill_ratio_rotation() {
+  const int NUM_SECTORS = 64;
+  const int BITS_PER_SECTOR = 32;
+  // no message limit, the fill ratio alone rotates
+  BloomFilter filter(NUM_SECTORS, 3, BITS_PER_SECTOR, 0);
+  filter.set_max_fill_ratio(0.25f);
+
+  unsigned char muid[MUID_LENGTH];
+  for (int i = 0; i < 5000; i++) {
+    muid[0] = i >> 24; muid[1] = i >> 16; muid[2] = i >> 8; muid[3] = i;
+    filter.bloom_add(muid, MUID_LENGTH);
+    assert(filter.bloom_stats().fillRatio < 0.25f);
+  }
+  BloomFilterStats stats = filter.bloom_stats();
+  assert(stats.rotations > 0);
+  // -m ln(1 - 0.25) / k messages fill a filter up to 25%
+  double expected = -NUM_SECTORS * BITS_PER_SECTOR * log(0.75) / 3;
+  assert(fabs(stats.lastGenerationMessages - expected) < expected * 0.2);
+  assert(stats.estimatedFpr < 2 * pow(0.25, 3));
+
+  filter.set_max_fill_ratio(0);
+  for (int i = 0; i < 5000; i++) {
+    muid[0] = 1; muid[1] = i >> 16; muid[2] = i >> 8; muid[3] = i;
+    filter.bloom_add(muid, MUID_LENGTH);
+  }
+  assert(filter.bloom_stats().rotations == stats.rotations);
+}
+
 int main() {
   const int NUM_SECTORS = 16;
   const int NUM_HASH_FUNCS = 2;
@@ -61,10 +208,8 @@ int main() {
   BloomFilter filter = BloomFilter(NUM_SECTORS, NUM_HASH_FUNCS,
     BITS_PER_SECTOR, MAX_MESSAGES);
 
-  const int SEED_0 = 0;
-  const int SEED_1 = 1;
-  BloomFilterTester::SetSeed(filter, 0, SEED_0);
-  BloomFilterTester::SetSeed(filter, 1, SEED_1);
+  const uint64_t SEED = 1;
+  BloomFilterTester::SetSeed(filter, SEED);
 
   assert(BloomFilterTester::activeFilter(filter) == 1);
   assert(BloomFilterTester::nMsg(filter) == 0);
@@ -174,4 +319,14 @@ int main() {
   filter.bloom_add(MUID15, MUID_LENGTH);
   assert(filter.bloom_check(MUID15, MUID_LENGTH));
 
+  test_false_positive_rate(16, 2, 32);
+  test_false_positive_rate(312, 2, 100);
+  test_false_positive_rate(312, 2, 1000);
+  test_false_positive_rate(312, 4, 1000);
+  test_false_positive_rate(1024, 3, 4000);
+  test_false_positive_rate(4096, 6, 8000);
+
+  test_rotation_and_stats();
+  test_fill_ratio_rotation();
+  test_long_run_false_positive_rate();
 }
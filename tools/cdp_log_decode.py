@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+"""Decode a CDP binary log (built with -DCDP_LOG_BINARY).
+
+The device writes one line per log entry:
+
+    #L <site id (hex)> <millis> <level> <arg> <arg> ...
+    #D <number of entries lost because the buffer was full>
+
+The site id is derived from the source file name and line of the log
+statement, so the sources the firmware was built from are scanned to find the
+statement and its format string.
+
+    python3 tools/cdp_log_decode.py [--src DIR ...] [capture.txt]
+
+Lines that are not log entries are printed unchanged, so a whole serial
+capture can be piped through the decoder.
+"""
+
+import argparse
+import os
+import re
+import sys
+
+LEVELS = {1: "ERR", 2: "WRN", 3: "INF", 4: "DBG"}
+MACROS = {"logerr": 1, "logwarn": 2, "loginfo": 3, "logdbg": 4}
+SOURCE_EXTENSIONS = (".c", ".cpp", ".h", ".hpp", ".ino")
+
+MACRO_RE = re.compile(r"\b(logerr|logwarn|loginfo|logdbg)(_f)?\s*\(")
+STRING_RE = re.compile(r'"((?:[^"\\]|\\.)*)"')
+# printf conversion: flags, width, precision, length modifier, conversion
+CONVERSION_RE = re.compile(r"%([-+ #0]*\d*(?:\.\d+)?)(hh|h|ll|l|z|j|t)?([diouxXcsfFeEgGp%])")
+
+
+def fnv1a(data, value=2166136261):
+    for byte in data:
+        value = ((value ^ byte) * 16777619) & 0xFFFFFFFF
+    return value
+
+
+def site_id(file_name, line):
+    """Same as ducklog::siteId() in src/include/DuckLogBuffer.h."""
+    return ((fnv1a(file_name.encode()) ^ line) * 16777619) & 0xFFFFFFFF
+
+
+def unescape(literal):
+    return literal.encode("latin-1", "backslashreplace").decode("unicode_escape")
+
+
+def find_call_end(text, start):
+    """Index of the parenthesis closing the call opened at text[start - 1]."""
+    depth = 1
+    i = start
+    while i < len(text) and depth > 0:
+        c = text[i]
+        if c in "\"'":
+            i += 1
+            while i < len(text) and text[i] != c:
+                i += 2 if text[i] == "\\" else 1
+        elif c == "(":
+            depth += 1
+        elif c == ")":
+            depth -= 1
+        i += 1
+    return i - 1
+
+
+def scan_sources(roots):
+    sites = {}
+    for root in roots:
+        for directory, _, files in os.walk(root):
+            for name in files:
+                if name.endswith(SOURCE_EXTENSIONS):
+                    scan_file(os.path.join(directory, name), sites)
+    return sites
+
+
+def scan_file(path, sites):
+    with open(path, encoding="utf-8", errors="replace") as f:
+        text = f.read()
+    name = os.path.basename(path)
+    for match in MACRO_RE.finditer(text):
+        line_start = text.rfind("\n", 0, match.start()) + 1
+        if text[line_start:match.start()].lstrip().startswith("#"):
+            continue  # the macro definitions themselves
+        macro, formatted = match.group(1), match.group(2) is not None
+        end = find_call_end(text, match.end())
+        args = text[match.end():end]
+        first = text.count("\n", 0, match.start()) + 1
+        last = first + args.count("\n")
+        if formatted:
+            # the format is the leading run of adjacent string literals
+            fmt = ""
+            rest = args.lstrip()
+            literal = STRING_RE.match(rest)
+            while literal:
+                fmt += unescape(literal.group(1))
+                rest = rest[literal.end():].lstrip()
+                literal = STRING_RE.match(rest)
+            message = fmt.rstrip("\n")
+        else:
+            message = " ".join(args.split())
+        site = (MACROS[macro], name, first, formatted, message)
+        # __LINE__ of a statement spanning several lines depends on the
+        # compiler, every line of the statement maps to it
+        for line in range(first, last + 1):
+            sites[site_id(name, line)] = site
+
+
+def format_message(fmt, args):
+    values = list(args)
+
+    def convert(match):
+        spec, _, conversion = match.groups()
+        if conversion == "%":
+            return "%"
+        value = values.pop(0) if values else 0
+        if conversion in "sp":
+            return "<?>"
+        if conversion in "ouxX":
+            value &= 0xFFFFFFFF
+        if conversion == "c":
+            return chr(value & 0xFF)
+        return ("%" + spec + conversion) % value
+
+    return CONVERSION_RE.sub(convert, fmt)
+
+
+def decode_line(line, sites):
+    fields = line.split()
+    if not fields or fields[0] not in ("#L", "#D"):
+        return line
+    try:
+        if fields[0] == "#D":
+            return "!! %d log entries lost (buffer full)" % int(fields[1])
+        ident = int(fields[1], 16)
+        timestamp = int(fields[2])
+        level = int(fields[3])
+        args = [int(a) for a in fields[4:]]
+    except (IndexError, ValueError):
+        return line
+    site = sites.get(ident)
+    if site is None:
+        return "[%s %10d] <unknown site %08x> %s" % (
+            LEVELS.get(level, "???"), timestamp, ident, " ".join(fields[4:]))
+    _, name, first, formatted, message = site
+    if formatted:
+        message = format_message(message, args)
+    return "[%s %10d] %s:%d  %s" % (LEVELS.get(level, "???"), timestamp, name, first, message)
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("capture", nargs="?", help="serial capture (default: stdin)")
+    parser.add_argument("--src", action="append",
+                        help="source directory to scan (default: the CDP src directory), "
+                             "repeat to add the sketch directory")
+    options = parser.parse_args()
+
+    sites = scan_sources(options.src or [os.path.join(here, "..", "src")])
+    stream = open(options.capture) if options.capture else sys.stdin
+    for line in stream:
+        print(decode_line(line.rstrip("\r\n"), sites))
+
+
+if __name__ == "__main__":
+    main()